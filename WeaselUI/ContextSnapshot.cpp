@@ -0,0 +1,296 @@
+#include "ContextSnapshot.h"
+#include <cstring>
+
+namespace weasel {
+
+static const uint32_t CONTEXT_SNAPSHOT_MAGIC = 0x58435452; // "RTCX"
+
+// ----------------------------------------------------------------------------
+// wstring <-> UTF-16; a plain copy where wchar_t is UTF-16 already
+
+static uint32_t utf16_length(const std::wstring &s) {
+  if constexpr (sizeof(wchar_t) == 2)
+    return (uint32_t)s.size();
+  uint32_t n = 0;
+  for (wchar_t ch : s)
+    n += (uint32_t)ch > 0xffff ? 2 : 1;
+  return n;
+}
+
+static char16_t *put_utf16(const std::wstring &s, char16_t *out) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    memcpy(out, s.data(), s.size() * sizeof(char16_t));
+    return out + s.size();
+  }
+  for (wchar_t ch : s) {
+    const uint32_t c = (uint32_t)ch;
+    if (c > 0xffff) {
+      *out++ = (char16_t)(0xd800 + ((c - 0x10000) >> 10));
+      *out++ = (char16_t)(0xdc00 + ((c - 0x10000) & 0x3ff));
+    } else {
+      *out++ = (char16_t)c;
+    }
+  }
+  return out;
+}
+
+static void get_utf16(std::u16string_view units, std::wstring &s) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    s.assign(reinterpret_cast<const wchar_t *>(units.data()), units.size());
+    return;
+  }
+  s.clear();
+  for (size_t i = 0; i < units.size(); i++) {
+    uint32_t c = units[i];
+    if (c >= 0xd800 && c < 0xdc00 && i + 1 < units.size() &&
+        units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (units[i + 1] - 0xdc00);
+      i++;
+    }
+    s.push_back((wchar_t)c);
+  }
+}
+
+static bool same_utf16(std::u16string_view units, const std::wstring &s) {
+  if constexpr (sizeof(wchar_t) == 2)
+    return units.size() == s.size() &&
+           !memcmp(units.data(), s.data(), s.size() * sizeof(char16_t));
+  size_t i = 0;
+  for (wchar_t ch : s) {
+    const uint32_t c = (uint32_t)ch;
+    if (c > 0xffff) {
+      if (i + 2 > units.size() ||
+          units[i] != (char16_t)(0xd800 + ((c - 0x10000) >> 10)) ||
+          units[i + 1] != (char16_t)(0xdc00 + ((c - 0x10000) & 0x3ff)))
+        return false;
+      i += 2;
+    } else {
+      if (i >= units.size() || units[i] != (char16_t)c)
+        return false;
+      i++;
+    }
+  }
+  return i == units.size();
+}
+
+// ----------------------------------------------------------------------------
+
+// fn(str, attributes) for each text in table order; attributes is null for
+// the schema name and id
+template <typename F>
+static void for_each_text(const Context &ctx, const Status &status, F fn) {
+  fn(ctx.preedit.str, &ctx.preedit.attributes);
+  fn(ctx.aux.str, &ctx.aux.attributes);
+  fn(status.schema_name, nullptr);
+  fn(status.schema_id, nullptr);
+  for (const auto &text : ctx.cinfo.candies)
+    fn(text.str, &text.attributes);
+  for (const auto &text : ctx.cinfo.comments)
+    fn(text.str, &text.attributes);
+  for (const auto &text : ctx.cinfo.labels)
+    fn(text.str, &text.attributes);
+}
+
+void EncodeContextSnapshot(const Context &ctx, const Status &status,
+                           std::string &out) {
+  const CandidateInfo &cinfo = ctx.cinfo;
+  uint32_t text_count = 0, attribute_count = 0, pool_units = 0;
+  for_each_text(ctx, status,
+                [&](const std::wstring &str,
+                    const std::vector<TextAttribute> *attributes) {
+                  text_count++;
+                  if (attributes)
+                    attribute_count += (uint32_t)attributes->size();
+                  pool_units += utf16_length(str);
+                });
+  const size_t texts_at = sizeof(ContextSnapshotHeader);
+  const size_t attributes_at =
+      texts_at + text_count * sizeof(ContextSnapshotText);
+  const size_t pool_at =
+      attributes_at + attribute_count * sizeof(ContextSnapshotAttribute);
+  const size_t size = (pool_at + pool_units * sizeof(char16_t) + 3) / 4 * 4;
+
+  const size_t start = (out.size() + 3) / 4 * 4;
+  out.resize(start + size);
+  char *base = &out[start];
+  ContextSnapshotHeader *header =
+      reinterpret_cast<ContextSnapshotHeader *>(base);
+  header->magic = CONTEXT_SNAPSHOT_MAGIC;
+  header->version = CONTEXT_SNAPSHOT_VERSION;
+  header->size = (uint32_t)size;
+  header->text_count = text_count;
+  header->attribute_count = attribute_count;
+  header->pool_units = pool_units;
+  header->candidate_count = (uint32_t)cinfo.candies.size();
+  header->comment_count = (uint32_t)cinfo.comments.size();
+  header->label_count = (uint32_t)cinfo.labels.size();
+  header->current_page = cinfo.currentPage;
+  header->total_pages = cinfo.totalPages;
+  header->highlighted = cinfo.highlighted;
+  header->type = (int32_t)status.type;
+  header->is_last_page = cinfo.is_last_page;
+  header->ascii_mode = status.ascii_mode;
+  header->composing = status.composing;
+  header->disabled = status.disabled;
+  header->full_shape = status.full_shape;
+
+  ContextSnapshotText *text =
+      reinterpret_cast<ContextSnapshotText *>(base + texts_at);
+  ContextSnapshotAttribute *const attributes =
+      reinterpret_cast<ContextSnapshotAttribute *>(base + attributes_at);
+  char16_t *const pool = reinterpret_cast<char16_t *>(base + pool_at);
+  uint32_t next_attribute = 0;
+  char16_t *at = pool;
+  for_each_text(ctx, status,
+                [&](const std::wstring &str,
+                    const std::vector<TextAttribute> *attrs) {
+                  text->offset = (uint32_t)(at - pool);
+                  at = put_utf16(str, at);
+                  text->length = (uint32_t)(at - pool) - text->offset;
+                  text->first_attribute = next_attribute;
+                  text->attribute_count = attrs ? (uint32_t)attrs->size() : 0;
+                  for (uint32_t i = 0; i < text->attribute_count; i++) {
+                    const TextAttribute &a = (*attrs)[i];
+                    ContextSnapshotAttribute &dst =
+                        attributes[next_attribute++];
+                    dst.start = a.range.start;
+                    dst.end = a.range.end;
+                    dst.cursor = a.range.cursor;
+                    dst.type = (int32_t)a.type;
+                  }
+                  text++;
+                });
+}
+
+// ----------------------------------------------------------------------------
+
+std::wstring TextView::wstr() const {
+  std::wstring s;
+  get_utf16(str, s);
+  return s;
+}
+
+void TextView::CopyTo(Text &text) const {
+  get_utf16(str, text.str);
+  text.attributes.resize(attribute_count);
+  for (uint32_t i = 0; i < attribute_count; i++) {
+    const ContextSnapshotAttribute &a = attributes[i];
+    text.attributes[i].range = TextRange(a.start, a.end, a.cursor);
+    text.attributes[i].type = (TextAttributeType)a.type;
+  }
+}
+
+bool TextView::operator==(const Text &text) const {
+  if (attribute_count != text.attributes.size() || !same_utf16(str, text.str))
+    return false;
+  for (uint32_t i = 0; i < attribute_count; i++) {
+    const ContextSnapshotAttribute &a = attributes[i];
+    const TextAttribute &b = text.attributes[i];
+    if (a.start != b.range.start || a.end != b.range.end ||
+        a.cursor != b.range.cursor || a.type != (int32_t)b.type)
+      return false;
+  }
+  return true;
+}
+
+bool ContextSnapshotView::Open(const void *data, size_t size) {
+  m_header = nullptr;
+  if (!data || (uintptr_t)data % 4 || size < sizeof(ContextSnapshotHeader))
+    return false;
+  const char *base = static_cast<const char *>(data);
+  const auto *header = reinterpret_cast<const ContextSnapshotHeader *>(base);
+  if (header->magic != CONTEXT_SNAPSHOT_MAGIC ||
+      header->version != CONTEXT_SNAPSHOT_VERSION || header->size > size ||
+      (uint64_t)header->candidate_count + header->comment_count +
+              header->label_count + 4 !=
+          header->text_count)
+    return false;
+  // 64 bit sums, no count can overflow them
+  const uint64_t texts_at = sizeof(ContextSnapshotHeader);
+  const uint64_t attributes_at =
+      texts_at + (uint64_t)header->text_count * sizeof(ContextSnapshotText);
+  const uint64_t pool_at =
+      attributes_at +
+      (uint64_t)header->attribute_count * sizeof(ContextSnapshotAttribute);
+  if (pool_at + (uint64_t)header->pool_units * sizeof(char16_t) > header->size)
+    return false;
+  const auto *texts =
+      reinterpret_cast<const ContextSnapshotText *>(base + texts_at);
+  for (uint32_t i = 0; i < header->text_count; i++) {
+    if ((uint64_t)texts[i].offset + texts[i].length > header->pool_units ||
+        (uint64_t)texts[i].first_attribute + texts[i].attribute_count >
+            header->attribute_count)
+      return false;
+  }
+  m_header = header;
+  m_texts = texts;
+  m_attributes =
+      reinterpret_cast<const ContextSnapshotAttribute *>(base + attributes_at);
+  m_pool = reinterpret_cast<const char16_t *>(base + pool_at);
+  return true;
+}
+
+TextView ContextSnapshotView::_Text(size_t i) const {
+  const ContextSnapshotText &text = m_texts[i];
+  TextView view;
+  view.str = std::u16string_view(m_pool + text.offset, text.length);
+  view.attributes = m_attributes + text.first_attribute;
+  view.attribute_count = text.attribute_count;
+  return view;
+}
+
+void ContextSnapshotView::Decode(Context &ctx, Status &status) const {
+  preedit().CopyTo(ctx.preedit);
+  aux().CopyTo(ctx.aux);
+  get_utf16(schema_name(), status.schema_name);
+  get_utf16(schema_id(), status.schema_id);
+  CandidateInfo &cinfo = ctx.cinfo;
+  cinfo.candies.resize(candidate_count());
+  for (size_t i = 0; i < cinfo.candies.size(); i++)
+    candidate(i).CopyTo(cinfo.candies[i]);
+  cinfo.comments.resize(comment_count());
+  for (size_t i = 0; i < cinfo.comments.size(); i++)
+    comment(i).CopyTo(cinfo.comments[i]);
+  cinfo.labels.resize(label_count());
+  for (size_t i = 0; i < cinfo.labels.size(); i++)
+    label(i).CopyTo(cinfo.labels[i]);
+  cinfo.currentPage = current_page();
+  cinfo.totalPages = total_pages();
+  cinfo.highlighted = highlighted();
+  cinfo.is_last_page = is_last_page();
+  status.ascii_mode = ascii_mode();
+  status.composing = composing();
+  status.disabled = disabled();
+  status.full_shape = full_shape();
+  status.type = type();
+}
+
+bool ContextSnapshotView::Equals(const Context &ctx,
+                                 const Status &status) const {
+  const CandidateInfo &cinfo = ctx.cinfo;
+  if (cinfo.currentPage != current_page() ||
+      cinfo.totalPages != total_pages() || cinfo.highlighted != highlighted() ||
+      cinfo.is_last_page != is_last_page() ||
+      status.ascii_mode != ascii_mode() || status.composing != composing() ||
+      status.disabled != disabled() || status.full_shape != full_shape() ||
+      status.type != type() || cinfo.candies.size() != candidate_count() ||
+      cinfo.comments.size() != comment_count() ||
+      cinfo.labels.size() != label_count())
+    return false;
+  if (preedit() != ctx.preedit || aux() != ctx.aux ||
+      !same_utf16(schema_name(), status.schema_name) ||
+      !same_utf16(schema_id(), status.schema_id))
+    return false;
+  for (size_t i = 0; i < cinfo.candies.size(); i++)
+    if (candidate(i) != cinfo.candies[i])
+      return false;
+  for (size_t i = 0; i < cinfo.comments.size(); i++)
+    if (comment(i) != cinfo.comments[i])
+      return false;
+  for (size_t i = 0; i < cinfo.labels.size(); i++)
+    if (label(i) != cinfo.labels[i])
+      return false;
+  return true;
+}
+
+} // namespace weasel
@@ -0,0 +1,123 @@
+#pragma once
+#include <WeaselIPCData.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace weasel {
+
+// A Context and Status flattened into one relocatable buffer: a header, a
+// table of texts, a table of their attributes and a pool of UTF-16 code
+// units, all referenced by offset. Encoding is one allocation at most, and a
+// ContextSnapshotView reads the buffer in place, wherever it was copied to.
+//
+// Texts, in table order: preedit, aux, schema name, schema id, then
+// candidates, comments and labels.
+struct ContextSnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; // of the whole snapshot, bytes
+  uint32_t text_count;
+  uint32_t attribute_count;
+  uint32_t pool_units;
+  uint32_t candidate_count;
+  uint32_t comment_count;
+  uint32_t label_count;
+  int32_t current_page;
+  int32_t total_pages;
+  int32_t highlighted;
+  int32_t type; // IconType
+  uint8_t is_last_page;
+  uint8_t ascii_mode;
+  uint8_t composing;
+  uint8_t disabled;
+  uint8_t full_shape;
+  uint8_t reserved[3];
+};
+
+struct ContextSnapshotText {
+  uint32_t offset; // into the pool, code units
+  uint32_t length;
+  uint32_t first_attribute;
+  uint32_t attribute_count;
+};
+
+struct ContextSnapshotAttribute {
+  int32_t start;
+  int32_t end;
+  int32_t cursor;
+  int32_t type; // TextAttributeType
+};
+
+// bumped on any change to the layout above
+static const uint32_t CONTEXT_SNAPSHOT_VERSION = 1;
+
+// appended to out at the next 4 byte aligned offset, which a view of it
+// needs; clear out first to reuse its capacity
+void EncodeContextSnapshot(const Context &ctx, const Status &status,
+                           std::string &out);
+
+// a text of a snapshot, pointing into it
+struct TextView {
+  std::u16string_view str;
+  const ContextSnapshotAttribute *attributes = nullptr;
+  uint32_t attribute_count = 0;
+
+  bool empty() const { return str.empty(); }
+  // a copy, for what takes a wstring
+  std::wstring wstr() const;
+  void CopyTo(Text &text) const;
+  bool operator==(const Text &text) const;
+  bool operator!=(const Text &text) const { return !(*this == text); }
+};
+
+// Reads a snapshot in place. Open checks every offset once, the accessors
+// after it do not; the buffer must outlive the view and stay unchanged.
+class ContextSnapshotView {
+public:
+  // false unless data, 4 byte aligned, holds a whole snapshot of this version
+  bool Open(const void *data, size_t size);
+  bool IsOpen() const { return m_header != nullptr; }
+  // bytes taken by the snapshot, which may be followed by other data
+  size_t size() const { return m_header->size; }
+
+  TextView preedit() const { return _Text(0); }
+  TextView aux() const { return _Text(1); }
+  std::u16string_view schema_name() const { return _Text(2).str; }
+  std::u16string_view schema_id() const { return _Text(3).str; }
+  size_t candidate_count() const { return m_header->candidate_count; }
+  size_t comment_count() const { return m_header->comment_count; }
+  size_t label_count() const { return m_header->label_count; }
+  TextView candidate(size_t i) const { return _Text(4 + i); }
+  TextView comment(size_t i) const {
+    return _Text(4 + m_header->candidate_count + i);
+  }
+  TextView label(size_t i) const {
+    return _Text(4 + m_header->candidate_count + m_header->comment_count + i);
+  }
+  int current_page() const { return m_header->current_page; }
+  int total_pages() const { return m_header->total_pages; }
+  int highlighted() const { return m_header->highlighted; }
+  bool is_last_page() const { return m_header->is_last_page != 0; }
+  bool ascii_mode() const { return m_header->ascii_mode != 0; }
+  bool composing() const { return m_header->composing != 0; }
+  bool disabled() const { return m_header->disabled != 0; }
+  bool full_shape() const { return m_header->full_shape != 0; }
+  IconType type() const { return (IconType)m_header->type; }
+
+  // materialized, reusing the storage of ctx and status
+  void Decode(Context &ctx, Status &status) const;
+  // compared without materializing
+  bool Equals(const Context &ctx, const Status &status) const;
+
+private:
+  TextView _Text(size_t i) const;
+
+  const ContextSnapshotHeader *m_header = nullptr;
+  const ContextSnapshotText *m_texts = nullptr;
+  const ContextSnapshotAttribute *m_attributes = nullptr;
+  const char16_t *m_pool = nullptr;
+};
+
+} // namespace weasel
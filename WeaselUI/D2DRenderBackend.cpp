@@ -0,0 +1,315 @@
+#include "D2DRenderBackend.h"
+#include <chrono>
+
+namespace weasel {
+
+static CRect to_crect(const PlaceRect &rc) {
+  return CRect(rc.left, rc.top, rc.right, rc.bottom);
+}
+
+static IsToRoundStruct to_round_info(const RenderCorners &corners) {
+  IsToRoundStruct info;
+  info.IsTopLeftNeedToRound = corners.top_left;
+  info.IsTopRightNeedToRound = corners.top_right;
+  info.IsBottomLeftNeedToRound = corners.bottom_left;
+  info.IsBottomRightNeedToRound = corners.bottom_right;
+  return info;
+}
+
+PtTextFormat &D2DRenderBackend::_Format(RenderFont font) {
+  switch (font) {
+  case kPreeditFont:
+    return m_pD2D->pPreeditFormat;
+  case kLabelFont:
+    return m_pD2D->pLabelFormat;
+  case kCommentFont:
+    return m_pD2D->pCommentFormat;
+  default:
+    return m_pD2D->pTextFormat;
+  }
+}
+
+bool D2DRenderBackend::BeginFrame() {
+  if (!m_pD2D || !m_pD2D->dc || !m_pD2D->swapChain)
+    return false;
+  auto hr = m_pD2D->direct3dDevice
+                ? m_pD2D->direct3dDevice->GetDeviceRemovedReason()
+                : DXGI_ERROR_DEVICE_REMOVED;
+  if (FAILED(hr)) {
+    DEBUG << StrzHr(hr);
+    m_pD2D->InitDirect2D();
+    if (!m_pD2D->dc || !m_pD2D->swapChain)
+      return false;
+  }
+  // a new frame replaces one still waiting for Present
+  m_presentPending = false;
+  m_pD2D->dc->BeginDraw();
+  m_pD2D->dc->Clear(D2D1::ColorF({0.0f, 0.0f, 0.0f, 0.0f}));
+  return true;
+}
+
+bool D2DRenderBackend::FrameReady() {
+  if (!m_pD2D || m_pD2D->FrameReady())
+    return true;
+  m_presentStats.not_ready++;
+  return false;
+}
+
+bool D2DRenderBackend::_Present() {
+  const UINT interval = m_presentNoWait ? 0 : 1;
+  const UINT flags = m_presentNoWait ? DXGI_PRESENT_DO_NOT_WAIT : 0;
+  const auto start = std::chrono::steady_clock::now();
+  HRESULT hrPresent = m_pD2D->swapChain->Present(interval, flags);
+  const auto blocked = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  m_presentPending = hrPresent == DXGI_ERROR_WAS_STILL_DRAWING;
+  if (m_presentPending) {
+    m_presentStats.still_drawing++;
+    return true;
+  }
+  m_presentStats.frames++;
+  m_presentStats.last_blocked_us = (uint64_t)blocked;
+  m_presentStats.max_blocked_us =
+      MAX(m_presentStats.max_blocked_us, (uint64_t)blocked);
+  m_presentStats.total_blocked_us += (uint64_t)blocked;
+  if (m_presentNoWait)
+    m_presentStats.no_wait++;
+  if (hrPresent == DXGI_ERROR_DEVICE_REMOVED ||
+      hrPresent == DXGI_ERROR_DEVICE_RESET) {
+    DEBUG << "Device lost during Present: " << StrzHr(hrPresent);
+    DeviceResources::Get().Reset();
+    m_pD2D->InitDirect2D();
+    return false;
+  } else if (FAILED(hrPresent)) {
+    DEBUG << "Present failed: " << StrzHr(hrPresent);
+    DeviceResources::Get().Reset();
+    m_pD2D->InitDirect2D();
+    return false;
+  }
+  return true;
+}
+
+bool D2DRenderBackend::RetryPresent() {
+  if (!m_presentPending || !m_pD2D || !m_pD2D->swapChain) {
+    m_presentPending = false;
+    return true;
+  }
+  _Present();
+  return !m_presentPending;
+}
+
+bool D2DRenderBackend::EndFrame() {
+  auto hrEnd = m_pD2D->dc->EndDraw();
+  if (FAILED(hrEnd)) {
+    DEBUG << "EndDraw failed: " << StrzHr(hrEnd);
+    DeviceResources::Get().Reset();
+    m_pD2D->InitDirect2D();
+    return false;
+  }
+  // Make the swap chain available to the composition engine
+  return _Present();
+}
+
+void D2DRenderBackend::FillRoundedRect(const PlaceRect &rc, float radius,
+                                       const RenderCorners &corners,
+                                       uint32_t color) {
+  m_pD2D->FillGeometry(to_crect(rc), color, (uint32_t)radius,
+                       to_round_info(corners));
+}
+
+void D2DRenderBackend::StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                         const RenderCorners &corners,
+                                         float width, uint32_t color) {
+  ComPtr<ID2D1PathGeometry> pGeometry;
+  const RECT rect = to_crect(rc);
+  HR(m_pD2D->CreateRoundedRectanglePath(rect, radius, to_round_info(corners),
+                                        pGeometry));
+  m_pD2D->SetBrushColor(color);
+  m_pD2D->dc->DrawGeometry(pGeometry.Get(), m_pD2D->m_pBrush.Get(), width);
+}
+
+void D2DRenderBackend::FillShadow(const PlaceRect &rc, float radius,
+                                  const RenderCorners &corners, int dx, int dy,
+                                  float blur, uint32_t color) {
+  CRect rect = to_crect(rc);
+  rect.OffsetRect(dx, dy);
+  m_pD2D->FillBlurredGeometry(rect, color, radius, to_round_info(corners),
+                              blur);
+}
+
+HRESULT D2DRenderBackend::_CreateLayout(const PlaceRect &rc,
+                                        const TextRun &run,
+                                        ComPtr<IDWriteTextLayout> &pTextLayout,
+                                        D2D1_POINT_2F &offset) {
+  PtTextFormat &pTextFormat = _Format(run.font);
+  if (!pTextFormat.Get() || !m_pD2D->m_pWriteFactory)
+    return E_POINTER;
+  HRESULT hr = m_pD2D->m_pWriteFactory->CreateTextLayout(
+      run.text, (UINT32)run.length, pTextFormat.Get(),
+      (float)(rc.right - rc.left), (float)(rc.bottom - rc.top),
+      reinterpret_cast<IDWriteTextLayout **>(pTextLayout.GetAddressOf()));
+  if (FAILED(hr) || !pTextLayout)
+    return FAILED(hr) ? hr : E_FAIL;
+  if (run.vertical) {
+    DWRITE_FLOW_DIRECTION flow = run.left_to_right
+                                     ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
+                                     : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
+    pTextLayout->SetReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
+    pTextLayout->SetFlowDirection(flow);
+  } else {
+    pTextLayout->SetReadingDirection(DWRITE_READING_DIRECTION_LEFT_TO_RIGHT);
+    pTextLayout->SetFlowDirection(DWRITE_FLOW_DIRECTION_TOP_TO_BOTTOM);
+  }
+  if (run.hilite_start < run.hilite_end && run.hilite_end <= run.length) {
+    // one layout, the highlighted range painted with its own brush
+    const DWRITE_TEXT_RANGE range = {
+        (UINT32)run.hilite_start, (UINT32)(run.hilite_end - run.hilite_start)};
+    D2D::SetHiliteSpacing(pTextLayout.Get(), (UINT32)run.length,
+                          TextRange((int)run.hilite_start,
+                                    (int)run.hilite_end, -1),
+                          run.hilite_spacing);
+    ComPtr<ID2D1SolidColorBrush> pBrush;
+    if (SUCCEEDED(m_pD2D->CreateBrush(run.hilite_color, pBrush)))
+      pTextLayout->SetDrawingEffect(pBrush.Get(), range);
+  }
+  offset = D2D1::Point2F(0.0f, 0.0f);
+  DWRITE_OVERHANG_METRICS omt;
+  pTextLayout->GetOverhangMetrics(&omt);
+  if (!run.vertical && omt.left > 0)
+    offset.x += omt.left;
+  if (run.vertical && omt.top > 0)
+    offset.y += omt.top;
+  return S_OK;
+}
+
+bool D2DRenderBackend::_DrawCachedText(const PlaceRect &rc, const TextRun &run,
+                                       uint32_t color) {
+  auto &dc = m_pD2D->dc;
+  if (m_textCacheDc != dc) {
+    // recorded on another device context, or the device was lost
+    m_textCache.clear();
+    m_textCacheDc = dc;
+  }
+  PtTextFormat &pTextFormat = _Format(run.font);
+  TextKey key{std::wstring(run.text, run.length),
+              pTextFormat.Get(),
+              color,
+              m_pD2D->m_dpiY,
+              rc.right - rc.left,
+              rc.bottom - rc.top,
+              run.vertical,
+              run.vertical && run.left_to_right};
+  auto it = m_textCache.find(key);
+  if (it != m_textCache.end()) {
+    m_textCacheHits++;
+  } else {
+    m_textCacheMisses++;
+    ComPtr<IDWriteTextLayout> pTextLayout;
+    D2D1_POINT_2F offset;
+    if (FAILED(_CreateLayout(rc, run, pTextLayout, offset)))
+      return true;
+    ComPtr<ID2D1CommandList> commands;
+    if (FAILED(dc->CreateCommandList(commands.GetAddressOf())))
+      return false;
+    ComPtr<ID2D1Image> target;
+    dc->GetTarget(target.GetAddressOf());
+    // recorded at the origin: a layer draws with its atlas offset set as the
+    // transform, which DrawImage applies again on replay
+    D2D1_MATRIX_3X2_F transform;
+    dc->GetTransform(&transform);
+    dc->SetTransform(D2D1::Matrix3x2F::Identity());
+    dc->SetTarget(commands.Get());
+    m_pD2D->DrawTextLayout(pTextLayout, offset.x, offset.y, color);
+    dc->SetTarget(target.Get());
+    dc->SetTransform(transform);
+    if (FAILED(commands->Close()))
+      return false;
+    if (m_textCache.size() >= TEXT_CACHE_SIZE) {
+      auto oldest = m_textCache.begin();
+      for (auto i = m_textCache.begin(); i != m_textCache.end(); ++i)
+        if (i->second.used < oldest->second.used)
+          oldest = i;
+      m_textCache.erase(oldest);
+    }
+    it = m_textCache.emplace(std::move(key), CachedText()).first;
+    it->second.commands = commands;
+    it->second.format = pTextFormat;
+  }
+  it->second.used = ++m_textCacheTick;
+  const D2D1_POINT_2F origin = D2D1::Point2F((float)rc.left, (float)rc.top);
+  dc->DrawImage(it->second.commands.Get(), &origin);
+  return true;
+}
+
+void D2DRenderBackend::DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                                   uint32_t color) {
+  if (run.repeated && run.hilite_start >= run.hilite_end &&
+      _DrawCachedText(rc, run, color))
+    return;
+  ComPtr<IDWriteTextLayout> pTextLayout;
+  D2D1_POINT_2F offset;
+  if (FAILED(_CreateLayout(rc, run, pTextLayout, offset)))
+    return;
+  m_pD2D->DrawTextLayout(pTextLayout, rc.left + offset.x, rc.top + offset.y,
+                         color);
+}
+
+bool D2DRenderBackend::BeginLayer(int layer, int width, int height) {
+  return m_pD2D && SUCCEEDED(m_pD2D->BeginLayerDraw(layer, MAX(width, 0),
+                                                    MAX(height, 0)));
+}
+
+bool D2DRenderBackend::EndLayer(int layer) {
+  return m_pD2D && SUCCEEDED(m_pD2D->EndLayerDraw(layer));
+}
+
+bool D2DRenderBackend::MoveLayer(int layer, int x, int y) {
+  return m_pD2D && SUCCEEDED(m_pD2D->MoveLayer(layer, x, y));
+}
+
+void D2DRenderBackend::HideLayer(int layer) {
+  if (m_pD2D)
+    m_pD2D->HideLayer(layer);
+}
+
+void D2DRenderBackend::ReleaseLayers() {
+  if (m_pD2D)
+    m_pD2D->ReleaseLayers();
+}
+
+bool D2DRenderBackend::Commit() {
+  return m_pD2D && SUCCEEDED(m_pD2D->CommitLayers());
+}
+
+D2DRenderBackend::TextCacheStats D2DRenderBackend::GetTextCacheStats() const {
+  TextCacheStats stats;
+  stats.entries = m_textCache.size();
+  stats.hits = m_textCacheHits;
+  stats.misses = m_textCacheMisses;
+  return stats;
+}
+
+void D2DRenderBackend::DrawImage(const PlaceRect &rc,
+                                 const RenderImage &image) {
+  ComPtr<ID2D1Bitmap1> pBitmap;
+  HRESULT hr = E_INVALIDARG;
+  if (image.native) {
+    hr = m_pD2D->GetBmpFromIcon(static_cast<HICON>(image.native), pBitmap);
+  } else if (image.pixels) {
+    const auto props = D2D1::BitmapProperties1(
+        D2D1_BITMAP_OPTIONS_NONE,
+        D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM,
+                          D2D1_ALPHA_MODE_PREMULTIPLIED));
+    hr = m_pD2D->dc->CreateBitmap(
+        D2D1::SizeU(image.width, image.height), image.pixels,
+        image.width * sizeof(uint32_t), props, pBitmap.GetAddressOf());
+  }
+  if (SUCCEEDED(hr) && pBitmap) {
+    D2D1_RECT_F rectf = D2D1::RectF((float)rc.left, (float)rc.top,
+                                    (float)rc.right, (float)rc.bottom);
+    m_pD2D->dc->DrawBitmap(pBitmap.Get(), rectf);
+  }
+}
+
+} // namespace weasel
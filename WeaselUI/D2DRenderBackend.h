@@ -0,0 +1,118 @@
+#pragma once
+#include "RenderBackend.h"
+#include "d2d.h"
+#include <map>
+#include <tuple>
+
+namespace weasel {
+
+// RenderBackend drawing to the panel's swap chain through D2D
+class D2DRenderBackend : public RenderBackend {
+public:
+  struct TextCacheStats {
+    size_t entries = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+  struct PresentStats {
+    uint64_t frames = 0;
+    // presented with DXGI_PRESENT_DO_NOT_WAIT
+    uint64_t no_wait = 0;
+    // FrameReady found the swap chain busy
+    uint64_t not_ready = 0;
+    // Present left a frame pending for RetryPresent
+    uint64_t still_drawing = 0;
+    // time spent in Present
+    uint64_t last_blocked_us = 0;
+    uint64_t max_blocked_us = 0;
+    uint64_t total_blocked_us = 0;
+  };
+  // repeated text runs kept as command lists, least recently used dropped
+  static const size_t TEXT_CACHE_SIZE = 128;
+
+  explicit D2DRenderBackend(an<D2D> &pD2D) : m_pD2D(pD2D) {}
+  virtual bool BeginFrame();
+  virtual bool EndFrame();
+  virtual void FillRoundedRect(const PlaceRect &rc, float radius,
+                               const RenderCorners &corners, uint32_t color);
+  virtual void StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                 const RenderCorners &corners, float width,
+                                 uint32_t color);
+  virtual void FillShadow(const PlaceRect &rc, float radius,
+                          const RenderCorners &corners, int dx, int dy,
+                          float blur, uint32_t color);
+  virtual void DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                           uint32_t color);
+  virtual void DrawImage(const PlaceRect &rc, const RenderImage &image);
+  // counters for a debugger, not logged per lookup or frame
+  TextCacheStats GetTextCacheStats() const;
+  const PresentStats &GetPresentStats() const { return m_presentStats; }
+
+  // see D2D::FrameReady; call once before a frame that is presented
+  bool FrameReady();
+  // the next EndFrame presents with sync interval 0 and
+  // DXGI_PRESENT_DO_NOT_WAIT; a frame the swap chain could not take yet is
+  // left pending for RetryPresent
+  void SetPresentNoWait(bool no_wait) { m_presentNoWait = no_wait; }
+  bool PresentPending() const { return m_presentPending; }
+  // true once the pending frame is presented
+  bool RetryPresent();
+
+  // DirectComposition layers over the swap chain, each above the one before
+  enum { kHoverLayer, kHiliteLayer, kTopLayer };
+  // draws go to layer, width x height from its top left, until EndLayer
+  bool BeginLayer(int layer, int width, int height);
+  bool EndLayer(int layer);
+  // false if the layer has nothing drawn to show
+  bool MoveLayer(int layer, int x, int y);
+  void HideLayer(int layer);
+  void ReleaseLayers();
+  // shows the layer changes since the last commit
+  bool Commit();
+
+private:
+  struct TextKey {
+    std::wstring text;
+    IDWriteTextFormat1 *format;
+    uint32_t color;
+    float dpi;
+    int width;
+    int height;
+    bool vertical;
+    bool left_to_right;
+    bool operator<(const TextKey &o) const {
+      return std::tie(text, format, color, dpi, width, height, vertical,
+                      left_to_right) < std::tie(o.text, o.format, o.color,
+                                                o.dpi, o.width, o.height,
+                                                o.vertical, o.left_to_right);
+    }
+  };
+  struct CachedText {
+    ComPtr<ID2D1CommandList> commands;
+    // holds the format so its address is not reused by another key
+    PtTextFormat format;
+    uint64_t used = 0;
+  };
+  PtTextFormat &_Format(RenderFont font);
+  // text layout for run in rc; the offset is where it is drawn relative to
+  // the top left of rc
+  HRESULT _CreateLayout(const PlaceRect &rc, const TextRun &run,
+                        ComPtr<IDWriteTextLayout> &pTextLayout,
+                        D2D1_POINT_2F &offset);
+  bool _DrawCachedText(const PlaceRect &rc, const TextRun &run,
+                       uint32_t color);
+  bool _Present();
+
+  an<D2D> &m_pD2D;
+  std::map<TextKey, CachedText> m_textCache;
+  // the device context m_textCache was recorded for
+  ComPtr<ID2D1DeviceContext> m_textCacheDc;
+  uint64_t m_textCacheTick = 0;
+  size_t m_textCacheHits = 0;
+  size_t m_textCacheMisses = 0;
+  bool m_presentNoWait = false;
+  bool m_presentPending = false;
+  PresentStats m_presentStats;
+};
+
+} // namespace weasel
@@ -0,0 +1,290 @@
+#include "DisplayList.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace weasel {
+
+static bool intersects(const PlaceRect &a, const PlaceRect &b) {
+  return a.left < b.right && b.left < a.right && a.top < b.bottom &&
+         b.top < a.bottom;
+}
+
+void DisplayList::Clear() {
+  m_ops.clear();
+  m_text.clear();
+}
+
+void DisplayList::FillRoundedRect(const PlaceRect &rc, float radius,
+                                  const RenderCorners &corners,
+                                  uint32_t color) {
+  DisplayOp op;
+  op.kind = DisplayOp::kFill;
+  op.rc = rc;
+  op.color = color;
+  op.radius = radius;
+  op.corners = corners;
+  m_ops.push_back(op);
+}
+
+void DisplayList::StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                    const RenderCorners &corners, float width,
+                                    uint32_t color) {
+  DisplayOp op;
+  op.kind = DisplayOp::kStroke;
+  op.rc = rc;
+  op.color = color;
+  op.radius = radius;
+  op.width = width;
+  op.corners = corners;
+  m_ops.push_back(op);
+}
+
+void DisplayList::FillShadow(const PlaceRect &rc, float radius,
+                             const RenderCorners &corners, int dx, int dy,
+                             float blur, uint32_t color) {
+  DisplayOp op;
+  op.kind = DisplayOp::kShadow;
+  op.rc = rc;
+  op.color = color;
+  op.radius = radius;
+  op.width = blur;
+  op.dx = dx;
+  op.dy = dy;
+  op.corners = corners;
+  m_ops.push_back(op);
+}
+
+void DisplayList::DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                              uint32_t color) {
+  if (!run.text || !run.length)
+    return;
+  DisplayOp op;
+  op.kind = DisplayOp::kText;
+  op.rc = rc;
+  op.color = color;
+  op.text_offset = (uint32_t)m_text.size();
+  op.text_length = (uint32_t)run.length;
+  op.font = run.font;
+  op.vertical = run.vertical;
+  op.left_to_right = run.left_to_right;
+  op.repeated = run.repeated;
+  if (run.hilite_start < run.hilite_end && run.hilite_end <= run.length) {
+    op.hilite_start = (uint32_t)run.hilite_start;
+    op.hilite_end = (uint32_t)run.hilite_end;
+    op.hilite_color = run.hilite_color;
+    op.hilite_spacing = run.hilite_spacing;
+  }
+  m_text.append(run.text, run.length);
+  m_ops.push_back(op);
+}
+
+void DisplayList::DrawImage(const PlaceRect &rc, const RenderImage &image) {
+  DisplayOp op;
+  op.kind = DisplayOp::kImage;
+  op.rc = rc;
+  op.image = image;
+  m_ops.push_back(op);
+}
+
+PlaceRect DisplayList::_Bounds(const DisplayOp &op) {
+  PlaceRect rc = op.rc;
+  int pad = 1;
+  switch (op.kind) {
+  case DisplayOp::kStroke:
+    pad += (int)std::ceil(op.width / 2);
+    break;
+  case DisplayOp::kShadow:
+    rc.left += op.dx;
+    rc.right += op.dx;
+    rc.top += op.dy;
+    rc.bottom += op.dy;
+    pad += (int)std::ceil(op.width * 3);
+    break;
+  case DisplayOp::kText:
+    // glyphs may overhang the measured rect
+    pad += std::max(rc.right - rc.left, rc.bottom - rc.top) / 2;
+    break;
+  default:
+    break;
+  }
+  return {rc.left - pad, rc.top - pad, rc.right + pad, rc.bottom + pad};
+}
+
+void DisplayList::Optimize() {
+  // Each op moves back to just after the last op of its color, unless an op
+  // in between overlaps it; then it stays at the end.
+  m_sorted.clear();
+  m_bounds.clear();
+  for (const auto &op : m_ops) {
+    const PlaceRect bounds = _Bounds(op);
+    size_t at = m_sorted.size();
+    if (op.kind != DisplayOp::kImage) {
+      for (size_t j = m_sorted.size(); j-- > 0;) {
+        if (m_sorted[j].kind != DisplayOp::kImage &&
+            m_sorted[j].color == op.color) {
+          at = j + 1;
+          break;
+        }
+        if (intersects(m_bounds[j], bounds))
+          break;
+      }
+    }
+    m_sorted.insert(m_sorted.begin() + at, op);
+    m_bounds.insert(m_bounds.begin() + at, bounds);
+  }
+  m_ops.swap(m_sorted);
+}
+
+PlaceRect DisplayList::Bounds() const {
+  if (m_ops.empty())
+    return PlaceRect();
+  PlaceRect rc = _Bounds(m_ops[0]);
+  for (size_t i = 1; i < m_ops.size(); i++) {
+    const PlaceRect b = _Bounds(m_ops[i]);
+    rc.left = std::min(rc.left, b.left);
+    rc.top = std::min(rc.top, b.top);
+    rc.right = std::max(rc.right, b.right);
+    rc.bottom = std::max(rc.bottom, b.bottom);
+  }
+  return rc;
+}
+
+bool DisplayList::SameAsMoved(const DisplayList &other, int dx, int dy) const {
+  if (m_ops.size() != other.m_ops.size())
+    return false;
+  for (size_t i = 0; i < m_ops.size(); i++) {
+    const DisplayOp &a = m_ops[i];
+    const DisplayOp &b = other.m_ops[i];
+    if (a.kind != b.kind || a.color != b.color || a.radius != b.radius ||
+        a.width != b.width || a.dx != b.dx || a.dy != b.dy ||
+        a.rc.left != b.rc.left + dx || a.rc.top != b.rc.top + dy ||
+        a.rc.right != b.rc.right + dx || a.rc.bottom != b.rc.bottom + dy ||
+        a.corners.top_left != b.corners.top_left ||
+        a.corners.top_right != b.corners.top_right ||
+        a.corners.bottom_left != b.corners.bottom_left ||
+        a.corners.bottom_right != b.corners.bottom_right)
+      return false;
+    if (a.kind == DisplayOp::kText &&
+        (a.font != b.font || a.vertical != b.vertical ||
+         a.left_to_right != b.left_to_right ||
+         a.hilite_start != b.hilite_start || a.hilite_end != b.hilite_end ||
+         a.hilite_color != b.hilite_color ||
+         a.hilite_spacing != b.hilite_spacing ||
+         m_text.compare(a.text_offset, a.text_length, other.m_text,
+                        b.text_offset, b.text_length) != 0))
+      return false;
+    if (a.kind == DisplayOp::kImage &&
+        (a.image.pixels != b.image.pixels || a.image.native != b.image.native))
+      return false;
+  }
+  return true;
+}
+
+void DisplayList::Replay(RenderBackend &target, int dx, int dy) const {
+  for (const auto &op : m_ops) {
+    const PlaceRect rc = {op.rc.left + dx, op.rc.top + dy, op.rc.right + dx,
+                          op.rc.bottom + dy};
+    switch (op.kind) {
+    case DisplayOp::kFill:
+      target.FillRoundedRect(rc, op.radius, op.corners, op.color);
+      break;
+    case DisplayOp::kStroke:
+      target.StrokeRoundedRect(rc, op.radius, op.corners, op.width, op.color);
+      break;
+    case DisplayOp::kShadow:
+      target.FillShadow(rc, op.radius, op.corners, op.dx, op.dy, op.width,
+                        op.color);
+      break;
+    case DisplayOp::kText: {
+      TextRun run;
+      run.text = m_text.data() + op.text_offset;
+      run.length = op.text_length;
+      run.font = op.font;
+      run.vertical = op.vertical;
+      run.left_to_right = op.left_to_right;
+      run.repeated = op.repeated;
+      run.hilite_start = op.hilite_start;
+      run.hilite_end = op.hilite_end;
+      run.hilite_color = op.hilite_color;
+      run.hilite_spacing = op.hilite_spacing;
+      target.DrawTextRun(rc, run, op.color);
+      break;
+    }
+    case DisplayOp::kImage:
+      target.DrawImage(rc, op.image);
+      break;
+    }
+  }
+}
+
+static void append_utf8(std::string &out, const wchar_t *text, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint32_t c = (uint32_t)text[i];
+    if (c >= 0xd800 && c < 0xdc00 && i + 1 < len &&
+        (uint32_t)text[i + 1] >= 0xdc00 && (uint32_t)text[i + 1] < 0xe000) {
+      c = 0x10000 + ((c - 0xd800) << 10) + ((uint32_t)text[i + 1] - 0xdc00);
+      i++;
+    }
+    if (c < 0x80) {
+      out.push_back((char)c);
+    } else if (c < 0x800) {
+      out.push_back((char)(0xc0 | (c >> 6)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+      out.push_back((char)(0xe0 | (c >> 12)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    } else {
+      out.push_back((char)(0xf0 | (c >> 18)));
+      out.push_back((char)(0x80 | ((c >> 12) & 0x3f)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    }
+  }
+}
+
+void DisplayList::Dump(std::string &out) const {
+  static const char *const kinds[] = {"fill", "stroke", "shadow", "text",
+                                      "image"};
+  char buf[160];
+  for (const auto &op : m_ops) {
+    snprintf(buf, sizeof(buf), "%s %d,%d,%d,%d #%08x", kinds[op.kind],
+             op.rc.left, op.rc.top, op.rc.right, op.rc.bottom, op.color);
+    out += buf;
+    switch (op.kind) {
+    case DisplayOp::kFill:
+    case DisplayOp::kStroke:
+    case DisplayOp::kShadow:
+      snprintf(buf, sizeof(buf), " r=%g w=%g d=%d,%d corners=%d%d%d%d",
+               op.radius, op.width, op.dx, op.dy, op.corners.top_left,
+               op.corners.top_right, op.corners.bottom_left,
+               op.corners.bottom_right);
+      out += buf;
+      break;
+    case DisplayOp::kText:
+      snprintf(buf, sizeof(buf), " font=%d%s%s", (int)op.font,
+               op.vertical ? (op.left_to_right ? " vlr" : " vrl") : "",
+               op.repeated ? " repeated" : "");
+      out += buf;
+      if (op.hilite_start < op.hilite_end) {
+        snprintf(buf, sizeof(buf), " hilite=%u,%u #%08x s=%d",
+                 op.hilite_start, op.hilite_end, op.hilite_color,
+                 op.hilite_spacing);
+        out += buf;
+      }
+      out += " \"";
+      append_utf8(out, m_text.data() + op.text_offset, op.text_length);
+      out += '"';
+      break;
+    case DisplayOp::kImage:
+      snprintf(buf, sizeof(buf), " %dx%d%s", op.image.width, op.image.height,
+               op.image.native ? " native" : "");
+      out += buf;
+      break;
+    }
+    out += '\n';
+  }
+}
+
+} // namespace weasel
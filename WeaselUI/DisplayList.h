@@ -0,0 +1,81 @@
+#pragma once
+#include "RenderBackend.h"
+#include <string>
+#include <vector>
+
+// A frame recorded as flat draw ops with resolved rects, colors and text, so
+// WM_PAINT replays it instead of walking the context, style and layout again.
+namespace weasel {
+
+struct DisplayOp {
+  enum Kind : uint8_t { kFill, kStroke, kShadow, kText, kImage };
+  Kind kind = kFill;
+  PlaceRect rc;
+  uint32_t color = 0;
+  float radius = 0;
+  // stroke width, or shadow standard deviation
+  float width = 0;
+  int dx = 0;
+  int dy = 0;
+  RenderCorners corners;
+  // text: [text_offset, text_offset + text_length) of the list's text pool
+  uint32_t text_offset = 0;
+  uint32_t text_length = 0;
+  RenderFont font = kTextFont;
+  bool vertical = false;
+  bool left_to_right = false;
+  bool repeated = false;
+  // highlighted text: [hilite_start, hilite_end) of the op's text
+  uint32_t hilite_start = 0;
+  uint32_t hilite_end = 0;
+  uint32_t hilite_color = 0;
+  int hilite_spacing = 0;
+  // image pixels or handle, owned by the caller and kept alive meanwhile
+  RenderImage image;
+};
+
+// Records what is drawn on it, as a RenderBackend, for Replay on another.
+class DisplayList : public RenderBackend {
+public:
+  void Clear();
+  bool empty() const { return m_ops.empty(); }
+  size_t size() const { return m_ops.size(); }
+  const std::vector<DisplayOp> &ops() const { return m_ops; }
+  // reorders ops that do not overlap so that ops of one color run together,
+  // for fewer brush changes; the replayed pixels stay the same
+  void Optimize();
+  // everything moved by (dx, dy)
+  void Replay(RenderBackend &target, int dx = 0, int dy = 0) const;
+  // union of the areas the ops may touch, empty if there are none
+  PlaceRect Bounds() const;
+  // the ops of other moved by (dx, dy), i.e. the same pixels at another place
+  bool SameAsMoved(const DisplayList &other, int dx, int dy) const;
+  // one op per line, text as UTF-8, for logs and comparing frames
+  void Dump(std::string &out) const;
+
+  virtual bool BeginFrame() { return true; }
+  virtual bool EndFrame() { return true; }
+  virtual void FillRoundedRect(const PlaceRect &rc, float radius,
+                               const RenderCorners &corners, uint32_t color);
+  virtual void StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                 const RenderCorners &corners, float width,
+                                 uint32_t color);
+  virtual void FillShadow(const PlaceRect &rc, float radius,
+                          const RenderCorners &corners, int dx, int dy,
+                          float blur, uint32_t color);
+  virtual void DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                           uint32_t color);
+  virtual void DrawImage(const PlaceRect &rc, const RenderImage &image);
+
+private:
+  // area an op may touch, antialiasing and glyph overhang included
+  static PlaceRect _Bounds(const DisplayOp &op);
+
+  std::vector<DisplayOp> m_ops;
+  std::wstring m_text;
+  // Optimize scratch
+  std::vector<DisplayOp> m_sorted;
+  std::vector<PlaceRect> m_bounds;
+};
+
+} // namespace weasel
@@ -0,0 +1,74 @@
+#include "FontFit.h"
+#include <algorithm>
+#include <climits>
+
+namespace weasel {
+
+// Content size grows about linearly with the font point, so instead of
+// stepping the point by halves (a full layout per step) the next point is
+// predicted from the measured size, and a pass or two corrects the
+// prediction. Content that wraps keeps its width, grows in steps and can
+// leave the passes overflowing or short of the band; the point is then
+// bisected between the largest point measured to fit and the smallest
+// measured to overflow.
+FontFit FitFontPoint(int point, int avail_w, int avail_h,
+                     const std::function<FitSize(int)> &layout) {
+  FontFit fit;
+  FitSize sz;
+  // largest point measured to fit, smallest measured to overflow
+  int fits_at = 0;
+  int over_at = INT_MAX;
+  auto over = [&]() { return sz.cx > avail_w || sz.cy > avail_h; };
+  auto under = [&]() {
+    return sz.cx <= avail_w * 31 / 32 && sz.cy <= avail_h * 31 / 32;
+  };
+  auto run = [&](int p) {
+    sz = layout(p);
+    fit.layouts++;
+    fit.point = p;
+    if (over())
+      over_at = std::min(over_at, p);
+    else
+      fits_at = std::max(fits_at, p);
+  };
+  run(point);
+
+  for (int pass = 0; pass < kMaxFitPasses; pass++) {
+    if (!over() && !under())
+      break;
+    const double scale = std::min((double)avail_w / std::max(sz.cx, 1),
+                                  (double)avail_h / std::max(sz.cy, 1));
+    // aim a little inside the band, margins don't scale with the font
+    int target = (int)(fit.point * scale * 0.98);
+    if (over())
+      target = std::min(target, fit.point - 1);
+    else
+      target = std::max(target, fit.point + 1);
+    target = std::max(target, 1);
+    if (target == fit.point)
+      break;
+    run(target);
+  }
+
+  if (over() || under()) {
+    // point 1 is taken to fit until measured; with no overflow measured yet
+    // the point doubles until one is
+    int lo = std::max(fits_at, 1);
+    int hi = over_at;
+    for (int i = 0; i < kMaxFitBisections && hi - lo > 1; i++) {
+      run(hi == INT_MAX ? lo * 2 : lo + (hi - lo) / 2);
+      if (over())
+        hi = fit.point;
+      else if (under())
+        lo = fit.point;
+      else
+        break;
+    }
+    if (over() || (under() && fit.point != lo))
+      run(lo);
+  }
+  fit.fits = !over();
+  return fit;
+}
+
+} // namespace weasel
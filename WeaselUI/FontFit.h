@@ -0,0 +1,32 @@
+#pragma once
+#include <functional>
+
+// Text point search of the fullscreen layouts, no DirectWrite: layout(point)
+// runs one full layout at point and returns the content size.
+namespace weasel {
+
+struct FitSize {
+  int cx = 0;
+  int cy = 0;
+};
+
+struct FontFit {
+  // the point laid out last; the layout is left at it
+  int point = 0;
+  int layouts = 0;
+  // the content doesn't overflow at point
+  bool fits = false;
+};
+
+// layouts after the first one that predict the point from the measured size
+const int kMaxFitPasses = 3;
+// layouts of the search once the predictions still overflow or fall short of
+// the band: doubling until the content overflows, then bisecting
+const int kMaxFitBisections = 8;
+
+// Fit the content into avail_w x avail_h starting at point, aiming above
+// 31/32 of it; at most 2 + kMaxFitPasses + kMaxFitBisections layouts.
+FontFit FitFontPoint(int point, int avail_w, int avail_h,
+                     const std::function<FitSize(int)> &layout);
+
+} // namespace weasel
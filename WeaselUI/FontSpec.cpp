@@ -0,0 +1,128 @@
+#include "FontSpec.h"
+
+namespace weasel {
+
+namespace {
+
+struct Keyword {
+  const wchar_t *name;
+  int value;
+};
+
+const Keyword kWeights[] = {
+    {L"thin", 100},        {L"extra_light", 200}, {L"ultra_light", 200},
+    {L"light", 300},       {L"semi_light", 350},  {L"medium", 500},
+    {L"demi_bold", 600},   {L"semi_bold", 600},   {L"bold", 700},
+    {L"extra_bold", 800},  {L"ultra_bold", 800},  {L"black", 900},
+    {L"heavy", 900},       {L"extra_black", 950}, {L"ultra_black", 950},
+};
+
+const Keyword kStyles[] = {
+    {L"normal", 0},
+    {L"oblique", 1},
+    {L"italic", 2},
+};
+
+// undefined is taken as normal
+const Keyword kStretches[] = {
+    {L"undefined", 5},      {L"ultra_condensed", 1}, {L"extra_condensed", 2},
+    {L"condensed", 3},      {L"semi_condensed", 4},  {L"normal_stretch", 5},
+    {L"medium_stretch", 5}, {L"semi_expanded", 6},   {L"expanded", 7},
+    {L"extra_expanded", 8}, {L"ultra_expanded", 9},
+};
+
+bool is_space(wchar_t c) { return c == L' ' || c == L'\t'; }
+
+// [begin, end) of s without surrounding blanks
+void trim(const std::wstring &s, size_t &begin, size_t &end) {
+  while (begin < end && is_space(s[begin]))
+    begin++;
+  while (end > begin && is_space(s[end - 1]))
+    end--;
+}
+
+// ASCII case insensitive
+bool equals(const std::wstring &s, size_t begin, size_t end,
+            const wchar_t *name) {
+  for (; begin < end; begin++, name++) {
+    wchar_t c = s[begin];
+    if (c >= L'A' && c <= L'Z')
+      c += L'a' - L'A';
+    if (!*name || c != *name)
+      return false;
+  }
+  return !*name;
+}
+
+template <size_t N>
+bool find(const Keyword (&keywords)[N], const std::wstring &s, size_t begin,
+          size_t end, int &value) {
+  for (const auto &k : keywords)
+    if (equals(s, begin, end, k.name)) {
+      value = k.value;
+      return true;
+    }
+  return false;
+}
+
+int hex_digit(wchar_t c) {
+  if (c >= L'0' && c <= L'9')
+    return c - L'0';
+  if (c >= L'a' && c <= L'f')
+    return c - L'a' + 10;
+  if (c >= L'A' && c <= L'F')
+    return c - L'A' + 10;
+  return -1;
+}
+
+// value keeps its default unless all of [begin, end) is hex digits
+void parse_hex(const std::wstring &s, size_t begin, size_t end,
+               uint32_t &value) {
+  uint32_t v = 0;
+  for (size_t i = begin; i < end; i++) {
+    const int d = hex_digit(s[i]);
+    if (d < 0)
+      return;
+    v = v > 0x10ffff ? v : v * 16 + d;
+  }
+  if (begin < end)
+    value = v > 0x10ffff ? 0x10ffff : v;
+}
+
+} // namespace
+
+bool ParseFontSpec(const std::wstring &spec, FontSpec &out) {
+  out = FontSpec();
+  size_t item = 0;
+  while (item <= spec.size()) {
+    size_t item_end = spec.find(L',', item);
+    if (item_end == std::wstring::npos)
+      item_end = spec.size();
+    FontMapping mapping;
+    int bounds = 0;
+    size_t part = item;
+    for (int i = 0; part <= item_end; i++) {
+      size_t part_end = spec.find(L':', part);
+      if (part_end == std::wstring::npos || part_end > item_end)
+        part_end = item_end;
+      size_t begin = part, end = part_end;
+      trim(spec, begin, end);
+      if (i == 0) {
+        mapping.family.assign(spec, begin, end - begin);
+      } else if (!find(kWeights, spec, begin, end, out.weight) &&
+                 !find(kStyles, spec, begin, end, out.style) &&
+                 !find(kStretches, spec, begin, end, out.stretch) &&
+                 bounds < 2) {
+        // face:first:last by position, so face:zz:10 sets last
+        parse_hex(spec, begin, end, bounds++ ? mapping.last : mapping.first);
+      }
+      part = part_end + 1;
+    }
+    if (!mapping.family.empty())
+      out.fonts.push_back(std::move(mapping));
+    item = item_end + 1;
+  }
+  return !out.fonts.empty();
+}
+
+} // namespace weasel
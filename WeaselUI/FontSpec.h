@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Font face specs as style/font_face gives them, parsed without regex or
+// DirectWrite:
+//   "Face:weight:style:stretch, Fallback:first:last, Fallback2:first, ..."
+// where first and last are hex code points. Names go anywhere after the
+// face; the other parts are the bounds by position, and a bound left empty
+// or not hex is open.
+namespace weasel {
+
+struct FontMapping {
+  std::wstring family;
+  uint32_t first = 0;
+  uint32_t last = 0x10ffff;
+};
+
+struct FontSpec {
+  // in fallback order, the main face first
+  std::vector<FontMapping> fonts;
+  // DWRITE_FONT_WEIGHT, DWRITE_FONT_STYLE and DWRITE_FONT_STRETCH values; a
+  // name in any part of the spec sets them, the last one wins
+  int weight = 400;
+  int style = 0;
+  int stretch = 5;
+};
+
+// unknown names are skipped; false if the spec names no family
+bool ParseFontSpec(const std::wstring &spec, FontSpec &out);
+
+} // namespace weasel
@@ -1,7 +1,20 @@
 #include "FullScreenLayout.h"
+#include "FontFit.h"
+#include <functional>
+#include <map>
 
 using namespace weasel;
 
+// fitted text point per (work area, content, fonts); a redraw of the same
+// content, e.g. on hover or highlight change, then takes a single layout
+static std::map<size_t, int> fit_cache;
+static const size_t kFitCacheSize = 64;
+
+void FullScreenLayout::Reset(const UIStyle &style) {
+  StandardLayout::Reset(style);
+  m_layout->Reset(style);
+}
+
 void weasel::FullScreenLayout::DoLayout() {
   if (_context.empty()) {
     int width = 0, height = 0;
@@ -20,16 +33,7 @@ void weasel::FullScreenLayout::DoLayout() {
     }
   }
 
-  int step = 32;
-  bool adjusted = false;
-  do {
-    if (adjusted) {
-      // Font changed, recalculate cached sizes
-      static_cast<StandardLayout *>(m_layout.get())->RecalculateSizes();
-    }
-    m_layout->DoLayout();
-    adjusted = AdjustFontPoint(workArea, step);
-  } while (adjusted);
+  _FitFontPoint(workArea);
 
   mark_height = m_layout->mark_height;
   mark_width = m_layout->mark_width;
@@ -51,9 +55,7 @@ void weasel::FullScreenLayout::DoLayout() {
     int delta_x = target_x - aux_center_x;
     int delta_y = target_y - aux_center_y;
     _auxiliaryRect.OffsetRect(delta_x, delta_y);
-    _auxBeforeRect.OffsetRect(delta_x, delta_y);
     _auxHiliteRect.OffsetRect(delta_x, delta_y);
-    _auxAfterRect.OffsetRect(delta_x, delta_y);
     _statusIconRect.SetRect(0, 0, 0, 0); // hide status icon
   }
   _highlightRect = m_layout->GetHighlightRect();
@@ -65,8 +67,7 @@ void weasel::FullScreenLayout::DoLayout() {
   _nextPageRect.OffsetRect(offsetx, offsety);
   _range = m_layout->GetPreeditRange();
 
-  for (auto i = 0, n = (int)_context.cinfo.candies.size();
-       i < n && i < MAX_CANDIDATES_COUNT; ++i) {
+  for (auto i = 0; i < candidates_count; ++i) {
     _candidateLabelRects[i] = m_layout->GetCandidateLabelRect(i);
     _candidateLabelRects[i].OffsetRect(offsetx, offsety);
     _candidateTextRects[i] = m_layout->GetCandidateTextRect(i);
@@ -82,89 +83,81 @@ void weasel::FullScreenLayout::DoLayout() {
   if (!_statusIconRect.IsRectNull())
     _statusIconRect.OffsetRect(offsetx, offsety);
 
-  // Get precomputed preedit sub-rectangles from m_layout and apply offset
-  _preeditBeforeRect = m_layout->GetPreeditBeforeRect();
-  _preeditBeforeRect.OffsetRect(offsetx, offsety);
+  // highlighted ranges of preedit and aux from m_layout, with the offset
   _preeditHiliteRect = m_layout->GetPreeditHiliteRect();
   _preeditHiliteRect.OffsetRect(offsetx, offsety);
-  _preeditAfterRect = m_layout->GetPreeditAfterRect();
-  _preeditAfterRect.OffsetRect(offsetx, offsety);
-
-  // Get precomputed auxiliary sub-rectangles from m_layout and apply offset
-  _auxBeforeRect = m_layout->GetAuxBeforeRect();
-  _auxBeforeRect.OffsetRect(offsetx, offsety);
   _auxHiliteRect = m_layout->GetAuxHiliteRect();
   _auxHiliteRect.OffsetRect(offsetx, offsety);
-  _auxAfterRect = m_layout->GetAuxAfterRect();
-  _auxAfterRect.OffsetRect(offsetx, offsety);
 
   _contentSize.SetSize(workArea.Width(), workArea.Height());
   _contentRect.SetRect(0, 0, workArea.Width(), workArea.Height());
   _contentRect.DeflateRect(offsetX, offsetY);
 }
 
-bool FullScreenLayout::AdjustFontPoint(const CRect &workArea, int &step) {
-  if (_context.empty() || step == 0)
-    return false;
-  {
-    int fontPointLabel;
-    int fontPoint;
-    int fontPointComment;
-
-    if (_pD2D->pLabelFormat != NULL)
-      fontPointLabel = (int)(_pD2D->pLabelFormat->GetFontSize() /
-                             _pD2D->m_dpiScaleFontPoint);
-    else
-      fontPointLabel = 0;
-    if (_pD2D->pTextFormat != NULL)
-      fontPoint =
-          (int)(_pD2D->pTextFormat->GetFontSize() / _pD2D->m_dpiScaleFontPoint);
-    else
-      fontPoint = 0;
-    if (_pD2D->pCommentFormat != NULL)
-      fontPointComment = (int)(_pD2D->pCommentFormat->GetFontSize() /
-                               _pD2D->m_dpiScaleFontPoint);
-    else
-      fontPointComment = 0;
-    CSize sz = m_layout->GetContentSize();
-    if (sz.cx > ((CRect)workArea).Width() - offsetX * 2 ||
-        sz.cy > ((CRect)workArea).Height() - offsetY * 2) {
-      if (step > 0) {
-        step = -(step >> 1);
-      }
-      fontPoint += step;
-      fontPointLabel += step;
-      fontPointComment += step;
-      if (fontPoint < 1)
-        fontPoint = 1;
-      if (fontPointLabel < 1)
-        fontPointLabel = 1;
-      if (fontPointComment < 1)
-        fontPointComment = 1;
-      _pD2D->InitFontFormats(_style.label_font_face, fontPointLabel,
-                             _style.font_face, fontPoint,
-                             _style.comment_font_face, fontPointComment);
-      return true;
-    } else if (sz.cx <= (((CRect)workArea).Width() - offsetX * 2) * 31 / 32 &&
-               sz.cy <= (((CRect)workArea).Height() - offsetY * 2) * 31 / 32) {
-      if (step < 0) {
-        step = -step >> 1;
-      }
-      fontPoint += step;
-      fontPointLabel += step;
-      fontPointComment += step;
-      if (fontPoint < 1)
-        fontPoint = 1;
-      if (fontPointLabel < 1)
-        fontPointLabel = 1;
-      if (fontPointComment < 1)
-        fontPointComment = 1;
-      _pD2D->InitFontFormats(_style.label_font_face, fontPointLabel,
-                             _style.font_face, fontPoint,
-                             _style.comment_font_face, fontPointComment);
-      return true;
-    }
+FullScreenLayout::FontPoints FullScreenLayout::_GetFontPoints() const {
+  const auto point = [this](const PtTextFormat &format) {
+    return format ? (int)(format->GetFontSize() / _pD2D->m_dpiScaleFontPoint)
+                  : 0;
+  };
+  return {point(_pD2D->pLabelFormat), point(_pD2D->pTextFormat),
+          point(_pD2D->pCommentFormat)};
+}
 
-    return false;
+void FullScreenLayout::_SetTextFontPoint(int point) {
+  FontPoints points = _GetFontPoints();
+  const int delta = point - points.text;
+  points.label = MAX(points.label + delta, 1);
+  points.text = MAX(points.text + delta, 1);
+  points.comment = MAX(points.comment + delta, 1);
+  _pD2D->InitFontFormats(_style.label_font_face, points.label,
+                         _style.font_face, points.text,
+                         _style.comment_font_face, points.comment);
+  // Font changed, recalculate cached sizes
+  static_cast<StandardLayout *>(m_layout.get())->RecalculateSizes();
+}
+
+size_t FullScreenLayout::_Fingerprint(const CRect &workArea) const {
+  std::hash<std::wstring> hs;
+  size_t h = std::hash<int>()(workArea.Width() * 65536 + workArea.Height());
+  const auto mix = [&h](size_t v) {
+    h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+  };
+  mix(_style.layout_type);
+  mix(hs(_style.font_face));
+  mix(hs(_style.label_font_face));
+  mix(hs(_style.comment_font_face));
+  mix(hs(_context.preedit.str));
+  mix(hs(_context.aux.str));
+  const auto &cinfo = _context.cinfo;
+  for (size_t i = 0; i < cinfo.candies.size(); i++) {
+    mix(hs(cinfo.candies[i].str));
+    mix(i < cinfo.comments.size() ? hs(cinfo.comments[i].str) : 0);
+    mix(i < cinfo.labels.size() ? hs(cinfo.labels[i].str) : 0);
   }
+  return h;
+}
+
+// Fit the content into the work area, keeping it above 31/32 of it; see
+// FitFontPoint. The fit starts from the point cached for the same content.
+void FullScreenLayout::_FitFontPoint(const CRect &workArea) {
+  const int avail_w = workArea.Width() - offsetX * 2;
+  const int avail_h = workArea.Height() - offsetY * 2;
+  const size_t key = _Fingerprint(workArea);
+  auto cached = fit_cache.find(key);
+  const int start =
+      cached != fit_cache.end() ? cached->second : _GetFontPoints().text;
+  const FontFit fit = FitFontPoint(start, avail_w, avail_h, [this](int point) {
+    if (point != _GetFontPoints().text)
+      _SetTextFontPoint(point);
+    m_layout->DoLayout();
+    const CSize &sz = m_layout->GetContentSize();
+    return FitSize{sz.cx, sz.cy};
+  });
+  // a point that still overflows is not worth remembering
+  if (!fit.fits)
+    return;
+
+  if (fit_cache.size() >= kFitCacheSize)
+    fit_cache.clear();
+  fit_cache[key] = fit.point;
 }
@@ -11,10 +11,21 @@ public:
       : StandardLayout(style, context, status, pD2D), mr_inputPos(inputPos),
         m_layout(std::move(layout)) {}
 
+  virtual void Reset(const UIStyle &style);
   virtual void DoLayout();
 
 private:
-  bool AdjustFontPoint(const CRect &workArea, int &step);
+  // font points of the label, text and comment formats
+  struct FontPoints {
+    int label;
+    int text;
+    int comment;
+  };
+  FontPoints _GetFontPoints() const;
+  // move all three formats by the same delta so text reaches point
+  void _SetTextFontPoint(int point);
+  size_t _Fingerprint(const CRect &workArea) const;
+  void _FitFontPoint(const CRect &workArea);
 
   const CRect &mr_inputPos;
   the<Layout> m_layout;
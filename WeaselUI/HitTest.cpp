@@ -0,0 +1,101 @@
+#include "HitTest.h"
+#include <algorithm>
+#include <climits>
+
+namespace weasel {
+
+// grid side limit, 100 candidates never need more
+static const int kMaxCells = 32;
+
+static bool rect_empty(const PlaceRect &rc) {
+  return rc.right <= rc.left || rc.bottom <= rc.top;
+}
+
+void CandidateHitTest::Clear() {
+  m_rects.clear();
+  m_cells.clear();
+  m_items.clear();
+  m_cols = m_rows = 0;
+}
+
+void CandidateHitTest::Build(const std::vector<PlaceRect> &rects) {
+  Clear();
+  m_rects = rects;
+  PlaceRect bounds{INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+  long long sum_w = 0, sum_h = 0;
+  int count = 0;
+  for (const auto &rc : rects) {
+    if (rect_empty(rc))
+      continue;
+    bounds.left = std::min(bounds.left, rc.left);
+    bounds.top = std::min(bounds.top, rc.top);
+    bounds.right = std::max(bounds.right, rc.right);
+    bounds.bottom = std::max(bounds.bottom, rc.bottom);
+    sum_w += rc.right - rc.left;
+    sum_h += rc.bottom - rc.top;
+    count++;
+  }
+  if (!count)
+    return;
+  m_bounds = bounds;
+  // cells about the size of an average candidate, so a rect spans few cells
+  // and a cell holds few rects, whether the candidates form a row, a column
+  // or a grid
+  const int width = bounds.right - bounds.left;
+  const int height = bounds.bottom - bounds.top;
+  const int avg_w = std::max(1, (int)(sum_w / count));
+  const int avg_h = std::max(1, (int)(sum_h / count));
+  m_cols = std::min(kMaxCells, std::max(1, width / avg_w));
+  m_rows = std::min(kMaxCells, std::max(1, height / avg_h));
+  m_cell_w = (width + m_cols - 1) / m_cols;
+  m_cell_h = (height + m_rows - 1) / m_rows;
+
+  // two passes, count then fill, so the cells end up in one flat array
+  const auto cell_range = [&](const PlaceRect &rc, int &c0, int &c1, int &r0,
+                              int &r1) {
+    c0 = (rc.left - bounds.left) / m_cell_w;
+    c1 = std::min(m_cols - 1, (rc.right - 1 - bounds.left) / m_cell_w);
+    r0 = (rc.top - bounds.top) / m_cell_h;
+    r1 = std::min(m_rows - 1, (rc.bottom - 1 - bounds.top) / m_cell_h);
+  };
+  m_cells.assign(m_cols * m_rows + 1, 0);
+  int c0, c1, r0, r1;
+  for (const auto &rc : rects) {
+    if (rect_empty(rc))
+      continue;
+    cell_range(rc, c0, c1, r0, r1);
+    for (int r = r0; r <= r1; r++)
+      for (int c = c0; c <= c1; c++)
+        m_cells[r * m_cols + c + 1]++;
+  }
+  for (size_t i = 1; i < m_cells.size(); i++)
+    m_cells[i] += m_cells[i - 1];
+  m_items.resize(m_cells.back());
+  auto &fill = m_fill;
+  fill.assign(m_cells.begin(), m_cells.end() - 1);
+  for (int i = 0; i < (int)rects.size(); i++) {
+    if (rect_empty(rects[i]))
+      continue;
+    cell_range(rects[i], c0, c1, r0, r1);
+    for (int r = r0; r <= r1; r++)
+      for (int c = c0; c <= c1; c++)
+        m_items[fill[r * m_cols + c]++] = i;
+  }
+}
+
+int CandidateHitTest::Find(int x, int y) const {
+  if (m_cells.empty() || x < m_bounds.left || x >= m_bounds.right ||
+      y < m_bounds.top || y >= m_bounds.bottom)
+    return -1;
+  const int c = std::min(m_cols - 1, (x - m_bounds.left) / m_cell_w);
+  const int r = std::min(m_rows - 1, (y - m_bounds.top) / m_cell_h);
+  const int cell = r * m_cols + c;
+  for (int k = m_cells[cell]; k < m_cells[cell + 1]; k++) {
+    const auto &rc = m_rects[m_items[k]];
+    if (x >= rc.left && x < rc.right && y >= rc.top && y < rc.bottom)
+      return m_items[k];
+  }
+  return -1;
+}
+
+} // namespace weasel
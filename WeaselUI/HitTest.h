@@ -0,0 +1,35 @@
+#pragma once
+#include "Placement.h"
+#include <vector>
+
+// Candidate hit testing over a uniform grid, no Win32 calls, built once per
+// layout instead of walking every candidate rect on each mouse message.
+namespace weasel {
+
+class CandidateHitTest {
+public:
+  // rects indexed by candidate, already inflated and offset as drawn; empty
+  // rects never hit
+  void Build(const std::vector<PlaceRect> &rects);
+  void Clear();
+  // lowest candidate index whose rect contains (x, y), -1 if none; same edge
+  // rule as PtInRect
+  int Find(int x, int y) const;
+  const PlaceRect &Rect(int index) const { return m_rects[index]; }
+  bool empty() const { return m_cells.empty(); }
+
+private:
+  std::vector<PlaceRect> m_rects;
+  PlaceRect m_bounds;
+  int m_cols = 0;
+  int m_rows = 0;
+  int m_cell_w = 1;
+  int m_cell_h = 1;
+  // candidate indices per cell, ascending; cell c owns
+  // m_items[m_cells[c] .. m_cells[c + 1])
+  std::vector<int> m_cells;
+  std::vector<int> m_items;
+  std::vector<int> m_fill; // Build scratch
+};
+
+} // namespace weasel
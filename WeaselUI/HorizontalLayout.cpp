@@ -28,9 +28,9 @@ void HorizontalLayout::DoLayout() {
 
   int row_cnt = 0;
   int max_width_of_rows = 0;
-  std::vector<int> height_of_rows(candidates_count);
-  std::vector<int> row_of_candidate(candidates_count);
-  std::vector<int> mintop_of_rows(candidates_count);
+  std::vector<int> &height_of_rows = _Scratch(0, candidates_count);
+  std::vector<int> &row_of_candidate = _Scratch(1, candidates_count);
+  std::vector<int> &mintop_of_rows = _Scratch(2, candidates_count);
   // only when there are candidates
   if (candidates_count) {
     w = offsetX + real_margin_x;
@@ -209,13 +209,11 @@ void HorizontalLayout::DoLayout() {
     }
   }
 
-  // Precompute preedit sub-rectangles
-  _PrecomputePreeditRects(_preeditRect, _context.preedit, _preeditBeforeRect,
-                          _preeditHiliteRect, _preeditAfterRect);
+  // highlighted range of the preedit
+  _PlaceHiliteRect(_preeditRect, _preeditSpan, _preeditHiliteRect);
 
-  // Precompute auxiliary sub-rectangles
-  _PrecomputePreeditRects(_auxiliaryRect, _context.aux, _auxBeforeRect,
-                          _auxHiliteRect, _auxAfterRect);
+  // highlighted range of the aux
+  _PlaceHiliteRect(_auxiliaryRect, _auxSpan, _auxHiliteRect);
 
   // truely draw content size calculation
   _contentRect.DeflateRect(offsetX, offsetY);
@@ -4,20 +4,27 @@ using namespace weasel;
 
 Layout::Layout(const UIStyle &style, const Context &context,
                const Status &status, an<D2D> &pD2D)
-    : _style(style), _context(context), _status(status),
-      candidates(_context.cinfo.candies), comments(_context.cinfo.comments),
-      labels(_context.cinfo.labels),
-      id((_context.cinfo.highlighted >= 0 &&
-          _context.cinfo.highlighted <
-              MIN((int)_context.cinfo.candies.size(), MAX_CANDIDATES_COUNT))
-             ? _context.cinfo.highlighted
-             : 0),
-      candidates_count(MIN((int)candidates.size(), MAX_CANDIDATES_COUNT)),
-      labelFontValid(!!(_style.label_font_point > 0)),
-      textFontValid(!!(_style.font_point > 0)), _pD2D(pD2D),
-      cmtFontValid(!!(_style.comment_font_point > 0)) {
-  if (pD2D) {
-    float scale = pD2D->m_dpiScaleLayout;
+    : _pD2D(pD2D), _context(context), _status(status),
+      candidates(_context.cinfo.candies), labels(_context.cinfo.labels),
+      comments(_context.cinfo.comments) {
+  Layout::Reset(style);
+}
+
+void Layout::Reset(const UIStyle &style) {
+  _style = style;
+  candidates_count = MIN((int)candidates.size(), MAX_CANDIDATES_COUNT);
+  id = (_context.cinfo.highlighted >= 0 &&
+        _context.cinfo.highlighted < candidates_count)
+           ? _context.cinfo.highlighted
+           : 0;
+  labelFontValid = !!(_style.label_font_point > 0);
+  textFontValid = !!(_style.font_point > 0);
+  cmtFontValid = !!(_style.comment_font_point > 0);
+  mark_width = 4;
+  mark_gap = 8;
+  mark_height = 0;
+  if (_pD2D) {
+    float scale = _pD2D->m_dpiScaleLayout;
     _style.min_width = (int)(_style.min_width * scale);
     _style.min_height = (int)(_style.min_height * scale);
     _style.max_width = (int)(_style.max_width * scale);
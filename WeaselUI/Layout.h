@@ -22,6 +22,10 @@ class Layout {
 public:
   Layout(const UIStyle &style, const Context &context, const Status &status,
          an<D2D> &pD2D);
+  virtual ~Layout() = default;
+  // take a new style and the current context, so the object can be reused by
+  // the next refresh instead of allocating another one
+  virtual void Reset(const UIStyle &style);
   virtual void DoLayout() = 0;
   virtual CSize &GetContentSize() = 0;
   virtual CRect &GetPreeditRect() = 0;
@@ -40,13 +44,10 @@ public:
   virtual bool ShouldDisplayStatusIcon() const = 0;
   virtual const IsToRoundStruct &GetRoundInfo(int id) = 0;
   virtual const IsToRoundStruct &GetTextRoundInfo() = 0;
-  // Precomputed preedit sub-rectangles for optimization
-  virtual CRect &GetPreeditBeforeRect() = 0;
+  // the highlighted range of preedit and aux, as laid out with the rest of
+  // the text in GetPreeditRect and GetAuxiliaryRect; empty if there is none
   virtual CRect &GetPreeditHiliteRect() = 0;
-  virtual CRect &GetPreeditAfterRect() = 0;
-  virtual CRect &GetAuxBeforeRect() = 0;
   virtual CRect &GetAuxHiliteRect() = 0;
-  virtual CRect &GetAuxAfterRect() = 0;
 
   int offsetX = 0;
   int offsetY = 0;
@@ -64,11 +65,11 @@ protected:
   const vector<Text> &candidates;
   const vector<Text> &labels;
   const vector<Text> &comments;
-  const int id;
-  const int candidates_count;
-  const int labelFontValid;
-  const int textFontValid;
-  const int cmtFontValid;
+  int id;
+  int candidates_count;
+  int labelFontValid;
+  int textFontValid;
+  int cmtFontValid;
 };
 
 } // namespace weasel
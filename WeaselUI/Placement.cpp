@@ -0,0 +1,93 @@
+#include "Placement.h"
+#include <algorithm>
+#include <climits>
+
+namespace weasel {
+
+static long long intersect_area(const PlaceRect &a, const PlaceRect &b) {
+  const long long w = std::min(a.right, b.right) - std::max(a.left, b.left);
+  const long long h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+  return (w > 0 && h > 0) ? w * h : 0;
+}
+
+static long long distance2(const PlaceRect &a, const PlaceRect &b) {
+  const long long dx = std::max({0, b.left - a.right, a.left - b.right});
+  const long long dy = std::max({0, b.top - a.bottom, a.top - b.bottom});
+  return dx * dx + dy * dy;
+}
+
+int PickMonitor(const std::vector<MonitorArea> &monitors, const PlaceRect &rc) {
+  int best = -1;
+  long long best_area = 0;
+  for (size_t i = 0; i < monitors.size(); i++) {
+    const long long area = intersect_area(rc, monitors[i].monitor);
+    if (area > best_area) {
+      best_area = area;
+      best = (int)i;
+    }
+  }
+  if (best >= 0)
+    return best;
+  long long best_distance = LLONG_MAX;
+  for (size_t i = 0; i < monitors.size(); i++) {
+    const long long d = distance2(rc, monitors[i].monitor);
+    if (d < best_distance) {
+      best_distance = d;
+      best = (int)i;
+    }
+  }
+  return best;
+}
+
+Placement PlacePanel(const PlacementInput &in,
+                     const std::vector<MonitorArea> &monitors) {
+  Placement out;
+  out.monitor = PickMonitor(monitors, in.anchor);
+  PlaceRect work;
+  if (out.monitor >= 0)
+    work = monitors[out.monitor].work;
+  // bounds of the panel's top-left corner
+  work.right -= in.width;
+  work.bottom -= in.height;
+
+  int x = in.anchor.left;
+  int y = in.anchor.bottom;
+  if (in.shadow_radius) {
+    x -= (in.shadow_offset_x >= 0 || in.shadow_transparent)
+             ? in.offset_x
+             : (in.offset_x / 2);
+    if (in.adjust)
+      y -= (in.shadow_offset_y > 0 || in.shadow_transparent)
+               ? in.offset_y
+               : (in.offset_y / 2);
+  }
+  if (in.vertical_text_rtl) {
+    x += in.offset_x - in.width;
+    if (in.shadow_offset_x < 0)
+      x += in.offset_x;
+  }
+  out.sticky = in.sticky;
+  out.reversed = in.adjust ? false : in.reversed;
+  if (x > work.right)
+    x = work.right;
+  if (x < work.left)
+    x = work.left;
+  if (y > work.bottom || out.sticky) {
+    out.sticky = true;
+    y = in.anchor.top - in.height - 6;
+    if (in.shadow_radius && in.shadow_offset_y > 0)
+      y -= in.shadow_offset_y;
+    out.reversed = in.auto_reverse;
+    if (in.shadow_radius > 0)
+      y += (in.shadow_offset_y < 0 || in.shadow_transparent)
+               ? in.offset_y
+               : (in.offset_y / 2);
+  }
+  if (y < work.top)
+    y = work.top;
+  out.x = x;
+  out.y = y;
+  return out;
+}
+
+} // namespace weasel
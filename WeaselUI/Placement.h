@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+
+// Panel placement as a pure function of its inputs, no Win32 calls, so it can
+// be reasoned about (and exercised) without a window.
+namespace weasel {
+
+// screen rect in physical pixels, same layout as RECT
+struct PlaceRect {
+  int left = 0;
+  int top = 0;
+  int right = 0;
+  int bottom = 0;
+};
+
+inline bool operator==(const PlaceRect &a, const PlaceRect &b) {
+  return a.left == b.left && a.top == b.top && a.right == b.right &&
+         a.bottom == b.bottom;
+}
+
+inline bool operator!=(const PlaceRect &a, const PlaceRect &b) {
+  return !(a == b);
+}
+
+struct MonitorArea {
+  PlaceRect monitor;
+  PlaceRect work;
+};
+
+// everything the panel placement depends on; lengths are DPI scaled
+struct PlacementInput {
+  // caret anchor: left/top is the caret's bottom-left, bottom adds the gap
+  PlaceRect anchor;
+  int width = 0; // panel window size
+  int height = 0;
+  int offset_x = 0; // layout margins reserved for the shadow
+  int offset_y = 0;
+  int shadow_radius = 0;
+  int shadow_offset_x = 0;
+  int shadow_offset_y = 0;
+  bool shadow_transparent = false;
+  // vertical text laid out right to left, the panel grows leftwards
+  bool vertical_text_rtl = false;
+  // vertical_auto_reverse on a vertical layout
+  bool auto_reverse = false;
+  // a new anchor: apply the vertical shadow margin and reset the reversal
+  bool adjust = false;
+  // state of the previous placement
+  bool sticky = false;
+  bool reversed = false;
+};
+
+struct Placement {
+  int x = 0;
+  int y = 0;
+  // flipped above the caret; kept until the anchor moves away
+  bool sticky = false;
+  // candidates drawn in reverse order, see vertical_auto_reverse
+  bool reversed = false;
+  // index into the monitor list, -1 when it is empty
+  int monitor = -1;
+};
+
+// monitor containing most of rc, or the nearest one (MONITOR_DEFAULTTONEAREST)
+int PickMonitor(const std::vector<MonitorArea> &monitors, const PlaceRect &rc);
+
+// clamp the panel into the work area of the anchor's monitor, flipping it
+// above the caret when it would run off the bottom
+Placement PlacePanel(const PlacementInput &in,
+                     const std::vector<MonitorArea> &monitors);
+
+} // namespace weasel
@@ -0,0 +1,72 @@
+#pragma once
+#include "Placement.h"
+#include <cstddef>
+#include <cstdint>
+
+// The drawing primitives the panel needs, so a frame can go to Direct2D or to
+// a CPU rasterizer. Colors are 0xAABBGGRR as in UIStyle, rects are physical
+// pixels.
+namespace weasel {
+
+// which corners are rounded, see IsToRoundStruct
+struct RenderCorners {
+  bool top_left = true;
+  bool top_right = true;
+  bool bottom_left = true;
+  bool bottom_right = true;
+};
+
+enum RenderFont { kPreeditFont, kLabelFont, kTextFont, kCommentFont };
+
+struct TextRun {
+  const wchar_t *text = nullptr;
+  size_t length = 0;
+  RenderFont font = kTextFont;
+  // LAYOUT_VERTICAL_TEXT: top to bottom, columns flowing as below
+  bool vertical = false;
+  bool left_to_right = false;
+  // the same text is drawn on most frames, like labels and page arrows; the
+  // backend may keep its rendering
+  bool repeated = false;
+  // characters [hilite_start, hilite_end) drawn in hilite_color, with
+  // hilite_spacing pixels after the text before them and after them
+  size_t hilite_start = 0;
+  size_t hilite_end = 0;
+  uint32_t hilite_color = 0;
+  int hilite_spacing = 0;
+};
+
+struct RenderImage {
+  int width = 0;
+  int height = 0;
+  // premultiplied 0xAARRGGBB rows, may be null when native is set
+  const uint32_t *pixels = nullptr;
+  // backend specific handle, an HICON for Direct2D
+  void *native = nullptr;
+};
+
+class RenderBackend {
+public:
+  virtual ~RenderBackend() = default;
+  // clear the target to transparent; false if there is nothing to draw on
+  virtual bool BeginFrame() = 0;
+  // finish the frame and present or store it
+  virtual bool EndFrame() = 0;
+  virtual void FillRoundedRect(const PlaceRect &rc, float radius,
+                               const RenderCorners &corners,
+                               uint32_t color) = 0;
+  // stroke centered on the outline of rc
+  virtual void StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                 const RenderCorners &corners, float width,
+                                 uint32_t color) = 0;
+  // rc moved by (dx, dy), gaussian blurred with standard deviation blur
+  virtual void FillShadow(const PlaceRect &rc, float radius,
+                          const RenderCorners &corners, int dx, int dy,
+                          float blur, uint32_t color) = 0;
+  // laid out in rc, which is the size the layout measured for the text
+  virtual void DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                           uint32_t color) = 0;
+  virtual void DrawImage(const PlaceRect &rc, const RenderImage &image) = 0;
+};
+
+} // namespace weasel
@@ -0,0 +1,332 @@
+#include "SoftwareRenderBackend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace weasel {
+
+static const int kSamples = 4; // per axis
+
+// 0xAABBGGRR to premultiplied r, g, b, a
+static void unpack(uint32_t color, float coverage, float out[4]) {
+  const float a = ((color >> 24) & 0xff) / 255.0f * coverage;
+  out[0] = (color & 0xff) / 255.0f * a;
+  out[1] = ((color >> 8) & 0xff) / 255.0f * a;
+  out[2] = ((color >> 16) & 0xff) / 255.0f * a;
+  out[3] = a;
+}
+
+bool SoftwareRenderBackend::_Inside(const Shape &s, float x, float y) {
+  if (x < s.left || x >= s.right || y < s.top || y >= s.bottom)
+    return false;
+  const float r = std::min({s.radius, (s.right - s.left) / 2,
+                            (s.bottom - s.top) / 2});
+  if (r <= 0)
+    return true;
+  const auto corner = [&](bool round, float cx, float cy, bool in_x,
+                          bool in_y) {
+    if (!round || !in_x || !in_y)
+      return true;
+    const float dx = x - cx, dy = y - cy;
+    return dx * dx + dy * dy <= r * r;
+  };
+  return corner(s.corners.top_left, s.left + r, s.top + r, x < s.left + r,
+                y < s.top + r) &&
+         corner(s.corners.top_right, s.right - r, s.top + r, x > s.right - r,
+                y < s.top + r) &&
+         corner(s.corners.bottom_left, s.left + r, s.bottom - r,
+                x < s.left + r, y > s.bottom - r) &&
+         corner(s.corners.bottom_right, s.right - r, s.bottom - r,
+                x > s.right - r, y > s.bottom - r);
+}
+
+void SoftwareRenderBackend::Resize(int width, int height) {
+  m_width = std::max(width, 0);
+  m_height = std::max(height, 0);
+  m_rgba.assign((size_t)m_width * m_height * 4, 0.0f);
+}
+
+bool SoftwareRenderBackend::BeginFrame() {
+  std::fill(m_rgba.begin(), m_rgba.end(), 0.0f);
+  return m_width > 0 && m_height > 0;
+}
+
+float SoftwareRenderBackend::_Coverage(const Shape &outer, const Shape *inner,
+                                       int x, int y) {
+  int hits = 0;
+  for (int j = 0; j < kSamples; j++) {
+    const float sy = y + (j + 0.5f) / kSamples;
+    for (int i = 0; i < kSamples; i++) {
+      const float sx = x + (i + 0.5f) / kSamples;
+      if (_Inside(outer, sx, sy) && !(inner && _Inside(*inner, sx, sy)))
+        hits++;
+    }
+  }
+  return (float)hits / (kSamples * kSamples);
+}
+
+void SoftwareRenderBackend::_Blend(int x, int y, const float src[4]) {
+  if (x < 0 || y < 0 || x >= m_width || y >= m_height || src[3] <= 0)
+    return;
+  float *dst = &m_rgba[((size_t)y * m_width + x) * 4];
+  const float keep = 1.0f - src[3];
+  for (int k = 0; k < 4; k++)
+    dst[k] = src[k] + dst[k] * keep;
+}
+
+void SoftwareRenderBackend::_Fill(const Shape &outer, const Shape *inner,
+                                  uint32_t color) {
+  if (!(color & 0xff000000))
+    return;
+  const int x0 = std::max(0, (int)std::floor(outer.left));
+  const int y0 = std::max(0, (int)std::floor(outer.top));
+  const int x1 = std::min(m_width, (int)std::ceil(outer.right));
+  const int y1 = std::min(m_height, (int)std::ceil(outer.bottom));
+  float src[4];
+  for (int y = y0; y < y1; y++)
+    for (int x = x0; x < x1; x++) {
+      const float coverage = _Coverage(outer, inner, x, y);
+      if (coverage <= 0)
+        continue;
+      unpack(color, coverage, src);
+      _Blend(x, y, src);
+    }
+}
+
+void SoftwareRenderBackend::FillRoundedRect(const PlaceRect &rc, float radius,
+                                            const RenderCorners &corners,
+                                            uint32_t color) {
+  const Shape shape{(float)rc.left, (float)rc.top, (float)rc.right,
+                    (float)rc.bottom, radius, corners};
+  _Fill(shape, nullptr, color);
+}
+
+void SoftwareRenderBackend::StrokeRoundedRect(const PlaceRect &rc,
+                                              float radius,
+                                              const RenderCorners &corners,
+                                              float width, uint32_t color) {
+  if (width <= 0)
+    return;
+  const float hw = width / 2;
+  const Shape outer{rc.left - hw, rc.top - hw, rc.right + hw,
+                    rc.bottom + hw, radius + hw, corners};
+  const Shape inner{rc.left + hw, rc.top + hw, rc.right - hw,
+                    rc.bottom - hw, std::max(radius - hw, 0.0f), corners};
+  _Fill(outer, &inner, color);
+}
+
+void SoftwareRenderBackend::FillShadow(const PlaceRect &rc, float radius,
+                                       const RenderCorners &corners, int dx,
+                                       int dy, float blur, uint32_t color) {
+  if (!(color & 0xff000000))
+    return;
+  const Shape shape{(float)(rc.left + dx), (float)(rc.top + dy),
+                    (float)(rc.right + dx), (float)(rc.bottom + dy), radius,
+                    corners};
+  if (blur <= 0) {
+    _Fill(shape, nullptr, color);
+    return;
+  }
+  // coverage mask with a 3 sigma margin, blurred by two 1D passes
+  const int pad = (int)std::ceil(blur * 3);
+  const int mx = (int)std::floor(shape.left) - pad;
+  const int my = (int)std::floor(shape.top) - pad;
+  const int mw = (int)std::ceil(shape.right) + pad - mx;
+  const int mh = (int)std::ceil(shape.bottom) + pad - my;
+  if (mw <= 0 || mh <= 0)
+    return;
+  std::vector<float> mask((size_t)mw * mh, 0.0f), tmp(mask.size(), 0.0f);
+  for (int y = 0; y < mh; y++)
+    for (int x = 0; x < mw; x++)
+      mask[(size_t)y * mw + x] = _Coverage(shape, nullptr, mx + x, my + y);
+  std::vector<float> kernel(pad * 2 + 1);
+  float sum = 0;
+  for (int i = -pad; i <= pad; i++)
+    sum += kernel[i + pad] = std::exp(-(i * i) / (2 * blur * blur));
+  for (auto &k : kernel)
+    k /= sum;
+  for (int y = 0; y < mh; y++)
+    for (int x = 0; x < mw; x++) {
+      float v = 0;
+      for (int i = -pad; i <= pad; i++) {
+        const int sx = x + i;
+        if (sx >= 0 && sx < mw)
+          v += mask[(size_t)y * mw + sx] * kernel[i + pad];
+      }
+      tmp[(size_t)y * mw + x] = v;
+    }
+  float src[4];
+  for (int y = 0; y < mh; y++)
+    for (int x = 0; x < mw; x++) {
+      float v = 0;
+      for (int i = -pad; i <= pad; i++) {
+        const int sy = y + i;
+        if (sy >= 0 && sy < mh)
+          v += tmp[(size_t)sy * mw + x] * kernel[i + pad];
+      }
+      if (v <= 0)
+        continue;
+      unpack(color, std::min(v, 1.0f), src);
+      _Blend(mx + x, my + y, src);
+    }
+}
+
+void SoftwareRenderBackend::DrawTextRun(const PlaceRect &rc,
+                                        const TextRun &run, uint32_t color) {
+  if (!run.text || !run.length)
+    return;
+  const float w = (float)(rc.right - rc.left);
+  const float h = (float)(rc.bottom - rc.top);
+  const bool hilite =
+      run.hilite_start < run.hilite_end && run.hilite_end <= run.length;
+  const float gap = hilite ? (float)std::max(run.hilite_spacing, 0) : 0.0f;
+  const int gaps = hilite ? (run.hilite_start > 0) + 1 : 0;
+  const float cell =
+      std::max((run.vertical ? h : w) - gap * gaps, 0.0f) / run.length;
+  float at = 0;
+  for (size_t i = 0; i < run.length; i++, at += cell) {
+    const bool hilited = hilite && i >= run.hilite_start && i < run.hilite_end;
+    // the gaps after the text before the highlight and after it
+    if (hilite && ((i && i == run.hilite_start) || i == run.hilite_end))
+      at += gap;
+    const wchar_t ch = run.text[i];
+    if (ch == L' ' || ch == L'\t' || ch == 0x3000)
+      continue;
+    Shape box;
+    if (run.vertical) {
+      box = {rc.left + w * 0.2f, rc.top + at + cell * 0.1f,
+             rc.right - w * 0.2f, rc.top + at + cell * 0.9f, 0, {}};
+    } else {
+      box = {rc.left + at + cell * 0.1f, rc.top + h * 0.2f,
+             rc.left + at + cell * 0.9f, rc.bottom - h * 0.2f, 0, {}};
+    }
+    _Fill(box, nullptr, hilited ? run.hilite_color : color);
+  }
+}
+
+void SoftwareRenderBackend::DrawImage(const PlaceRect &rc,
+                                      const RenderImage &image) {
+  const int w = rc.right - rc.left, h = rc.bottom - rc.top;
+  if (w <= 0 || h <= 0)
+    return;
+  if (!image.pixels || image.width <= 0 || image.height <= 0) {
+    // nothing to sample, e.g. a native icon: mark the spot
+    FillRoundedRect(rc, 0, RenderCorners(), 0x80808080);
+    return;
+  }
+  float src[4];
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++) {
+      const uint32_t p =
+          image.pixels[(size_t)(y * image.height / h) * image.width +
+                       x * image.width / w];
+      src[0] = ((p >> 16) & 0xff) / 255.0f;
+      src[1] = ((p >> 8) & 0xff) / 255.0f;
+      src[2] = (p & 0xff) / 255.0f;
+      src[3] = ((p >> 24) & 0xff) / 255.0f;
+      _Blend(rc.left + x, rc.top + y, src);
+    }
+}
+
+void SoftwareRenderBackend::GetPixels(std::vector<uint32_t> &pixels) const {
+  pixels.resize((size_t)m_width * m_height);
+  const auto byte = [](float v) {
+    return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255 + 0.5f);
+  };
+  for (size_t i = 0; i < pixels.size(); i++) {
+    const float *p = &m_rgba[i * 4];
+    pixels[i] = byte(p[3]) << 24 | byte(p[0]) << 16 | byte(p[1]) << 8 |
+                byte(p[2]);
+  }
+}
+
+static void put_be32(std::string &out, uint32_t v) {
+  out.push_back((char)(v >> 24));
+  out.push_back((char)(v >> 16));
+  out.push_back((char)(v >> 8));
+  out.push_back((char)v);
+}
+
+static uint32_t crc32(const std::string &data, size_t from) {
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+  }
+  uint32_t c = 0xffffffffu;
+  for (size_t i = from; i < data.size(); i++)
+    c = table[(c ^ (unsigned char)data[i]) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffu;
+}
+
+static void put_chunk(std::string &out, const char *type,
+                      const std::string &data) {
+  put_be32(out, (uint32_t)data.size());
+  const size_t from = out.size();
+  out.append(type, 4);
+  out += data;
+  put_be32(out, crc32(out, from));
+}
+
+bool SoftwareRenderBackend::SavePng(const std::string &file_path) const {
+  if (m_width <= 0 || m_height <= 0)
+    return false;
+  // filter type 0 rows of straight RGBA
+  std::string raw;
+  raw.reserve((size_t)(m_width * 4 + 1) * m_height);
+  const auto byte = [](float v) {
+    return (char)(std::min(std::max(v, 0.0f), 1.0f) * 255 + 0.5f);
+  };
+  for (int y = 0; y < m_height; y++) {
+    raw.push_back(0);
+    for (int x = 0; x < m_width; x++) {
+      const float *p = &m_rgba[((size_t)y * m_width + x) * 4];
+      const float a = p[3];
+      for (int k = 0; k < 3; k++)
+        raw.push_back(a > 0 ? byte(p[k] / a) : 0);
+      raw.push_back(byte(a));
+    }
+  }
+  // zlib stream of stored deflate blocks
+  std::string z("\x78\x01", 2);
+  uint32_t s1 = 1, s2 = 0;
+  for (size_t pos = 0; pos < raw.size() || pos == 0;) {
+    const size_t len = std::min<size_t>(65535, raw.size() - pos);
+    const bool last = pos + len >= raw.size();
+    z.push_back(last ? 1 : 0);
+    z.push_back((char)(len & 0xff));
+    z.push_back((char)(len >> 8));
+    z.push_back((char)(~len & 0xff));
+    z.push_back((char)((~len >> 8) & 0xff));
+    z.append(raw, pos, len);
+    for (size_t i = pos; i < pos + len; i++) {
+      s1 = (s1 + (unsigned char)raw[i]) % 65521;
+      s2 = (s2 + s1) % 65521;
+    }
+    pos += len;
+    if (last)
+      break;
+  }
+  put_be32(z, s2 << 16 | s1);
+
+  std::string ihdr;
+  put_be32(ihdr, m_width);
+  put_be32(ihdr, m_height);
+  ihdr += std::string("\x08\x06\x00\x00\x00", 5); // 8 bit RGBA
+  std::string png("\x89PNG\r\n\x1a\n", 8);
+  put_chunk(png, "IHDR", ihdr);
+  put_chunk(png, "IDAT", z);
+  put_chunk(png, "IEND", std::string());
+
+  std::FILE *f = std::fopen(file_path.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool ok = std::fwrite(png.data(), 1, png.size(), f) == png.size();
+  return std::fclose(f) == 0 && ok;
+}
+
+} // namespace weasel
@@ -0,0 +1,57 @@
+#pragma once
+#include "RenderBackend.h"
+#include <string>
+#include <vector>
+
+namespace weasel {
+
+// CPU rasterizer behind the RenderBackend interface, no Win32 or D3D, for
+// golden images and frame timing off Windows. Shapes are antialiased by 4x4
+// supersampling. There is no font engine: a text run is drawn as one box per
+// character over the rect the layout measured, which keeps layout, colors
+// and highlight regressions visible in an image diff.
+class SoftwareRenderBackend : public RenderBackend {
+public:
+  SoftwareRenderBackend(int width, int height) { Resize(width, height); }
+  void Resize(int width, int height);
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  // premultiplied 0xAARRGGBB, the layout RenderImage takes
+  void GetPixels(std::vector<uint32_t> &pixels) const;
+  // 8 bit RGBA, straight alpha, stored (uncompressed) deflate
+  bool SavePng(const std::string &file_path) const;
+
+  virtual bool BeginFrame();
+  virtual bool EndFrame() { return true; }
+  virtual void FillRoundedRect(const PlaceRect &rc, float radius,
+                               const RenderCorners &corners, uint32_t color);
+  virtual void StrokeRoundedRect(const PlaceRect &rc, float radius,
+                                 const RenderCorners &corners, float width,
+                                 uint32_t color);
+  virtual void FillShadow(const PlaceRect &rc, float radius,
+                          const RenderCorners &corners, int dx, int dy,
+                          float blur, uint32_t color);
+  virtual void DrawTextRun(const PlaceRect &rc, const TextRun &run,
+                           uint32_t color);
+  virtual void DrawImage(const PlaceRect &rc, const RenderImage &image);
+
+private:
+  struct Shape {
+    float left, top, right, bottom;
+    float radius;
+    RenderCorners corners;
+  };
+  static bool _Inside(const Shape &s, float x, float y);
+  // coverage of the pixel (x, y) by outer minus inner (if any), 0..1
+  static float _Coverage(const Shape &outer, const Shape *inner, int x, int y);
+  void _Fill(const Shape &outer, const Shape *inner, uint32_t color);
+  // src is premultiplied r, g, b, a in 0..1
+  void _Blend(int x, int y, const float src[4]);
+
+  int m_width = 0;
+  int m_height = 0;
+  // premultiplied r, g, b, a per pixel
+  std::vector<float> m_rgba;
+};
+
+} // namespace weasel
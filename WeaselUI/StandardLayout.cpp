@@ -14,54 +14,65 @@ wstring FormatCandidateLabel(const wstring &label, const wchar_t *format) {
 } // namespace
 
 CSize StandardLayout::_GetPreeditSize(const Text &text,
-                                      ComPtr<IDWriteTextFormat1> &pTextFormat) {
+                                      ComPtr<IDWriteTextFormat1> &pTextFormat,
+                                      HiliteSpan &span) {
   const wstring &preedit = text.str;
   const vector<TextAttribute> &attrs = text.attributes;
   CSize size(0, 0);
+  span = HiliteSpan();
   if (!preedit.empty()) {
     weasel::TextRange range;
     for (size_t j = 0; j < attrs.size(); ++j)
       if (attrs[j].type == weasel::HIGHLIGHTED)
         range = attrs[j].range;
-    if (range.start < range.end) {
-      wstring before_str = preedit.substr(0, range.start);
-      wstring hilited_str =
-          preedit.substr(range.start, range.end - range.start);
-      wstring after_str = preedit.substr(range.end);
-      CSize beforesz, hilitedsz, aftersz;
-      _pD2D->GetTextSize(before_str, before_str.length(), pTextFormat,
-                         &beforesz);
-      _pD2D->GetTextSize(hilited_str, hilited_str.length(), pTextFormat,
-                         &hilitedsz);
-      _pD2D->GetTextSize(after_str, after_str.length(), pTextFormat, &aftersz);
-      auto width_max = 0, height_max = 0;
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN) {
-        width_max = MAX(width_max, beforesz.cx, hilitedsz.cx, aftersz.cx);
-        height_max += beforesz.cy + (beforesz.cy > 0) * _style.hilite_spacing;
-        height_max += hilitedsz.cy + (hilitedsz.cy > 0) * _style.hilite_spacing;
-        height_max += aftersz.cy;
-      } else {
-        height_max = MAX(height_max, beforesz.cy, hilitedsz.cy, aftersz.cy);
-        width_max += beforesz.cx + (beforesz.cx > 0) * _style.hilite_spacing;
-        width_max += hilitedsz.cx + (hilitedsz.cx > 0) * _style.hilite_spacing;
-        width_max += aftersz.cx;
-      }
-      size.cx = width_max;
-      size.cy = height_max;
-    } else
+    if (range.start < range.end)
+      _pD2D->GetTextSize(preedit, range, _style.hilite_spacing, pTextFormat,
+                         &size, span.from, span.to);
+    else
       _pD2D->GetTextSize(preedit, preedit.length(), pTextFormat, &size);
   }
   return size;
 }
 
+void StandardLayout::Reset(const UIStyle &style) {
+  Layout::Reset(style);
+  _ResetResults();
+  RecalculateSizes();
+}
+
+void StandardLayout::_ResetResults() {
+  // sized by the page, at least one so _highlightRect always has a source
+  const size_t n = MAX(candidates_count, 1);
+  _candidateRects.assign(n, CRect());
+  _candidateLabelRects.assign(n, CRect());
+  _candidateTextRects.assign(n, CRect());
+  _candidateCommentRects.assign(n, CRect());
+  _roundInfo.assign(n, IsToRoundStruct());
+  _textRoundInfo = IsToRoundStruct();
+  _range = TextRange();
+  _contentSize = CSize();
+  for (CRect *rc :
+       {&_preeditRect, &_auxiliaryRect, &_highlightRect, &_statusIconRect,
+        &_bgRect, &_contentRect, &_prePageRect, &_nextPageRect,
+        &_preeditHiliteRect, &_auxHiliteRect})
+    rc->SetRectEmpty();
+  _pageEnabled = (_style.prevpage_color & 0xff000000) &&
+                 (_style.nextpage_color & 0xff000000);
+}
+
+std::vector<int> &StandardLayout::_Scratch(int slot, size_t n) {
+  _scratch[slot].assign(n, 0);
+  return _scratch[slot];
+}
+
 void StandardLayout::RecalculateSizes() {
-  _preeditSize = _GetPreeditSize(_context.preedit, _pD2D->pPreeditFormat);
+  _preeditSize = _GetPreeditSize(_context.preedit, _pD2D->pPreeditFormat,
+                                 _preeditSpan);
   _range = TextRange();
   for (size_t j = 0; j < _context.preedit.attributes.size(); ++j)
     if (_context.preedit.attributes[j].type == HIGHLIGHTED)
       _range = _context.preedit.attributes[j].range;
-  _auxSize = _GetPreeditSize(_context.aux, _pD2D->pPreeditFormat);
+  _auxSize = _GetPreeditSize(_context.aux, _pD2D->pPreeditFormat, _auxSpan);
   _pD2D->GetTextSize(_pre, _pre.length(), _pD2D->pPreeditFormat,
                      &_pagePrevSize);
   _pD2D->GetTextSize(_next, _next.length(), _pD2D->pPreeditFormat,
@@ -71,7 +82,7 @@ void StandardLayout::RecalculateSizes() {
   _candidateLabelSizes.clear();
   _candidateTextSizes.clear();
   _candidateCommentSizes.clear();
-  for (size_t i = 0; i < candidates.size(); ++i) {
+  for (int i = 0; i < candidates_count; ++i) {
     CSize labelSize(0, 0), textSize(0, 0), commentSize(0, 0);
     if (labelFontValid) {
       const auto label = FormatCandidateLabel(labels.at(i).str,
@@ -408,79 +419,20 @@ void StandardLayout::_PrepareRoundInfo() {
   }
 }
 
-void StandardLayout::_PrecomputePreeditRects(const CRect &baseRect,
-                                             const Text &text,
-                                             CRect &beforeRect,
-                                             CRect &hiliteRect,
-                                             CRect &afterRect) {
-  beforeRect = hiliteRect = afterRect = CRect(0, 0, 0, 0);
-
+void StandardLayout::_PlaceHiliteRect(const CRect &baseRect,
+                                      const HiliteSpan &span,
+                                      CRect &hiliteRect) {
+  hiliteRect = CRect(0, 0, 0, 0);
   if (baseRect.left >= baseRect.right || baseRect.top >= baseRect.bottom ||
-      text.str.empty())
+      span.from >= span.to)
     return;
-
-  TextRange range;
-  for (size_t j = 0; j < text.attributes.size(); ++j)
-    if (text.attributes[j].type == HIGHLIGHTED)
-      range = text.attributes[j].range;
-  if (range.start >= range.end)
-    return;
-
-  CSize beforesz, hilitedsz, aftersz;
-  auto &fmt = _pD2D->pPreeditFormat;
-
-  int x = baseRect.left, y = baseRect.top;
-
-  // Before part
-  if (range.start > 0) {
-    _pD2D->GetTextSize(text.str.substr(0, range.start), range.start, fmt,
-                       &beforesz);
-    if (beforesz.cx > 0 && beforesz.cy > 0) {
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
-        beforeRect = CRect(baseRect.left, y, baseRect.right, y + beforesz.cy);
-      else
-        beforeRect = CRect(x, baseRect.top, x + beforesz.cx, baseRect.bottom);
-
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
-        y += beforesz.cy + _style.hilite_spacing;
-      else
-        x += beforesz.cx + _style.hilite_spacing;
-    }
-  }
-
-  // Highlighted part
-  {
-    _pD2D->GetTextSize(text.str.substr(range.start, range.end - range.start),
-                       range.end - range.start, fmt, &hilitedsz);
-    if (hilitedsz.cx > 0 && hilitedsz.cy > 0) {
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
-        hiliteRect = CRect(baseRect.left, y, baseRect.right, y + hilitedsz.cy);
-      else
-        hiliteRect = CRect(x, baseRect.top, x + hilitedsz.cx, baseRect.bottom);
-
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
-        y += hilitedsz.cy + _style.hilite_spacing;
-      else
-        x += hilitedsz.cx + _style.hilite_spacing;
-    }
-  }
-
-  // After part
-  if (range.end < static_cast<int>(text.str.length())) {
-    _pD2D->GetTextSize(text.str.substr(range.end),
-                       text.str.length() - range.end, fmt, &aftersz);
-    if (aftersz.cx > 0 && aftersz.cy > 0) {
-      if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-          _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
-        afterRect = CRect(baseRect.left, y, baseRect.right, y + aftersz.cy);
-      else
-        afterRect = CRect(x, baseRect.top, x + aftersz.cx, baseRect.bottom);
-    }
-  }
+  if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
+      _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN)
+    hiliteRect = CRect(baseRect.left, baseRect.top + span.from,
+                       baseRect.right, baseRect.top + span.to);
+  else
+    hiliteRect = CRect(baseRect.left + span.from, baseRect.top,
+                       baseRect.left + span.to, baseRect.bottom);
 }
 
 int StandardLayout::_CalcMarkMetrics(bool vertical_text_layout) {
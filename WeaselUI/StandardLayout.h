@@ -8,10 +8,10 @@ public:
   StandardLayout(const UIStyle &style, const Context &context,
                  const Status &status, an<D2D> &pD2D)
       : Layout(style, context, status, pD2D) {
-    _pageEnabled = (_style.prevpage_color & 0xff000000) &&
-                   (_style.nextpage_color & 0xff000000);
+    _ResetResults();
     RecalculateSizes();
   }
+  virtual void Reset(const UIStyle &style);
   virtual void DoLayout() = 0;
   virtual CSize &GetContentSize() { return _contentSize; };
   void RecalculateSizes();
@@ -40,24 +40,31 @@ public:
     return _roundInfo[id];
   };
   virtual const IsToRoundStruct &GetTextRoundInfo() { return _textRoundInfo; };
-  // Precomputed preedit sub-rectangles for optimization
-  virtual CRect &GetPreeditBeforeRect() { return _preeditBeforeRect; };
   virtual CRect &GetPreeditHiliteRect() { return _preeditHiliteRect; };
-  virtual CRect &GetPreeditAfterRect() { return _preeditAfterRect; };
-  virtual CRect &GetAuxBeforeRect() { return _auxBeforeRect; };
   virtual CRect &GetAuxHiliteRect() { return _auxHiliteRect; };
-  virtual CRect &GetAuxAfterRect() { return _auxAfterRect; };
 
 protected:
+  // where the highlighted range of a text starts and ends along its reading
+  // direction, from the start of the text; from == to if there is none
+  struct HiliteSpan {
+    int from = 0;
+    int to = 0;
+  };
+  // clear the results of the previous layout, keeping their storage
+  void _ResetResults();
+  // zeroed int array of n items, reused by every DoLayout
+  std::vector<int> &_Scratch(int slot, size_t n);
   bool _IsHighlightOverCandidateWindow(const CRect &rc);
   void _PrepareRoundInfo();
+  // measured as one text layout, the highlighted range with it
   CSize _GetPreeditSize(const Text &text,
-                        ComPtr<IDWriteTextFormat1> &pTextFormat);
+                        ComPtr<IDWriteTextFormat1> &pTextFormat,
+                        HiliteSpan &span);
   void _UpdateStatusIconLayout(int *width, int *height);
   void _CalcPageIndicator(bool vertical_text_layout, int &pgw, int &pgh);
-  void _PrecomputePreeditRects(const CRect &baseRect, const Text &text,
-                               CRect &beforeRect, CRect &hiliteRect,
-                               CRect &afterRect);
+  // the span placed in the text's rect
+  void _PlaceHiliteRect(const CRect &baseRect, const HiliteSpan &span,
+                        CRect &hiliteRect);
   int _CalcMarkMetrics(bool vertical_text_layout);
   // page indicator uses pre/next glyphs, implemented in StandardLayout
   int _CalcStatusIconOffset(int extent) const;
@@ -68,26 +75,26 @@ protected:
   TextRange _range;
   CSize _contentSize;
   CRect _preeditRect, _auxiliaryRect, _highlightRect;
-  CRect _candidateRects[MAX_CANDIDATES_COUNT];
-  CRect _candidateLabelRects[MAX_CANDIDATES_COUNT];
-  CRect _candidateTextRects[MAX_CANDIDATES_COUNT];
-  CRect _candidateCommentRects[MAX_CANDIDATES_COUNT];
+  std::vector<CRect> _candidateRects;
+  std::vector<CRect> _candidateLabelRects;
+  std::vector<CRect> _candidateTextRects;
+  std::vector<CRect> _candidateCommentRects;
   CRect _statusIconRect;
   CRect _bgRect;
   CRect _contentRect;
 
-  IsToRoundStruct _roundInfo[MAX_CANDIDATES_COUNT];
+  std::vector<IsToRoundStruct> _roundInfo;
   IsToRoundStruct _textRoundInfo;
 
   CRect _prePageRect;
   CRect _nextPageRect;
-  // Precomputed preedit sub-rectangles for optimization
-  CRect _preeditBeforeRect, _preeditHiliteRect, _preeditAfterRect;
-  CRect _auxBeforeRect, _auxHiliteRect, _auxAfterRect;
+  CRect _preeditHiliteRect, _auxHiliteRect;
 
   // Cached sizes
   CSize _preeditSize;
   CSize _auxSize;
+  HiliteSpan _preeditSpan;
+  HiliteSpan _auxSpan;
   CSize _pagePrevSize;
   CSize _pageNextSize;
 
@@ -99,6 +106,7 @@ protected:
   CSize _markTextSize;
 
   bool _pageEnabled;
+  std::vector<int> _scratch[5];
 
   static const wstring _pre;
   static const wstring _next;
@@ -0,0 +1,459 @@
+#include "UIChannel.h"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace weasel {
+
+// ----------------------------------------------------------------------------
+// snapshot encoding: after the context snapshot, fields in the order of the
+// serialize hooks in WeaselIPCData.h, numbers as laid out in memory (both
+// ends are the same build on one machine), bools as one byte, enums as int32,
+// strings and vectors as a uint32 count followed by UTF-16 code units or items
+
+namespace {
+
+template <typename T> struct is_vector : std::false_type {};
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+class SnapshotWriter {
+public:
+  explicit SnapshotWriter(std::string &out) : m_out(out) {}
+  template <typename T> SnapshotWriter &operator&(const T &v) {
+    Put(v);
+    return *this;
+  }
+
+private:
+  template <typename T> void Put(const T &v) {
+    if constexpr (std::is_same_v<T, bool>) {
+      _Raw<uint8_t>(v ? 1 : 0);
+    } else if constexpr (std::is_enum_v<T>) {
+      _Raw<int32_t>((int32_t)v);
+    } else if constexpr (std::is_arithmetic_v<T>) {
+      _Raw<T>(v);
+    } else if constexpr (std::is_same_v<T, std::wstring>) {
+      _String(v);
+    } else if constexpr (is_vector<T>::value) {
+      _Raw<uint32_t>((uint32_t)v.size());
+      for (const auto &item : v)
+        Put(item);
+    } else {
+      // the hooks take the object by non-const reference
+      boost::serialization::serialize(*this, const_cast<T &>(v), 0);
+    }
+  }
+  template <typename T> void _Raw(T v) {
+    m_out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+  void _String(const std::wstring &s) {
+    const size_t at = m_out.size();
+    _Raw<uint32_t>(0);
+    uint32_t units = 0;
+    for (wchar_t ch : s) {
+      const uint32_t c = (uint32_t)ch;
+      if (c > 0xffff) {
+        _Raw<uint16_t>((uint16_t)(0xd800 + ((c - 0x10000) >> 10)));
+        _Raw<uint16_t>((uint16_t)(0xdc00 + ((c - 0x10000) & 0x3ff)));
+        units += 2;
+      } else {
+        _Raw<uint16_t>((uint16_t)c);
+        units++;
+      }
+    }
+    memcpy(&m_out[at], &units, sizeof(units));
+  }
+
+  std::string &m_out;
+};
+
+class SnapshotReader {
+public:
+  SnapshotReader(const char *data, size_t size)
+      : m_at(data), m_end(data + size) {}
+  template <typename T> SnapshotReader &operator&(T &v) {
+    Get(v);
+    return *this;
+  }
+  bool ok() const { return m_ok; }
+  bool done() const { return m_ok && m_at == m_end; }
+
+private:
+  template <typename T> void Get(T &v) {
+    if constexpr (std::is_same_v<T, bool>) {
+      v = _Raw<uint8_t>() != 0;
+    } else if constexpr (std::is_enum_v<T>) {
+      v = (T)_Raw<int32_t>();
+    } else if constexpr (std::is_arithmetic_v<T>) {
+      v = _Raw<T>();
+    } else if constexpr (std::is_same_v<T, std::wstring>) {
+      _String(v);
+    } else if constexpr (is_vector<T>::value) {
+      const uint32_t n = _Raw<uint32_t>();
+      // every item takes a byte at least, a bad count must not allocate
+      if (n > (size_t)(m_end - m_at)) {
+        m_ok = false;
+        return;
+      }
+      v.resize(n);
+      for (auto &item : v)
+        Get(item);
+    } else {
+      boost::serialization::serialize(*this, v, 0);
+    }
+  }
+  template <typename T> T _Raw() {
+    T v{};
+    if (!m_ok || (size_t)(m_end - m_at) < sizeof(T)) {
+      m_ok = false;
+      return v;
+    }
+    memcpy(&v, m_at, sizeof(T));
+    m_at += sizeof(T);
+    return v;
+  }
+  void _String(std::wstring &s) {
+    const uint32_t units = _Raw<uint32_t>();
+    s.clear();
+    if (!m_ok || units > (size_t)(m_end - m_at) / 2) {
+      m_ok = false;
+      return;
+    }
+    s.reserve(units);
+    for (uint32_t i = 0; i < units; i++) {
+      uint32_t c = _Raw<uint16_t>();
+      if (sizeof(wchar_t) > 2 && c >= 0xd800 && c < 0xdc00 && i + 1 < units) {
+        uint16_t lo;
+        memcpy(&lo, m_at, sizeof(lo));
+        if (lo >= 0xdc00 && lo < 0xe000) {
+          c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+          m_at += sizeof(lo);
+          i++;
+        }
+      }
+      s.push_back((wchar_t)c);
+    }
+  }
+
+  const char *m_at;
+  const char *m_end;
+  bool m_ok = true;
+};
+
+} // namespace
+
+void EncodeUISnapshot(const Context &ctx, const Status &status,
+                      const UISnapshot &snap, std::string &out) {
+  out.clear();
+  SnapshotWriter ar(out);
+  ar & UI_SNAPSHOT_VERSION;
+  EncodeContextSnapshot(ctx, status, out);
+  ar & snap.style;
+  ar & snap.input_left & snap.input_top & snap.input_right & snap.input_bottom;
+  ar & snap.shown & snap.timeout_ms & snap.show_serial & snap.refresh_serial;
+}
+
+bool DecodeUISnapshot(const char *data, size_t size,
+                      ContextSnapshotView &context, UISnapshot &snap) {
+  uint32_t version = 0;
+  if (size < sizeof(version))
+    return false;
+  memcpy(&version, data, sizeof(version));
+  if (version != UI_SNAPSHOT_VERSION ||
+      !context.Open(data + sizeof(version), size - sizeof(version)))
+    return false;
+  const size_t used = sizeof(version) + context.size();
+  SnapshotReader ar(data + used, size - used);
+  ar & snap.style;
+  ar & snap.input_left & snap.input_top & snap.input_right & snap.input_bottom;
+  ar & snap.shown & snap.timeout_ms & snap.show_serial & snap.refresh_serial;
+  return ar.done();
+}
+
+// ----------------------------------------------------------------------------
+// shared memory layout
+
+static const uint32_t CHANNEL_MAGIC = 0x43555452; // "RTUC"
+// bumped on any change to Shared
+static const uint32_t CHANNEL_VERSION = 2;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "the channel needs lock free atomics in shared memory");
+
+struct UIChannel::Shared {
+  // stored last by Create, with release
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  std::atomic<uint32_t> client_pid;
+  std::atomic<uint64_t> client_window;
+  // serial of the newest complete snapshot, in slot serial % SLOT_COUNT; 0
+  // before the first
+  std::atomic<uint64_t> published;
+  // seq is odd while the slot is being written
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> size;
+    std::atomic<uint64_t> serial;
+  } slots[SLOT_COUNT];
+  // written by the server only, seqlocked the same way
+  std::atomic<uint32_t> state_seq;
+  UIServerState state;
+  // server to client; head is written by the server, tail by the client
+  std::atomic<uint32_t> callback_head;
+  std::atomic<uint32_t> callback_tail;
+  UICallbackEvent callbacks[CALLBACK_COUNT];
+  // slot payloads follow, SLOT_SIZE bytes each
+};
+
+const size_t UIChannel::PAYLOAD_OFFSET = (sizeof(Shared) + 63) / 64 * 64;
+const size_t UIChannel::MAPPING_SIZE =
+    PAYLOAD_OFFSET + (size_t)SLOT_COUNT * SLOT_SIZE;
+
+char *UIChannel::_Payload(uint32_t slot) const {
+  return reinterpret_cast<char *>(m_shm) + PAYLOAD_OFFSET +
+         (size_t)slot * SLOT_SIZE;
+}
+
+bool UIChannel::Create(const std::string &name) {
+  Close();
+  if (!_Map(name, true))
+    return false;
+  // fresh mappings are zero filled
+  m_shm->version = CHANNEL_VERSION;
+  m_shm->slot_count = SLOT_COUNT;
+  m_shm->slot_size = SLOT_SIZE;
+#ifdef _WIN32
+  m_shm->client_pid.store(GetCurrentProcessId(), std::memory_order_relaxed);
+#else
+  m_shm->client_pid.store((uint32_t)getpid(), std::memory_order_relaxed);
+#endif
+  m_shm->magic.store(CHANNEL_MAGIC, std::memory_order_release);
+  return true;
+}
+
+bool UIChannel::Open(const std::string &name) {
+  Close();
+  if (!_Map(name, false))
+    return false;
+  if (m_shm->magic.load(std::memory_order_acquire) != CHANNEL_MAGIC ||
+      m_shm->version != CHANNEL_VERSION || m_shm->slot_count != SLOT_COUNT ||
+      m_shm->slot_size != SLOT_SIZE) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+#ifdef _WIN32
+bool UIChannel::_Map(const std::string &name, bool create) {
+  m_path = "Local\\" + name;
+  HANDLE mapping;
+  if (create) {
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                 (DWORD)((uint64_t)MAPPING_SIZE >> 32),
+                                 (DWORD)MAPPING_SIZE, m_path.c_str());
+    // someone else's, or a leftover of ours; not zero filled either way
+    if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+      CloseHandle(mapping);
+      mapping = nullptr;
+    }
+  } else {
+    mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, m_path.c_str());
+  }
+  if (!mapping)
+    return false;
+  void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, MAPPING_SIZE);
+  if (!view) {
+    CloseHandle(mapping);
+    return false;
+  }
+  m_mapping = mapping;
+  m_shm = static_cast<Shared *>(view);
+  m_size = MAPPING_SIZE;
+  m_owner = create;
+  return true;
+}
+
+void UIChannel::Close() {
+  if (m_shm)
+    UnmapViewOfFile(m_shm);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  m_shm = nullptr;
+  m_mapping = nullptr;
+  m_size = 0;
+  m_owner = false;
+}
+#else
+bool UIChannel::_Map(const std::string &name, bool create) {
+  m_path = "/" + name;
+  int fd;
+  if (create) {
+    // a leftover of a crashed client with the same name
+    shm_unlink(m_path.c_str());
+    fd = shm_open(m_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0 && ftruncate(fd, (off_t)MAPPING_SIZE) != 0) {
+      close(fd);
+      shm_unlink(m_path.c_str());
+      fd = -1;
+    }
+  } else {
+    fd = shm_open(m_path.c_str(), O_RDWR, 0);
+    struct stat st;
+    if (fd >= 0 && (fstat(fd, &st) != 0 || (size_t)st.st_size < MAPPING_SIZE)) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd < 0)
+    return false;
+  void *view =
+      mmap(nullptr, MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    if (create)
+      shm_unlink(m_path.c_str());
+    return false;
+  }
+  m_shm = static_cast<Shared *>(view);
+  m_size = MAPPING_SIZE;
+  m_owner = create;
+  return true;
+}
+
+void UIChannel::Close() {
+  if (m_shm)
+    munmap(m_shm, m_size);
+  if (m_shm && m_owner)
+    shm_unlink(m_path.c_str());
+  m_shm = nullptr;
+  m_size = 0;
+  m_owner = false;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// client side
+
+bool UIChannel::Publish(const std::string &data) {
+  if (!m_shm || data.size() > SLOT_SIZE)
+    return false;
+  const uint64_t serial =
+      m_shm->published.load(std::memory_order_relaxed) + 1;
+  Shared::Slot &slot = m_shm->slots[serial % SLOT_COUNT];
+  const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(_Payload(serial % SLOT_COUNT), data.data(), data.size());
+  slot.size.store((uint32_t)data.size(), std::memory_order_relaxed);
+  slot.serial.store(serial, std::memory_order_relaxed);
+  slot.seq.store(seq + 2, std::memory_order_release);
+  m_shm->published.store(serial, std::memory_order_release);
+  return true;
+}
+
+bool UIChannel::PopCallback(UICallbackEvent &event) {
+  if (!m_shm)
+    return false;
+  const uint32_t tail = m_shm->callback_tail.load(std::memory_order_relaxed);
+  if (tail == m_shm->callback_head.load(std::memory_order_acquire))
+    return false;
+  event = m_shm->callbacks[tail % CALLBACK_COUNT];
+  m_shm->callback_tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool UIChannel::ReadServerState(UIServerState &state) const {
+  if (!m_shm)
+    return false;
+  // the server writes it rarely, a few tries are plenty
+  for (int i = 0; i < 8; i++) {
+    const uint32_t seq = m_shm->state_seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    memcpy(&state, &m_shm->state, sizeof(state));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_shm->state_seq.load(std::memory_order_relaxed) == seq)
+      return seq != 0;
+  }
+  return false;
+}
+
+void UIChannel::SetClientWindow(uint64_t window) {
+  if (m_shm)
+    m_shm->client_window.store(window, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+// server side
+
+bool UIChannel::ReadLatest(uint64_t &serial, std::string &data) const {
+  if (!m_shm)
+    return false;
+  // each retry means the client lapped the whole ring meanwhile
+  for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+    const uint64_t latest = m_shm->published.load(std::memory_order_acquire);
+    if (!latest || latest == serial)
+      return false;
+    const Shared::Slot &slot = m_shm->slots[latest % SLOT_COUNT];
+    const uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    const uint32_t size = slot.size.load(std::memory_order_relaxed);
+    if (slot.serial.load(std::memory_order_relaxed) != latest ||
+        size > SLOT_SIZE)
+      continue;
+    data.assign(_Payload(latest % SLOT_COUNT), size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq)
+      continue;
+    serial = latest;
+    return true;
+  }
+  return false;
+}
+
+bool UIChannel::PushCallback(const UICallbackEvent &event) {
+  if (!m_shm)
+    return false;
+  const uint32_t head = m_shm->callback_head.load(std::memory_order_relaxed);
+  if (head - m_shm->callback_tail.load(std::memory_order_acquire) >=
+      CALLBACK_COUNT)
+    return false;
+  m_shm->callbacks[head % CALLBACK_COUNT] = event;
+  m_shm->callback_head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+void UIChannel::WriteServerState(const UIServerState &state) {
+  if (!m_shm)
+    return;
+  const uint32_t seq = m_shm->state_seq.load(std::memory_order_relaxed);
+  m_shm->state_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&m_shm->state, &state, sizeof(state));
+  m_shm->state_seq.store(seq + 2, std::memory_order_release);
+}
+
+uint64_t UIChannel::ClientWindow() const {
+  return m_shm ? m_shm->client_window.load(std::memory_order_acquire) : 0;
+}
+
+uint32_t UIChannel::ClientProcess() const {
+  return m_shm ? m_shm->client_pid.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace weasel
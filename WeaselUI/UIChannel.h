@@ -0,0 +1,119 @@
+#pragma once
+#include "ContextSnapshot.h"
+#include <WeaselIPCData.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace weasel {
+
+// what the UI server shows besides context and status, as the process running
+// rime last set it on its UI object
+struct UISnapshot {
+  UIStyle style;
+  // caret rect, screen pixels
+  int32_t input_left = 0;
+  int32_t input_top = 0;
+  int32_t input_right = 0;
+  int32_t input_bottom = 0;
+  // as of the last Show, Hide or ShowWithTimeout, which bumps show_serial;
+  // the server repeats the call when it changes, as it does Refresh on
+  // refresh_serial
+  bool shown = false;
+  uint32_t timeout_ms = 0;
+  uint32_t show_serial = 0;
+  uint32_t refresh_serial = 0;
+};
+
+// bumped on any change to the encoding; a snapshot of another version is
+// rejected, so a server left over from an older build shows nothing rather
+// than garbage
+static const uint32_t UI_SNAPSHOT_VERSION = 2;
+// the version, a ContextSnapshot of ctx and status, then snap
+void EncodeUISnapshot(const Context &ctx, const Status &status,
+                      const UISnapshot &snap, std::string &out);
+// false on another version or malformed data; context reads data in place,
+// which must be 4 byte aligned
+bool DecodeUISnapshot(const char *data, size_t size,
+                      ContextSnapshotView &context, UISnapshot &snap);
+
+// one call of UICallbackFunc; a flag per argument that was not null
+struct UICallbackEvent {
+  enum { SELECT = 1, HOVER = 2, NEXT_PAGE = 4, SCROLL_DOWN = 8 };
+  uint32_t flags = 0;
+  uint32_t select = 0;
+  uint32_t hover = 0;
+  bool next_page = false;
+  bool scroll_down = false;
+};
+
+// what the client asks its UI object that only the server knows
+struct UIServerState {
+  uint64_t panel = 0;  // panel HWND
+  uint64_t window = 0; // HWND taking snapshot notices
+  uint32_t pid = 0;
+  // UISnapshot::show_serial of the last snapshot applied
+  uint32_t show_serial = 0;
+  bool shown = false;
+  bool counting_down = false;
+  bool is_reposition = false;
+};
+
+// Shared memory between a process running rime, the client, and a UI server
+// process drawing its panel. The client publishes encoded snapshots into a
+// ring of seqlocked slots and the server reads the newest one; UI callbacks
+// come back through a single producer single consumer queue. Neither side
+// ever waits on the other, so a stalled server cannot stall the keyboard hook.
+class UIChannel {
+public:
+  static const uint32_t SLOT_COUNT = 4;
+  static const uint32_t SLOT_SIZE = 256 * 1024;
+  static const uint32_t CALLBACK_COUNT = 64;
+
+  UIChannel() = default;
+  ~UIChannel() { Close(); }
+  UIChannel(const UIChannel &) = delete;
+  UIChannel &operator=(const UIChannel &) = delete;
+
+  // the client creates the mapping and removes its name on Close, the server
+  // opens it; name is plain ASCII, without a platform prefix
+  bool Create(const std::string &name);
+  bool Open(const std::string &name);
+  void Close();
+  bool IsOpen() const { return m_shm != nullptr; }
+
+  // client side
+  // false if data does not fit a slot
+  bool Publish(const std::string &data);
+  bool PopCallback(UICallbackEvent &event);
+  // false if the server has not written it yet
+  bool ReadServerState(UIServerState &state) const;
+  void SetClientWindow(uint64_t window);
+
+  // server side
+  // the newest snapshot if it is newer than serial, which is then updated
+  bool ReadLatest(uint64_t &serial, std::string &data) const;
+  // false if the queue is full, the event is dropped
+  bool PushCallback(const UICallbackEvent &event);
+  void WriteServerState(const UIServerState &state);
+  uint64_t ClientWindow() const;
+  uint32_t ClientProcess() const;
+
+private:
+  struct Shared;
+  // Shared, then the slot payloads
+  static const size_t PAYLOAD_OFFSET;
+  static const size_t MAPPING_SIZE;
+  bool _Map(const std::string &name, bool create);
+  char *_Payload(uint32_t slot) const;
+
+  Shared *m_shm = nullptr;
+  size_t m_size = 0;
+  bool m_owner = false;
+  std::string m_path;
+#ifdef _WIN32
+  void *m_mapping = nullptr;
+#endif
+};
+
+} // namespace weasel
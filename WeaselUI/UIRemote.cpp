@@ -0,0 +1,177 @@
+#include "UIRemote.h"
+
+namespace weasel {
+
+static HWND to_hwnd(uint64_t handle) { return (HWND)(uintptr_t)handle; }
+
+UIRemote::~UIRemote() {
+  if (m_process) {
+    // the server also quits when this process exits, without being told
+    const HWND server = to_hwnd(_State().window);
+    if (Alive() && !(server && PostMessage(server, WM_CLOSE, 0, 0)))
+      TerminateProcess(m_process, 0);
+    CloseHandle(m_process);
+  }
+  if (m_hWnd)
+    DestroyWindow(m_hWnd);
+}
+
+bool UIRemote::Start() {
+  const std::string name =
+      "rime.toy.ui." + std::to_string(GetCurrentProcessId());
+  if (!m_channel.Create(name)) {
+    DEBUG << "UIRemote: cannot create channel " << name << ", "
+          << GetLastError();
+    return false;
+  }
+  m_snapshotMessage = RegisterWindowMessageW(UI_SNAPSHOT_MESSAGE);
+  m_callbackMessage = RegisterWindowMessageW(UI_CALLBACK_MESSAGE);
+  HINSTANCE hInstance = GetModuleHandle(nullptr);
+  WNDCLASS wc = {};
+  wc.lpfnWndProc = UIRemote::WindowProc;
+  wc.hInstance = hInstance;
+  wc.lpszClassName = L"WeaselUIRemote";
+  ATOM atom = RegisterClass(&wc);
+  if (!atom && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    return false;
+  m_hWnd = CreateWindowEx(0, L"WeaselUIRemote", L"", 0, 0, 0, 0, 0,
+                          HWND_MESSAGE, nullptr, hInstance, this);
+  if (!m_hWnd)
+    return false;
+  m_channel.SetClientWindow((uint64_t)(uintptr_t)m_hWnd);
+
+  wchar_t exePath[MAX_PATH] = {0};
+  if (!GetModuleFileNameW(nullptr, exePath, MAX_PATH))
+    return false;
+  std::wstring cmdLine = L"\"" + std::wstring(exePath) + L"\" --ui-server " +
+                         std::wstring(name.begin(), name.end());
+  STARTUPINFOW si = {sizeof(si)};
+  PROCESS_INFORMATION pi = {};
+  if (!CreateProcessW(exePath, &cmdLine[0], nullptr, nullptr, FALSE, 0,
+                      nullptr, nullptr, &si, &pi)) {
+    DEBUG << "UIRemote: cannot start UI server, " << GetLastError();
+    return false;
+  }
+  CloseHandle(pi.hThread);
+  m_process = pi.hProcess;
+  DEBUG << "UIRemote: UI server " << pi.dwProcessId << " on " << name;
+  // the server reads the newest snapshot as soon as it is up
+  Publish();
+  return true;
+}
+
+bool UIRemote::Alive() const {
+  return m_process && WaitForSingleObject(m_process, 0) == WAIT_TIMEOUT;
+}
+
+void UIRemote::Show(bool shown) {
+  m_snap.shown = shown;
+  m_snap.timeout_ms = 0;
+  m_snap.show_serial++;
+  _Schedule();
+}
+
+void UIRemote::ShowWithTimeout(size_t millisec) {
+  m_snap.shown = true;
+  m_snap.timeout_ms = (uint32_t)millisec;
+  m_snap.show_serial++;
+  _Schedule();
+}
+
+void UIRemote::Refresh() {
+  m_snap.refresh_serial++;
+  _Schedule();
+}
+
+void UIRemote::MoveTo(const RECT &rc) {
+  m_snap.input_left = rc.left;
+  m_snap.input_top = rc.top;
+  m_snap.input_right = rc.right;
+  m_snap.input_bottom = rc.bottom;
+  _Schedule();
+}
+
+void UIRemote::_Schedule() {
+  if (m_scheduled)
+    return;
+  m_scheduled = !!PostMessage(m_hWnd, PUBLISH_MESSAGE, 0, 0);
+  // no message loop to come back to, publish now
+  if (!m_scheduled)
+    Publish();
+}
+
+void UIRemote::Publish() {
+  m_scheduled = false;
+  m_snap.style = m_ui.style();
+  EncodeUISnapshot(m_ui.ctx(), m_ui.status(), m_snap, m_data);
+  if (!m_channel.Publish(m_data)) {
+    DEBUG << "UIRemote: snapshot of " << m_data.size() << " bytes dropped";
+    return;
+  }
+  const HWND server = to_hwnd(_State().window);
+  if (server)
+    PostMessage(server, m_snapshotMessage, 0, 0);
+}
+
+bool UIRemote::IsShown() const {
+  const UIServerState state = _State();
+  return state.show_serial == m_snap.show_serial ? state.shown : m_snap.shown;
+}
+
+bool UIRemote::IsCountingDown() const {
+  const UIServerState state = _State();
+  return state.show_serial == m_snap.show_serial
+             ? state.counting_down
+             : m_snap.shown && m_snap.timeout_ms;
+}
+
+bool UIRemote::GetIsReposition() const { return _State().is_reposition; }
+
+HWND UIRemote::hwnd() const { return to_hwnd(_State().panel); }
+
+UIServerState UIRemote::_State() const {
+  UIServerState state;
+  if (!m_channel.ReadServerState(state))
+    state = UIServerState();
+  return state;
+}
+
+void UIRemote::_DispatchCallbacks() {
+  UICallbackEvent event;
+  while (m_channel.PopCallback(event)) {
+    UICallbackFunc &callback = m_ui.uiCallback();
+    if (!callback)
+      continue;
+    size_t select = event.select;
+    size_t hover = event.hover;
+    bool next_page = event.next_page;
+    bool scroll_down = event.scroll_down;
+    callback(event.flags & UICallbackEvent::SELECT ? &select : nullptr,
+             event.flags & UICallbackEvent::HOVER ? &hover : nullptr,
+             event.flags & UICallbackEvent::NEXT_PAGE ? &next_page : nullptr,
+             event.flags & UICallbackEvent::SCROLL_DOWN ? &scroll_down
+                                                        : nullptr);
+  }
+}
+
+LRESULT CALLBACK UIRemote::WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
+                                      LPARAM lParam) {
+  if (uMsg == WM_NCCREATE) {
+    auto self = static_cast<UIRemote *>(
+        reinterpret_cast<LPCREATESTRUCT>(lParam)->lpCreateParams);
+    SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(self));
+  }
+  auto self =
+      reinterpret_cast<UIRemote *>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+  if (self && uMsg == self->m_callbackMessage) {
+    self->_DispatchCallbacks();
+    return 0;
+  }
+  if (self && uMsg == PUBLISH_MESSAGE) {
+    self->Publish();
+    return 0;
+  }
+  return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
+} // namespace weasel
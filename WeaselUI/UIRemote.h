@@ -0,0 +1,66 @@
+#pragma once
+#include "UIChannel.h"
+#include <WeaselUI.h>
+
+namespace weasel {
+
+// registered window messages: the client posts the first to the server window
+// after each snapshot, the server the second to the client window after each
+// callback
+static const wchar_t UI_SNAPSHOT_MESSAGE[] = L"rime.toy.ui.snapshot";
+static const wchar_t UI_CALLBACK_MESSAGE[] = L"rime.toy.ui.callback";
+
+// The client end of a UI server, see UI::StartServer. Changes to the UI are
+// published as a whole snapshot of it, once the thread is back in its message
+// loop, so that the MoveTo, Refresh and Show of one key go out together;
+// callbacks of the server panel come back as a message to a message-only
+// window, on the thread that started it.
+class UIRemote {
+public:
+  UIRemote(UI &ui) : m_ui(ui) {}
+  ~UIRemote();
+  // creates the channel and the server process
+  bool Start();
+  // false once the server process has exited
+  bool Alive() const;
+
+  void Show(bool shown);
+  void ShowWithTimeout(size_t millisec);
+  void Refresh();
+  void MoveTo(const RECT &rc);
+  // the UI's context, status and style as they are now; context and status
+  // are encoded straight from the UI, not copied
+  void Publish();
+
+  // as last asked for until the server has applied that Show or Hide, then
+  // the server's own, which a timeout may have changed since
+  bool IsShown() const;
+  bool IsCountingDown() const;
+  // the server's, as of the last snapshot it applied; a key handled before
+  // the server laid out the previous one sees the value from before it
+  bool GetIsReposition() const;
+  // the server's panel, null until the server has applied a snapshot
+  HWND hwnd() const;
+
+private:
+  // posted to m_hWnd, at most one at a time
+  static const UINT PUBLISH_MESSAGE = WM_APP + 1;
+  // publishes on PUBLISH_MESSAGE
+  void _Schedule();
+  UIServerState _State() const;
+  void _DispatchCallbacks();
+  static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
+                                     LPARAM lParam);
+
+  UI &m_ui;
+  UIChannel m_channel;
+  UISnapshot m_snap;
+  std::string m_data;
+  HANDLE m_process = nullptr;
+  HWND m_hWnd = nullptr;
+  UINT m_snapshotMessage = 0;
+  UINT m_callbackMessage = 0;
+  bool m_scheduled = false;
+};
+
+} // namespace weasel
@@ -0,0 +1,224 @@
+#include "UIRemote.h"
+
+namespace weasel {
+
+namespace {
+
+// A UI drawing for the rime.toy process that created the channel: it applies
+// the newest snapshot on each notice and reports its panel's state back
+class UIServer {
+public:
+  ~UIServer();
+  bool Start(const std::string &name);
+  // until the client exits or closes the server
+  int Run();
+
+private:
+  void _Apply();
+  void _WriteState();
+  void _OnCallback(size_t *const select, size_t *const hover,
+                   bool *const next_page, bool *const scroll_down);
+  static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
+                                     LPARAM lParam);
+
+  // the state is written again on STATE_TIMER while the panel counts down to
+  // hide itself, every STATE_INTERVAL ms
+  static const int STATE_TIMER = 20250720;
+  static const UINT STATE_INTERVAL = 50;
+
+  UI m_ui;
+  UIChannel m_channel;
+  HANDLE m_client = nullptr;
+  HWND m_hWnd = nullptr;
+  UINT m_snapshotMessage = 0;
+  UINT m_callbackMessage = 0;
+  uint64_t m_serial = 0;
+  std::string m_data;
+  // the snapshot applied last
+  UISnapshot m_applied;
+  bool m_first = true;
+};
+
+UIServer::~UIServer() {
+  if (m_hWnd)
+    DestroyWindow(m_hWnd);
+  if (m_client)
+    CloseHandle(m_client);
+}
+
+bool UIServer::Start(const std::string &name) {
+  if (!m_channel.Open(name)) {
+    DEBUG << "UIServer: cannot open channel " << name;
+    return false;
+  }
+  m_client = OpenProcess(SYNCHRONIZE, FALSE, m_channel.ClientProcess());
+  if (!m_client)
+    return false;
+  m_snapshotMessage = RegisterWindowMessageW(UI_SNAPSHOT_MESSAGE);
+  m_callbackMessage = RegisterWindowMessageW(UI_CALLBACK_MESSAGE);
+  HINSTANCE hInstance = GetModuleHandle(nullptr);
+  WNDCLASS wc = {};
+  wc.lpfnWndProc = UIServer::WindowProc;
+  wc.hInstance = hInstance;
+  wc.lpszClassName = L"WeaselUIServer";
+  ATOM atom = RegisterClass(&wc);
+  if (!atom && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    return false;
+  m_hWnd = CreateWindowEx(0, L"WeaselUIServer", L"", 0, 0, 0, 0, 0,
+                          HWND_MESSAGE, nullptr, hInstance, this);
+  if (!m_hWnd)
+    return false;
+  m_ui.SetCallback([this](size_t *const select, size_t *const hover,
+                          bool *const next_page, bool *const scroll_down) {
+    _OnCallback(select, hover, next_page, scroll_down);
+  });
+  if (!m_ui.Create(nullptr))
+    return false;
+  // the client learns m_hWnd from the state, and may have published already
+  _WriteState();
+  _Apply();
+  return true;
+}
+
+int UIServer::Run() {
+  MSG msg;
+  for (;;) {
+    const DWORD ret = MsgWaitForMultipleObjects(1, &m_client, FALSE, INFINITE,
+                                                QS_ALLINPUT);
+    // the client exited, or the wait failed
+    if (ret != WAIT_OBJECT_0 + 1)
+      return 0;
+    while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+      if (msg.message == WM_QUIT)
+        return (int)msg.wParam;
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
+    }
+  }
+}
+
+void UIServer::_Apply() {
+  if (!m_channel.ReadLatest(m_serial, m_data))
+    return;
+  ContextSnapshotView context;
+  UISnapshot snap;
+  if (!DecodeUISnapshot(m_data.data(), m_data.size(), context, snap)) {
+    DEBUG << "UIServer: snapshot " << m_serial << " rejected";
+    return;
+  }
+  // most snapshots only move the caret or show and hide; the context is
+  // compared in place and decoded only when it changed
+  const bool content_changed =
+      m_first || !context.Equals(m_ui.ctx(), m_ui.status());
+  const bool changed = content_changed || m_ui.style() != snap.style ||
+                       snap.refresh_serial != m_applied.refresh_serial;
+  m_ui.style() = snap.style;
+  if (content_changed)
+    context.Decode(m_ui.ctx(), m_ui.status());
+  if (m_first || snap.input_left != m_applied.input_left ||
+      snap.input_top != m_applied.input_top ||
+      snap.input_right != m_applied.input_right ||
+      snap.input_bottom != m_applied.input_bottom) {
+    const RECT rc = {snap.input_left, snap.input_top, snap.input_right,
+                     snap.input_bottom};
+    m_ui.UpdateInputPosition(rc);
+  }
+  if (changed)
+    m_ui.Refresh();
+  if (snap.show_serial != m_applied.show_serial) {
+    if (!snap.shown)
+      m_ui.Hide();
+    else if (snap.timeout_ms)
+      m_ui.ShowWithTimeout(snap.timeout_ms);
+    else
+      m_ui.Show();
+  }
+  m_applied = std::move(snap);
+  m_first = false;
+  _WriteState();
+}
+
+void UIServer::_WriteState() {
+  UIServerState state;
+  state.panel = (uint64_t)(uintptr_t)m_ui.hwnd();
+  state.window = (uint64_t)(uintptr_t)m_hWnd;
+  state.pid = GetCurrentProcessId();
+  state.show_serial = m_applied.show_serial;
+  state.shown = !!m_ui.IsShown();
+  state.counting_down = !!m_ui.IsCountingDown();
+  state.is_reposition = m_ui.GetIsReposition();
+  m_channel.WriteServerState(state);
+  if (state.counting_down)
+    SetTimer(m_hWnd, STATE_TIMER, STATE_INTERVAL, nullptr);
+  else
+    KillTimer(m_hWnd, STATE_TIMER);
+}
+
+void UIServer::_OnCallback(size_t *const select, size_t *const hover,
+                           bool *const next_page, bool *const scroll_down) {
+  UICallbackEvent event;
+  if (select) {
+    event.flags |= UICallbackEvent::SELECT;
+    event.select = (uint32_t)*select;
+  }
+  if (hover) {
+    event.flags |= UICallbackEvent::HOVER;
+    event.hover = (uint32_t)*hover;
+  }
+  if (next_page) {
+    event.flags |= UICallbackEvent::NEXT_PAGE;
+    event.next_page = *next_page;
+  }
+  if (scroll_down) {
+    event.flags |= UICallbackEvent::SCROLL_DOWN;
+    event.scroll_down = *scroll_down;
+  }
+  if (!m_channel.PushCallback(event))
+    DEBUG << "UIServer: callback queue full, event dropped";
+  const HWND client = (HWND)(uintptr_t)m_channel.ClientWindow();
+  if (client)
+    PostMessage(client, m_callbackMessage, 0, 0);
+}
+
+LRESULT CALLBACK UIServer::WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
+                                      LPARAM lParam) {
+  if (uMsg == WM_NCCREATE) {
+    auto self = static_cast<UIServer *>(
+        reinterpret_cast<LPCREATESTRUCT>(lParam)->lpCreateParams);
+    SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(self));
+  }
+  auto self =
+      reinterpret_cast<UIServer *>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+  if (!self)
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+  if (uMsg == self->m_snapshotMessage) {
+    self->_Apply();
+    return 0;
+  }
+  switch (uMsg) {
+  case WM_TIMER:
+    if (wParam == STATE_TIMER) {
+      self->_WriteState();
+      return 0;
+    }
+    break;
+  case WM_CLOSE:
+    PostQuitMessage(0);
+    return 0;
+  }
+  return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
+} // namespace
+
+int RunUIServer(const std::wstring &name) {
+  std::string channel;
+  for (wchar_t ch : name)
+    channel.push_back((char)ch);
+  UIServer server;
+  if (!server.Start(channel))
+    return 1;
+  return server.Run();
+}
+
+} // namespace weasel
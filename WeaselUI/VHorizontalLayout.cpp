@@ -30,7 +30,7 @@ void VHorizontalLayout::DoLayout() {
                       _auxiliaryRect);
   }
   /* Candidates */
-  std::vector<int> wids(candidates_count);
+  std::vector<int> &wids = _Scratch(0, candidates_count);
   int w = width;
   int max_comment_heihgt = 0, max_content_height = 0;
   if (candidates_count) {
@@ -193,13 +193,11 @@ void VHorizontalLayout::DoLayout() {
   CopyRect(_bgRect, _contentRect);
   _bgRect.DeflateRect(offsetX + 1, offsetY + 1);
 
-  // Precompute preedit sub-rectangles
-  _PrecomputePreeditRects(_preeditRect, _context.preedit, _preeditBeforeRect,
-                          _preeditHiliteRect, _preeditAfterRect);
+  // highlighted range of the preedit
+  _PlaceHiliteRect(_preeditRect, _preeditSpan, _preeditHiliteRect);
 
-  // Precompute auxiliary sub-rectangles
-  _PrecomputePreeditRects(_auxiliaryRect, _context.aux, _auxBeforeRect,
-                          _auxHiliteRect, _auxAfterRect);
+  // highlighted range of the aux
+  _PlaceHiliteRect(_auxiliaryRect, _auxSpan, _auxHiliteRect);
 
   // prepare round info
   _PrepareRoundInfo();
@@ -270,9 +268,9 @@ void VHorizontalLayout::DoLayoutWithWrap() {
   // candidates
   int col_cnt = 0;
   int max_height_of_cols = 0;
-  std::vector<int> width_of_cols(candidates_count);
-  std::vector<int> col_of_candidate(candidates_count);
-  std::vector<int> minleft_of_cols(candidates_count);
+  std::vector<int> &width_of_cols = _Scratch(0, candidates_count);
+  std::vector<int> &col_of_candidate = _Scratch(1, candidates_count);
+  std::vector<int> &minleft_of_cols = _Scratch(2, candidates_count);
   if (candidates_count) {
     h = offsetY + real_margin_y;
     for (auto i = 0; i < candidates_count && i < MAX_CANDIDATES_COUNT; i++) {
@@ -388,8 +386,8 @@ void VHorizontalLayout::DoLayoutWithWrap() {
   } else
     width -= _style.spacing + offsetX;
   // reposition if not left to right
-  std::vector<int> first_cand_of_cols(candidates_count);
-  std::vector<int> offset_of_cols(candidates_count);
+  std::vector<int> &first_cand_of_cols = _Scratch(3, candidates_count);
+  std::vector<int> &offset_of_cols = _Scratch(4, candidates_count);
   if (!_style.vertical_text_left_to_right) {
     // re position right to left
     int base_left;
@@ -536,13 +534,11 @@ void VHorizontalLayout::DoLayoutWithWrap() {
     }
   }
 
-  // Precompute preedit sub-rectangles
-  _PrecomputePreeditRects(_preeditRect, _context.preedit, _preeditBeforeRect,
-                          _preeditHiliteRect, _preeditAfterRect);
+  // highlighted range of the preedit
+  _PlaceHiliteRect(_preeditRect, _preeditSpan, _preeditHiliteRect);
 
-  // Precompute auxiliary sub-rectangles
-  _PrecomputePreeditRects(_auxiliaryRect, _context.aux, _auxBeforeRect,
-                          _auxHiliteRect, _auxAfterRect);
+  // highlighted range of the aux
+  _PlaceHiliteRect(_auxiliaryRect, _auxSpan, _auxHiliteRect);
 
   // truely draw content size calculation
   _contentRect.DeflateRect(offsetX, offsetY);
@@ -177,13 +177,11 @@ void weasel::VerticalLayout::DoLayout() {
     }
   }
 
-  // Precompute preedit sub-rectangles
-  _PrecomputePreeditRects(_preeditRect, _context.preedit, _preeditBeforeRect,
-                          _preeditHiliteRect, _preeditAfterRect);
+  // highlighted range of the preedit
+  _PlaceHiliteRect(_preeditRect, _preeditSpan, _preeditHiliteRect);
 
-  // Precompute auxiliary sub-rectangles
-  _PrecomputePreeditRects(_auxiliaryRect, _context.aux, _auxBeforeRect,
-                          _auxHiliteRect, _auxAfterRect);
+  // highlighted range of the aux
+  _PlaceHiliteRect(_auxiliaryRect, _auxSpan, _auxHiliteRect);
 
   if (_style.vertical_right_to_left) {
     for (auto i = 0; i < candidates_count && i < MAX_CANDIDATES_COUNT; ++i) {
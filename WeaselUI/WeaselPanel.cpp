@@ -4,6 +4,7 @@
 #include "VHorizontalLayout.h"
 #include "VerticalLayout.h"
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <resource.h>
 #include <windowsx.h>
@@ -79,6 +80,7 @@ WeaselPanel::WeaselPanel(UI &ui)
       m_lastCandidateCount(0), hide_candidates(false) {
   // Prepare shared graphics resources early to reduce first paint latency.
   m_pD2D = std::make_shared<D2D>(m_style);
+  m_renderer = std::make_unique<D2DRenderBackend>(m_pD2D);
   auto hInstance = GetModuleHandle(nullptr);
   m_iconAlpha = (HICON)LoadImage(hInstance, MAKEINTRESOURCE(IDI_EN), IMAGE_ICON,
                                  STATUS_ICON_SIZE, STATUS_ICON_SIZE, LR_SHARED);
@@ -111,6 +113,63 @@ void WeaselPanel::_ClearTimers() {
     ::KillTimer(m_hWnd, AUTOHIDE_TIMER);
     m_autoHideTimer = 0;
   }
+  if (m_releaseTimer) {
+    ::KillTimer(m_hWnd, RELEASE_TIMER);
+    m_releaseTimer = 0;
+  }
+  if (m_hoverTimer) {
+    ::KillTimer(m_hWnd, HOVER_TIMER);
+    m_hoverTimer = 0;
+  }
+  if (m_paintTimer) {
+    ::KillTimer(m_hWnd, PAINT_TIMER);
+    m_paintTimer = 0;
+  }
+  m_deferredPaints = 0;
+}
+
+void WeaselPanel::_SchedulePaint() {
+  if (!m_paintTimer)
+    m_paintTimer = ::SetTimer(m_hWnd, PAINT_TIMER, USER_TIMER_MINIMUM, NULL);
+}
+
+bool WeaselPanel::_FrameReady() {
+  const bool ready = m_renderer->FrameReady();
+  if (!ready && m_deferredPaints < MAX_DEFERRED_PAINTS) {
+    // everything is drawn on the next try, the recorded frame is current
+    m_deferredPaints++;
+    _SchedulePaint();
+    return false;
+  }
+  m_deferredPaints = 0;
+  // the last frame is still queued and the content changed: present without
+  // waiting for vsync rather than block the caller
+  m_renderer->SetPresentNoWait(!ready);
+  return true;
+}
+
+void WeaselPanel::_ScheduleResourceRelease() {
+  if (!m_hWnd || !m_pD2D || !m_pD2D->swapChain || m_preview_mode)
+    return;
+  // large swap chains (e.g. fullscreen layouts) are not worth keeping
+  if (m_pD2D->WindowResourceBytes() > RESOURCE_BUDGET) {
+    _ReleaseIdleResources();
+    return;
+  }
+  if (!m_releaseTimer)
+    m_releaseTimer =
+        ::SetTimer(m_hWnd, RELEASE_TIMER, RESOURCE_IDLE_TIMEOUT, NULL);
+}
+
+void WeaselPanel::_ReleaseIdleResources() {
+  if (m_releaseTimer) {
+    ::KillTimer(m_hWnd, RELEASE_TIMER);
+    m_releaseTimer = 0;
+  }
+  if (!m_pD2D || ::IsWindowVisible(m_hWnd))
+    return;
+  // the window itself is kept, Refresh or ShowWindow reattaches
+  m_pD2D->ReleaseWindowResources();
 }
 
 void WeaselPanel::ShowWithTimeout(size_t millisec) {
@@ -130,15 +189,19 @@ bool WeaselPanel::IsCountingDown() const { return m_autoHideTimer != 0; }
 
 void WeaselPanel::ShowWindow(int nCmdShow) {
   ::ShowWindow(m_hWnd, nCmdShow);
-  if (m_pD2D) {
-    if (nCmdShow != SW_HIDE) {
-      // ensure window resources exist when showing
-      if (!m_pD2D->swapChain) {
-        m_pD2D->AttachWindow(m_hWnd);
-        if (!m_style.font_face.empty())
-          m_pD2D->InitDirectWriteResources();
-      }
-    }
+  if (nCmdShow == SW_HIDE) {
+    _ScheduleResourceRelease();
+    return;
+  }
+  if (m_releaseTimer) {
+    ::KillTimer(m_hWnd, RELEASE_TIMER);
+    m_releaseTimer = 0;
+  }
+  // ensure window resources exist when showing
+  if (m_pD2D && !m_pD2D->swapChain) {
+    m_pD2D->AttachWindow(m_hWnd);
+    if (!m_style.font_face.empty())
+      m_pD2D->InitDirectWriteResources();
   }
 }
 
@@ -165,6 +228,8 @@ void WeaselPanel::ReleaseAllResources() {
     DeviceResources::Get().Reset();
     m_pD2D.reset();
   }
+  // a new D2D counts its generations from zero again
+  _ForgetShown();
 }
 
 void WeaselPanel::MoveTo(RECT rc) {
@@ -220,39 +285,114 @@ void WeaselPanel::MoveTo(RECT rc) {
 
 void WeaselPanel::_ResizeWindow() {
   CSize &size = m_layout->GetContentSize();
+  m_windowSize = size;
   SetWindowPos(m_hWnd, 0, 0, 0, size.cx, size.cy,
                SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOZORDER | SWP_NOREDRAW);
   m_pD2D->OnResize(size.cx, size.cy);
 }
 
 void WeaselPanel::_CreateLayout() {
+  // one layout object per layout type and context, reset for each refresh;
+  // a new one only when the style switches to a type not used before
+  auto &pooled = m_layouts[m_style.layout_type * 2 + m_virtualized];
+  if (pooled) {
+    pooled->Reset(m_style);
+    m_layout = pooled.get();
+    m_layoutsReused++;
+    return;
+  }
+  m_layoutsCreated++;
+  const Context &ctx = _LayoutContext();
   the<Layout> layout;
   if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
       m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN) {
     layout =
-        std::make_unique<VHorizontalLayout>(m_style, m_ctx, m_status, m_pD2D);
+        std::make_unique<VHorizontalLayout>(m_style, ctx, m_status, m_pD2D);
   } else {
     if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL ||
         m_style.layout_type == UIStyle::LAYOUT_VERTICAL_FULLSCREEN) {
       layout =
-          std::make_unique<VerticalLayout>(m_style, m_ctx, m_status, m_pD2D);
+          std::make_unique<VerticalLayout>(m_style, ctx, m_status, m_pD2D);
     } else if (m_style.layout_type == UIStyle::LAYOUT_HORIZONTAL ||
                m_style.layout_type == UIStyle::LAYOUT_HORIZONTAL_FULLSCREEN) {
       layout =
-          std::make_unique<HorizontalLayout>(m_style, m_ctx, m_status, m_pD2D);
+          std::make_unique<HorizontalLayout>(m_style, ctx, m_status, m_pD2D);
     }
   }
   if (IS_FULLSCREENLAYOUT(m_style)) {
     layout = std::make_unique<FullScreenLayout>(
-        m_style, m_ctx, m_status, m_inputPos, std::move(layout), m_pD2D);
+        m_style, ctx, m_status, m_inputPos, std::move(layout), m_pD2D);
   }
-  m_layout = std::move(layout);
+  pooled = std::move(layout);
+  m_layout = pooled.get();
+}
+
+// the strings and page number of a candidate page, not the highlight: moving
+// the highlight scrolls the window, a new page is measured again
+static size_t _PageKey(const CandidateInfo &cinfo) {
+  size_t key = std::hash<int>()(cinfo.currentPage);
+  const auto mix = [&key](const vector<Text> &texts) {
+    key = key * 31 + texts.size();
+    for (const auto &text : texts)
+      key = key * 31 + std::hash<std::wstring>()(text.str);
+  };
+  mix(cinfo.candies);
+  mix(cinfo.comments);
+  mix(cinfo.labels);
+  return key;
+}
+
+void WeaselPanel::_UpdateCandidateWindow() {
+  const auto &cinfo = m_ctx.cinfo;
+  const int total = (int)cinfo.candies.size();
+  const size_t page = total > MAX_CANDIDATES_COUNT ? _PageKey(cinfo) : 0;
+  if (page != m_windowPage) {
+    m_windowPage = page;
+    m_visibleCount = MAX_CANDIDATES_COUNT;
+  }
+  m_virtualized = total > m_visibleCount;
+  if (!m_virtualized) {
+    m_candidateFirst = 0;
+    return;
+  }
+  // keep the scroll offset, move it only as far as needed to show the
+  // highlighted candidate
+  const int old_first = m_candidateFirst;
+  if (cinfo.highlighted >= 0 && cinfo.highlighted < total) {
+    if (cinfo.highlighted < m_candidateFirst)
+      m_candidateFirst = cinfo.highlighted;
+    else if (cinfo.highlighted >= m_candidateFirst + m_visibleCount)
+      m_candidateFirst = cinfo.highlighted - m_visibleCount + 1;
+  }
+  m_candidateFirst = MAX(0, MIN(m_candidateFirst, total - m_visibleCount));
+  if (m_candidateFirst != old_first)
+    m_hoverIndex = -1;
+  // only the visible slice is copied, measured and laid out
+  const auto slice = [this](const vector<Text> &src, vector<Text> &dst) {
+    const int first = MIN(m_candidateFirst, (int)src.size());
+    const int last = MIN(first + m_visibleCount, (int)src.size());
+    dst.assign(src.begin() + first, src.begin() + last);
+  };
+  m_view.preedit = m_ctx.preedit;
+  m_view.aux = m_ctx.aux;
+  auto &view = m_view.cinfo;
+  slice(cinfo.candies, view.candies);
+  slice(cinfo.comments, view.comments);
+  slice(cinfo.labels, view.labels);
+  view.currentPage = cinfo.currentPage;
+  view.totalPages = cinfo.totalPages;
+  view.is_last_page = cinfo.is_last_page;
+  view.highlighted = cinfo.highlighted - m_candidateFirst;
+  if (view.highlighted < 0 || view.highlighted >= m_visibleCount)
+    view.highlighted = -1;
 }
 
 void WeaselPanel::_UpdateHideCandidates() {
   bool should_show_icon =
       (m_status.ascii_mode || !m_status.composing || !m_ctx.aux.empty());
-  m_candidateCount = MIN((int)m_ctx.cinfo.candies.size(), MAX_CANDIDATES_COUNT);
+  _UpdateCandidateWindow();
+  m_candidateCount = MIN((int)_LayoutContext().cinfo.candies.size(),
+                         MAX_CANDIDATES_COUNT);
   // When candidate list vanishes, release sticky top/bottom placement state.
   if (m_lastCandidateCount > 0 && m_candidateCount == 0) {
     m_sticky = false;
@@ -289,6 +429,8 @@ void WeaselPanel::Refresh() {
   if (!m_style.font_face.empty() &&
       (m_ostyle != m_style || !m_pD2D->pTextFormat))
     m_pD2D->InitDirectWriteResources();
+  if (m_ostyle != m_style)
+    m_visibleCount = MAX_CANDIDATES_COUNT;
   m_ostyle = m_style;
   _UpdateHideCandidates();
   auto hr = m_pD2D->direct3dDevice
@@ -302,6 +444,16 @@ void WeaselPanel::Refresh() {
   }
   _CreateLayout();
   m_layout->DoLayout();
+  if (_FitCandidateWindow()) {
+    // the first refresh of a page that runs off the work area only: sliced
+    // again to the candidates that fit, into the same pooled layout
+    _UpdateCandidateWindow();
+    m_candidateCount = (int)m_view.cinfo.candies.size();
+    m_lastCandidateCount = m_candidateCount;
+    m_layout->Reset(m_style);
+    m_layout->DoLayout();
+  }
+  m_hitTestDirty = true;
   _ResizeWindow();
   if (m_preview_mode) {
     if (!m_preview_positioned && !m_preview_detached)
@@ -312,6 +464,23 @@ void WeaselPanel::Refresh() {
   RedrawWindow();
 }
 
+void WeaselPanel::LogStats() const {
+  // without the pool every refresh created a layout
+  DEBUG << "layouts: " << m_layoutsCreated << " created, " << m_layoutsReused
+        << " reused";
+  const auto text = m_renderer->GetTextCacheStats();
+  const size_t draws = text.hits + text.misses;
+  DEBUG << "text cache: " << text.entries << " entries, " << text.hits << "/"
+        << draws << " hits (" << (draws ? text.hits * 100 / draws : 0)
+        << "%)";
+  const auto &present = m_renderer->GetPresentStats();
+  DEBUG << "present: " << present.frames << " frames, " << present.no_wait
+        << " no wait, " << present.not_ready << " not ready, "
+        << present.still_drawing << " still drawing, blocked "
+        << (present.frames ? present.total_blocked_us / present.frames : 0)
+        << "us avg, " << present.max_blocked_us << "us max";
+}
+
 void WeaselPanel::RepositionPreview() {
   if (!m_hWnd || !m_preview_mode || m_preview_detached || !m_parent ||
       !m_layout)
@@ -375,18 +544,18 @@ BOOL WeaselPanel::Create(HWND parent, bool preview_mode) {
 
 void WeaselPanel::_UpdateOffsetY(CRect &arc, CRect &prc) {
   if (m_istorepos) {
-    std::vector<CRect> rects(m_candidateCount);
-    std::vector<int> btmys(m_candidateCount);
-    for (int i = 0; i < m_candidateCount && i < MAX_CANDIDATES_COUNT; ++i) {
-      rects[i] = m_layout->GetCandidateRect(i);
-      btmys[i] = rects[i].bottom;
-    }
+    // read straight from the layout, no per paint copies
+    const auto rect = [this](int i) -> const CRect & {
+      return m_layout->GetCandidateRect(i);
+    };
+    const int last_bottom =
+        m_candidateCount ? rect(m_candidateCount - 1).bottom : 0;
     m_offsety_preedit = m_candidateCount && !m_layout->IsInlinePreedit() &&
                                 !m_ctx.preedit.str.empty()
-                            ? rects.back().bottom - prc.bottom
+                            ? last_bottom - prc.bottom
                             : 0;
     m_offsety_aux = m_candidateCount && !m_ctx.aux.str.empty()
-                        ? rects.back().bottom - arc.bottom
+                        ? last_bottom - arc.bottom
                         : 0;
     int base_gap =
         !m_ctx.aux.str.empty()
@@ -394,29 +563,134 @@ void WeaselPanel::_UpdateOffsetY(CRect &arc, CRect &prc) {
             : (!m_layout->IsInlinePreedit() && !m_ctx.preedit.str.empty()
                    ? prc.Height() + DPI_SCALE(m_style.spacing)
                    : 0);
-    for (int i = 0; i < m_candidateCount && i < MAX_CANDIDATES_COUNT; ++i) {
-      m_offsetys[i] = i == 0 ? btmys.back() - base_gap - rects[i].bottom
-                             : rects[i - 1].top + m_offsetys[i - 1] -
+    m_offsetys.resize(m_candidateCount);
+    for (int i = 0; i < m_candidateCount; ++i) {
+      m_offsetys[i] = i == 0 ? last_bottom - base_gap - rect(i).bottom
+                             : rect(i - 1).top + m_offsetys[i - 1] -
                                    DPI_SCALE(m_style.candidate_spacing) -
-                                   rects[i].bottom;
+                                   rect(i).bottom;
     }
   }
 }
 
+static PlaceRect _PlaceRect(const RECT &rc) {
+  return {rc.left, rc.top, rc.right, rc.bottom};
+}
+
 void WeaselPanel::DoPaint() {
-  if (!m_pD2D || !m_layout || !m_pD2D->dc || !m_pD2D->swapChain)
+  if (!m_layout)
     return;
-  auto hr = m_pD2D->direct3dDevice
-                ? m_pD2D->direct3dDevice->GetDeviceRemovedReason()
-                : DXGI_ERROR_DEVICE_REMOVED;
-  if (FAILED(hr)) {
-    DEBUG << StrzHr(hr);
-    m_pD2D->InitDirect2D();
-    if (!m_pD2D->dc || !m_pD2D->swapChain)
+  if (m_frameDirty) {
+    _RecordFrame();
+  } else if (m_hoverDirty) {
+    // the hovered candidate drops its shadow, the rest stays
+    m_frame[1].Clear();
+    m_canvas = &m_frame[1];
+    if (!hide_candidates && m_candidateCount)
+      _DrawCandidateShadows();
+    m_frame[1].Optimize();
+    m_frame[2].Clear();
+    m_canvas = &m_frame[2];
+    if (!hide_candidates && m_candidateCount)
+      _DrawHover();
+  } else {
+    // a plain WM_PAINT draws all of it again
+    _ForgetShown();
+  }
+  m_hoverDirty = false;
+  if (!_Layered()) {
+    m_renderer->ReleaseLayers();
+    _ForgetShown();
+    if (!_FrameReady() || !m_renderer->BeginFrame())
       return;
+    for (const auto &list : m_frame)
+      list.Replay(*m_renderer);
+    m_renderer->EndFrame();
+    if (m_renderer->PresentPending())
+      _SchedulePaint();
+    return;
+  }
+  // a key that only moves the highlight ends up with a Commit
+  _CheckShown();
+  if (!m_baseShown || !m_frame[0].SameAsMoved(m_shown[0], 0, 0) ||
+      !m_frame[1].SameAsMoved(m_shown[1], 0, 0)) {
+    m_baseShown = false;
+    if (!_FrameReady() || !m_renderer->BeginFrame())
+      return;
+    m_frame[0].Replay(*m_renderer);
+    m_frame[1].Replay(*m_renderer);
+    if (!m_renderer->EndFrame())
+      return;
+    if (m_renderer->PresentPending())
+      _SchedulePaint();
+    m_shown[0] = m_frame[0];
+    m_shown[1] = m_frame[1];
+    m_baseShown = true;
+  }
+  _CheckShown();
+  if (!m_topShown || !m_frame[4].SameAsMoved(m_shown[4], 0, 0)) {
+    m_topShown = false;
+    if (m_renderer->BeginLayer(D2DRenderBackend::kTopLayer, m_windowSize.cx,
+                               m_windowSize.cy)) {
+      m_frame[4].Replay(*m_renderer);
+      if (m_renderer->EndLayer(D2DRenderBackend::kTopLayer) &&
+          m_renderer->MoveLayer(D2DRenderBackend::kTopLayer, 0, 0)) {
+        m_shown[4] = m_frame[4];
+        m_topShown = true;
+      }
+    }
+  }
+  _PaintMovableLayer(D2DRenderBackend::kHoverLayer, 2);
+  _PaintMovableLayer(D2DRenderBackend::kHiliteLayer, 3);
+  m_renderer->Commit();
+}
+
+void WeaselPanel::_ForgetShown() {
+  for (auto &list : m_shown)
+    list.Clear();
+  m_baseShown = m_topShown = false;
+}
+
+void WeaselPanel::_CheckShown() {
+  if (m_pD2D && m_shownGeneration != m_pD2D->contentGeneration) {
+    _ForgetShown();
+    m_shownGeneration = m_pD2D->contentGeneration;
   }
-  m_pD2D->dc->BeginDraw();
-  m_pD2D->dc->Clear(D2D1::ColorF({0.0f, 0.0f, 0.0f, 0.0f}));
+}
+
+void WeaselPanel::_PaintMovableLayer(int layer, int i) {
+  const DisplayList &list = m_frame[i];
+  DisplayList &shown = m_shown[i];
+  PlaceRect &at = m_shownAt[i];
+  if (list.empty()) {
+    m_renderer->HideLayer(layer);
+    shown.Clear();
+    return;
+  }
+  const PlaceRect rc = list.Bounds();
+  // the same highlight over a candidate of the same size is only moved
+  if (!shown.empty() &&
+      list.SameAsMoved(shown, rc.left - at.left, rc.top - at.top) &&
+      m_renderer->MoveLayer(layer, rc.left, rc.top)) {
+    shown = list;
+    at = rc;
+    return;
+  }
+  shown.Clear();
+  if (!m_renderer->BeginLayer(layer, rc.right - rc.left, rc.bottom - rc.top))
+    return;
+  list.Replay(*m_renderer, -rc.left, -rc.top);
+  if (!m_renderer->EndLayer(layer) ||
+      !m_renderer->MoveLayer(layer, rc.left, rc.top))
+    return;
+  shown = list;
+  at = rc;
+}
+
+void WeaselPanel::_RecordFrame() {
+  for (auto &list : m_frame)
+    list.Clear();
+  m_canvas = &m_frame[0];
   if (!hide_candidates) {
     const bool should_draw_background =
         ((!m_ctx.empty() && !m_style.inline_preedit) ||
@@ -432,17 +706,24 @@ void WeaselPanel::DoPaint() {
     CRect &arc = m_layout->GetAuxiliaryRect();
     // if vertical auto reverse triggered
     _UpdateOffsetY(arc, prc);
+    if (m_istorepos)
+      m_hitTestDirty = true;
     if (!m_layout->IsInlinePreedit() && !m_ctx.preedit.empty()) {
       _DrawPreedit(m_ctx.preedit, true);
     }
     if (!m_ctx.aux.empty()) {
       _DrawPreedit(m_ctx.aux, false);
     }
-    if (m_candidateCount) {
+    m_canvas = &m_frame[1];
+    if (m_candidateCount)
+      _DrawCandidateShadows();
+    m_canvas = &m_frame[2];
+    if (m_candidateCount)
+      _DrawHover();
+    m_canvas = &m_frame[4];
+    if (m_candidateCount)
       _DrawCandidates();
-    }
     if (m_layout->ShouldDisplayStatusIcon()) {
-      ComPtr<ID2D1Bitmap1> pBitmap;
 #define LOADICON(x, icon, id) LoadIconIfNeed(m_##x, m_style.x, icon, id)
       LOADICON(current_ascii_icon, m_iconAlpha, IDI_EN);
       LOADICON(current_zhung_icon, m_iconEnabled, IDI_ZH);
@@ -457,105 +738,58 @@ void WeaselPanel::DoPaint() {
               : (m_status.type == SCHEMA
                      ? m_iconEnabled
                      : (m_status.full_shape ? m_iconFull : m_iconHalf));
-      HRESULT hrIcon = m_pD2D->GetBmpFromIcon(ico, pBitmap);
-      // Draw the bitmap
-      if (SUCCEEDED(hrIcon) && pBitmap) {
-        auto iconRect = m_layout->GetStatusIconRect();
-        if (m_istorepos)
-          iconRect.OffsetRect(0, m_offsety_preedit);
-        D2D1_RECT_F iconRectf = D2D1::RectF(iconRect.left, iconRect.top,
-                                            iconRect.right, iconRect.bottom);
-        m_pD2D->dc->DrawBitmap(pBitmap.Get(), iconRectf);
-      }
+      auto iconRect = m_layout->GetStatusIconRect();
+      if (m_istorepos)
+        iconRect.OffsetRect(0, m_offsety_preedit);
+      RenderImage image;
+      image.native = ico;
+      m_canvas->DrawImage(_PlaceRect(iconRect), image);
     }
   }
-
-  auto hrEnd = m_pD2D->dc->EndDraw();
-  if (FAILED(hrEnd)) {
-    DEBUG << "EndDraw failed: " << StrzHr(hrEnd);
-    DeviceResources::Get().Reset();
-    m_pD2D->InitDirect2D();
-    return;
-  }
-  // Make the swap chain available to the composition engine
-  HRESULT hrPresent = m_pD2D->swapChain->Present(1, 0); // sync
-  if (hrPresent == DXGI_ERROR_DEVICE_REMOVED ||
-      hrPresent == DXGI_ERROR_DEVICE_RESET) {
-    DEBUG << "Device lost during Present: " << StrzHr(hrPresent);
-    DeviceResources::Get().Reset();
-    m_pD2D->InitDirect2D();
-  } else if (FAILED(hrPresent)) {
-    DEBUG << "Present failed: " << StrzHr(hrPresent);
-    DeviceResources::Get().Reset();
-    m_pD2D->InitDirect2D();
-  }
+  for (auto &list : m_frame)
+    list.Optimize();
+  m_frameDirty = false;
 }
 
 bool WeaselPanel::_DrawPreedit(const Text &text, bool isPreedit) {
   bool drawn = false;
   wstring const &t = text.str;
-  PtTextFormat &pTextFormat = m_pD2D->pPreeditFormat;
 
   if (!t.empty()) {
-    const TextRange &range = m_layout->GetPreeditRange();
-    if (range.start < range.end) {
-      auto before_str = t.substr(0, range.start);
-      auto hilited_str = t.substr(range.start, range.end - range.start);
-      auto after_str = t.substr(range.end);
-
-      // Use precomputed rectangles - make copies when we need to modify them
-      CRect rc_before = isPreedit ? m_layout->GetPreeditBeforeRect()
-                                  : m_layout->GetAuxBeforeRect();
-      CRect rc_hi = isPreedit ? m_layout->GetPreeditHiliteRect()
-                              : m_layout->GetAuxHiliteRect();
-      CRect rc_after = isPreedit ? m_layout->GetPreeditAfterRect()
-                                 : m_layout->GetAuxAfterRect();
-
-      // Apply m_istorepos offset if needed
-      if (m_istorepos) {
-        int offsetY = isPreedit ? m_offsety_preedit : m_offsety_aux;
-        rc_before.OffsetRect(0, offsetY);
-        rc_hi.OffsetRect(0, offsetY);
-        rc_after.OffsetRect(0, offsetY);
-      }
+    CRect rcText =
+        isPreedit ? m_layout->GetPreeditRect() : m_layout->GetAuxiliaryRect();
+    CRect rc_hi = isPreedit ? m_layout->GetPreeditHiliteRect()
+                            : m_layout->GetAuxHiliteRect();
+    // Apply m_istorepos offset if needed
+    if (m_istorepos) {
+      int offsetY = isPreedit ? m_offsety_preedit : m_offsety_aux;
+      rcText.OffsetRect(0, offsetY);
+      rc_hi.OffsetRect(0, offsetY);
+    }
+    TextRun run = _MakeTextRun(t, t.length(), kPreeditFont);
+    if (!rc_hi.IsRectNull()) {
+      // zzz[yyy]xxx in one layout, [yyy] with its own color and the gaps
+      // the layout measured around it
+      TextRange range;
+      for (const auto &attr : text.attributes)
+        if (attr.type == HIGHLIGHTED)
+          range = attr.range;
+      run.hilite_start = MAX(range.start, 0);
+      run.hilite_end = MIN(MAX(range.end, 0), (int)t.length());
+      run.hilite_color = m_style.hilited_text_color;
+      run.hilite_spacing = m_layout->_style.hilite_spacing;
 
       // Use DPI_SCALE macro for consistency with other code
       auto padx = DPI_SCALE(m_style.hilite_padding_x);
       auto pady = DPI_SCALE(m_style.hilite_padding_y);
-
-      if (range.start > 0 && !rc_before.IsRectNull()) {
-        _TextOut(rc_before, before_str, before_str.length(), m_style.text_color,
-                 pTextFormat);
-      }
-      if (!rc_hi.IsRectNull()) {
-        // zzz[yyy]
-        CRect rc_hib = rc_hi;
-        rc_hib.InflateRect(padx, pady);
-        const IsToRoundStruct &roundInfo = m_layout->GetTextRoundInfo();
-        _HighlightRect(rc_hib, DPI_SCALE(m_style.round_corner),
-                       DPI_SCALE(m_style.border), m_style.hilited_back_color,
-                       m_style.hilited_shadow_color, 0, roundInfo);
-        _TextOut(rc_hi, hilited_str, hilited_str.length(),
-                 m_style.hilited_text_color, pTextFormat);
-      }
-      if (range.end < static_cast<int>(t.length()) && !rc_after.IsRectNull()) {
-        // zzz[yyy]xxx
-        _TextOut(rc_after, after_str, after_str.length(), m_style.text_color,
-                 pTextFormat);
-      }
-    } else {
-      // No highlighted text, use the base rectangle from layout
-      CRect rcText =
-          isPreedit ? m_layout->GetPreeditRect() : m_layout->GetAuxiliaryRect();
-
-      // Apply m_istorepos offset if needed
-      if (m_istorepos) {
-        int offsetY = isPreedit ? m_offsety_preedit : m_offsety_aux;
-        rcText.OffsetRect(0, offsetY);
-      }
-
-      _TextOut(rcText, t.c_str(), t.length(), m_style.text_color, pTextFormat);
+      CRect rc_hib = rc_hi;
+      rc_hib.InflateRect(padx, pady);
+      const IsToRoundStruct &roundInfo = m_layout->GetTextRoundInfo();
+      _HighlightRect(rc_hib, DPI_SCALE(m_style.round_corner),
+                     DPI_SCALE(m_style.border), m_style.hilited_back_color,
+                     m_style.hilited_shadow_color, 0, roundInfo);
     }
+    m_canvas->DrawTextRun(_PlaceRect(rcText), run, m_style.text_color);
     if (m_candidateCount && !m_style.inline_preedit &&
         COLORNOTTRANSPARENT(m_style.prevpage_color) &&
         COLORNOTTRANSPARENT(m_style.nextpage_color)) {
@@ -567,7 +801,7 @@ bool WeaselPanel::_DrawPreedit(const Text &text, bool isPreedit) {
       // clickable color / disabled color
       int color =
           m_ctx.cinfo.currentPage ? m_style.prevpage_color : m_style.text_color;
-      _TextOut(prc, pre.c_str(), pre.length(), color, pTextFormat);
+      _TextOut(prc, pre.c_str(), pre.length(), color, kPreeditFont, true);
 
       CRect nrc = m_layout->GetNextpageRect();
       if (m_istorepos)
@@ -575,7 +809,7 @@ bool WeaselPanel::_DrawPreedit(const Text &text, bool isPreedit) {
       // clickable color / disabled color
       color = m_ctx.cinfo.is_last_page ? m_style.text_color
                                        : m_style.nextpage_color;
-      _TextOut(nrc, next.c_str(), next.length(), color, pTextFormat);
+      _TextOut(nrc, next.c_str(), next.length(), color, kPreeditFont, true);
     }
     drawn = true;
   }
@@ -590,7 +824,8 @@ CRect WeaselPanel::_GetInflatedCandRect(int i) {
     return rc;
   }
   rc = m_layout->GetCandidateRect(i);
-  if (m_istorepos)
+  // offsets are sized on paint, a hit test may come first after a layout
+  if (m_istorepos && i < (int)m_offsetys.size())
     rc.OffsetRect(0, m_offsetys[i]);
   const auto padx = DPI_SCALE(m_style.hilite_padding_x);
   const auto pady = DPI_SCALE(m_style.hilite_padding_y);
@@ -598,57 +833,81 @@ CRect WeaselPanel::_GetInflatedCandRect(int i) {
   return rc;
 }
 
-bool WeaselPanel::_DrawCandidates() {
-  bool drawn = false;
-  if (m_candidateCount <= 0)
-    return false;
-  const int highlighted = (m_ctx.cinfo.highlighted >= 0 &&
-                           m_ctx.cinfo.highlighted < m_candidateCount)
-                              ? m_ctx.cinfo.highlighted
-                              : -1;
-  const vector<Text> &candidates(m_ctx.cinfo.candies);
-  const vector<Text> &comments(m_ctx.cinfo.comments);
-  const vector<Text> &labels(m_ctx.cinfo.labels);
-  PtTextFormat &txtFormat = m_pD2D->pTextFormat;
-  PtTextFormat &labeltxtFormat = m_pD2D->pLabelFormat;
-  PtTextFormat &commenttxtFormat = m_pD2D->pCommentFormat;
-  auto padx = DPI_SCALE(m_style.hilite_padding_x);
-  auto pady = DPI_SCALE(m_style.hilite_padding_y);
-  const auto hilitefunc = [&](int i, uint32_t back_color, uint32_t shadow_color,
-                              uint32_t border_color, uint32_t border = 0) {
-    auto rect = _GetInflatedCandRect(i);
-    const IsToRoundStruct &roundInfo = m_layout->GetRoundInfo(i);
-    _HighlightRect(rect, DPI_SCALE(m_style.round_corner), DPI_SCALE(border),
-                   back_color, shadow_color, border_color, roundInfo);
-  };
+int WeaselPanel::_HitTestCandidate(const CPoint &point) {
+  if (!m_layout || hide_candidates)
+    return -1;
+  if (m_hitTestDirty) {
+    m_hitRects.resize(m_candidateCount);
+    for (int i = 0; i < m_candidateCount; i++) {
+      const CRect rc = _GetInflatedCandRect(i);
+      m_hitRects[i] = {rc.left, rc.top, rc.right, rc.bottom};
+    }
+    m_hitTest.Build(m_hitRects);
+    m_hitTestDirty = false;
+  }
+  return m_hitTest.Find(point.x, point.y);
+}
+
+void WeaselPanel::_HighlightCandidate(int i, uint32_t back_color,
+                                      uint32_t shadow_color,
+                                      uint32_t border_color, uint32_t border) {
+  auto rect = _GetInflatedCandRect(i);
+  const IsToRoundStruct &roundInfo = m_layout->GetRoundInfo(i);
+  _HighlightRect(rect, DPI_SCALE(m_style.round_corner), DPI_SCALE(border),
+                 back_color, shadow_color, border_color, roundInfo);
+}
+
+void WeaselPanel::_DrawCandidateShadows() {
+  const auto &cinfo = _LayoutContext().cinfo;
   for (auto i = 0; i < m_candidateCount; i++) {
     if (i == m_hoverIndex)
       continue;
-    bool hilited = (i == highlighted);
+    bool hilited = (i == cinfo.highlighted);
     int shadow_color = hilited ? m_style.hilited_candidate_shadow_color
                                : m_style.candidate_shadow_color;
     if (COLORNOTTRANSPARENT(shadow_color))
-      hilitefunc(i, 0, shadow_color, 0);
-    drawn = true;
+      _HighlightCandidate(i, 0, shadow_color, 0);
   }
+}
+
+void WeaselPanel::_DrawHover() {
   if (m_hoverIndex >= 0 && m_hoverIndex < m_candidateCount) {
-    hilitefunc(m_hoverIndex,
-               HALF_ALPHA_COLOR(m_style.hilited_candidate_back_color),
-               HALF_ALPHA_COLOR(m_style.hilited_candidate_shadow_color),
-               HALF_ALPHA_COLOR(m_style.hilited_candidate_border_color));
+    _HighlightCandidate(
+        m_hoverIndex, HALF_ALPHA_COLOR(m_style.hilited_candidate_back_color),
+        HALF_ALPHA_COLOR(m_style.hilited_candidate_shadow_color),
+        HALF_ALPHA_COLOR(m_style.hilited_candidate_border_color));
   }
+}
+
+bool WeaselPanel::_DrawCandidates() {
+  bool drawn = false;
+  if (m_candidateCount <= 0)
+    return false;
+  const auto &cinfo = _LayoutContext().cinfo;
+  const int highlighted =
+      (cinfo.highlighted >= 0 && cinfo.highlighted < m_candidateCount)
+          ? cinfo.highlighted
+          : -1;
+  const vector<Text> &candidates(cinfo.candies);
+  const vector<Text> &comments(cinfo.comments);
+  const vector<Text> &labels(cinfo.labels);
+  auto padx = DPI_SCALE(m_style.hilite_padding_x);
+  auto pady = DPI_SCALE(m_style.hilite_padding_y);
+  // with layers the highlighted back, border and mark go under the text of
+  // all candidates, to a layer of their own
+  DisplayList *const canvas = m_canvas;
+  DisplayList *const hilite_canvas = _Layered() ? &m_frame[3] : canvas;
   // draw highlighted background and text
   const auto drawText = [&](int i, const vector<Text> &texts, int color,
-                            PtTextFormat &textFormat, CRect rc) {
+                            RenderFont font, CRect rc) {
     if (i < 0 || i >= (int)texts.size())
       return;
     const auto &text = texts[i].str;
-    if (COLORTRANSPARENT(color) || rc.IsRectNull() || text.empty() ||
-        !textFormat.Get())
+    if (COLORTRANSPARENT(color) || rc.IsRectNull() || text.empty())
       return;
     if (m_istorepos)
       rc.OffsetRect(0, m_offsetys[i]);
-    _TextOut(rc, text, text.length(), color, textFormat);
+    _TextOut(rc, text, text.length(), color, font);
   };
   for (auto i = 0; i < m_candidateCount; i++) {
     bool hilited = (i == highlighted);
@@ -662,26 +921,30 @@ bool WeaselPanel::_DrawCandidates() {
                              : m_style.candidate_back_color;
     int border_color = hilited ? m_style.hilited_candidate_border_color
                                : m_style.candidate_border_color;
-    hilitefunc(i, back_color, 0, border_color, m_style.border);
+    m_canvas = hilited ? hilite_canvas : canvas;
+    _HighlightCandidate(i, back_color, 0, border_color, m_style.border);
+    m_canvas = canvas;
     if (i >= 0 && i < (int)labels.size()) {
       auto rc = m_layout->GetCandidateLabelRect(i);
       auto label = FormatCandidateLabel(labels[i].str,
                                         m_style.label_text_format.c_str());
       if (!COLORTRANSPARENT(label_text_color) && !rc.IsRectNull() &&
-          !label.empty() && labeltxtFormat.Get()) {
+          !label.empty()) {
         if (m_istorepos)
           rc.OffsetRect(0, m_offsetys[i]);
-        _TextOut(rc, label, label.length(), label_text_color, labeltxtFormat);
+        _TextOut(rc, label, label.length(), label_text_color, kLabelFont,
+                 true);
       }
     }
-    drawText(i, candidates, candidate_text_color, txtFormat,
+    drawText(i, candidates, candidate_text_color, kTextFont,
              m_layout->GetCandidateTextRect(i));
-    drawText(i, comments, comment_text_color, commenttxtFormat,
+    drawText(i, comments, comment_text_color, kCommentFont,
              m_layout->GetCandidateCommentRect(i));
     drawn = true;
   }
   // draw highlight mark
   if (COLORNOTTRANSPARENT(m_style.hilited_mark_color) && highlighted >= 0) {
+    m_canvas = hilite_canvas;
     CRect rc = _GetInflatedCandRect(highlighted);
     if (!m_style.mark_text.empty()) {
       int vgap =
@@ -698,7 +961,7 @@ bool WeaselPanel::_DrawCandidates() {
         hlRc = CRect(rc.left + padx, rc.top + vgap,
                      rc.left + padx + m_layout->mark_width, rc.bottom - vgap);
       _TextOut(hlRc, m_style.mark_text.c_str(), m_style.mark_text.length(),
-               m_style.hilited_mark_color, txtFormat);
+               m_style.hilited_mark_color, kTextFont, true);
     } else {
       int height = MIN(rc.Height() - pady * 2,
                        rc.Height() - DPI_SCALE(m_style.round_corner) * 2);
@@ -727,53 +990,29 @@ bool WeaselPanel::_DrawCandidates() {
       _HighlightRect(mkrc, mark_radius, 0, m_style.hilited_mark_color, 0, 0,
                      roundInfo);
     }
+    m_canvas = canvas;
   }
   return drawn;
 }
 
-void WeaselPanel::_TextOut(CRect &rc, const wstring &text, size_t cch,
-                           uint32_t color, PtTextFormat &pTextFormat) {
-  if (!pTextFormat.Get() || !m_pD2D || !m_pD2D->m_pWriteFactory)
-    return;
-  m_pD2D->SetBrushColor(color);
+TextRun WeaselPanel::_MakeTextRun(const wstring &text, size_t cch,
+                                  RenderFont font) const {
+  TextRun run;
+  run.text = text.c_str();
+  run.length = cch;
+  run.font = font;
+  run.vertical =
+      m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
+      m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN;
+  run.left_to_right = m_style.vertical_text_left_to_right;
+  return run;
+}
 
-  ComPtr<IDWriteTextLayout> pTextLayout;
-  HRESULT hr = m_pD2D->m_pWriteFactory->CreateTextLayout(
-      text.c_str(), cch, pTextFormat.Get(), rc.Width(), rc.Height(),
-      reinterpret_cast<IDWriteTextLayout **>(pTextLayout.GetAddressOf()));
-  if (FAILED(hr) || !pTextLayout)
-    return;
-  if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-      m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN) {
-    DWRITE_FLOW_DIRECTION flow = m_style.vertical_text_left_to_right
-                                     ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
-                                     : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
-    pTextLayout->SetReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-    pTextLayout->SetFlowDirection(flow);
-  } else {
-    pTextLayout->SetReadingDirection(DWRITE_READING_DIRECTION_LEFT_TO_RIGHT);
-    pTextLayout->SetFlowDirection(DWRITE_FLOW_DIRECTION_TOP_TO_BOTTOM);
-  }
-  float offsetx = (float)rc.left;
-  float offsety = (float)rc.top;
-
-  DWRITE_OVERHANG_METRICS omt;
-  pTextLayout->GetOverhangMetrics(&omt);
-  if (m_style.layout_type != UIStyle::LAYOUT_VERTICAL_TEXT &&
-      m_style.layout_type != UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN &&
-      omt.left > 0)
-    offsetx += omt.left;
-  if ((m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT ||
-       m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT_FULLSCREEN) &&
-      omt.top > 0)
-    offsety += omt.top;
-
-  m_pD2D->DrawTextLayout(pTextLayout, offsetx, offsety, color);
-  // draw rectangle for debug
-  // m_pD2D->dc->DrawRectangle(
-  //     D2D1::RectF((float)rc.left, (float)rc.top, (float)rc.right,
-  //                 (float)rc.bottom),
-  //     m_pD2D->m_pBrush.Get(), 1.0f); // 1.0f is the border width
+void WeaselPanel::_TextOut(CRect &rc, const wstring &text, size_t cch,
+                           uint32_t color, RenderFont font, bool repeated) {
+  TextRun run = _MakeTextRun(text, cch, font);
+  run.repeated = repeated;
+  m_canvas->DrawTextRun(_PlaceRect(rc), run, color);
 }
 
 void WeaselPanel::_HighlightRect(const RECT &rect, float radius,
@@ -782,93 +1021,139 @@ void WeaselPanel::_HighlightRect(const RECT &rect, float radius,
                                  const IsToRoundStruct &roundInfo) {
   if (roundInfo.Hemispherical)
     radius = DPI_SCALE(m_style.round_corner_ex) - DPI_SCALE(border) / 2.0f;
+  const PlaceRect rc = _PlaceRect(rect);
+  RenderCorners corners;
+  corners.top_left = roundInfo.IsTopLeftNeedToRound;
+  corners.top_right = roundInfo.IsTopRightNeedToRound;
+  corners.bottom_left = roundInfo.IsBottomLeftNeedToRound;
+  corners.bottom_right = roundInfo.IsBottomRightNeedToRound;
   // draw shadow
   if (COLORNOTTRANSPARENT(shadow_color) && DPI_SCALE(m_style.shadow_radius))
-    m_pD2D->FillGeometry(rect, shadow_color, radius, roundInfo, true);
+    m_canvas->FillShadow(rc, radius, corners,
+                         DPI_SCALE(m_style.shadow_offset_x),
+                         DPI_SCALE(m_style.shadow_offset_y),
+                         m_pD2D->m_dpiScaleLayout * m_style.shadow_radius,
+                         shadow_color);
   // draw back color
   if (COLORNOTTRANSPARENT(back_color))
-    m_pD2D->FillGeometry(rect, back_color, radius, roundInfo);
+    m_canvas->FillRoundedRect(rc, radius, corners, back_color);
   // draw border
-  if (COLORNOTTRANSPARENT(border_color) && border) {
-    float hb = -(float)border / 2;
-    ComPtr<ID2D1PathGeometry> pGeometry;
-    HR(m_pD2D->CreateRoundedRectanglePath(rect, radius + hb, roundInfo,
-                                          pGeometry));
-    m_pD2D->SetBrushColor(border_color);
-    m_pD2D->dc->DrawGeometry(pGeometry.Get(), m_pD2D->m_pBrush.Get(), border);
+  if (COLORNOTTRANSPARENT(border_color) && border)
+    m_canvas->StrokeRoundedRect(rc, radius - (float)border / 2, corners,
+                                (float)border, border_color);
+}
+
+// monitor topology, rebuilt after WM_DISPLAYCHANGE, WM_DPICHANGED or a work
+// area change instead of queried on every reposition
+static std::vector<MonitorArea> monitor_cache;
+static bool monitor_cache_valid = false;
+
+static BOOL CALLBACK _AddMonitor(HMONITOR hMonitor, HDC, LPRECT, LPARAM) {
+  MONITORINFO info;
+  info.cbSize = sizeof(MONITORINFO);
+  if (GetMonitorInfo(hMonitor, &info)) {
+    const RECT &m = info.rcMonitor;
+    const RECT &w = info.rcWork;
+    monitor_cache.push_back({{m.left, m.top, m.right, m.bottom},
+                             {w.left, w.top, w.right, w.bottom}});
   }
+  return TRUE;
+}
+
+static const std::vector<MonitorArea> &_GetMonitors() {
+  if (!monitor_cache_valid) {
+    monitor_cache.clear();
+    EnumDisplayMonitors(NULL, NULL, _AddMonitor, 0);
+    monitor_cache_valid = true;
+  }
+  return monitor_cache;
 }
 
 void WeaselPanel::_Reposition(bool adj) {
   if (!m_layout || !m_hWnd)
     return;
-  RECT rcWorkArea;
-  memset(&rcWorkArea, 0, sizeof(rcWorkArea));
-  HMONITOR hMonitor = MonitorFromRect(&m_inputPos, MONITOR_DEFAULTTONEAREST);
-  if (hMonitor) {
-    MONITORINFO info;
-    info.cbSize = sizeof(MONITORINFO);
-    if (GetMonitorInfo(hMonitor, &info)) {
-      rcWorkArea = info.rcWork;
-    }
-    if (hMonitor != m_hMonitor) {
-      m_hMonitor = hMonitor;
-      m_redraw_by_monitor_change = true;
-    }
+  PlacementInput in;
+  in.anchor = {m_inputPos.left, m_inputPos.top, m_inputPos.right,
+               m_inputPos.bottom};
+  in.width = m_windowSize.cx;
+  in.height = m_windowSize.cy;
+  in.offset_x = m_layout->offsetX;
+  in.offset_y = m_layout->offsetY;
+  in.shadow_radius = DPI_SCALE(m_style.shadow_radius);
+  in.shadow_offset_x = DPI_SCALE(m_style.shadow_offset_x);
+  in.shadow_offset_y = DPI_SCALE(m_style.shadow_offset_y);
+  in.shadow_transparent = COLORTRANSPARENT(m_style.shadow_color);
+  in.vertical_text_rtl =
+      m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT &&
+      !m_style.vertical_text_left_to_right;
+  in.auto_reverse = m_style.vertical_auto_reverse &&
+                    m_style.layout_type == UIStyle::LAYOUT_VERTICAL;
+  in.adjust = adj;
+  in.sticky = m_sticky;
+  in.reversed = m_istorepos;
+  const std::vector<MonitorArea> &monitors = _GetMonitors();
+  const Placement out = PlacePanel(in, monitors);
+  const PlaceRect monitor =
+      out.monitor >= 0 ? monitors[out.monitor].monitor : PlaceRect();
+  if (monitor != m_monitor) {
+    m_monitor = monitor;
+    m_redraw_by_monitor_change = true;
+    // measure the candidate window again for the new work area
+    m_visibleCount = MAX_CANDIDATES_COUNT;
   }
-  CRect rcWindow;
-  GetWindowRect(m_hWnd, &rcWindow);
-  int width = rcWindow.Width();
-  int height = rcWindow.Height();
-  rcWorkArea.right -= width;
-  rcWorkArea.bottom -= height;
-  int x = m_inputPos.left;
-  int y = m_inputPos.bottom;
-  if (DPI_SCALE(m_style.shadow_radius)) {
-    x -= (DPI_SCALE(m_style.shadow_offset_x) >= 0 ||
-          COLORTRANSPARENT(m_style.shadow_color))
-             ? m_layout->offsetX
-             : (m_layout->offsetX / 2);
-    if (adj)
-      y -= (DPI_SCALE(m_style.shadow_offset_y) > 0 ||
-            COLORTRANSPARENT(m_style.shadow_color))
-               ? m_layout->offsetY
-               : (m_layout->offsetY / 2);
-  }
-  if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT &&
-      !m_style.vertical_text_left_to_right) {
-    x += m_layout->offsetX - width;
-    if (DPI_SCALE(m_style.shadow_offset_x) < 0)
-      x += m_layout->offsetX;
-  }
-  if (adj)
-    m_istorepos = false;
-  if (x > rcWorkArea.right)
-    x = rcWorkArea.right;
-  if (x < rcWorkArea.left)
-    x = rcWorkArea.left;
-  if (y > rcWorkArea.bottom || m_sticky) {
-    if (!m_sticky)
-      m_sticky = true;
-    y = m_inputPos.top - height - 6;
-    if (DPI_SCALE(m_style.shadow_radius) &&
-        DPI_SCALE(m_style.shadow_offset_y) > 0)
-      y -= DPI_SCALE(m_style.shadow_offset_y);
-    m_istorepos = (m_style.vertical_auto_reverse &&
-                   m_style.layout_type == UIStyle::LAYOUT_VERTICAL);
-    if (DPI_SCALE(m_style.shadow_radius) > 0)
-      y += (DPI_SCALE(m_style.shadow_offset_y) < 0 ||
-            COLORTRANSPARENT(m_style.shadow_color))
-               ? m_layout->offsetY
-               : (m_layout->offsetY / 2);
-  }
-  if (y < rcWorkArea.top)
-    y = rcWorkArea.top;
-  m_inputPos.bottom = y;
-  SetWindowPos(m_hWnd, HWND_TOPMOST, x, y, 0, 0,
+  m_sticky = out.sticky;
+  m_istorepos = out.reversed;
+  m_inputPos.bottom = out.y;
+  SetWindowPos(m_hWnd, HWND_TOPMOST, out.x, out.y, 0, 0,
                SWP_NOSIZE | SWP_NOACTIVATE | SWP_NOREDRAW);
 }
 
+// A page longer than MAX_CANDIDATES_COUNT that runs off the work area of its
+// monitor keeps only the leading candidates that fit; the rest are reached by
+// scrolling the window with the highlight. Shorter pages are laid out whole,
+// as before. True when m_visibleCount shrank and the page must be sliced and
+// laid out again.
+bool WeaselPanel::_FitCandidateWindow() {
+  // fullscreen layouts fit by shrinking the font instead
+  if (IS_FULLSCREENLAYOUT(m_style) || !m_virtualized || m_candidateCount <= 1)
+    return false;
+  const std::vector<MonitorArea> &monitors = _GetMonitors();
+  const PlaceRect anchor = {m_inputPos.left, m_inputPos.top, m_inputPos.right,
+                            m_inputPos.bottom};
+  const int index = PickMonitor(monitors, anchor);
+  if (index < 0)
+    return false;
+  const PlaceRect &work = monitors[index].work;
+  const CSize &size = m_layout->GetContentSize();
+  if (size.cx <= work.right - work.left && size.cy <= work.bottom - work.top)
+    return false;
+  // the margin past the candidates, no wider than the one before them; the
+  // preedit or aux may be what makes the content wide
+  const CRect &first = m_layout->GetCandidateRect(0);
+  int right = 0, bottom = 0;
+  for (int i = 0; i < m_candidateCount; i++) {
+    const CRect &rc = m_layout->GetCandidateRect(i);
+    right = MAX(right, (int)rc.right);
+    bottom = MAX(bottom, (int)rc.bottom);
+  }
+  const int avail_w = work.right - work.left -
+                      MAX(0, MIN(size.cx - right, (int)first.left));
+  const int avail_h = work.bottom - work.top -
+                      MAX(0, MIN(size.cy - bottom, (int)first.top));
+  int fit = 0;
+  while (fit < m_candidateCount) {
+    const CRect &rc = m_layout->GetCandidateRect(fit);
+    if (rc.right > avail_w || rc.bottom > avail_h)
+      break;
+    fit++;
+  }
+  fit = MAX(fit, 1);
+  if (fit >= m_candidateCount)
+    return false;
+  m_visibleCount = fit;
+  return true;
+}
+
 static HBITMAP CopyDCToBitmap(HDC hDC, LPRECT lpRect) {
   if (!hDC || !lpRect || IsRectEmpty(lpRect))
     return NULL;
@@ -913,7 +1198,13 @@ void WeaselPanel::OnDestroy() {
   _ClearTimers();
 
   m_hoverIndex = -1;
-  m_layout.reset();
+  m_layout = nullptr;
+  m_layouts.clear();
+  for (auto &list : m_frame)
+    list.Clear();
+  _ForgetShown();
+  m_frameDirty = true;
+  m_hitTestDirty = true;
   m_sticky = false;
   m_dragging = false;
 }
@@ -945,41 +1236,53 @@ LRESULT WeaselPanel::OnMouseMove(UINT uMsg, WPARAM wParam, LPARAM lParam) {
   if (m_style.hover_type == UIStyle::NONE)
     return 0;
   CPoint point(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
-  bool hovered = false;
-  bool hover_index_change = false;
   CPoint ptScreen = point;
   ClientToScreen(m_hWnd, &ptScreen);
   if (ptScreen == m_lastCursorPos)
     return 0;
   m_lastCursorPos = ptScreen;
-  for (int i = 0; i < m_candidateCount; i++) {
-    CRect rect = _GetInflatedCandRect(i);
-    if (rect.PtInRect(point)) {
-      hovered = true;
-      if (i != m_ctx.cinfo.highlighted) {
-        if (m_style.hover_type == UIStyle::HoverType::HILITE) {
-          if (m_uiCallback) {
-            size_t hover_index = i;
-            m_uiCallback(nullptr, &hover_index, nullptr, nullptr);
-          }
-        } else if (m_hoverIndex != i) {
-          m_hoverIndex = i;
-          hover_index_change = true;
+  // coalesce a burst of moves, the timer takes the latest point
+  const ULONGLONG now = ::GetTickCount64();
+  if (now - m_lastHoverTick < HOVER_INTERVAL) {
+    m_pendingHover = point;
+    if (!m_hoverTimer)
+      m_hoverTimer = ::SetTimer(m_hWnd, HOVER_TIMER,
+                                HOVER_INTERVAL - (UINT)(now - m_lastHoverTick),
+                                NULL);
+    return 0;
+  }
+  _UpdateHover(point);
+  return 0;
+}
+
+void WeaselPanel::_UpdateHover(const CPoint &point) {
+  m_lastHoverTick = ::GetTickCount64();
+  bool hover_index_change = false;
+  const int i = _HitTestCandidate(point);
+  if (i >= 0) {
+    if (i != _LayoutContext().cinfo.highlighted) {
+      if (m_style.hover_type == UIStyle::HoverType::HILITE) {
+        if (m_uiCallback) {
+          size_t hover_index = m_candidateFirst + i;
+          m_uiCallback(nullptr, &hover_index, nullptr, nullptr);
         }
-      } else if (m_style.hover_type == UIStyle::HoverType::SEMI_HILITE &&
-                 m_hoverIndex != -1) {
-        m_hoverIndex = -1;
+      } else if (m_hoverIndex != i) {
+        m_hoverIndex = i;
         hover_index_change = true;
       }
+    } else if (m_style.hover_type == UIStyle::HoverType::SEMI_HILITE &&
+               m_hoverIndex != -1) {
+      m_hoverIndex = -1;
+      hover_index_change = true;
     }
-  }
-  if (!hovered && m_hoverIndex >= 0) {
+  } else if (m_hoverIndex >= 0) {
     m_hoverIndex = -1;
     hover_index_change = true;
   }
-  if (hover_index_change)
-    RedrawWindow();
-  return 0;
+  if (hover_index_change) {
+    m_hoverDirty = true;
+    InvalidateRect(m_hWnd, nullptr, true);
+  }
 }
 
 LRESULT WeaselPanel::OnMouseActive(UINT uMsg, WPARAM wParam, LPARAM lParam) {
@@ -1007,10 +1310,11 @@ LRESULT WeaselPanel::OnLeftClickUp(UINT uMsg, WPARAM wParam, LPARAM lParam) {
   }
   if (hide_candidates || m_candidateCount <= 0)
     return 0;
-  const int highlighted = (m_ctx.cinfo.highlighted >= 0 &&
-                           m_ctx.cinfo.highlighted < m_candidateCount)
-                              ? m_ctx.cinfo.highlighted
-                              : -1;
+  const auto &cinfo = _LayoutContext().cinfo;
+  const int highlighted =
+      (cinfo.highlighted >= 0 && cinfo.highlighted < m_candidateCount)
+          ? cinfo.highlighted
+          : -1;
   if (highlighted < 0)
     return 0;
   CPoint point(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
@@ -1021,11 +1325,11 @@ LRESULT WeaselPanel::OnLeftClickUp(UINT uMsg, WPARAM wParam, LPARAM lParam) {
 
   auto rect = _GetInflatedCandRect(highlighted);
   if (rect.PtInRect(point)) {
-    size_t i = (size_t)highlighted;
+    size_t i = (size_t)(m_candidateFirst + highlighted);
     if (m_uiCallback) {
       m_uiCallback(&i, nullptr, nullptr, nullptr);
       if (!m_status.composing)
-        DestroyWindow();
+        ShowWindow(SW_HIDE);
     }
   } else {
     RedrawWindow();
@@ -1044,10 +1348,11 @@ LRESULT WeaselPanel::OnLeftClickDown(UINT uMsg, WPARAM wParam, LPARAM lParam) {
   }
   if (hide_candidates || m_candidateCount <= 0)
     return 0;
-  const int highlighted = (m_ctx.cinfo.highlighted >= 0 &&
-                           m_ctx.cinfo.highlighted < m_candidateCount)
-                              ? m_ctx.cinfo.highlighted
-                              : -1;
+  const auto &cinfo = _LayoutContext().cinfo;
+  const int highlighted =
+      (cinfo.highlighted >= 0 && cinfo.highlighted < m_candidateCount)
+          ? cinfo.highlighted
+          : -1;
   CPoint point(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
   auto padx = DPI_SCALE(m_style.hilite_padding_x);
   auto pady = DPI_SCALE(m_style.hilite_padding_y);
@@ -1114,20 +1419,19 @@ LRESULT WeaselPanel::OnLeftClickDown(UINT uMsg, WPARAM wParam, LPARAM lParam) {
       }
     }
     // select by click relative actions
-    for (size_t i = 0; i < m_candidateCount && i < MAX_CANDIDATES_COUNT; ++i) {
-      auto rect = _GetInflatedCandRect(i);
-      if (rect.PtInRect(point)) {
-        m_bar_scale = 0.8f;
-        //  modify highlighted
-        if (i != m_ctx.cinfo.highlighted) {
-          if (m_uiCallback)
-            m_uiCallback(NULL, &i, NULL, NULL);
-        } else {
-          RedrawWindow();
-        }
-        m_clickTimer = ::SetTimer(m_hWnd, AUTOREV_TIMER, 1000, NULL);
-        return 0;
+    const int hit = _HitTestCandidate(point);
+    if (hit >= 0) {
+      size_t i = m_candidateFirst + hit;
+      m_bar_scale = 0.8f;
+      //  modify highlighted
+      if (hit != cinfo.highlighted) {
+        if (m_uiCallback)
+          m_uiCallback(NULL, &i, NULL, NULL);
+      } else {
+        RedrawWindow();
       }
+      m_clickTimer = ::SetTimer(m_hWnd, AUTOREV_TIMER, 1000, NULL);
+      return 0;
     }
   }
   return 0;
@@ -1170,12 +1474,21 @@ LRESULT WeaselPanel::MsgHandler(HWND hwnd, UINT uMsg, WPARAM wParam,
     return OnLeftClickUp(uMsg, wParam, lParam);
   case WM_LBUTTONDOWN:
     return OnLeftClickDown(uMsg, wParam, lParam);
+  case WM_DISPLAYCHANGE:
+    monitor_cache_valid = false;
+    break;
+  case WM_SETTINGCHANGE:
+    if (wParam == SPI_SETWORKAREA)
+      monitor_cache_valid = false;
+    break;
   case WM_DPICHANGED:
+    monitor_cache_valid = false;
     if (lParam) {
       const auto *rc = reinterpret_cast<RECT *>(lParam);
       ::SetWindowPos(hwnd, nullptr, rc->left, rc->top, rc->right - rc->left,
                      rc->bottom - rc->top,
                      SWP_NOZORDER | SWP_NOACTIVATE | SWP_NOREDRAW);
+      m_windowSize = {rc->right - rc->left, rc->bottom - rc->top};
     }
     if (m_pD2D) {
       m_pD2D->InitDpiInfo();
@@ -1189,7 +1502,7 @@ LRESULT WeaselPanel::MsgHandler(HWND hwnd, UINT uMsg, WPARAM wParam,
       ::KillTimer(m_hWnd, AUTOREV_TIMER);
       m_clickTimer = 0;
       m_bar_scale = 1.0f;
-      InvalidateRect(m_hWnd, nullptr, TRUE);
+      RedrawWindow();
       return 0;
     } else if (wParam == AUTOHIDE_TIMER) {
       ::KillTimer(m_hWnd, AUTOHIDE_TIMER);
@@ -1197,6 +1510,25 @@ LRESULT WeaselPanel::MsgHandler(HWND hwnd, UINT uMsg, WPARAM wParam,
       // hide the panel on auto-hide
       ShowWindow(SW_HIDE);
       return 0;
+    } else if (wParam == RELEASE_TIMER) {
+      _ReleaseIdleResources();
+      return 0;
+    } else if (wParam == PAINT_TIMER) {
+      ::KillTimer(m_hWnd, PAINT_TIMER);
+      m_paintTimer = 0;
+      if (m_renderer->PresentPending()) {
+        if (!m_renderer->RetryPresent())
+          _SchedulePaint();
+      } else {
+        DoPaint();
+      }
+      return 0;
+    } else if (wParam == HOVER_TIMER) {
+      ::KillTimer(m_hWnd, HOVER_TIMER);
+      m_hoverTimer = 0;
+      if (m_style.hover_type != UIStyle::NONE && !m_preview_mode)
+        _UpdateHover(m_pendingHover);
+      return 0;
     }
   }
   return DefWindowProc(hwnd, uMsg, wParam, lParam);
@@ -1,6 +1,10 @@
 #include <WeaselUI.h>
 
+#include "D2DRenderBackend.h"
+#include "DisplayList.h"
+#include "HitTest.h"
 #include "Layout.h"
+#include "Placement.h"
 #include "d2d.h"
 #include <utils.h>
 
@@ -31,27 +35,79 @@ public:
   BOOL Create(HWND parent, bool preview_mode = false);
   void SetPreviewMode(bool enabled) { m_preview_mode = enabled; }
   bool GetIsReposition() { return m_istorepos; }
+  // render stats, for the debug log
+  void LogStats() const;
 
   static const int AUTOREV_TIMER = 20241209;
   static const int AUTOHIDE_TIMER = 20241107;
+  static const int RELEASE_TIMER = 20250312;
+  static const int HOVER_TIMER = 20250610;
+  // mouse moves are hit tested at most once per HOVER_INTERVAL ms, about a
+  // frame; the latest point is picked up by HOVER_TIMER
+  static const UINT HOVER_INTERVAL = 16;
+  static const int PAINT_TIMER = 20250702;
+  // a paint waits for the swap chain on PAINT_TIMER instead of blocking in
+  // Present, at most this many times in a row
+  static const int MAX_DEFERRED_PAINTS = 2;
+  // the hidden panel keeps its window and swap chain; GPU resources are
+  // released after RESOURCE_IDLE_TIMEOUT ms hidden, or on hide right away
+  // when the swap chain is larger than RESOURCE_BUDGET bytes
+  static const UINT RESOURCE_IDLE_TIMEOUT = 5 * 60 * 1000;
+  static const size_t RESOURCE_BUDGET = 16 * 1024 * 1024;
 
   HWND hwnd() const;
 
 private:
-  void RedrawWindow() { InvalidateRect(m_hWnd, nullptr, true); }
+  // the frame is recorded again on the next paint
+  void RedrawWindow() {
+    m_frameDirty = true;
+    InvalidateRect(m_hWnd, nullptr, true);
+  }
   void _CreateLayout();
   bool _DrawPreedit(const Text &text, bool isPreedit);
   bool _DrawCandidates();
+  void _DrawCandidateShadows();
+  void _DrawHover();
+  void _HighlightCandidate(int i, uint32_t back_color, uint32_t shadow_color,
+                           uint32_t border_color, uint32_t border = 0);
+  void _RecordFrame();
+  // m_frame[i] on layer, at its bounds; the same ops at another place only
+  // move the layer
+  void _PaintMovableLayer(int layer, int i);
+  // the next paint draws every part again
+  void _ForgetShown();
+  // forgets what is shown once the swap chain or the layers were recreated
+  void _CheckShown();
+  // false if the paint is deferred to PAINT_TIMER
+  bool _FrameReady();
+  void _SchedulePaint();
+  // hover and the highlighted candidate's back on their own composition
+  // layers, between candidate shadows and candidates, so that moving them
+  // leaves the rest of the frame alone
+  bool _Layered() const {
+    return m_style.hover_type == UIStyle::HoverType::SEMI_HILITE &&
+           !m_preview_mode;
+  }
   void _ResizeWindow();
   void _Reposition(bool adj = false);
+  TextRun _MakeTextRun(const wstring &text, size_t cch, RenderFont font) const;
+  // repeated: labels, page arrows and mark text, see TextRun
   void _TextOut(CRect &rc, const wstring &text, size_t cch, uint32_t color,
-                ComPtr<IDWriteTextFormat1> &pTextFormat);
+                RenderFont font, bool repeated = false);
   void _HighlightRect(const RECT &rect, float radius, uint32_t border,
                       uint32_t back_color, uint32_t shadow_color,
                       uint32_t border_color, const IsToRoundStruct &roundInfo);
   CRect _GetInflatedCandRect(int i);
+  int _HitTestCandidate(const CPoint &point);
+  void _UpdateHover(const CPoint &point);
   void _CaptureRect(CRect &rect);
+  void _UpdateCandidateWindow();
+  bool _FitCandidateWindow();
   void _UpdateHideCandidates();
+  // what the layout sees: m_ctx, or the visible slice of a long page
+  const Context &_LayoutContext() const {
+    return m_virtualized ? m_view : m_ctx;
+  }
 
   void _UpdateOffsetY(CRect &arc, CRect &prc);
 
@@ -69,6 +125,8 @@ private:
 
   // helper to clear any active timers
   void _ClearTimers();
+  void _ScheduleResourceRelease();
+  void _ReleaseIdleResources();
 
   RECT m_inputPos{0, 0, 0, 0};
   CPoint m_lastCursorPos = {-1, -1};
@@ -79,23 +137,70 @@ private:
   UIStyle &m_style;
   UIStyle &m_ostyle;
 
+  // candidates laid out, at most m_visibleCount; on a longer page they are
+  // m_ctx candidates [m_candidateFirst, m_candidateFirst + count)
   int m_candidateCount;
+  int m_candidateFirst = 0;
+  // how many candidates of a page longer than MAX_CANDIDATES_COUNT fit on the
+  // monitor, measured from the layout when the page runs off it; reset by
+  // another page, a style or a monitor change
+  int m_visibleCount = MAX_CANDIDATES_COUNT;
+  size_t m_windowPage = 0;
+  bool m_virtualized = false;
+  Context m_view;
   int m_lastCandidateCount = 0;
   int m_hoverIndex = -1;
   bool hide_candidates;
 
-  int m_offsetys[MAX_CANDIDATES_COUNT]; // offset y for candidates when
-                                        // vertical layout over bottom
+  // offset y for candidates when vertical layout over bottom, one per
+  // candidate laid out
+  std::vector<int> m_offsetys;
   int m_offsety_preedit = 0;
   int m_offsety_aux = 0;
   bool m_istorepos = false;
+  // candidate rects as _GetInflatedCandRect returns them, rebuilt lazily
+  // after a layout or a change of m_offsetys
+  CandidateHitTest m_hitTest;
+  std::vector<PlaceRect> m_hitRects;
+  bool m_hitTestDirty = true;
+  CPoint m_pendingHover = {-1, -1};
+  ULONGLONG m_lastHoverTick = 0;
   bool m_sticky = false;
   float m_bar_scale = 1.0f;
-  HMONITOR m_hMonitor = NULL;
+  // monitor rect of the last placement; an index into the monitor list
+  // could point at another monitor once the list is rebuilt
+  PlaceRect m_monitor;
+  // panel window size as last set, saves a GetWindowRect per reposition
+  SIZE m_windowSize{0, 0};
   bool m_redraw_by_monitor_change = false;
   // ------------------------------------------------------------
   an<D2D> m_pD2D;
-  the<Layout> m_layout;
+  // draws through m_pD2D
+  the<D2DRenderBackend> m_renderer;
+  // the recorded frame, replayed on each paint: background and preedit,
+  // candidate shadows, the hover highlight, the highlighted candidate's back
+  // and mark, then candidates and icon; a hover change records m_frame[1] and
+  // m_frame[2] only. When _Layered the first two go to the swap chain and the
+  // others to their own layers; otherwise m_frame[3] stays empty and the
+  // highlight is drawn in order with the other candidates.
+  DisplayList m_frame[5];
+  DisplayList *m_canvas = &m_frame[0];
+  // when _Layered, what the swap chain and the layers show of m_frame, and
+  // where; a part is drawn again only if its ops changed
+  DisplayList m_shown[5];
+  PlaceRect m_shownAt[5];
+  bool m_baseShown = false;
+  bool m_topShown = false;
+  uint64_t m_shownGeneration = 0;
+  bool m_frameDirty = true;
+  bool m_hoverDirty = false;
+  // layouts kept across refreshes, keyed by layout type and m_virtualized;
+  // m_layout points to the one in use
+  std::map<int, the<Layout>> m_layouts;
+  Layout *m_layout = nullptr;
+  // refreshes that created a layout or reset a pooled one, for LogStats
+  uint64_t m_layoutsCreated = 0;
+  uint64_t m_layoutsReused = 0;
   HICON m_iconAlpha;
   HICON m_iconEnabled;
   HICON m_iconFull;
@@ -117,6 +222,10 @@ private:
   RECT m_drag_window{0, 0, 0, 0};
   UINT_PTR m_clickTimer = 0;
   UINT_PTR m_autoHideTimer = 0;
+  UINT_PTR m_releaseTimer = 0;
+  UINT_PTR m_hoverTimer = 0;
+  UINT_PTR m_paintTimer = 0;
+  int m_deferredPaints = 0;
 
 public:
   void ShowWithTimeout(size_t millisec);
@@ -1,3 +1,4 @@
+#include "UIRemote.h"
 #include "WeaselPanel.h"
 #include <WeaselUI.h>
 
@@ -35,6 +36,8 @@ public:
 };
 // ----------------------------------------------------------------------------
 BOOL UI::IsCountingDown() const {
+  if (_Remote())
+    return remote_->IsCountingDown();
   return pimpl_ && pimpl_->panel.IsCountingDown();
 };
 
@@ -44,9 +47,16 @@ UI::~UI() {
   if (pimpl_)
     Destroy(true);
 }
-BOOL UI::IsShown() const { return pimpl_ && pimpl_->IsShown(); }
+bool UI::_Remote() const { return remote_ && remote_->Alive(); }
+BOOL UI::IsShown() const {
+  if (_Remote())
+    return remote_->IsShown();
+  return pimpl_ && pimpl_->IsShown();
+}
 void UI::UpdateInputPosition(RECT const &rc) {
-  if (pimpl_ && pimpl_->panel.IsWindow()) {
+  if (_Remote()) {
+    remote_->MoveTo(rc);
+  } else if (pimpl_ && pimpl_->panel.IsWindow()) {
     pimpl_->panel.MoveTo(rc);
   }
 }
@@ -67,6 +77,10 @@ void UI::Update(const Context &ctx, const Status &status) {
   Refresh();
 }
 void UI::Refresh() {
+  if (_Remote()) {
+    remote_->Refresh();
+    return;
+  }
   if (!pimpl_)
     return;
   if (ctx_.empty())
@@ -81,21 +95,29 @@ void UI::RepositionPreview() {
     pimpl_->RepositionPreview();
 }
 void UI::ShowWithTimeout(size_t millisec) {
-  if (pimpl_) {
+  if (_Remote()) {
+    remote_->ShowWithTimeout(millisec);
+  } else if (pimpl_) {
     pimpl_->ShowWithTimeout(millisec);
   }
 }
 void UI::Show() {
-  if (pimpl_) {
+  if (_Remote()) {
+    remote_->Show(true);
+  } else if (pimpl_) {
     pimpl_->Show();
   }
 }
 void UI::Hide() {
-  if (pimpl_) {
+  if (_Remote()) {
+    remote_->Show(false);
+  } else if (pimpl_) {
     pimpl_->Hide();
   }
 }
 void UI::Destroy(bool full) {
+  if (_Remote())
+    remote_->Show(false);
   if (pimpl_) {
     if (pimpl_->panel.IsWindow())
       pimpl_->panel.DestroyWindow();
@@ -107,6 +129,12 @@ void UI::Destroy(bool full) {
   }
 }
 bool UI::Create(HWND parent, bool preview_mode) {
+  if (remote_ && !preview_mode) {
+    if (remote_->Alive())
+      return true;
+    DEBUG << "UI server exited, drawing in this process again";
+    remote_.reset();
+  }
   if (pimpl_) {
     pimpl_->panel.SetPreviewMode(preview_mode);
     pimpl_->panel.Create(parent, preview_mode);
@@ -117,11 +145,36 @@ bool UI::Create(HWND parent, bool preview_mode) {
     return false;
   return pimpl_->panel.Create(parent, preview_mode);
 }
-bool UI::GetIsReposition() { return pimpl_ && pimpl_->panel.GetIsReposition(); }
+bool UI::GetIsReposition() {
+  if (_Remote())
+    return remote_->GetIsReposition();
+  return pimpl_ && pimpl_->panel.GetIsReposition();
+}
+
+void UI::LogStats() {
+  // a UI server keeps its stats in its own process
+  if (!_Remote() && pimpl_)
+    pimpl_->panel.LogStats();
+}
 
 HWND UI::hwnd() {
+  if (_Remote())
+    return remote_->hwnd();
   if (pimpl_ && pimpl_->panel.IsWindow())
     return pimpl_->panel.hwnd();
   return nullptr;
 }
+
+bool UI::StartServer() {
+  if (_Remote())
+    return true;
+  remote_ = std::make_unique<UIRemote>(*this);
+  if (!remote_->Start()) {
+    remote_.reset();
+    return false;
+  }
+  // the server draws from now on
+  Destroy(true);
+  return true;
+}
 } // namespace weasel
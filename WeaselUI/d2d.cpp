@@ -1,6 +1,7 @@
 #include "d2d.h"
 #include <Dwmapi.h>
 #include <ShellScalingApi.h>
+#include <cfloat>
 #include <wincodec.h>
 
 namespace weasel {
@@ -100,25 +101,191 @@ void D2D::ClearDeviceDependentCaches() {
   // text formats created from IDWriteFactory are generally immutable and can
   // survive device reset; however if DWriteFactory is reset, clear cache
   if (!m_pWriteFactory) {
-    for (auto &kv : textFormatCache) {
-      kv.second.Reset();
+    dpiResourceSets.clear();
+    fontFaceCache.clear();
+  }
+}
+
+D2D::DpiResourceSet &D2D::_DpiResources() {
+  const UINT dpi = (UINT)m_dpiY;
+  auto it = dpiResourceSets.find(dpi);
+  if (it == dpiResourceSets.end()) {
+    if (dpiResourceSets.size() >= MAX_DPI_RESOURCE_SETS) {
+      auto oldest = dpiResourceSets.begin();
+      for (auto i = dpiResourceSets.begin(); i != dpiResourceSets.end(); ++i)
+        if (i->second.used < oldest->second.used)
+          oldest = i;
+      dpiResourceSets.erase(oldest);
     }
-    textFormatCache.clear();
+    it = dpiResourceSets.emplace(dpi, DpiResourceSet()).first;
   }
+  it->second.used = ++dpiResourceTick;
+  return it->second;
 }
 
 void D2D::ReleaseWindowResources() {
   // detach DC target first
   if (dc)
     dc->SetTarget(nullptr);
+  ReleaseLayers();
   bitmap.Reset();
   surface.Reset();
   visual.Reset();
   target.Reset();
+  ReleaseFrameLatencyWaitable();
   swapChain.Reset();
   m_hWnd = nullptr;
 }
 
+void D2D::ReleaseFrameLatencyWaitable() {
+  if (frameLatencyWaitable) {
+    CloseHandle(frameLatencyWaitable);
+    frameLatencyWaitable = nullptr;
+  }
+}
+
+bool D2D::FrameReady() {
+  if (!frameLatencyWaitable)
+    return true;
+  return WaitForSingleObjectEx(frameLatencyWaitable, 0, TRUE) == WAIT_OBJECT_0;
+}
+
+size_t D2D::WindowResourceBytes() const {
+  DXGI_SWAP_CHAIN_DESC1 desc = {};
+  if (!swapChain || FAILED(swapChain->GetDesc1(&desc)))
+    return 0;
+  // B8G8R8A8, 4 bytes per pixel
+  size_t bytes = (size_t)desc.Width * desc.Height * 4 * desc.BufferCount;
+  for (const auto &layer : layers)
+    if (layer.surface)
+      bytes += (size_t)layer.width * layer.height * 4;
+  return bytes;
+}
+
+void D2D::ReleaseLayers() {
+  contentGeneration++;
+  for (auto &layer : layers) {
+    if (layer.visual && visual)
+      visual->RemoveVisual(layer.visual.Get());
+    layer = CompositionLayer();
+  }
+}
+
+HRESULT D2D::BeginLayerDraw(int i, UINT width, UINT height) {
+  if (!dc || !visual || !dcompDevice || i < 0 || i >= LAYER_COUNT)
+    return E_POINTER;
+  width = MAX(width, 1u);
+  height = MAX(height, 1u);
+  if (!layers[0].visual) {
+    // created together so that the z-order holds
+    for (int k = 0; k < LAYER_COUNT; k++) {
+      HRESULT hr =
+          dcompDevice->CreateVisual(layers[k].visual.ReleaseAndGetAddressOf());
+      if (SUCCEEDED(hr))
+        hr = visual->AddVisual(layers[k].visual.Get(), TRUE,
+                               k ? layers[k - 1].visual.Get() : nullptr);
+      if (FAILED(hr)) {
+        DEBUG << "create layer visual failed: " << StrzHr(hr);
+        ReleaseLayers();
+        return hr;
+      }
+    }
+  }
+  auto &layer = layers[i];
+  if (!layer.surface || width > layer.width || height > layer.height) {
+    layer.width = MAX(width, layer.width);
+    layer.height = MAX(height, layer.height);
+    HRESULT hr = dcompDevice->CreateSurface(
+        layer.width, layer.height, DXGI_FORMAT_B8G8R8A8_UNORM,
+        DXGI_ALPHA_MODE_PREMULTIPLIED, layer.surface.ReleaseAndGetAddressOf());
+    if (FAILED(hr)) {
+      DEBUG << "CreateSurface failed: " << StrzHr(hr);
+      layer.surface.Reset();
+      return hr;
+    }
+    layer.shown = false;
+  }
+  ComPtr<IDXGISurface> dxgiSurface;
+  POINT offset = {};
+  HRESULT hr = layer.surface->BeginDraw(
+      nullptr, __uuidof(IDXGISurface),
+      reinterpret_cast<void **>(dxgiSurface.GetAddressOf()), &offset);
+  if (FAILED(hr)) {
+    DEBUG << "IDCompositionSurface::BeginDraw failed: " << StrzHr(hr);
+    return hr;
+  }
+  D2D1_BITMAP_PROPERTIES1 properties = {};
+  properties.pixelFormat.alphaMode = D2D1_ALPHA_MODE_PREMULTIPLIED;
+  properties.pixelFormat.format = DXGI_FORMAT_B8G8R8A8_UNORM;
+  properties.bitmapOptions =
+      D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW;
+  hr = dc->CreateBitmapFromDxgiSurface(dxgiSurface.Get(), properties,
+                                       layer.bitmap.ReleaseAndGetAddressOf());
+  if (FAILED(hr)) {
+    DEBUG << "CreateBitmapFromDxgiSurface failed: " << StrzHr(hr);
+    layer.surface->EndDraw();
+    return hr;
+  }
+  // the surface may sit at offset in a shared atlas, clear only our part
+  dc->SetTarget(layer.bitmap.Get());
+  dc->BeginDraw();
+  dc->SetTransform(D2D1::Matrix3x2F::Translation((float)offset.x,
+                                                 (float)offset.y));
+  dc->PushAxisAlignedClip(
+      D2D1::RectF(0.0f, 0.0f, (float)layer.width, (float)layer.height),
+      D2D1_ANTIALIAS_MODE_ALIASED);
+  dc->Clear(D2D1::ColorF({0.0f, 0.0f, 0.0f, 0.0f}));
+  return S_OK;
+}
+
+HRESULT D2D::EndLayerDraw(int i) {
+  if (!dc || i < 0 || i >= LAYER_COUNT || !layers[i].bitmap)
+    return E_POINTER;
+  auto &layer = layers[i];
+  dc->PopAxisAlignedClip();
+  dc->SetTransform(D2D1::Matrix3x2F::Identity());
+  HRESULT hr = dc->EndDraw();
+  dc->SetTarget(bitmap.Get());
+  layer.bitmap.Reset();
+  layer.surface->EndDraw();
+  if (FAILED(hr)) {
+    DEBUG << "layer EndDraw failed: " << StrzHr(hr);
+    return hr;
+  }
+  if (!layer.shown) {
+    hr = layer.visual->SetContent(layer.surface.Get());
+    layer.shown = SUCCEEDED(hr);
+  }
+  return hr;
+}
+
+HRESULT D2D::MoveLayer(int i, int x, int y) {
+  if (i < 0 || i >= LAYER_COUNT || !layers[i].surface)
+    return E_POINTER;
+  auto &layer = layers[i];
+  if (!layer.shown) {
+    HRESULT hr = layer.visual->SetContent(layer.surface.Get());
+    FR(hr);
+    layer.shown = true;
+  }
+  HRESULT hr = layer.visual->SetOffsetX((float)x);
+  FR(hr);
+  return layer.visual->SetOffsetY((float)y);
+}
+
+HRESULT D2D::HideLayer(int i) {
+  if (i < 0 || i >= LAYER_COUNT || !layers[i].visual || !layers[i].shown)
+    return S_OK;
+  layers[i].shown = false;
+  return layers[i].visual->SetContent(nullptr);
+}
+
+HRESULT D2D::CommitLayers() {
+  if (!dcompDevice)
+    return E_POINTER;
+  return dcompDevice->Commit();
+}
+
 D2D::D2D(UIStyle &style)
     : m_style(style), m_hWnd(nullptr), m_dpiX(96.0f), m_dpiY(96.0f) {
   // Prepare shared device resources early so formats can be built before window
@@ -144,12 +311,16 @@ D2D::~D2D() {
                  d2Device, dc, surface, bitmap, dcompDevice, target, visual,
                  pPreeditFormat, pLabelFormat, pTextFormat, pCommentFormat,
                  m_pWriteFactory, m_pBrush);
-  textFormatCache.clear();
+  ReleaseFrameLatencyWaitable();
+  dpiResourceSets.clear();
+  fontFaceCache.clear();
 }
 
 void D2D::InitDirect2D() {
   // clear device-dependent caches before reinitializing
   ClearDeviceDependentCaches();
+  // the layers hang off the visual that is recreated below
+  ReleaseLayers();
 
   // Use shared device resources to avoid recreating expensive objects per
   // window
@@ -190,14 +361,28 @@ void D2D::InitDirect2D() {
   }
   description.Width = rect.right - rect.left;
   description.Height = rect.bottom - rect.top;
+  description.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
 
+  ReleaseFrameLatencyWaitable();
   hr = dxFactory->CreateSwapChainForComposition(
       dxgiDevice.Get(), &description, nullptr,
       swapChain.ReleaseAndGetAddressOf());
+  if (FAILED(hr)) {
+    // no waitable swap chains before Windows 8.1
+    description.Flags = 0;
+    hr = dxFactory->CreateSwapChainForComposition(
+        dxgiDevice.Get(), &description, nullptr,
+        swapChain.ReleaseAndGetAddressOf());
+  }
   if (FAILED(hr)) {
     DEBUG << "CreateSwapChainForComposition failed: " << StrzHr(hr);
     return;
   }
+  swapChainFlags = description.Flags;
+  ComPtr<IDXGISwapChain2> swapChain2;
+  if (swapChainFlags && SUCCEEDED(swapChain.As(&swapChain2)) &&
+      SUCCEEDED(swapChain2->SetMaximumFrameLatency(1)))
+    frameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
 
   // Retrieve the swap chain's back buffer
   hr = swapChain->GetBuffer(
@@ -267,13 +452,19 @@ void D2D::OnResize(UINT width, UINT height) {
     if (!dc || !swapChain || !visual || !target || !dcompDevice)
       return;
   }
+  // the same size keeps the buffers and what they show
+  DXGI_SWAP_CHAIN_DESC1 desc = {};
+  if (bitmap && SUCCEEDED(swapChain->GetDesc1(&desc)) &&
+      desc.Width == width && desc.Height == height)
+    return;
+  contentGeneration++;
   // Release Direct2D resources
   dc->SetTarget(nullptr);
   bitmap.Reset();
   surface.Reset();
   // Resize the swap chain
-  HRESULT hr =
-      swapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_B8G8R8A8_UNORM, 0);
+  HRESULT hr = swapChain->ResizeBuffers(
+      2, width, height, DXGI_FORMAT_B8G8R8A8_UNORM, swapChainFlags);
   if (hr == DXGI_ERROR_DEVICE_RESET || hr == DXGI_ERROR_DEVICE_REMOVED) {
     DEBUG << "Device lost during ResizeBuffers: " << StrzHr(hr);
     // attempt device recovery
@@ -303,33 +494,6 @@ void D2D::OnResize(UINT width, UINT height) {
   HR(dcompDevice->Commit());
 }
 
-std::vector<std::wstring> ws_split(const std::wstring &in,
-                                   const std::wstring &delim) {
-  std::wregex re{delim};
-  return std::vector<std::wstring>{
-      std::wsregex_token_iterator(in.begin(), in.end(), re, -1),
-      std::wsregex_token_iterator()};
-}
-
-static std::wstring MatchWordsOutLowerCaseTrim1st(const std::wstring &wstr,
-                                                  const std::wregex &pattern) {
-  std::wstring mat = L"";
-  std::wsmatch mc;
-  std::wstring::const_iterator iter = wstr.cbegin();
-  std::wstring::const_iterator end = wstr.cend();
-  while (regex_search(iter, end, mc, pattern)) {
-    for (const auto &m : mc) {
-      mat = m;
-      mat = mat.substr(1);
-      break;
-    }
-    iter = mc.suffix().first;
-  }
-  std::wstring res;
-  std::transform(mat.begin(), mat.end(), std::back_inserter(res), ::tolower);
-  return res;
-}
-
 PtTextFormat D2D::GetOrCreateTextFormat(const std::wstring &face, int point,
                                         DWRITE_WORD_WRAPPING wrap) {
   // safety checks: require write factory and valid point
@@ -348,8 +512,9 @@ PtTextFormat D2D::GetOrCreateTextFormat(const std::wstring &face, int point,
   PtTextFormat pFormat;
   {
     std::lock_guard<std::mutex> lk(cacheMutex);
-    auto it = textFormatCache.find(key);
-    if (it != textFormatCache.end()) {
+    auto &textFormats = _DpiResources().textFormats;
+    auto it = textFormats.find(key);
+    if (it != textFormats.end()) {
       pFormat = it->second;
     }
   }
@@ -357,31 +522,41 @@ PtTextFormat D2D::GetOrCreateTextFormat(const std::wstring &face, int point,
   if (!pFormat) {
     // create new text format
     static const std::wstring _mainFontFace = L"_InvalidFontName_";
-    DWRITE_FONT_WEIGHT fontWeight = DWRITE_FONT_WEIGHT_NORMAL;
-    DWRITE_FONT_STYLE fontStyle = DWRITE_FONT_STYLE_NORMAL;
-    DWRITE_FONT_STRETCH fontStretch = DWRITE_FONT_STRETCH_NORMAL;
-    ParseFontFace(face, fontWeight, fontStyle, fontStretch);
+    FontFace font;
+    {
+      std::lock_guard<std::mutex> lk(cacheMutex);
+      auto it = fontFaceCache.find(face);
+      if (it != fontFaceCache.end())
+        font = it->second;
+    }
+    if (!font.fallback) {
+      FontSpec spec;
+      ParseFontSpec(face, spec);
+      font.weight = (DWRITE_FONT_WEIGHT)spec.weight;
+      font.style = (DWRITE_FONT_STYLE)spec.style;
+      font.stretch = (DWRITE_FONT_STRETCH)spec.stretch;
+      HRESULT hr = CreateFontFallback(spec, font.fallback);
+      if (FAILED(hr))
+        DEBUG << "CreateFontFallback failed: " << StrzHr(hr);
+      std::lock_guard<std::mutex> lk(cacheMutex);
+      if (font.fallback)
+        fontFaceCache.emplace(face, font);
+    }
     ComPtr<IDWriteTextFormat> pFormatBase;
     HRESULT hr = m_pWriteFactory->CreateTextFormat(
-        _mainFontFace.c_str(), NULL, fontWeight, fontStyle, fontStretch,
+        _mainFontFace.c_str(), NULL, font.weight, font.style, font.stretch,
         point * m_dpiScaleFontPoint, L"", pFormatBase.ReleaseAndGetAddressOf());
     if (FAILED(hr) || !pFormatBase) {
       return PtTextFormat();
     }
     pFormatBase.As(&pFormat);
     pFormat->SetWordWrapping(wrap);
-
-    std::vector<std::wstring> fontFaceStrVector;
-    fontFaceStrVector = ws_split(face, L",");
-    static const std::wregex styleorweight((L":[^:]*[^a-f0-9:]+[^:]*"),
-                                           std::wregex::icase);
-    fontFaceStrVector[0] =
-        std::regex_replace(fontFaceStrVector[0], styleorweight, L"");
-    SetFontFallback(pFormat, fontFaceStrVector);
+    if (font.fallback)
+      pFormat->SetFontFallback(font.fallback.Get());
 
     {
       std::lock_guard<std::mutex> lk(cacheMutex);
-      textFormatCache.emplace(key, pFormat);
+      _DpiResources().textFormats.emplace(key, pFormat);
     }
   }
 
@@ -461,15 +636,26 @@ void D2D::InitDirectWriteResources() {
   InitFontFormats();
 }
 
-void D2D::SetBrushColor(uint32_t color) {
-  if (!m_pBrush)
-    return;
+static D2D1_COLOR_F to_colorf(uint32_t color) {
   float a = ((color >> 24) & 0xFF) / 255.0f;
   float b = ((color >> 16) & 0xFF) / 255.0f;
   float g = ((color >> 8) & 0xFF) / 255.0f;
   float r = (color & 0xFF) / 255.0f;
-  auto colorf = D2D1::ColorF(r, g, b, a);
-  m_pBrush->SetColor(colorf);
+  return D2D1::ColorF(r, g, b, a);
+}
+
+void D2D::SetBrushColor(uint32_t color) {
+  if (!m_pBrush)
+    return;
+  m_pBrush->SetColor(to_colorf(color));
+}
+
+HRESULT D2D::CreateBrush(uint32_t color,
+                         ComPtr<ID2D1SolidColorBrush> &pBrush) {
+  if (!dc)
+    return E_POINTER;
+  return dc->CreateSolidColorBrush(to_colorf(color),
+                                   pBrush.ReleaseAndGetAddressOf());
 }
 
 void D2D::InitDpiInfo() {
@@ -498,8 +684,10 @@ void D2D::InitDpiInfo() {
   m_dpiScaleLayout = m_dpiY / 96.0;
   if (m_dpiScaleFontPoint != oldDpiScaleFontPoint ||
       m_dpiScaleLayout != oldDpiScaleLayout) {
+    // the formats of the new DPI come from its resource set, warm if the
+    // panel has been on a monitor of that DPI before
     std::lock_guard<std::mutex> lk(cacheMutex);
-    textFormatCache.clear();
+    _DpiResources();
     pPreeditFormat.Reset();
     pTextFormat.Reset();
     pLabelFormat.Reset();
@@ -507,135 +695,78 @@ void D2D::InitDpiInfo() {
   }
 }
 
-void D2D::SetFontFallback(PtTextFormat textFormat,
-                          const std::vector<std::wstring> &fontVector) {
-  if (!m_pWriteFactory || !textFormat)
-    return;
+HRESULT D2D::CreateFontFallback(const FontSpec &spec,
+                                ComPtr<IDWriteFontFallback> &pFontFallback) {
+  if (!m_pWriteFactory)
+    return E_POINTER;
   ComPtr<IDWriteFontFallback> pSysFallback;
-  HR(m_pWriteFactory->GetSystemFontFallback(
-      pSysFallback.ReleaseAndGetAddressOf()));
-  ComPtr<IDWriteFontFallback> pFontFallback = NULL;
-  ComPtr<IDWriteFontFallbackBuilder> pFontFallbackBuilder = NULL;
-  HR(m_pWriteFactory->CreateFontFallbackBuilder(
-      pFontFallbackBuilder.ReleaseAndGetAddressOf()));
-  std::vector<std::wstring> fallbackFontsVector;
-  for (UINT32 i = 0; i < fontVector.size(); i++) {
-    fallbackFontsVector = ws_split(fontVector[i], L":");
-    std::wstring _fontFaceWstr, firstWstr, lastWstr;
-    if (fallbackFontsVector.size() == 3) {
-      _fontFaceWstr = fallbackFontsVector[0];
-      firstWstr = fallbackFontsVector[1];
-      lastWstr = fallbackFontsVector[2];
-      if (lastWstr.empty())
-        lastWstr = L"10ffff";
-      if (firstWstr.empty())
-        firstWstr = L"0";
-    } else if (fallbackFontsVector.size() == 2) // fontName : codepoint
-    {
-      _fontFaceWstr = fallbackFontsVector[0];
-      firstWstr = fallbackFontsVector[1];
-      if (firstWstr.empty())
-        firstWstr = L"0";
-      lastWstr = L"10ffff";
-    } else if (fallbackFontsVector.size() ==
-               1) // if only font defined, use all range
-    {
-      _fontFaceWstr = fallbackFontsVector[0];
-      firstWstr = L"0";
-      lastWstr = L"10ffff";
-    }
-    const auto func = [](wstring wstr, UINT fallback) -> UINT {
-      try {
-        return std::stoul(wstr.c_str(), 0, 16);
-      } catch (...) {
-        return fallback;
-      }
-    };
-    UINT first = func(firstWstr, 0), last = func(lastWstr, 0x10ffff);
-    DWRITE_UNICODE_RANGE range = {first, last};
-    const WCHAR *familys = {_fontFaceWstr.c_str()};
-    HR(pFontFallbackBuilder->AddMapping(&range, 1, &familys, 1));
+  HRESULT hr = m_pWriteFactory->GetSystemFontFallback(
+      pSysFallback.ReleaseAndGetAddressOf());
+  if (FAILED(hr))
+    return hr;
+  ComPtr<IDWriteFontFallbackBuilder> pFontFallbackBuilder;
+  hr = m_pWriteFactory->CreateFontFallbackBuilder(
+      pFontFallbackBuilder.ReleaseAndGetAddressOf());
+  if (FAILED(hr))
+    return hr;
+  for (const auto &font : spec.fonts) {
+    if (font.first > font.last)
+      continue;
+    DWRITE_UNICODE_RANGE range = {font.first, font.last};
+    const WCHAR *familys = {font.family.c_str()};
+    hr = pFontFallbackBuilder->AddMapping(&range, 1, &familys, 1);
+    if (FAILED(hr))
+      return hr;
   }
   // add system defalt font fallback
-  HR(pFontFallbackBuilder->AddMappings(pSysFallback.Get()));
-  HR(pFontFallbackBuilder->CreateFontFallback(
-      pFontFallback.ReleaseAndGetAddressOf()));
-  HR(textFormat->SetFontFallback(pFontFallback.Get()));
-}
-
-void D2D::ParseFontFace(const std::wstring &fontFaceStr,
-                        DWRITE_FONT_WEIGHT &fontWeight,
-                        DWRITE_FONT_STYLE &fontStyle,
-                        DWRITE_FONT_STRETCH &fontStretch) {
-  static const std::wregex patWeight(
-      L"(:thin|:extra_light|:ultra_light|:light|:semi_light|:medium|:demi_bold|"
-      L":semi_bold|:bold|:extra_bold|:ultra_bold|:black|:heavy|:extra_black|:"
-      L"ultra_black)",
-      std::wregex::icase);
-  static const std::map<wstring, DWRITE_FONT_WEIGHT> _mapWeight = {
-      {L"thin", DWRITE_FONT_WEIGHT_THIN},
-      {L"extra_light", DWRITE_FONT_WEIGHT_EXTRA_LIGHT},
-      {L"ultra_light", DWRITE_FONT_WEIGHT_ULTRA_LIGHT},
-      {L"light", DWRITE_FONT_WEIGHT_LIGHT},
-      {L"semi_light", DWRITE_FONT_WEIGHT_SEMI_LIGHT},
-      {L"medium", DWRITE_FONT_WEIGHT_MEDIUM},
-      {L"demi_bold", DWRITE_FONT_WEIGHT_DEMI_BOLD},
-      {L"semi_bold", DWRITE_FONT_WEIGHT_SEMI_BOLD},
-      {L"bold", DWRITE_FONT_WEIGHT_BOLD},
-      {L"extra_bold", DWRITE_FONT_WEIGHT_EXTRA_BOLD},
-      {L"ultra_bold", DWRITE_FONT_WEIGHT_ULTRA_BOLD},
-      {L"black", DWRITE_FONT_WEIGHT_BLACK},
-      {L"heavy", DWRITE_FONT_WEIGHT_HEAVY},
-      {L"extra_black", DWRITE_FONT_WEIGHT_EXTRA_BLACK},
-      {L"normal", DWRITE_FONT_WEIGHT_NORMAL},
-      {L"ultra_black", DWRITE_FONT_WEIGHT_ULTRA_BLACK}};
-  const wstring weight = MatchWordsOutLowerCaseTrim1st(fontFaceStr, patWeight);
-  const auto it = _mapWeight.find(weight);
-  fontWeight =
-      (it != _mapWeight.end()) ? it->second : DWRITE_FONT_WEIGHT_NORMAL;
-
-  static const std::wregex patStyle(L"(:italic|:oblique|:normal)",
-                                    std::wregex::icase);
-  static const std::map<wstring, DWRITE_FONT_STYLE> _mapStyle = {
-      {L"italic", DWRITE_FONT_STYLE_ITALIC},
-      {L"oblique", DWRITE_FONT_STYLE_OBLIQUE},
-      {L"normal", DWRITE_FONT_STYLE_NORMAL},
-  };
-  const wstring style = MatchWordsOutLowerCaseTrim1st(fontFaceStr, patStyle);
-  const auto it2 = _mapStyle.find(style);
-  fontStyle = (it2 != _mapStyle.end()) ? it2->second : DWRITE_FONT_STYLE_NORMAL;
-
-  static const std::wregex patStretch(
-      L"(:undefined|:ultra_condensed|:extra_condensed|"
-      L":condensed|:semi_condensed|"
-      L":normal_stretch|:medium_stretch|:semi_expanded|"
-      L":expanded|:extra_expanded|:ultra_expanded)",
-      std::wregex::icase);
-  const std::map<wstring, DWRITE_FONT_STRETCH> _mapStretch = {
-      {L"undefined", DWRITE_FONT_STRETCH_UNDEFINED},
-      {L"ultra_condensed", DWRITE_FONT_STRETCH_ULTRA_CONDENSED},
-      {L"extra_condensed", DWRITE_FONT_STRETCH_EXTRA_CONDENSED},
-      {L"condensed", DWRITE_FONT_STRETCH_CONDENSED},
-      {L"semi_condensed", DWRITE_FONT_STRETCH_SEMI_CONDENSED},
-      {L"normal_stretch", DWRITE_FONT_STRETCH_NORMAL},
-      {L"medium_stretch", DWRITE_FONT_STRETCH_MEDIUM},
-      {L"semi_expanded", DWRITE_FONT_STRETCH_SEMI_EXPANDED},
-      {L"expanded", DWRITE_FONT_STRETCH_EXPANDED},
-      {L"extra_expanded", DWRITE_FONT_STRETCH_EXTRA_EXPANDED},
-      {L"ultra_expanded", DWRITE_FONT_STRETCH_ULTRA_EXPANDED}};
-  const wstring stretch =
-      MatchWordsOutLowerCaseTrim1st(fontFaceStr, patStretch);
-  const auto it3 = _mapStretch.find(stretch);
-  fontStretch =
-      (it3 != _mapStretch.end()) ? it3->second : DWRITE_FONT_STRETCH_NORMAL;
-  if (fontStretch == DWRITE_FONT_STRETCH_UNDEFINED)
-    fontStretch = DWRITE_FONT_STRETCH_NORMAL;
+  hr = pFontFallbackBuilder->AddMappings(pSysFallback.Get());
+  if (FAILED(hr))
+    return hr;
+  return pFontFallbackBuilder->CreateFontFallback(
+      pFontFallback.ReleaseAndGetAddressOf());
 }
 
 void D2D::GetTextSize(const wstring &text, size_t nCount,
                       PtTextFormat &pTextFormat, LPSIZE lpSize) {
+  _GetTextSize(text.c_str(), (UINT32)nCount, pTextFormat, nullptr, 0, lpSize,
+               nullptr, nullptr);
+}
+
+void D2D::GetTextSize(const wstring &text, const TextRange &range, int spacing,
+                      PtTextFormat &pTextFormat, LPSIZE lpSize,
+                      int &hilite_from, int &hilite_to) {
+  _GetTextSize(text.c_str(), (UINT32)text.length(), pTextFormat, &range,
+               spacing, lpSize, &hilite_from, &hilite_to);
+}
+
+HRESULT D2D::SetHiliteSpacing(IDWriteTextLayout *pTextLayout, UINT32 length,
+                              const TextRange &range, int spacing) {
+  if (spacing <= 0 || range.start < 0 || range.start >= range.end ||
+      (UINT32)range.end > length)
+    return S_OK;
+  ComPtr<IDWriteTextLayout1> pTextLayout1;
+  HRESULT hr = pTextLayout->QueryInterface(IID_PPV_ARGS(&pTextLayout1));
+  if (FAILED(hr))
+    return hr;
+  // trailing spacing on the last character before the gap
+  if (range.start > 0) {
+    hr = pTextLayout1->SetCharacterSpacing(0, (float)spacing, 0,
+                                           {(UINT32)range.start - 1, 1});
+    if (FAILED(hr))
+      return hr;
+  }
+  return pTextLayout1->SetCharacterSpacing(0, (float)spacing, 0,
+                                           {(UINT32)range.end - 1, 1});
+}
+
+void D2D::_GetTextSize(const wchar_t *text, UINT32 nCount,
+                       PtTextFormat &pTextFormat, const TextRange *range,
+                       int spacing, LPSIZE lpSize, int *hilite_from,
+                       int *hilite_to) {
   D2D1_SIZE_F sz;
 
+  if (hilite_from && hilite_to)
+    *hilite_from = *hilite_to = 0;
   if (!pTextFormat) {
     lpSize->cx = 0;
     lpSize->cy = 0;
@@ -650,15 +781,17 @@ void D2D::GetTextSize(const wstring &text, size_t nCount,
                                    : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
   if (vertical_text_layout) {
     HR(m_pWriteFactory->CreateTextLayout(
-        text.c_str(), (int)nCount, pTextFormat.Get(), 0.0f,
-        (float)m_style.max_height, pTextLayout.ReleaseAndGetAddressOf()));
+        text, nCount, pTextFormat.Get(), 0.0f, (float)m_style.max_height,
+        pTextLayout.ReleaseAndGetAddressOf()));
     HR(pTextLayout->SetReadingDirection(
         DWRITE_READING_DIRECTION_TOP_TO_BOTTOM));
     HR(pTextLayout->SetFlowDirection(flow));
   } else
     HR(m_pWriteFactory->CreateTextLayout(
-        text.c_str(), (int)nCount, pTextFormat.Get(), (float)m_style.max_width,
-        0, pTextLayout.ReleaseAndGetAddressOf()));
+        text, nCount, pTextFormat.Get(), (float)m_style.max_width, 0,
+        pTextLayout.ReleaseAndGetAddressOf()));
+  if (range)
+    SetHiliteSpacing(pTextLayout.Get(), nCount, *range, spacing);
 
   DWRITE_TEXT_METRICS textMetrics;
   HR(pTextLayout->GetMetrics(&textMetrics));
@@ -671,7 +804,7 @@ void D2D::GetTextSize(const wstring &text, size_t nCount,
     auto max_height =
         m_style.max_height == 0 ? textMetrics.height : m_style.max_height;
     HR(m_pWriteFactory->CreateTextLayout(
-        text.c_str(), (int)nCount, pTextFormat.Get(),
+        text, nCount, pTextFormat.Get(),
         textMetrics.widthIncludingTrailingWhitespace, max_height,
         pTextLayout.ReleaseAndGetAddressOf()));
     HR(pTextLayout->SetReadingDirection(
@@ -682,9 +815,11 @@ void D2D::GetTextSize(const wstring &text, size_t nCount,
                          ? textMetrics.widthIncludingTrailingWhitespace
                          : m_style.max_width;
     HR(m_pWriteFactory->CreateTextLayout(
-        text.c_str(), (int)nCount, pTextFormat.Get(), max_width,
-        textMetrics.height, pTextLayout.ReleaseAndGetAddressOf()));
+        text, nCount, pTextFormat.Get(), max_width, textMetrics.height,
+        pTextLayout.ReleaseAndGetAddressOf()));
   }
+  if (range)
+    SetHiliteSpacing(pTextLayout.Get(), nCount, *range, spacing);
 
   DWRITE_OVERHANG_METRICS overhangMetrics;
   HR(pTextLayout->GetOverhangMetrics(&overhangMetrics));
@@ -698,6 +833,39 @@ void D2D::GetTextSize(const wstring &text, size_t nCount,
     if (overhangMetrics.bottom > 0)
       lpSize->cy += (LONG)(overhangMetrics.bottom + 1);
   }
+
+  if (!range || range->start < 0 || range->start >= range->end ||
+      (UINT32)range->end > nCount || !hilite_from || !hilite_to)
+    return;
+  // the highlight as the hit test of its characters, on possibly several
+  // lines, without the spacing after it
+  const UINT32 length = (UINT32)(range->end - range->start);
+  UINT32 count = 0;
+  pTextLayout->HitTestTextRange(range->start, length, 0, 0, nullptr, 0,
+                                &count);
+  if (!count)
+    return;
+  std::vector<DWRITE_HIT_TEST_METRICS> hits(count);
+  if (FAILED(pTextLayout->HitTestTextRange(range->start, length, 0, 0,
+                                           hits.data(), count, &count)))
+    return;
+  float from = FLT_MAX, to = 0;
+  for (UINT32 i = 0; i < count; i++) {
+    const float start = vertical_text_layout ? hits[i].top : hits[i].left;
+    const float extent = vertical_text_layout ? hits[i].height : hits[i].width;
+    from = MIN(from, start);
+    to = MAX(to, start + extent);
+  }
+  to -= MAX(spacing, 0);
+  // drawn moved by the overhang, as D2DRenderBackend does
+  const float overhang =
+      vertical_text_layout ? overhangMetrics.top : overhangMetrics.left;
+  if (overhang > 0) {
+    from += overhang;
+    to += overhang;
+  }
+  *hilite_from = (int)floor(from);
+  *hilite_to = MAX((int)ceil(to), *hilite_from);
 }
 
 // Helper function to convert IWICBitmap to a format compatible with Direct2D
@@ -955,51 +1123,62 @@ HRESULT D2D::FillGeometry(const CRect &rect, uint32_t color, uint32_t radius,
     dc->FillRectangle(&rf, m_pBrush.Get());
     return S_OK;
   }
-  SetBrushColor(color);
-  ComPtr<ID2D1PathGeometry> pGeometry;
-  HRESULT hr;
   if (to_blur) {
     CRect rc = rect;
     rc.OffsetRect(m_dpiScaleLayout * m_style.shadow_offset_x,
                   m_dpiScaleLayout * m_style.shadow_offset_y);
-    CreateRoundedRectanglePath(rc, radius, roundInfo, pGeometry);
-    ComPtr<ID2D1BitmapRenderTarget> bitmapRenderTarget;
-    hr = dc->CreateCompatibleRenderTarget(&bitmapRenderTarget);
-    if (FAILED(hr)) {
-      DEBUG << "CreateCompatibleRenderTarget failed: " << StrzHr(hr);
-      return hr;
-    }
-    bitmapRenderTarget->BeginDraw();
-    bitmapRenderTarget->Clear(D2D1::ColorF(0, 0.0f));
-    bitmapRenderTarget->FillGeometry(pGeometry.Get(), m_pBrush.Get());
-    bitmapRenderTarget->EndDraw();
-    // Get the bitmap from the bitmap render target
-    ComPtr<ID2D1Bitmap> bitmap;
-    hr = bitmapRenderTarget->GetBitmap(&bitmap);
-    if (FAILED(hr)) {
-      DEBUG << "GetBitmap failed: " << StrzHr(hr);
-      return hr;
-    }
-    //// Create a Gaussian blur effect
-    ComPtr<ID2D1Effect> blurEffect;
-    hr = dc->CreateEffect(CLSID_D2D1GaussianBlur, &blurEffect);
-    if (FAILED(hr)) {
-      DEBUG << "CreateEffect(GaussianBlur) failed: " << StrzHr(hr);
-      return hr;
-    }
-    blurEffect->SetInput(0, bitmap.Get());
-    blurEffect->SetValue(D2D1_GAUSSIANBLUR_PROP_STANDARD_DEVIATION,
-                         (float)(m_dpiScaleLayout * m_style.shadow_radius));
-    // Draw the blurred rounded rectangle onto the main render target
-    dc->DrawImage(blurEffect.Get());
-  } else {
-    hr = CreateRoundedRectanglePath(rect, radius, roundInfo, pGeometry);
-    if (FAILED(hr)) {
-      DEBUG << "CreateRoundedRectanglePath failed: " << StrzHr(hr);
-      return hr;
-    }
-    dc->FillGeometry(pGeometry.Get(), m_pBrush.Get());
+    return FillBlurredGeometry(rc, color, (float)radius, roundInfo,
+                               m_dpiScaleLayout * m_style.shadow_radius);
+  }
+  SetBrushColor(color);
+  ComPtr<ID2D1PathGeometry> pGeometry;
+  HRESULT hr = CreateRoundedRectanglePath(rect, radius, roundInfo, pGeometry);
+  if (FAILED(hr)) {
+    DEBUG << "CreateRoundedRectanglePath failed: " << StrzHr(hr);
+    return hr;
+  }
+  dc->FillGeometry(pGeometry.Get(), m_pBrush.Get());
+  return S_OK;
+}
+
+HRESULT D2D::FillBlurredGeometry(const CRect &rect, uint32_t color,
+                                 float radius, const IsToRoundStruct &roundInfo,
+                                 float std_dev) {
+  if (!dc || !d2Factory)
+    return E_POINTER;
+  if (((color >> 24) & 0xFF) == 0)
+    return S_OK;
+  SetBrushColor(color);
+  ComPtr<ID2D1PathGeometry> pGeometry;
+  CreateRoundedRectanglePath(rect, radius, roundInfo, pGeometry);
+  ComPtr<ID2D1BitmapRenderTarget> bitmapRenderTarget;
+  HRESULT hr = dc->CreateCompatibleRenderTarget(&bitmapRenderTarget);
+  if (FAILED(hr)) {
+    DEBUG << "CreateCompatibleRenderTarget failed: " << StrzHr(hr);
+    return hr;
+  }
+  bitmapRenderTarget->BeginDraw();
+  bitmapRenderTarget->Clear(D2D1::ColorF(0, 0.0f));
+  bitmapRenderTarget->FillGeometry(pGeometry.Get(), m_pBrush.Get());
+  bitmapRenderTarget->EndDraw();
+  // Get the bitmap from the bitmap render target
+  ComPtr<ID2D1Bitmap> bitmap;
+  hr = bitmapRenderTarget->GetBitmap(&bitmap);
+  if (FAILED(hr)) {
+    DEBUG << "GetBitmap failed: " << StrzHr(hr);
+    return hr;
+  }
+  //// Create a Gaussian blur effect
+  ComPtr<ID2D1Effect> blurEffect;
+  hr = dc->CreateEffect(CLSID_D2D1GaussianBlur, &blurEffect);
+  if (FAILED(hr)) {
+    DEBUG << "CreateEffect(GaussianBlur) failed: " << StrzHr(hr);
+    return hr;
   }
+  blurEffect->SetInput(0, bitmap.Get());
+  blurEffect->SetValue(D2D1_GAUSSIANBLUR_PROP_STANDARD_DEVIATION, std_dev);
+  // Draw the blurred rounded rectangle onto the main render target
+  dc->DrawImage(blurEffect.Get());
   return S_OK;
 }
 
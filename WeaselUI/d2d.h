@@ -2,6 +2,7 @@
 #ifndef D2D_H
 #define D2D_H
 
+#include "FontSpec.h"
 #include <BaseTypes.h>
 #include <WeaselIPCData.h>
 #include <d2d1.h>
@@ -56,6 +57,17 @@ struct IsToRoundStruct {
         Hemispherical(false) {}
 };
 
+// a DirectComposition surface on a child visual of D2D::visual, stacked over
+// the swap chain; moving it is a SetOffset and a Commit, no drawing
+struct CompositionLayer {
+  ComPtr<IDCompositionVisual> visual;
+  ComPtr<IDCompositionSurface> surface;
+  ComPtr<ID2D1Bitmap1> bitmap; // while drawing
+  UINT width = 0;
+  UINT height = 0;
+  bool shown = false;
+};
+
 struct D2D {
   // Construct without window; call AttachWindow when HWND is ready.
   D2D(UIStyle &style);
@@ -77,12 +89,21 @@ struct D2D {
   void SetBrushColor(uint32_t color);
   void GetTextSize(const wstring &text, size_t nCount,
                    PtTextFormat &pTextFormat, LPSIZE lpSize);
-  void SetFontFallback(PtTextFormat textFormat,
-                       const std::vector<std::wstring> &fontVector);
-  void ParseFontFace(const std::wstring &fontFaceStr,
-                     DWRITE_FONT_WEIGHT &fontWeight,
-                     DWRITE_FONT_STYLE &fontStyle,
-                     DWRITE_FONT_STRETCH &fontStretch);
+  // text laid out as one run with range highlighted, see SetHiliteSpacing;
+  // the highlight spans [hilite_from, hilite_to) along the reading direction,
+  // from the top left of the text
+  void GetTextSize(const wstring &text, const TextRange &range, int spacing,
+                   PtTextFormat &pTextFormat, LPSIZE lpSize, int &hilite_from,
+                   int &hilite_to);
+  // spacing after the text before range and after range, the gaps a
+  // highlighted range keeps from the rest of the run
+  static HRESULT SetHiliteSpacing(IDWriteTextLayout *pTextLayout,
+                                  UINT32 length, const TextRange &range,
+                                  int spacing);
+  HRESULT CreateBrush(uint32_t color, ComPtr<ID2D1SolidColorBrush> &pBrush);
+  // spec.fonts mapped over the system font fallback
+  HRESULT CreateFontFallback(const FontSpec &spec,
+                             ComPtr<IDWriteFontFallback> &pFontFallback);
   HRESULT GetBmpFromIcon(HICON hIcon, ComPtr<ID2D1Bitmap1> &pBitmap);
   HRESULT GetIconFromFile(const wstring &iconPath,
                           ComPtr<ID2D1Bitmap1> &pD2DBitmap);
@@ -92,12 +113,20 @@ struct D2D {
                                      ComPtr<ID2D1PathGeometry> &pPathGeometry);
   HRESULT FillGeometry(const CRect &rect, uint32_t color, uint32_t radius,
                        IsToRoundStruct roundInfo, bool to_blur = false);
+  // rect filled, then gaussian blurred with standard deviation std_dev
+  HRESULT FillBlurredGeometry(const CRect &rect, uint32_t color, float radius,
+                              const IsToRoundStruct &roundInfo, float std_dev);
   HRESULT DrawTextLayout(ComPtr<IDWriteTextLayout> pTextLayout, float x,
                          float y, uint32_t color);
   ComPtr<ID3D11Device> direct3dDevice;
   ComPtr<IDXGIDevice> dxgiDevice;
   ComPtr<IDXGIFactory2> dxFactory;
   ComPtr<IDXGISwapChain1> swapChain;
+  // DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT when supported, with a
+  // maximum frame latency of 1; frameLatencyWaitable is signalled when the
+  // swap chain takes a new frame without blocking Present
+  UINT swapChainFlags = 0;
+  HANDLE frameLatencyWaitable = nullptr;
   ComPtr<ID2D1Factory2> d2Factory;
   ComPtr<ID2D1Device1> d2Device;
   ComPtr<ID2D1DeviceContext> dc;
@@ -113,14 +142,59 @@ struct D2D {
   ComPtr<IDWriteFactory2> m_pWriteFactory;
   ComPtr<ID2D1SolidColorBrush> m_pBrush;
   // caches
-  std::map<std::wstring, PtTextFormat> textFormatCache; // key = face|size|wrap
+  // the DPI dependent resources of a monitor DPI the panel has been on, kept
+  // so that moving back and forth between monitors finds them warm
+  struct DpiResourceSet {
+    std::map<std::wstring, PtTextFormat> textFormats; // key = face|size|wrap
+    uint64_t used = 0;
+  };
+  // least recently used set dropped beyond this
+  static const size_t MAX_DPI_RESOURCE_SETS = 4;
+  std::map<UINT, DpiResourceSet> dpiResourceSets; // key = m_dpiY
+  uint64_t dpiResourceTick = 0;
+  // the set for m_dpiY, created as needed; cacheMutex held
+  DpiResourceSet &_DpiResources();
+  // a face spec parsed and its fallback built, shared by the text formats of
+  // every point size and wrapping; key = face
+  struct FontFace {
+    DWRITE_FONT_WEIGHT weight = DWRITE_FONT_WEIGHT_NORMAL;
+    DWRITE_FONT_STYLE style = DWRITE_FONT_STYLE_NORMAL;
+    DWRITE_FONT_STRETCH stretch = DWRITE_FONT_STRETCH_NORMAL;
+    ComPtr<IDWriteFontFallback> fallback;
+  };
+  std::map<std::wstring, FontFace> fontFaceCache;
   std::mutex cacheMutex;
   // clear caches that depend on device/context
   void ClearDeviceDependentCaches();
-  // release per-window resources (swapchain/visual/bitmap/dc) without touching
-  // shared devices if keepResourcesOnHide is true, ReleaseWindowResources will
-  // be a no-op
+  // release per-window resources (swapchain/visual/bitmap) without touching
+  // shared devices; AttachWindow recreates them on next use
   void ReleaseWindowResources();
+  // approximate GPU memory held by the swap chain buffers and layers, in
+  // bytes
+  size_t WindowResourceBytes() const;
+  // layers[0] is above the swap chain, layers[i] above layers[i - 1]
+  static const int LAYER_COUNT = 3;
+  CompositionLayer layers[LAYER_COUNT];
+  // bumped whenever what the swap chain or the layers show is lost: new
+  // buffers, a resize or released layers
+  uint64_t contentGeneration = 0;
+  // dc draws into layers[i], width x height at the layer's top left, until
+  // EndLayerDraw; the surface is created or grown as needed
+  HRESULT BeginLayerDraw(int i, UINT width, UINT height);
+  HRESULT EndLayerDraw(int i);
+  HRESULT MoveLayer(int i, int x, int y);
+  HRESULT HideLayer(int i);
+  // true if a frame can be presented now, and takes that slot; always true
+  // without a waitable swap chain
+  bool FrameReady();
+  void ReleaseFrameLatencyWaitable();
+  // changes to layers show up on Commit
+  HRESULT CommitLayers();
+  void ReleaseLayers();
+  void _GetTextSize(const wchar_t *text, UINT32 nCount,
+                    PtTextFormat &pTextFormat, const TextRange *range,
+                    int spacing, LPSIZE lpSize, int *hilite_from,
+                    int *hilite_to);
   UIStyle &m_style;
   HWND m_hWnd;
   float m_dpiX;
@@ -383,7 +383,8 @@ struct UIStyle {
   }
 };
 } // namespace weasel
-#ifdef _BOOST
+// field lists for boost archives, also walked by the UI channel snapshot
+// (UIChannel.cpp) without boost
 namespace boost {
 namespace serialization {
 template <typename Archive>
@@ -462,6 +463,22 @@ void serialize(Archive &ar, weasel::UIStyle &s, const unsigned int version) {
   ar & s.linespacing;
 }
 
+template <typename Archive>
+void serialize(Archive &ar, weasel::Context &s, const unsigned int version) {
+  ar & s.preedit;
+  ar & s.aux;
+  ar & s.cinfo;
+}
+template <typename Archive>
+void serialize(Archive &ar, weasel::Status &s, const unsigned int version) {
+  ar & s.schema_name;
+  ar & s.schema_id;
+  ar & s.ascii_mode;
+  ar & s.composing;
+  ar & s.disabled;
+  ar & s.full_shape;
+  ar & s.type;
+}
 template <typename Archive>
 void serialize(Archive &ar, weasel::CandidateInfo &s,
                const unsigned int version) {
@@ -492,4 +509,3 @@ void serialize(Archive &ar, weasel::TextRange &s, const unsigned int version) {
 }
 } // namespace serialization
 } // namespace boost
-#endif
@@ -20,6 +20,7 @@ enum ClientCapabilities {
 };
 
 class UIImpl;
+class UIRemote;
 class UI {
 public:
   UI();
@@ -51,9 +52,16 @@ public:
   UICallbackFunc &uiCallback() { return _uiCallback; }
   void SetCallback(const UICallbackFunc &func) { _uiCallback = func; }
   HWND hwnd();
+  // 调试日志：本进程绘制时的渲染统计
+  void LogStats();
+  // 由 UI 服务进程（rime.toy --ui-server）绘制界面，见 RunUIServer；服务进程
+  // 退出后，下次 Create 时回到本进程绘制
+  bool StartServer();
 
 private:
+  bool _Remote() const;
   the<UIImpl> pimpl_;
+  the<UIRemote> remote_;
   Context ctx_;
   Context octx_;
   Status status_;
@@ -62,4 +70,7 @@ private:
   bool in_server_ = true;
   UICallbackFunc _uiCallback;
 };
+
+// 作为 UI 服务进程运行：绘制创建共享内存 name 的进程的界面，直到其退出
+int RunUIServer(const std::wstring &name);
 } // namespace weasel
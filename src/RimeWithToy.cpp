@@ -2,6 +2,8 @@
 #include "caret.h"
 #include "i18n.h"
 #include "key_table.h"
+#include "rime_context.h"
+#include <ctime>
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <regex>
@@ -23,6 +25,11 @@ typedef enum { COLOR_ABGR = 0, COLOR_ARGB, COLOR_RGBA } ColorFormat;
 static RimeApi *rime_api = nullptr;
 PositionType position_type = PositionType::kMousePos;
 
+// session pool limits: at most kMaxSessions live sessions, and a session not
+// used for kSessionIdleTimeout is destroyed on the next window switch
+static const size_t kMaxSessions = 8;
+static const auto kSessionIdleTimeout = std::chrono::minutes(30);
+
 #define OPEN(x)                                                                \
   ShellExecute(nullptr, _T("open"), data_path(x).c_str(), NULL, NULL,          \
                SW_SHOWNORMAL);
@@ -39,12 +46,6 @@ static path data_path(string subdir) {
   return path(_path).remove_filename().append(subdir);
 }
 
-static wstring GetLabelText(const wstring label, const wchar_t *format) {
-  wchar_t buffer[128];
-  swprintf_s<128>(buffer, format, label.c_str());
-  return std::wstring(buffer);
-}
-
 string RimeWithToy::m_message_type;
 string RimeWithToy::m_message_value;
 string RimeWithToy::m_message_label;
@@ -126,6 +127,7 @@ static void write_position_type_to_config(PositionType t) {
 
 void RimeWithToy::setup_rime() {
   RIME_STRUCT(RimeTraits, traits);
+  bool record_keys = false;
   shared_path = data_path("shared");
   usr_path = data_path("usr");
   log_path = data_path("log");
@@ -164,6 +166,8 @@ void RimeWithToy::setup_rime() {
         else
           position_type = PositionType::kMousePos;
       }
+      if (j.contains("record_keys"))
+        record_keys = j["record_keys"].get<bool>();
       if (j.contains("use_caret_hook"))
         caret::SetUseCaretHook(j["use_caret_hook"].get<bool>());
       if (j.contains("watch_files")) {
@@ -188,6 +192,18 @@ void RimeWithToy::setup_rime() {
   CREATE_DIR_IF_NOT_EXIST(shared_path);
   CREATE_DIR_IF_NOT_EXIST(usr_path);
   CREATE_DIR_IF_NOT_EXIST(log_path);
+  caret::SetStrategyFile((usr_path / "caret_strategy.json").wstring());
+  if (record_keys) {
+    // keys_yyyymmdd_hhmmss.rec, replayed by rime.toy.replay
+    const auto now = std::time(nullptr);
+    char name[32];
+    std::strftime(name, sizeof(name), "keys_%Y%m%d_%H%M%S.rec",
+                  std::localtime(&now));
+    if (!m_recorder.Start((log_path / name).string()))
+      DEBUG << "Failed to open key record file: " << log_path / name;
+  } else {
+    m_recorder.Stop();
+  }
   CONDDEBUG << "shared_path: " << shared_path << ", usr_path: " << usr_path
             << ", log_path: " << log_path;
   const auto shared_dir = shared_path.u8string();
@@ -245,7 +261,8 @@ void RimeWithToy::BalloonMsg(const string &msg) {
 }
 
 RimeWithToy::RimeWithToy(HINSTANCE hInstance)
-    : m_hInstance(hInstance), m_disabled(false),
+    : m_hInstance(hInstance), m_session_id(0), m_session_hwnd(nullptr),
+      m_work_area_hwnd(nullptr), m_disabled(false),
       m_show_notifications_time(1200) {
   rime_api = rime_get_api();
   m_ui = std::make_shared<UI>();
@@ -276,6 +293,7 @@ RimeWithToy::RimeWithToy(HINSTANCE hInstance)
     if (m_ui)
       m_ui->Refresh();
   });
+  m_trayIcon->SetDisplayChangeFunc([&]() { ForgetWorkArea(); });
   m_trayIcon->SetOpenSharedDirFunc([&]() { OPEN(shared_path.string()); });
   m_trayIcon->SetOpenUserdDirFunc([&]() { OPEN(usr_path.string()); });
   m_trayIcon->SetOpenLogDirFunc([&]() { OPEN(log_path.string()); });
@@ -330,7 +348,12 @@ void RimeWithToy::Initialize() {
   if (rime_api->start_maintenance(true))
     rime_api->join_maintenance_thread();
   rime_api->deploy_config_file("weasel.yaml", "config_version");
+  // the sync path re-initializes without Finalize; drop the pooled sessions
+  _DestroyAllSessions();
   m_session_id = rime_api->create_session();
+  if (m_session_hwnd)
+    m_sessions[m_session_hwnd] = {m_session_id,
+                                  std::chrono::steady_clock::now()};
   RimeConfig config = {NULL};
   if (rime_api->config_open("weasel", &config)) {
     _UpdateUIStyle(&config, m_ui.get(), true);
@@ -351,7 +374,8 @@ void RimeWithToy::Initialize() {
 
 void RimeWithToy::Finalize() {
   CONDDEBUG << L"RimeWithToy::Finalize() called";
-  rime_api->destroy_session(m_session_id);
+  _DestroyAllSessions();
+  m_recorder.Stop();
   rime_api->finalize();
 }
 
@@ -620,8 +644,15 @@ void RimeWithToy::ToggleOption(const std::wstring &option_name) {
 BOOL RimeWithToy::ProcessKeyEvent(KeyEvent keyEvent) {
   if (m_disabled)
     return False;
-  auto reprstr = repr(keyEvent.keycode, expand_ibus_modifier(keyEvent.mask));
-  CONDDEBUG << "RimeWithToy::ProcessKeyEvent " << reprstr;
+  // repr is only evaluated when debug logging is on
+  CONDDEBUG << "RimeWithToy::ProcessKeyEvent "
+            << repr(keyEvent.keycode, expand_ibus_modifier(keyEvent.mask));
+  if (m_recorder.recording()) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    m_recorder.Record(
+        keyEvent.keycode, keyEvent.mask,
+        std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+  }
   if (m_ui->GetIsReposition()) {
     if (keyEvent.keycode == ibus::Up)
       keyEvent.keycode = ibus::Down;
@@ -680,6 +711,8 @@ bool RimeWithToy::CheckCommit(bool update_ui) {
   if (!m_commit_str.empty()) {
     send_input_to_window(m_commit_str);
     m_commit_str.clear();
+    // the commit moves the caret, don't trust the tracked rect
+    caret::Invalidate();
     if (!m_ui->status().composing)
       HideUI();
     else if (update_ui) {
@@ -723,39 +756,8 @@ BOOL RimeWithToy::ShowMessage(Context &ctx, Status &status) {
   return true;
 }
 
-void RimeWithToy::GetCandidateInfo(CandidateInfo &cinfo, RimeContext &ctx) {
-  cinfo.candies.resize(ctx.menu.num_candidates);
-  cinfo.comments.resize(ctx.menu.num_candidates);
-  cinfo.labels.resize(ctx.menu.num_candidates);
-  for (int i = 0; i < ctx.menu.num_candidates; ++i) {
-    cinfo.candies[i].str = u8tow(ctx.menu.candidates[i].text);
-    if (ctx.menu.candidates[i].comment) {
-      cinfo.comments[i].str = u8tow(ctx.menu.candidates[i].comment);
-    }
-    if (RIME_STRUCT_HAS_MEMBER(ctx, ctx.select_labels) && ctx.select_labels) {
-      cinfo.labels[i].str = u8tow(ctx.select_labels[i]);
-    } else if (ctx.menu.select_keys) {
-      cinfo.labels[i].str = wstring(1, ctx.menu.select_keys[i]);
-    } else {
-      cinfo.labels[i].str = std::to_wstring((i + 1) % 10);
-    }
-  }
-  cinfo.highlighted = ctx.menu.highlighted_candidate_index;
-  cinfo.currentPage = ctx.menu.page_no;
-  cinfo.is_last_page = ctx.menu.is_last_page;
-}
-
 void RimeWithToy::GetStatus(Status &status) {
-  RIME_STRUCT(RimeStatus, status_);
-  if (rime_api->get_status(m_session_id, &status_)) {
-    status.ascii_mode = !!status_.is_ascii_mode;
-    status.composing = !!status_.is_composing;
-    status.disabled = !!status_.is_disabled;
-    status.full_shape = !!status_.is_full_shape;
-    status.schema_id = u8tow(status_.schema_id);
-    status.schema_name = u8tow(status_.schema_name);
-    rime_api->free_status(&status_);
-  }
+  ReadRimeStatus(rime_api, m_session_id, status);
   if (status.schema_id != m_last_schema_id) {
     m_last_schema_id = status.schema_id;
     if (m_last_schema_id != L".default")
@@ -764,83 +766,7 @@ void RimeWithToy::GetStatus(Status &status) {
 }
 
 void RimeWithToy::GetContext(Context &context, const Status &status) {
-  RIME_STRUCT(RimeContext, ctx);
-  if (rime_api->get_context(m_session_id, &ctx)) {
-    if (status.composing) {
-      auto style = m_ui->style();
-      switch (m_ui->style().preedit_type) {
-      case UIStyle::PreeditType::PREVIEW_ALL: {
-        CandidateInfo cinfo;
-        GetCandidateInfo(cinfo, ctx);
-        string topush = string(ctx.composition.preedit) + "  [";
-        auto &candies = ctx.menu.candidates;
-        auto hilite = ctx.menu.highlighted_candidate_index;
-        for (auto i = 0; i < ctx.menu.num_candidates; i++) {
-          string label =
-              style.label_font_point > 0
-                  ? wtou8(GetLabelText(cinfo.labels[i].str,
-                                       style.label_text_format.c_str()))
-                  : "";
-          string comment =
-              style.comment_font_point > 0 ? wtou8(cinfo.comments[i].str) : "";
-          string mark_text =
-              style.mark_text.empty() ? "*" : wtou8(style.mark_text);
-          string prefix = (i != hilite) ? "" : mark_text;
-          topush += " " + prefix + label + (candies[i].text) + " " + comment;
-        }
-        context.preedit.str = u8tow(topush) + wstring(L"]");
-        if (ctx.composition.sel_start <= ctx.composition.sel_end) {
-          TextAttribute attr;
-          attr.range.start =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_start);
-          attr.range.end =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_end);
-          attr.range.cursor =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.cursor_pos);
-          context.preedit.attributes.push_back(attr);
-        }
-      } break;
-      case UIStyle::PreeditType::PREVIEW: {
-        if (ctx.commit_text_preview) {
-          string text = ctx.commit_text_preview;
-          context.preedit.str = u8tow(text);
-          TextAttribute attr;
-          attr.range.start = 0;
-          attr.range.end = utf8towcslen(text.c_str(), (int)text.size());
-          attr.range.cursor = utf8towcslen(text.c_str(), (int)text.size());
-          context.preedit.attributes.push_back(attr);
-        }
-        break;
-      }
-      case UIStyle::PreeditType::COMPOSITION: {
-        auto text = string(ctx.composition.preedit);
-        context.preedit.str = u8tow(text);
-        if (ctx.composition.sel_start <= ctx.composition.sel_end) {
-          TextAttribute attr;
-          auto start =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_start);
-          auto end =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_end);
-          auto cursor =
-              utf8towcslen(ctx.composition.preedit, ctx.composition.cursor_pos);
-          attr.range.start = start;
-          attr.range.end = end;
-          attr.range.cursor = cursor;
-          attr.type = HIGHLIGHTED;
-          context.preedit.attributes.push_back(attr);
-        }
-        break;
-      }
-      default:
-        break;
-      }
-    }
-    if (ctx.menu.num_candidates) {
-      CandidateInfo &cinfo(context.cinfo);
-      GetCandidateInfo(cinfo, ctx);
-    }
-    rime_api->free_context(&ctx);
-  }
+  ReadRimeContext(rime_api, m_session_id, m_ui->style(), status, context);
 }
 
 Bool RimeWithToy::SelectCandidateCurrentPage(size_t index) {
@@ -908,57 +834,83 @@ void RimeWithToy::RefreshInputPosition(HWND hwnd) {
     return;
   if (position_type == PositionType::kAuto) {
     RECT caret;
-    if (caret::GetScreenRect(&caret)) {
+    const bool found = caret::GetScreenRect(&caret);
+    if (m_trayIcon->debug() && caret::LookupCount() % 1000 == 0) {
+      caret::Stats stats;
+      caret::GetStats(&stats);
+      DEBUG << "caret lookups: " << stats.lookups
+            << ", probes: " << stats.probes << ", p99: " << stats.p99_us
+            << "us";
+      caret::LogStrategyStats();
+    }
+    if (found) {
       UpdateInputPosition(caret);
       return;
     }
   }
 
-  POINT pt;
-  if (!GetCursorPos(&pt)) {
-    RECT rect{};
-    if (hwnd)
-      GetWindowRect(hwnd, &rect);
-    pt.x = rect.left + (rect.right - rect.left) / 2 - 150;
-    pt.y = rect.bottom - (rect.bottom - rect.top) / 2 - 100;
+  // the mouse position, also when kAuto found no caret
+  POINT pt{0, 0};
+  if (position_type == PositionType::kMousePos ||
+      position_type == PositionType::kAuto) {
+    if (!GetCursorPos(&pt)) {
+      RECT rect{};
+      if (hwnd)
+        GetWindowRect(hwnd, &rect);
+      pt.x = rect.left + (rect.right - rect.left) / 2 - 150;
+      pt.y = rect.bottom - (rect.bottom - rect.top) / 2 - 100;
+    }
+    UpdateInputPosition({pt.x, pt.y, pt.x, pt.y});
+    return;
   }
 
-  if (position_type != PositionType::kMousePos) {
-    HMONITOR hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
+  // the monitor of the input window, looked up once per foreground window
+  if (!hwnd || hwnd != m_work_area_hwnd) {
+    HMONITOR hMonitor = nullptr;
+    if (hwnd)
+      hMonitor = MonitorFromWindow(hwnd, MONITOR_DEFAULTTONEAREST);
+    else if (GetCursorPos(&pt))
+      hMonitor = MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST);
     MONITORINFO mi;
-    RECT rcWork;
     mi.cbSize = sizeof(MONITORINFO);
-    HWND panel = UIHwnd();
-    RECT rcPanel;
-    if (panel)
-      GetWindowRect(panel, &rcPanel);
-    if (GetMonitorInfo(hMonitor, &mi)) {
-      rcWork = mi.rcWork;
-      int panelWidth = rcPanel.right - rcPanel.left;
-      if (position_type == PositionType::kTopLeft) {
-        pt.x = rcWork.left;
-        pt.y = rcWork.top;
-      } else if (position_type == PositionType::kTopCenter) {
-        pt.x = rcWork.left + (rcWork.right - rcWork.left - panelWidth) / 2;
-        pt.y = rcWork.top;
-      } else if (position_type == PositionType::kTopRight) {
-        pt.x = rcWork.right;
-        pt.y = rcWork.top;
-      } else if (position_type == PositionType::kBottomLeft) {
-        pt.x = rcWork.left;
-        pt.y = rcWork.bottom;
-      } else if (position_type == PositionType::kBottomCenter) {
-        pt.x = rcWork.left + (rcWork.right - rcWork.left - panelWidth) / 2;
-        pt.y = rcWork.bottom;
-      } else if (position_type == PositionType::kBottomRight) {
-        pt.x = rcWork.right;
-        pt.y = rcWork.bottom;
-      } else if (position_type == PositionType::kCenter) {
-        int panelHeight = rcPanel.bottom - rcPanel.top;
-        pt.x = rcWork.left + (rcWork.right - rcWork.left - panelWidth) / 2;
-        pt.y = rcWork.top + (rcWork.bottom - rcWork.top - panelHeight) / 2;
-      }
+    if (!hMonitor || !GetMonitorInfo(hMonitor, &mi)) {
+      UpdateInputPosition({pt.x, pt.y, pt.x, pt.y});
+      return;
     }
+    m_work_area = mi.rcWork;
+    m_work_area_hwnd = hwnd;
+  }
+  const RECT &rcWork = m_work_area;
+  SIZE panel{0, 0};
+  if (position_type == PositionType::kTopCenter ||
+      position_type == PositionType::kBottomCenter ||
+      position_type == PositionType::kCenter) {
+    RECT rcPanel;
+    HWND hPanel = UIHwnd();
+    if (hPanel && GetWindowRect(hPanel, &rcPanel))
+      panel = {rcPanel.right - rcPanel.left, rcPanel.bottom - rcPanel.top};
+  }
+  if (position_type == PositionType::kTopLeft) {
+    pt.x = rcWork.left;
+    pt.y = rcWork.top;
+  } else if (position_type == PositionType::kTopCenter) {
+    pt.x = rcWork.left + (rcWork.right - rcWork.left - panel.cx) / 2;
+    pt.y = rcWork.top;
+  } else if (position_type == PositionType::kTopRight) {
+    pt.x = rcWork.right;
+    pt.y = rcWork.top;
+  } else if (position_type == PositionType::kBottomLeft) {
+    pt.x = rcWork.left;
+    pt.y = rcWork.bottom;
+  } else if (position_type == PositionType::kBottomCenter) {
+    pt.x = rcWork.left + (rcWork.right - rcWork.left - panel.cx) / 2;
+    pt.y = rcWork.bottom;
+  } else if (position_type == PositionType::kBottomRight) {
+    pt.x = rcWork.right;
+    pt.y = rcWork.bottom;
+  } else if (position_type == PositionType::kCenter) {
+    pt.x = rcWork.left + (rcWork.right - rcWork.left - panel.cx) / 2;
+    pt.y = rcWork.top + (rcWork.bottom - rcWork.top - panel.cy) / 2;
   }
 
   UpdateInputPosition({pt.x, pt.y, pt.x, pt.y});
@@ -968,8 +920,105 @@ void RimeWithToy::DestroyUI() {
   if (m_ui) {
     m_ui->ctx().clear();
     rime_api->clear_composition(m_session_id);
-    m_ui->Destroy();
+    // keep the panel window and swap chain, the panel releases its GPU
+    // resources itself after staying hidden for a while
+    m_ui->Hide();
+    if (m_trayIcon->debug())
+      m_ui->LogStats();
+  }
+}
+
+RimeSessionId RimeWithToy::_CreateSession() {
+  RimeSessionId id = rime_api->create_session();
+  if (id)
+    rime_api->set_option(id, "soft_cursor",
+                         Bool(!m_ui->style().inline_preedit));
+  return id;
+}
+
+void RimeWithToy::_PruneSessions(std::chrono::steady_clock::time_point now) {
+  for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+    if (it->first != m_session_hwnd &&
+        (!IsWindow(it->first) ||
+         now - it->second.last_used > kSessionIdleTimeout)) {
+      rime_api->destroy_session(it->second.id);
+      it = m_sessions.erase(it);
+    } else
+      ++it;
+  }
+  // evict the least recently used one, leave room for a new session
+  while (m_sessions.size() >= kMaxSessions) {
+    auto lru = m_sessions.end();
+    for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+      if (it->first == m_session_hwnd)
+        continue;
+      if (lru == m_sessions.end() ||
+          it->second.last_used < lru->second.last_used)
+        lru = it;
+    }
+    if (lru == m_sessions.end())
+      break;
+    rime_api->destroy_session(lru->second.id);
+    m_sessions.erase(lru);
+  }
+}
+
+void RimeWithToy::_DestroyAllSessions() {
+  for (const auto &kv : m_sessions) {
+    if (kv.second.id != m_session_id)
+      rime_api->destroy_session(kv.second.id);
+  }
+  m_sessions.clear();
+  // 0 before the first Initialize and after a Finalize
+  if (m_session_id)
+    rime_api->destroy_session(m_session_id);
+  m_session_id = 0;
+}
+
+void RimeWithToy::SwitchSession(HWND hwnd) {
+  if (!hwnd || m_disabled)
+    return;
+  // owned popups and dialogs share the session of their owner
+  HWND root = GetAncestor(hwnd, GA_ROOTOWNER);
+  if (root)
+    hwnd = root;
+  // tray menu and panel belong to ourselves, keep the current session
+  DWORD pid = 0;
+  GetWindowThreadProcessId(hwnd, &pid);
+  if (pid == GetCurrentProcessId())
+    return;
+  const auto start = std::chrono::steady_clock::now();
+  if (!m_session_hwnd) {
+    // adopt the session created by Initialize
+    m_session_hwnd = hwnd;
+    m_sessions[hwnd] = {m_session_id, start};
+    return;
+  }
+  if (hwnd == m_session_hwnd)
+    return;
+  HideUI();
+  if (m_ui)
+    m_ui->ctx().clear();
+  m_sessions[m_session_hwnd] = {m_session_id, start};
+  _PruneSessions(start);
+  auto it = m_sessions.find(hwnd);
+  if (it != m_sessions.end() && rime_api->find_session(it->second.id)) {
+    m_session_id = it->second.id;
+  } else {
+    m_session_id = _CreateSession();
   }
+  m_sessions[hwnd] = {m_session_id, start};
+  m_session_hwnd = hwnd;
+  Status &status = m_ui->status();
+  GetStatus(status);
+  if (m_trayIconCallback)
+    m_trayIconCallback(status);
+  CONDDEBUG << "SwitchSession hwnd: " << hwnd << ", session: " << m_session_id
+            << ", pool size: " << m_sessions.size() << ", cost: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " us";
 }
 
 void RimeWithToy::_LoadSchemaSpecificSettings(RimeSessionId id,
@@ -2,10 +2,12 @@
 #ifndef _RIME_WITH_TOY
 #define _RIME_WITH_TOY
 
+#include "key_recorder.h"
 #include "keymodule.h"
 #include "trayicon.h"
 #include <WeaselIPCData.h>
 #include <WeaselUI.h>
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <map>
@@ -134,8 +136,16 @@ public:
   RimeSessionId session_id() const { return m_session_id; }
   void UpdateInputPosition(const RECT &rc);
   void RefreshInputPosition(HWND hwnd = nullptr);
+  // the next RefreshInputPosition looks the work area up again; on focus and
+  // display changes
+  void ForgetWorkArea() { m_work_area_hwnd = nullptr; }
   bool StartUI();
+  // draw the panel in a UI server process, see UI::StartServer
+  bool StartUIServer() { return m_ui && m_ui->StartServer(); }
   void DestroyUI();
+  // activate the session owned by the foreground window, creating it if
+  // needed; the panel is hidden, not destroyed
+  void SwitchSession(HWND hwnd);
   void HideUI() {
     if (m_ui)
       m_ui->Hide();
@@ -150,7 +160,6 @@ private:
   static void on_message(void *context_object, RimeSessionId session_id,
                          const char *message_type, const char *message_value);
   void GetStatus(Status &stat);
-  void GetCandidateInfo(CandidateInfo &cinfo, RimeContext &ctx);
   void GetContext(Context &context, const Status &status);
   BOOL ShowMessage(Context &ctx, Status &status);
   void BalloonMsg(const string &msg);
@@ -163,6 +172,9 @@ private:
 
   void _HandleMousePageEvent(bool *next_page, bool *scroll_down);
   void _LoadSchemaSpecificSettings(RimeSessionId id, const wstring &schema_id);
+  RimeSessionId _CreateSession();
+  void _PruneSessions(std::chrono::steady_clock::time_point now);
+  void _DestroyAllSessions();
 
   static string m_message_type;
   static string m_message_value;
@@ -178,6 +190,16 @@ private:
   HICON m_reload_icon;
   HINSTANCE m_hInstance;
   RimeSessionId m_session_id;
+  // one librime session per top-level window, LRU bounded
+  struct SessionEntry {
+    RimeSessionId id;
+    std::chrono::steady_clock::time_point last_used;
+  };
+  std::map<HWND, SessionEntry> m_sessions;
+  HWND m_session_hwnd;
+  // work area of the monitor of m_work_area_hwnd, for the fixed positions
+  HWND m_work_area_hwnd;
+  RECT m_work_area{};
   an<UI> m_ui;
   wstring m_last_schema_id;
   wstring m_commit_str;
@@ -186,6 +208,8 @@ private:
   bool m_current_dark_mode;
   int m_show_notifications_time;
   std::unique_ptr<SimpleFileMonitor> m_file_monitor;
+  // enabled by "record_keys" in rime.toy.json
+  KeyRecorder m_recorder;
 };
 
 void _UpdateUIStyle(RimeConfig *config, UI *ui, bool initialize);
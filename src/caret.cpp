@@ -8,13 +8,18 @@
 #include <combaseapi.h>
 #include <psapi.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <map>
 #include <mutex>
+#include <nlohmann/json.hpp>
 #include <thread>
+#include <utils.h>
 #include <vector>
 
 // Auto caret positioning algorithm, ported from rabbit's GetCaretPosEx.ahk
@@ -217,12 +222,18 @@ bool RangeRect(IUIAutomationTextRange *range, RECT *out) {
   return true;
 }
 
+// One UIA client for the life of the process; creating CUIAutomation is far
+// more expensive than the caret query itself. Released by Shutdown.
+IUIAutomation *g_automation = nullptr;
+
 bool GetCaretFromUia(RECT *out) {
-  IUIAutomation *automation = nullptr;
-  if (FAILED(CoCreateInstance(__uuidof(CUIAutomation), nullptr,
+  if (!g_automation &&
+      FAILED(CoCreateInstance(__uuidof(CUIAutomation), nullptr,
                               CLSCTX_INPROC_SERVER, __uuidof(IUIAutomation),
-                              reinterpret_cast<void **>(&automation))) ||
-      !automation)
+                              reinterpret_cast<void **>(&g_automation))))
+    g_automation = nullptr;
+  IUIAutomation *automation = g_automation;
+  if (!automation)
     return false;
 
   bool ok = false;
@@ -267,7 +278,6 @@ bool GetCaretFromUia(RECT *out) {
     }
     focused->Release();
   }
-  automation->Release();
   return ok;
 }
 
@@ -289,11 +299,6 @@ bool IsX64Process(HANDLE hProcess) {
 #endif
 }
 
-// Module bases are cached per target process: enumerating modules is the
-// expensive part of the hook, and base addresses do not change.
-std::mutex g_bases_mutex;
-std::map<DWORD, std::pair<uintptr_t, uintptr_t>> g_bases_cache;
-
 bool GetModuleBase(HANDLE hProcess, const wchar_t *name, uintptr_t *base) {
   HMODULE mods[512];
   DWORD needed = 0;
@@ -314,28 +319,170 @@ bool GetModuleBase(HANDLE hProcess, const wchar_t *name, uintptr_t *base) {
   return false;
 }
 
-bool GetModuleBases(HANDLE hProcess, DWORD pid, uintptr_t *user32,
-                    uintptr_t *combase) {
-  {
-    std::lock_guard<std::mutex> lk(g_bases_mutex);
-    auto it = g_bases_cache.find(pid);
-    if (it != g_bases_cache.end()) {
-      *user32 = it->second.first;
-      *combase = it->second.second;
-      return true;
-    }
-  }
-  uintptr_t u = 0, c = 0;
-  if (!GetModuleBase(hProcess, L"user32.dll", &u) ||
-      !GetModuleBase(hProcess, L"combase.dll", &c))
-    return false;
-  {
-    std::lock_guard<std::mutex> lk(g_bases_mutex);
-    g_bases_cache[pid] = std::make_pair(u, c);
+// Loop of the resident agent thread, started on the control block:
+//   DWORD r;
+//   while ((r = WaitForMultipleObjects(2, &ctrl->request, FALSE, INFINITE)) ==
+//              WAIT_OBJECT_0 &&
+//          !ctrl->quit) {
+//     ctrl->result = ctrl->entry(ctrl->page);
+//     SetEvent(ctrl->done);
+//   }
+//   if (r == WAIT_OBJECT_0 + 1) {
+//     // rime.toy is gone without asking it to quit, nobody else frees it
+//     CloseHandle(ctrl->request);
+//     CloseHandle(ctrl->host);
+//     CloseHandle(ctrl->done);
+//     VirtualFree(ctrl->region, 0, MEM_RELEASE); // returns into ExitThread
+//   }
+// The control block holds wait, set_event, request, host, done, entry, page,
+// close_handle, virtual_free, exit_thread and region as pointers of the
+// target's size, then quit and result as 32-bit words. On x64 VirtualFree is
+// entered with the stack off by 8 so that ExitThread, which runs the thread
+// detach of every dll, gets it aligned.
+const unsigned char kAgentLoop64[] = {
+    0x53, 0x48, 0x83, 0xec, 0x20, 0x48, 0x89, 0xcb, 0xb9, 0x02, 0x00, 0x00,
+    0x00, 0x48, 0x8d, 0x53, 0x10, 0x45, 0x31, 0xc0, 0x41, 0xb9, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x13, 0x85, 0xc0, 0x75, 0x19, 0x83, 0x7b, 0x58, 0x00,
+    0x75, 0x43, 0x48, 0x8b, 0x4b, 0x30, 0xff, 0x53, 0x28, 0x89, 0x43, 0x5c,
+    0x48, 0x8b, 0x4b, 0x20, 0xff, 0x53, 0x08, 0xeb, 0xcf, 0x83, 0xf8, 0x01,
+    0x75, 0x2b, 0x48, 0x8b, 0x4b, 0x10, 0xff, 0x53, 0x38, 0x48, 0x8b, 0x4b,
+    0x18, 0xff, 0x53, 0x38, 0x48, 0x8b, 0x4b, 0x20, 0xff, 0x53, 0x38, 0x48,
+    0x8b, 0x4b, 0x50, 0x31, 0xd2, 0x41, 0xb8, 0x00, 0x80, 0x00, 0x00, 0x48,
+    0x83, 0xec, 0x08, 0xff, 0x73, 0x48, 0xff, 0x63, 0x40, 0x48, 0x83, 0xc4,
+    0x20, 0x5b, 0x31, 0xc0, 0xc3};
+const unsigned char kAgentLoop32[] = {
+    0x53, 0x56, 0x8b, 0x5c, 0x24, 0x0c, 0x6a, 0xff, 0x6a, 0x00, 0x8d, 0x43,
+    0x08, 0x50, 0x6a, 0x02, 0xff, 0x13, 0x85, 0xc0, 0x75, 0x1b, 0x83, 0x7b,
+    0x2c, 0x00, 0x75, 0x40, 0x89, 0xe6, 0xff, 0x73, 0x18, 0xff, 0x53, 0x14,
+    0x89, 0xf4, 0x89, 0x43, 0x30, 0xff, 0x73, 0x10, 0xff, 0x53, 0x04, 0xeb,
+    0xd5, 0x83, 0xf8, 0x01, 0x75, 0x26, 0xff, 0x73, 0x08, 0xff, 0x53, 0x1c,
+    0xff, 0x73, 0x0c, 0xff, 0x53, 0x1c, 0xff, 0x73, 0x10, 0xff, 0x53, 0x1c,
+    0x6a, 0x00, 0x6a, 0x00, 0x68, 0x00, 0x80, 0x00, 0x00, 0x6a, 0x00, 0xff,
+    0x73, 0x28, 0xff, 0x73, 0x24, 0xff, 0x63, 0x20, 0x5e, 0x5b, 0x31, 0xc0,
+    0xc2, 0x04, 0x00};
+// the loop stub and the control block follow the shellcode page
+const size_t kLoopSize = 128;
+const size_t kControlSize = 128;
+
+// The caret agent injected into a target process: one remote region with the
+// shellcode page, the loop stub and the control block, and a thread parked
+// in the loop. A probe rewrites the page, signals request and waits on done;
+// no thread is created per probe. Module bases are looked up once.
+struct RemoteAgent {
+  HANDLE process = nullptr;
+  unsigned char *remote = nullptr;
+  unsigned char *control = nullptr;
+  bool is_x64 = false;
+  uintptr_t user32 = 0;
+  uintptr_t combase = 0;
+  HANDLE thread = nullptr;
+  HANDLE request = nullptr;
+  HANDLE done = nullptr;
+  // request, done and rime.toy itself as duplicated into the target
+  HANDLE remote_request = nullptr;
+  HANDLE remote_done = nullptr;
+  HANDLE remote_host = nullptr;
+  // the last probe outlived its wait; done is signalled when it finishes
+  bool pending = false;
+  // a probe is running on another thread
+  bool busy = false;
+  // retire once the running probe returns
+  bool retire = false;
+};
+
+std::mutex g_agents_mutex;
+std::map<DWORD, RemoteAgent> g_agents;
+// agents asked to quit, freed once their thread has left the loop
+std::vector<RemoteAgent> g_retired_agents;
+
+size_t QuitOffset(const RemoteAgent &agent) { return agent.is_x64 ? 88 : 44; }
+
+bool ReadRemote(HANDLE hProcess, const void *addr, void *buf, size_t size) {
+  SIZE_T read = 0;
+  return ReadProcessMemory(hProcess, addr, buf, size, &read) && read == size;
+}
+
+// Address of an export of the module at base, read from the target's own
+// export directory so it works across bitness. A forwarder is followed into
+// its module; the api sets are served by kernelbase.
+uintptr_t GetRemoteProc(HANDLE hProcess, uintptr_t base, const char *name,
+                        int depth = 0) {
+  IMAGE_DOS_HEADER dos;
+  if (!ReadRemote(hProcess, reinterpret_cast<void *>(base), &dos,
+                  sizeof(dos)) ||
+      dos.e_magic != IMAGE_DOS_SIGNATURE)
+    return 0;
+  union {
+    IMAGE_NT_HEADERS32 h32;
+    IMAGE_NT_HEADERS64 h64;
+  } nt;
+  if (!ReadRemote(hProcess, reinterpret_cast<void *>(base + dos.e_lfanew),
+                  &nt, sizeof(nt)) ||
+      nt.h32.Signature != IMAGE_NT_SIGNATURE)
+    return 0;
+  const IMAGE_DATA_DIRECTORY dir =
+      nt.h32.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC
+          ? nt.h64.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]
+          : nt.h32.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+  if (dir.Size < sizeof(IMAGE_EXPORT_DIRECTORY))
+    return 0;
+  // the directory, its tables and the names are read in one go
+  std::vector<unsigned char> exports(dir.Size);
+  if (!ReadRemote(hProcess, reinterpret_cast<void *>(base + dir.VirtualAddress),
+                  exports.data(), exports.size()))
+    return 0;
+  // size bytes at rva inside the directory, or nullptr
+  auto at = [&](DWORD rva, size_t size) -> const unsigned char * {
+    if (rva < dir.VirtualAddress ||
+        rva - dir.VirtualAddress + size > exports.size())
+      return nullptr;
+    return exports.data() + (rva - dir.VirtualAddress);
+  };
+  // a nul terminated string at rva inside the directory, or nullptr
+  auto str = [&](DWORD rva) -> const char * {
+    const char *s = reinterpret_cast<const char *>(at(rva, 1));
+    if (!s)
+      return nullptr;
+    const size_t left = exports.size() - (rva - dir.VirtualAddress);
+    return strnlen(s, left) < left ? s : nullptr;
+  };
+  const auto *ed =
+      reinterpret_cast<const IMAGE_EXPORT_DIRECTORY *>(exports.data());
+  const auto *names = reinterpret_cast<const DWORD *>(
+      at(ed->AddressOfNames, ed->NumberOfNames * sizeof(DWORD)));
+  const auto *ordinals = reinterpret_cast<const WORD *>(
+      at(ed->AddressOfNameOrdinals, ed->NumberOfNames * sizeof(WORD)));
+  const auto *functions = reinterpret_cast<const DWORD *>(
+      at(ed->AddressOfFunctions, ed->NumberOfFunctions * sizeof(DWORD)));
+  if (!names || !ordinals || !functions)
+    return 0;
+  for (DWORD i = 0; i < ed->NumberOfNames; i++) {
+    const char *s = str(names[i]);
+    if (!s || strcmp(s, name) != 0)
+      continue;
+    if (ordinals[i] >= ed->NumberOfFunctions)
+      return 0;
+    const DWORD rva = functions[ordinals[i]];
+    if (!at(rva, 1))
+      return base + rva;
+    // a forwarder, "module.function"
+    const char *forward = str(rva);
+    const char *dot = forward ? strchr(forward, '.') : nullptr;
+    if (!dot || depth > 1)
+      return 0;
+    const std::string module(forward, dot);
+    std::wstring dll;
+    if (_strnicmp(forward, "api-", 4) == 0 ||
+        _strnicmp(forward, "ext-", 4) == 0)
+      dll = L"kernelbase.dll";
+    else
+      dll = std::wstring(module.begin(), module.end()) + L".dll";
+    uintptr_t forward_base = 0;
+    if (!GetModuleBase(hProcess, dll.c_str(), &forward_base))
+      return 0;
+    return GetRemoteProc(hProcess, forward_base, dot + 1, depth + 1);
   }
-  *user32 = u;
-  *combase = c;
-  return true;
+  return 0;
 }
 
 void PutU32(unsigned char *p, uint32_t v) {
@@ -350,8 +497,213 @@ void PutU64(unsigned char *p, uint64_t v) {
   PutU32(p + 4, static_cast<uint32_t>(v >> 32));
 }
 
-// Inject the shellcode into the target and read back the caret rect. The wait
-// is bounded so a hung target cannot stall the caller.
+// Allocate the region of an opened agent, hand it the events and start the
+// resident thread; code_size is the shellcode page rounded up.
+bool StartAgent(RemoteAgent &agent, size_t code_size, size_t entry_offset) {
+  uintptr_t kernel32 = 0;
+  if (!GetModuleBase(agent.process, L"kernel32.dll", &kernel32))
+    return false;
+  const uintptr_t wait =
+      GetRemoteProc(agent.process, kernel32, "WaitForMultipleObjects");
+  const uintptr_t set_event =
+      GetRemoteProc(agent.process, kernel32, "SetEvent");
+  const uintptr_t close_handle =
+      GetRemoteProc(agent.process, kernel32, "CloseHandle");
+  const uintptr_t virtual_free =
+      GetRemoteProc(agent.process, kernel32, "VirtualFree");
+  const uintptr_t exit_thread =
+      GetRemoteProc(agent.process, kernel32, "ExitThread");
+  if (!wait || !set_event || !close_handle || !virtual_free || !exit_thread)
+    return false;
+  agent.remote = static_cast<unsigned char *>(
+      VirtualAllocEx(agent.process, nullptr,
+                     code_size + kLoopSize + kControlSize, MEM_COMMIT,
+                     PAGE_EXECUTE_READWRITE));
+  if (!agent.remote)
+    return false;
+  unsigned char *loop = agent.remote + code_size;
+  agent.control = loop + kLoopSize;
+
+  const HANDLE self = GetCurrentProcess();
+  const DWORD access = SYNCHRONIZE | EVENT_MODIFY_STATE;
+  agent.request = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+  agent.done = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+  if (!agent.request || !agent.done ||
+      !DuplicateHandle(self, agent.request, agent.process,
+                       &agent.remote_request, access, FALSE, 0) ||
+      !DuplicateHandle(self, agent.done, agent.process, &agent.remote_done,
+                       access, FALSE, 0) ||
+      !DuplicateHandle(self, self, agent.process, &agent.remote_host,
+                       SYNCHRONIZE, FALSE, 0))
+    return false;
+
+  unsigned char block[kLoopSize + kControlSize] = {0};
+  const uint64_t fields[] = {
+      wait,
+      set_event,
+      reinterpret_cast<uintptr_t>(agent.remote_request),
+      reinterpret_cast<uintptr_t>(agent.remote_host),
+      reinterpret_cast<uintptr_t>(agent.remote_done),
+      reinterpret_cast<uintptr_t>(agent.remote + entry_offset),
+      reinterpret_cast<uintptr_t>(agent.remote),
+      close_handle,
+      virtual_free,
+      exit_thread,
+      reinterpret_cast<uintptr_t>(agent.remote)};
+  if (agent.is_x64) {
+    memcpy(block, kAgentLoop64, sizeof(kAgentLoop64));
+    for (size_t i = 0; i < _countof(fields); i++)
+      PutU64(block + kLoopSize + i * 8, fields[i]);
+  } else {
+    memcpy(block, kAgentLoop32, sizeof(kAgentLoop32));
+    for (size_t i = 0; i < _countof(fields); i++)
+      PutU32(block + kLoopSize + i * 4, static_cast<uint32_t>(fields[i]));
+  }
+  SIZE_T written = 0;
+  if (!WriteProcessMemory(agent.process, loop, block, sizeof(block),
+                          &written) ||
+      written != sizeof(block))
+    return false;
+  FlushInstructionCache(agent.process, loop, kLoopSize);
+  agent.thread = CreateRemoteThread(
+      agent.process, nullptr, 0,
+      reinterpret_cast<LPTHREAD_START_ROUTINE>(loop), agent.control, 0,
+      nullptr);
+  return agent.thread != nullptr;
+}
+
+// Close what an agent holds. The region and the handles in the target are
+// only freed once the thread has left the loop; freeing them under a running
+// thread would crash the target, so they are left to the process then.
+void FreeAgent(RemoteAgent &agent) {
+  if (!agent.thread || WaitForSingleObject(agent.thread, 0) == WAIT_OBJECT_0) {
+    if (agent.remote)
+      VirtualFreeEx(agent.process, agent.remote, 0, MEM_RELEASE);
+    for (HANDLE h :
+         {agent.remote_request, agent.remote_done, agent.remote_host}) {
+      if (h)
+        DuplicateHandle(agent.process, h, nullptr, nullptr, 0, FALSE,
+                        DUPLICATE_CLOSE_SOURCE);
+    }
+  }
+  for (HANDLE h : {agent.thread, agent.request, agent.done, agent.process}) {
+    if (h)
+      CloseHandle(h);
+  }
+  agent = RemoteAgent();
+}
+
+// Ask the thread of a live agent to leave its loop and move the agent to
+// the retired list; doesn't wait. g_agents_mutex held.
+void RetireAgent(RemoteAgent &agent) {
+  if (agent.thread) {
+    const uint32_t quit = 1;
+    WriteProcessMemory(agent.process, agent.control + QuitOffset(agent), &quit,
+                       sizeof(quit), nullptr);
+    SetEvent(agent.request);
+  }
+  g_retired_agents.push_back(agent);
+  agent = RemoteAgent();
+}
+
+// free the agents whose thread has ended, by quitting or with its process;
+// g_agents_mutex held
+void PruneAgents() {
+  for (auto it = g_agents.begin(); it != g_agents.end();) {
+    if (!it->second.busy &&
+        WaitForSingleObject(it->second.thread, 0) == WAIT_OBJECT_0) {
+      FreeAgent(it->second);
+      it = g_agents.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = g_retired_agents.begin(); it != g_retired_agents.end();) {
+    if (WaitForSingleObject(it->thread, 0) == WAIT_OBJECT_0) {
+      FreeAgent(*it);
+      it = g_retired_agents.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// find or inject the agent of pid and mark it busy; nullptr if the process
+// can't be injected or the agent is still answering another probe
+RemoteAgent *AcquireAgent(DWORD pid, size_t code_size, size_t entry64,
+                          size_t entry32) {
+  std::lock_guard<std::mutex> lk(g_agents_mutex);
+  PruneAgents();
+  auto it = g_agents.find(pid);
+  if (it == g_agents.end()) {
+    RemoteAgent agent;
+    agent.process = OpenProcess(
+        PROCESS_CREATE_THREAD | PROCESS_QUERY_INFORMATION |
+            PROCESS_VM_OPERATION | PROCESS_VM_WRITE | PROCESS_VM_READ |
+            PROCESS_DUP_HANDLE | SYNCHRONIZE,
+        FALSE, pid);
+    if (!agent.process)
+      return nullptr;
+    agent.is_x64 = IsX64Process(agent.process);
+    if (!GetModuleBase(agent.process, L"user32.dll", &agent.user32) ||
+        !GetModuleBase(agent.process, L"combase.dll", &agent.combase) ||
+        !StartAgent(agent, code_size, agent.is_x64 ? entry64 : entry32)) {
+      FreeAgent(agent);
+      return nullptr;
+    }
+    it = g_agents.emplace(pid, agent).first;
+  }
+  RemoteAgent &agent = it->second;
+  if (agent.busy)
+    return nullptr;
+  if (agent.pending) {
+    // the page is reusable once the late probe has signalled done
+    if (WaitForSingleObject(agent.done, 0) != WAIT_OBJECT_0)
+      return nullptr;
+    agent.pending = false;
+  }
+  agent.busy = true;
+  return &agent;
+}
+
+// Retire the agents of every process but pid, on a foreground change; an
+// agent answering a probe is retired when the probe returns.
+void RetireAgentsExcept(DWORD pid) {
+  std::lock_guard<std::mutex> lk(g_agents_mutex);
+  for (auto it = g_agents.begin(); it != g_agents.end();) {
+    if (it->first == pid) {
+      ++it;
+    } else if (it->second.busy) {
+      it->second.retire = true;
+      ++it;
+    } else {
+      RetireAgent(it->second);
+      it = g_agents.erase(it);
+    }
+  }
+  PruneAgents();
+}
+
+// on shutdown, give the threads a moment to leave their loops
+void ReleaseAgents() {
+  std::lock_guard<std::mutex> lk(g_agents_mutex);
+  for (auto &item : g_agents)
+    RetireAgent(item.second);
+  g_agents.clear();
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+  for (auto &agent : g_retired_agents) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() > 0)
+      WaitForSingleObject(agent.thread, static_cast<DWORD>(left.count()));
+    FreeAgent(agent);
+  }
+  g_retired_agents.clear();
+}
+
+// Run the shellcode in the target's resident agent and read back the caret
+// rect. The wait is bounded so a hung target cannot stall the caller.
 bool GetCaretFromHook(HWND hwnd, RECT *out) {
   if (!hwnd || !g_use_caret_hook)
     return false;
@@ -366,95 +718,78 @@ bool GetCaretFromHook(HWND hwnd, RECT *out) {
   SendMessageTimeoutW(hwnd, WM_IME_COMPOSITION, 0, 0, SMTO_ABORTIFHUNG, 30,
                       nullptr);
 
-  HANDLE hProcess =
-      OpenProcess(PROCESS_CREATE_THREAD | PROCESS_QUERY_INFORMATION |
-                      PROCESS_VM_OPERATION | PROCESS_VM_WRITE | PROCESS_VM_READ,
-                  FALSE, pid);
-  if (!hProcess)
+  // one page fits either shellcode
+  const size_t sc_max = (std::max)(sizeof(kCaretHookShellcode64),
+                                   sizeof(kCaretHookShellcode32));
+  const size_t code_size = (sc_max + 15) & ~size_t(15);
+  RemoteAgent *agent = AcquireAgent(pid, code_size, 0x4e0, 0x43c);
+  if (!agent)
     return false;
 
-  bool is_x64 = IsX64Process(hProcess);
-  uintptr_t user32_base = 0, combase_base = 0;
-  if (!GetModuleBases(hProcess, pid, &user32_base, &combase_base)) {
-    CloseHandle(hProcess);
-    return false;
-  }
-
   const unsigned char *sc;
   size_t sc_size;
-  size_t entry_offset;
   size_t rect_offset;
-  if (is_x64) {
+  if (agent->is_x64) {
     sc = kCaretHookShellcode64;
     sc_size = sizeof(kCaretHookShellcode64);
-    entry_offset = 0x4e0;
     rect_offset = 56;
   } else {
     sc = kCaretHookShellcode32;
     sc_size = sizeof(kCaretHookShellcode32);
-    entry_offset = 0x43c;
     rect_offset = 32;
   }
 
+  // the shellcode keeps its state in the page, so it is rewritten whole for
+  // every probe; that is a small copy next to a fresh allocation
   std::vector<unsigned char> buf(sc, sc + sc_size);
-  if (is_x64) {
-    PutU64(&buf[0], user32_base);
-    PutU64(&buf[8], combase_base);
+  if (agent->is_x64) {
+    PutU64(&buf[0], agent->user32);
+    PutU64(&buf[8], agent->combase);
     PutU64(&buf[16], reinterpret_cast<uint64_t>(hwnd));
     PutU32(&buf[24], tid);
     PutU32(&buf[28], WM_GET_CARET_POS);
   } else {
-    PutU32(&buf[0], static_cast<uint32_t>(user32_base));
-    PutU32(&buf[4], static_cast<uint32_t>(combase_base));
+    PutU32(&buf[0], static_cast<uint32_t>(agent->user32));
+    PutU32(&buf[4], static_cast<uint32_t>(agent->combase));
     PutU32(&buf[8], static_cast<uint32_t>(reinterpret_cast<uintptr_t>(hwnd)));
     PutU32(&buf[12], tid);
     PutU32(&buf[16], WM_GET_CARET_POS);
   }
 
-  void *remote = VirtualAllocEx(hProcess, nullptr, sc_size, MEM_COMMIT,
-                                PAGE_EXECUTE_READWRITE);
-  if (!remote) {
-    CloseHandle(hProcess);
-    return false;
-  }
-
+  HANDLE hProcess = agent->process;
   bool result = false;
-  bool thread_created = false;
-  bool thread_finished = false;
+  bool signalled = false;
+  bool answered = false;
   SIZE_T written = 0;
-  if (WriteProcessMemory(hProcess, remote, buf.data(), sc_size, &written)) {
-    FlushInstructionCache(hProcess, remote, sc_size);
-    LPTHREAD_START_ROUTINE entry = reinterpret_cast<LPTHREAD_START_ROUTINE>(
-        reinterpret_cast<unsigned char *>(remote) + entry_offset);
-    HANDLE hThread =
-        CreateRemoteThread(hProcess, nullptr, 0, entry, remote, 0, nullptr);
-    if (hThread) {
-      thread_created = true;
-      thread_finished = (WaitForSingleObject(hThread, 150) == WAIT_OBJECT_0);
-      if (thread_finished) {
-        DWORD exit_code = 0;
-        if (GetExitCodeThread(hThread, &exit_code) && exit_code == 0) {
-          RECT r = {0};
-          SIZE_T bytes_read = 0;
-          void *prect = reinterpret_cast<unsigned char *>(remote) + rect_offset;
-          if (ReadProcessMemory(hProcess, prect, &r, sizeof(r), &bytes_read) &&
-              bytes_read == sizeof(r)) {
-            PhysicalToScreenRect(hwnd, &r);
-            *out = r;
-            result = true;
-          }
-        }
-      }
-      CloseHandle(hThread);
+  if (WriteProcessMemory(hProcess, agent->remote, buf.data(), sc_size,
+                         &written)) {
+    FlushInstructionCache(hProcess, agent->remote, sc_size);
+    signalled = SetEvent(agent->request) != FALSE;
+    answered =
+        signalled && WaitForSingleObject(agent->done, 150) == WAIT_OBJECT_0;
+  }
+  if (answered) {
+    uint32_t exit_code = 1;
+    RECT r = {0};
+    if (ReadRemote(hProcess, agent->control + QuitOffset(*agent) + 4,
+                   &exit_code, sizeof(exit_code)) &&
+        exit_code == 0 &&
+        ReadRemote(hProcess, agent->remote + rect_offset, &r, sizeof(r))) {
+      PhysicalToScreenRect(hwnd, &r);
+      *out = r;
+      result = true;
     }
   }
 
-  // Release the remote allocation only once the thread is done; freeing it
-  // under a still-running thread would crash the target process. On timeout
-  // the page is leaked (the thread finishes on its own internal timeouts).
-  if (!thread_created || thread_finished)
-    VirtualFreeEx(hProcess, remote, 0, MEM_RELEASE);
-  CloseHandle(hProcess);
+  // On timeout the probe finishes on the shellcode's own timeouts; the page
+  // is not rewritten until it has signalled done.
+  std::lock_guard<std::mutex> lk(g_agents_mutex);
+  agent->pending = signalled && !answered;
+  agent->busy = false;
+  if (agent->retire) {
+    RetireAgent(*agent);
+    g_agents.erase(pid);
+  }
   return result;
 }
 
@@ -532,18 +867,190 @@ bool IsUwpClass(HWND hwnd) {
          wcsncmp(cls, L"Microsoft.UI", 12) == 0;
 }
 
-} // namespace
+// ---------------------------------------------------------------------------
+// Probe strategy per (process name, window class). Apps are consistent about
+// which probe finds their caret, so the last winner is tried first, and a
+// probe that keeps failing is only retried every kRetryInterval lookups.
 
-void SetUseCaretHook(bool enable) { g_use_caret_hook = enable; }
+enum ProbeKind { kMsaa, kUia, kHook, kProbeKinds };
+const char *const kProbeNames[kProbeKinds] = {"msaa", "uia", "hook"};
+const uint32_t kBackoffStreak = 4;
+const uint32_t kRetryInterval = 32;
 
-void Shutdown() {
-  if (g_hook_worker.joinable())
-    g_hook_worker.join();
+struct ProbeStat {
+  uint32_t successes = 0;
+  uint32_t failures = 0;
+  uint32_t fail_streak = 0;
+  double total_us = 0;
+};
+
+struct Strategy {
+  ProbeStat probes[kProbeKinds];
+  int winner = -1;
+  uint32_t lookups = 0;
+};
+
+std::map<std::wstring, Strategy> g_strategies;
+std::wstring g_strategy_file;
+bool g_strategies_dirty = false;
+
+std::wstring ProcessName(HWND hwnd) {
+  DWORD pid = 0;
+  GetWindowThreadProcessId(hwnd, &pid);
+  HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (!hProcess)
+    return L"";
+  wchar_t image[MAX_PATH] = {0};
+  DWORD size = _countof(image);
+  std::wstring name;
+  if (QueryFullProcessImageNameW(hProcess, 0, image, &size)) {
+    const wchar_t *slash = wcsrchr(image, L'\\');
+    name = slash ? slash + 1 : image;
+    CharLowerBuffW(&name[0], (DWORD)name.size());
+  }
+  CloseHandle(hProcess);
+  return name;
 }
 
-bool GetScreenRect(RECT *out) {
-  if (!out)
+Strategy &StrategyFor(HWND hwnd) {
+  // the focused window rarely changes between lookups
+  static HWND last_hwnd = nullptr;
+  static std::wstring last_key;
+  if (hwnd != last_hwnd || last_key.empty()) {
+    wchar_t cls[256] = {0};
+    GetClassNameW(hwnd, cls, 255);
+    last_key = ProcessName(hwnd) + L"|" + cls;
+    last_hwnd = hwnd;
+  }
+  return g_strategies[last_key];
+}
+
+bool RunProbe(ProbeKind kind, HWND hwnd, RECT *out) {
+  switch (kind) {
+  case kMsaa:
+    return GetCaretFromMsaa(hwnd, out);
+  case kUia:
+    return GetCaretFromUia(out);
+  case kHook:
+    return GetCaretViaHook(hwnd, out);
+  default:
     return false;
+  }
+}
+
+void LoadStrategies() {
+  g_strategies.clear();
+  std::ifstream ifs(g_strategy_file);
+  if (!ifs)
+    return;
+  try {
+    nlohmann::json j;
+    ifs >> j;
+    for (const auto &item : j.items()) {
+      Strategy &strategy = g_strategies[u8tow(item.key())];
+      strategy.winner = item.value().value("winner", -1);
+      for (int i = 0; i < kProbeKinds; i++) {
+        const auto &v = item.value().value(kProbeNames[i], nlohmann::json());
+        if (!v.is_array() || v.size() != 4)
+          continue;
+        ProbeStat &stat = strategy.probes[i];
+        stat.successes = v[0].get<uint32_t>();
+        stat.failures = v[1].get<uint32_t>();
+        stat.fail_streak = v[2].get<uint32_t>();
+        stat.total_us = v[3].get<double>();
+      }
+    }
+  } catch (const std::exception &e) {
+    DEBUG << "Failed to read caret strategies: " << e.what();
+    g_strategies.clear();
+  }
+}
+
+void SaveStrategies() {
+  if (g_strategy_file.empty() || !g_strategies_dirty)
+    return;
+  nlohmann::json j = nlohmann::json::object();
+  for (const auto &item : g_strategies) {
+    nlohmann::json &entry = j[wtou8(item.first)];
+    entry["winner"] = item.second.winner;
+    for (int i = 0; i < kProbeKinds; i++) {
+      const ProbeStat &stat = item.second.probes[i];
+      entry[kProbeNames[i]] = {stat.successes, stat.failures, stat.fail_streak,
+                               stat.total_us};
+    }
+  }
+  std::ofstream ofs(g_strategy_file);
+  if (ofs)
+    ofs << j.dump(2);
+  g_strategies_dirty = false;
+}
+
+// ---------------------------------------------------------------------------
+// Caret tracker. Out-of-context win events are delivered on the thread that
+// installed them, the same one calling GetScreenRect, so the cache needs no
+// locking.
+
+std::vector<HWINEVENTHOOK> g_event_hooks;
+bool g_cache_dirty = true;
+bool g_cache_valid = false;
+bool g_cache_found = false;
+HWND g_cache_hwnd = nullptr;
+RECT g_cache_rect = {0};
+std::chrono::steady_clock::time_point g_cache_time;
+// bound on staleness for apps that move the caret without raising events
+const auto kCacheMaxAge = std::chrono::milliseconds(1000);
+
+size_t g_lookups = 0;
+size_t g_probes = 0;
+// cost of the recent lookups in microseconds, a ring buffer
+float g_costs[1024] = {0};
+
+// EVENT_OBJECT_LOCATIONCHANGE is only hooked for the foreground process; a
+// global hook would get every window and mouse cursor move on the desktop
+HWINEVENTHOOK g_location_hook = nullptr;
+DWORD g_location_pid = 0;
+
+void CALLBACK CaretEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                             LONG idObject, LONG idChild, DWORD idEventThread,
+                             DWORD dwmsEventTime);
+
+void WatchLocationOf(HWND hwnd) {
+  DWORD pid = 0;
+  if (hwnd)
+    GetWindowThreadProcessId(hwnd, &pid);
+  if (pid == g_location_pid)
+    return;
+  if (g_location_hook) {
+    UnhookWinEvent(g_location_hook);
+    g_location_hook = nullptr;
+  }
+  g_location_pid = pid;
+  if (!pid || pid == GetCurrentProcessId())
+    return;
+  g_location_hook =
+      SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE,
+                      NULL, CaretEventProc, pid, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+void CALLBACK CaretEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                             LONG idObject, LONG idChild, DWORD idEventThread,
+                             DWORD dwmsEventTime) {
+  // the other objects of the foreground process still move often
+  if (event == EVENT_OBJECT_LOCATIONCHANGE && idObject != OBJID_CARET)
+    return;
+  if (event == EVENT_SYSTEM_FOREGROUND) {
+    WatchLocationOf(hwnd);
+    // only the foreground process is probed; let the other agents go
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    RetireAgentsExcept(pid);
+  }
+  g_cache_dirty = true;
+}
+
+// probe GUI thread info, then MSAA, UIA and the hook in the app's preferred
+// order; cacheable is cleared when the result came from the hook
+bool Probe(RECT *out, bool *cacheable) {
   HWND hwnd = nullptr;
   if (GetGuiThreadInfoCaret(&hwnd, out))
     return true;
@@ -553,20 +1060,42 @@ bool GetScreenRect(RECT *out) {
     return false;
 
   // UWP surfaces prefer UIA; legacy apps prefer MSAA first. The hook is the
-  // last resort for both.
+  // last resort for both. The app's last winner goes before them all.
+  ProbeKind order[kProbeKinds] = {kMsaa, kUia, kHook};
+  if (IsUwpClass(hwnd))
+    std::swap(order[0], order[1]);
+  Strategy &strategy = StrategyFor(hwnd);
+  if (strategy.winner >= 0 && strategy.winner < kProbeKinds) {
+    auto winner = std::find(order, order + kProbeKinds, strategy.winner);
+    std::rotate(order, winner, winner + 1);
+  }
+  strategy.lookups++;
+  g_strategies_dirty = true;
+
   bool ok = false;
-  if (IsUwpClass(hwnd)) {
-    ok = GetCaretFromUia(out);
-    if (!ok)
-      ok = GetCaretFromMsaa(hwnd, out);
-    if (!ok)
-      ok = GetCaretViaHook(hwnd, out);
-  } else {
-    ok = GetCaretFromMsaa(hwnd, out);
-    if (!ok)
-      ok = GetCaretFromUia(out);
-    if (!ok)
-      ok = GetCaretViaHook(hwnd, out);
+  for (ProbeKind kind : order) {
+    ProbeStat &stat = strategy.probes[kind];
+    if (kind == kHook && !g_use_caret_hook)
+      continue;
+    if (stat.fail_streak >= kBackoffStreak &&
+        strategy.lookups % kRetryInterval != 0)
+      continue;
+    const auto start = std::chrono::steady_clock::now();
+    ok = RunProbe(kind, hwnd, out);
+    const std::chrono::duration<double, std::micro> cost =
+        std::chrono::steady_clock::now() - start;
+    stat.total_us += cost.count();
+    if (!ok) {
+      stat.failures++;
+      stat.fail_streak++;
+      continue;
+    }
+    stat.successes++;
+    stat.fail_streak = 0;
+    strategy.winner = kind;
+    // the hook keeps its own cache
+    *cacheable = kind != kHook;
+    break;
   }
   if (!ok)
     return false;
@@ -583,4 +1112,109 @@ bool GetScreenRect(RECT *out) {
   return true;
 }
 
+} // namespace
+
+void SetUseCaretHook(bool enable) { g_use_caret_hook = enable; }
+
+void StartTracking() {
+  if (!g_event_hooks.empty())
+    return;
+  const DWORD events[] = {EVENT_SYSTEM_FOREGROUND, EVENT_OBJECT_FOCUS,
+                          EVENT_OBJECT_TEXTSELECTIONCHANGED};
+  for (DWORD event : events) {
+    HWINEVENTHOOK hook =
+        SetWinEventHook(event, event, NULL, CaretEventProc, 0, 0,
+                        WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    if (hook)
+      g_event_hooks.push_back(hook);
+  }
+  WatchLocationOf(GetForegroundWindow());
+  g_cache_dirty = true;
+}
+
+void Invalidate() { g_cache_dirty = true; }
+
+void SetStrategyFile(const std::wstring &file) {
+  SaveStrategies();
+  g_strategy_file = file;
+  LoadStrategies();
+}
+
+void LogStrategyStats() {
+  for (const auto &item : g_strategies) {
+    std::ostringstream oss;
+    oss << "winner: "
+        << (item.second.winner >= 0 ? kProbeNames[item.second.winner]
+                                    : "none");
+    for (int i = 0; i < kProbeKinds; i++) {
+      const ProbeStat &stat = item.second.probes[i];
+      const uint32_t runs = stat.successes + stat.failures;
+      if (!runs)
+        continue;
+      oss << ", " << kProbeNames[i] << ": " << stat.successes << "/" << runs
+          << " avg " << (long)(stat.total_us / runs) << "us";
+    }
+    DEBUG << "caret strategy " << item.first << " " << oss.str();
+  }
+}
+
+size_t LookupCount() { return g_lookups; }
+
+void GetStats(Stats *stats) {
+  const size_t n = (std::min)(g_lookups, _countof(g_costs));
+  std::vector<float> costs(g_costs, g_costs + n);
+  stats->lookups = g_lookups;
+  stats->probes = g_probes;
+  stats->p99_us = 0;
+  if (!costs.empty()) {
+    auto p99 = costs.begin() + costs.size() * 99 / 100;
+    std::nth_element(costs.begin(), p99, costs.end());
+    stats->p99_us = *p99;
+  }
+}
+
+void Shutdown() {
+  if (g_hook_worker.joinable())
+    g_hook_worker.join();
+  ReleaseAgents();
+  SaveStrategies();
+  for (HWINEVENTHOOK hook : g_event_hooks)
+    UnhookWinEvent(hook);
+  g_event_hooks.clear();
+  WatchLocationOf(nullptr);
+  if (g_automation) {
+    g_automation->Release();
+    g_automation = nullptr;
+  }
+}
+
+bool GetScreenRect(RECT *out) {
+  if (!out)
+    return false;
+  const auto start = std::chrono::steady_clock::now();
+  const HWND foreground = GetForegroundWindow();
+  bool ok = false;
+  if (!g_event_hooks.empty() && g_cache_valid && !g_cache_dirty &&
+      g_cache_hwnd == foreground && start - g_cache_time < kCacheMaxAge) {
+    ok = g_cache_found;
+    if (ok)
+      *out = g_cache_rect;
+  } else {
+    bool cacheable = true;
+    ok = Probe(out, &cacheable);
+    g_probes++;
+    g_cache_valid = cacheable;
+    g_cache_dirty = false;
+    g_cache_found = ok;
+    g_cache_hwnd = foreground;
+    g_cache_time = start;
+    if (ok)
+      g_cache_rect = *out;
+  }
+  const std::chrono::duration<float, std::micro> cost =
+      std::chrono::steady_clock::now() - start;
+  g_costs[g_lookups++ % _countof(g_costs)] = cost.count();
+  return ok;
+}
+
 } // namespace caret
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <windows.h>
 
 // Auto caret positioning, ported from rabbit (AutoHotkey) GetCaretPosEx.
@@ -12,11 +13,38 @@ void SetUseCaretHook(bool enable);
 
 // Resolve the focused window's caret into screen coordinates. Returns false
 // when no caret can be located, in which case callers should fall back to
-// the mouse position.
+// the mouse position. While tracking, the last result is reused until a
+// focus, selection or caret-location event (or Invalidate) marks it stale.
 bool GetScreenRect(RECT *out);
 
-// Join the background caret-hook worker. Call before process exit so the
-// worker does not outlive the global objects it touches.
+// Subscribe to the win events that move the caret. Call on the thread that
+// runs the message loop and calls GetScreenRect, after COM is initialized.
+void StartTracking();
+
+// Force the next GetScreenRect to probe, e.g. after text was committed.
+void Invalidate();
+
+// Load the per-(process, window class) probe strategy table from file, and
+// save it there on Shutdown. Probes that found an app's caret are tried first
+// for that app; probes that keep failing are backed off.
+void SetStrategyFile(const std::wstring &file);
+
+// Log the probe success rate and cost per app.
+void LogStrategyStats();
+
+// GetScreenRect calls so far, without the cost of GetStats
+size_t LookupCount();
+
+struct Stats {
+  size_t lookups; // GetScreenRect calls
+  size_t probes;  // lookups that had to probe GUI thread info/MSAA/UIA/hook
+  double p99_us;  // p99 GetScreenRect cost over the recent lookups
+};
+void GetStats(Stats *stats);
+
+// Join the background caret-hook worker, remove the event hooks and release
+// the UIA client. Call before process exit so the worker does not outlive
+// the global objects it touches.
 void Shutdown();
 
 } // namespace caret
@@ -0,0 +1,76 @@
+#include "key_recorder.h"
+#include <algorithm>
+
+namespace weasel {
+
+static const char kMagic[4] = {'R', 'T', 'K', 'R'};
+static const uint32_t kVersion = 1;
+
+static void put_u32(unsigned char *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool KeyRecorder::Start(const std::string &file_path) {
+  Stop();
+  m_file = std::fopen(file_path.c_str(), "wb");
+  if (!m_file)
+    return false;
+  unsigned char header[8];
+  std::copy(kMagic, kMagic + 4, header);
+  put_u32(header + 4, kVersion);
+  std::fwrite(header, 1, sizeof(header), m_file);
+  m_last_us = 0;
+  m_flushed_us = 0;
+  return true;
+}
+
+void KeyRecorder::Stop() {
+  if (m_file) {
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+void KeyRecorder::Record(uint16_t keycode, uint16_t mask, uint64_t now_us) {
+  if (!m_file)
+    return;
+  const uint64_t delay = m_last_us ? now_us - m_last_us : 0;
+  m_last_us = now_us;
+  unsigned char rec[8];
+  put_u32(rec, delay > UINT32_MAX ? UINT32_MAX : (uint32_t)delay);
+  put_u32(rec + 4, keycode | ((uint32_t)mask << 16));
+  std::fwrite(rec, 1, sizeof(rec), m_file);
+  // stdio buffers the writes, flush them once in a while instead of per key
+  if (now_us - m_flushed_us >= kFlushIntervalUs) {
+    std::fflush(m_file);
+    m_flushed_us = now_us;
+  }
+}
+
+bool LoadKeyRecords(const std::string &file_path,
+                    std::vector<KeyRecord> &records) {
+  std::FILE *f = std::fopen(file_path.c_str(), "rb");
+  if (!f)
+    return false;
+  unsigned char buf[8];
+  bool ok = std::fread(buf, 1, 8, f) == 8 &&
+            std::equal(kMagic, kMagic + 4, (const char *)buf) &&
+            get_u32(buf + 4) == kVersion;
+  records.clear();
+  while (ok && std::fread(buf, 1, 8, f) == 8) {
+    const uint32_t key = get_u32(buf + 4);
+    records.push_back({get_u32(buf), uint16_t(key & 0xffff),
+                       uint16_t(key >> 16)});
+  }
+  std::fclose(f);
+  return ok;
+}
+
+} // namespace weasel
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace weasel {
+
+// one recorded key event, as passed to RimeWithToy::ProcessKeyEvent
+struct KeyRecord {
+  uint32_t delay_us; // time since the previous record
+  uint16_t keycode;
+  uint16_t mask; // ibus modifier mask, before expand_ibus_modifier
+};
+
+// Appends key events to a compact binary file:
+//   "RTKR" magic, uint32 version, then 8 byte little endian KeyRecord entries
+class KeyRecorder {
+public:
+  KeyRecorder() : m_file(nullptr), m_last_us(0), m_flushed_us(0) {}
+  ~KeyRecorder() { Stop(); }
+  bool Start(const std::string &file_path);
+  void Stop();
+  bool recording() const { return m_file != nullptr; }
+  // now_us: a monotonic timestamp in microseconds. Writes are flushed by the
+  // first key after each kFlushIntervalUs, so while typing a crash loses
+  // about a second of keys
+  void Record(uint16_t keycode, uint16_t mask, uint64_t now_us);
+
+private:
+  static const uint64_t kFlushIntervalUs = 1000000;
+  std::FILE *m_file;
+  uint64_t m_last_us;
+  uint64_t m_flushed_us;
+};
+
+// read a file written by KeyRecorder, false if it is missing or malformed
+bool LoadKeyRecords(const std::string &file_path,
+                    std::vector<KeyRecord> &records);
+
+} // namespace weasel
@@ -2,5 +2,11 @@
 
 #include <string>
 namespace weasel {
+// keyval returned by GetKeycodeByName for unknown names (VoidSymbol)
+const int kVoidSymbol = 0xffffff;
+// name of a keyval, nullptr if it has none
+const char *GetKeyName(int keycode);
+// keyval of a key name, e.g. "Page_Up", kVoidSymbol if unknown
+int GetKeycodeByName(const char *name);
 std::string repr(int keycode_, int modifier_);
-}
+} // namespace weasel
@@ -0,0 +1,29 @@
+#include "keymap.h"
+#include <cstring>
+#include <cwctype>
+
+namespace weasel {
+
+void KeyMap::Clear() { memset(m_chars, 0, sizeof(m_chars)); }
+
+void KeyMap::Set(uint8_t vk, ShiftState state, uint32_t ch, bool dead) {
+  m_chars[vk][state] = dead ? (ch | kDeadKeyFlag) : ch;
+}
+
+uint32_t KeyMap::Lookup(uint8_t vk, ShiftState state) const {
+  const uint32_t ch = m_chars[vk][state];
+  return (ch & kDeadKeyFlag) ? 0 : ch;
+}
+
+bool KeyMap::IsDeadKey(uint8_t vk, ShiftState state) const {
+  return (m_chars[vk][state] & kDeadKeyFlag) != 0;
+}
+
+uint32_t KeyMap::Translate(uint8_t vk, bool shift, bool caps_lock) const {
+  uint32_t ch = Lookup(vk, shift ? kShift : kPlain);
+  if (ch && caps_lock && !shift)
+    ch = (uint32_t)towlower((wint_t)ch);
+  return ch;
+}
+
+} // namespace weasel
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+namespace weasel {
+
+// Characters produced by each virtual key of one keyboard layout, in the
+// plain and shift states. Filled once per layout by BuildKeyMap in
+// keymodule.cpp; lookups are plain table reads, no Win32 calls.
+class KeyMap {
+public:
+  enum ShiftState { kPlain = 0, kShift = 1, kShiftStates = 2 };
+
+  KeyMap() { Clear(); }
+  void Clear();
+  // ch: UTF-16 code unit produced by the key, dead: the key is a dead key
+  void Set(uint8_t vk, ShiftState state, uint32_t ch, bool dead);
+  // character of the key, 0 when the key produces none or is a dead key
+  uint32_t Lookup(uint8_t vk, ShiftState state) const;
+  bool IsDeadKey(uint8_t vk, ShiftState state) const;
+  // CapsLock is reported by LOCK_MASK instead, so without shift the
+  // character is lowercased
+  uint32_t Translate(uint8_t vk, bool shift, bool caps_lock) const;
+
+private:
+  static const uint32_t kDeadKeyFlag = 0x80000000u;
+  uint32_t m_chars[256][kShiftStates];
+};
+
+} // namespace weasel
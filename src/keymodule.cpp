@@ -1,10 +1,45 @@
 #include "keymodule.h"
+#include "keymap.h"
 #include <vector>
 
 namespace weasel {
 
 BYTE keyState[256] = {0};
 bool caps_lock_on = (GetAsyncKeyState(VK_CAPITAL) & 0x01) != 0;
+static KeyMap keymap;
+static HKL keymap_hkl = NULL;
+
+// fill keymap with the characters of every vk in plain and shift state, so
+// the key path never calls ToUnicodeEx (which also clobbers the dead key
+// buffer of the focused app)
+static void BuildKeyMap(HKL hkl, KeyMap &map) {
+  // don't change keyboard state (Windows 10 1607+)
+  const UINT flags = 0x4;
+  BYTE table[256] = {0};
+  WCHAR buf[8];
+  const UINT sc_space = MapVirtualKeyEx(VK_SPACE, MAPVK_VK_TO_VSC, hkl);
+  map.Clear();
+  for (int state = 0; state < KeyMap::kShiftStates; state++) {
+    table[VK_SHIFT] = (state == KeyMap::kShift) ? 0x80 : 0;
+    for (UINT vk = 1; vk < 256; vk++) {
+      const UINT sc = MapVirtualKeyEx(vk, MAPVK_VK_TO_VSC, hkl);
+      int ret = ToUnicodeEx(vk, sc, table, buf, _countof(buf), flags, hkl);
+      if (ret == 1 || ret == -1)
+        map.Set((uint8_t)vk, (KeyMap::ShiftState)state, buf[0], ret < 0);
+      // older systems ignore flags, flush the pending dead key
+      while (ret < 0)
+        ret = ToUnicodeEx(VK_SPACE, sc_space, table, buf, _countof(buf), flags,
+                          hkl);
+    }
+  }
+}
+
+void SyncKeyboardLayout(HKL hkl) {
+  if (!hkl || hkl == keymap_hkl)
+    return;
+  BuildKeyMap(hkl, keymap);
+  keymap_hkl = hkl;
+}
 // ----------------------------------------------------------------------------
 ibus::Keycode TranslateKeycode(UINT vkey, KeyInfo kinfo) {
   switch (vkey) {
@@ -203,7 +238,6 @@ ibus::Keycode TranslateKeycode(UINT vkey, KeyInfo kinfo) {
 
 bool ConvertKeyEvent(const KBDLLHOOKSTRUCT *pKeyboard, KeyInfo &kinfo,
                      KeyEvent &result) {
-  static HKL hkl = GetKeyboardLayout(0);
   const BYTE KEY_DOWN = 0x80;
   const BYTE TOGGLED = 0x01;
   result.mask = ibus::NULL_MASK;
@@ -241,24 +275,15 @@ bool ConvertKeyEvent(const KBDLLHOOKSTRUCT *pKeyboard, KeyInfo &kinfo,
     return true;
   }
 
-  const int buf_len = 8;
-  static WCHAR buf[buf_len];
-  static BYTE table[256];
-  // 清除Ctrl、Alt鍵狀態，以令ToUnicodeEx()返回字符
-  memcpy(table, keyState, sizeof(table));
-  table[VK_CONTROL] = 0;
-  table[VK_MENU] = 0;
-  // Do not let CapsLock toggle affect ToUnicodeEx output; report LOCK via mask
-  // instead
-  table[VK_CAPITAL] = 0;
-  int ret = ToUnicodeEx(vkey, UINT(kinfo), table, buf, buf_len, 0, NULL);
-  if (ret == 1) {
-    wchar_t ch = buf[0];
-    // If CapsLock is active (reported via LOCK_MASK) and Shift is not pressed,
-    // ensure we send the lowercase letter while still setting LOCK_MASK.
-    if ((result.mask & ibus::LOCK_MASK) && !(result.mask & ibus::SHIFT_MASK))
-      ch = towlower(ch);
-    result.keycode = UINT(ch);
+  if (!keymap_hkl)
+    SyncKeyboardLayout(GetKeyboardLayout(0));
+  // Ctrl、Alt and CapsLock don't take part in the lookup; LOCK is reported via
+  // mask, and lowercased when Shift is not pressed
+  const uint32_t ch = keymap.Translate(
+      (uint8_t)vkey, (result.mask & ibus::SHIFT_MASK) != 0,
+      (result.mask & ibus::LOCK_MASK) != 0);
+  if (ch) {
+    result.keycode = ch;
     return true;
   }
 
@@ -324,9 +349,11 @@ void update_keystates(WPARAM wParam, LPARAM lParam) {
       keyState[key] &= ~0x80;
   };
   // avoid keyState[VK_LWIN] or keyState[VK_RWIN] not released after action that
-  // logout with win+l and re-login
-  update(VK_LWIN);
-  update(VK_RWIN);
+  // logout with win+l and re-login; only a key we believe down can be stale
+  if (keyState[VK_LWIN] & 0x80)
+    update(VK_LWIN);
+  if (keyState[VK_RWIN] & 0x80)
+    update(VK_RWIN);
   keyState[VK_SHIFT] = (keyState[VK_LSHIFT] | keyState[VK_RSHIFT]);
   keyState[VK_CONTROL] = (keyState[VK_LCONTROL] | keyState[VK_RCONTROL]);
   keyState[VK_MENU] = (keyState[VK_LMENU] | keyState[VK_RMENU]);
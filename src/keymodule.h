@@ -246,6 +246,8 @@ bool AcquireDeployerMutex();
 void ReleaseDeployerMutex();
 void send_input_to_window(const std::wstring &text);
 void update_keystates(WPARAM wParam, LPARAM lParam);
+// rebuild the vk to character table when the active keyboard layout changes
+void SyncKeyboardLayout(HKL hkl);
 KeyInfo parse_key(WPARAM wParam, LPARAM lParam);
 bool ConvertKeyEvent(const KBDLLHOOKSTRUCT *pKeyboard, KeyInfo &kinfo,
                      KeyEvent &result);
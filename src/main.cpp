@@ -8,6 +8,7 @@
 #include <WeaselIPCData.h>
 #include <WeaselUI.h>
 #include <imm.h>
+#include <unordered_map>
 
 using namespace std;
 using namespace weasel;
@@ -48,14 +49,50 @@ void update_position(HWND hwnd) {
 }
 
 static HWND hwnd_previous = nullptr;
+// tick of the last IME check per window
+static std::unordered_map<HWND, ULONGLONG> ime_checked;
 static HWINEVENTHOOK g_foregroundHook = nullptr;
+static HWINEVENTHOOK g_focusHook = nullptr;
 static bool caps_key_down = false;
+// ms to wait for the target's IME window, a hung app must not stall typing
+static const UINT kImeControlTimeout = 50;
+// ms before a focus event checks the same window again
+static const ULONGLONG kImeRecheckInterval = 2000;
+static const size_t kMaxImeChecked = 64;
+
+// ensure ime keyboard not open, not ok yet to Weasel; done on foreground and
+// focus changes only, never on the keyboard hook path
+static void close_system_ime(HWND hwnd) {
+  if (!rime_toy_enabled || !hwnd)
+    return;
+  const ULONGLONG now = GetTickCount64();
+  auto it = ime_checked.find(hwnd);
+  if (it != ime_checked.end() && now - it->second < kImeRecheckInterval)
+    return;
+  if (it == ime_checked.end() && ime_checked.size() >= kMaxImeChecked) {
+    for (auto i = ime_checked.begin(); i != ime_checked.end();)
+      i = IsWindow(i->first) ? std::next(i) : ime_checked.erase(i);
+    if (ime_checked.size() >= kMaxImeChecked)
+      ime_checked.clear();
+  }
+  ime_checked[hwnd] = now;
+  HWND hImcWnd = ImmGetDefaultIMEWnd(hwnd);
+  if (!hImcWnd)
+    return;
+  DWORD_PTR open = 0;
+  // 5: IMC_GETOPENSTATUS, 6: IMC_SETOPENSTATUS
+  if (SendMessageTimeout(hImcWnd, WM_IME_CONTROL, 5, 0, SMTO_ABORTIFHUNG,
+                         kImeControlTimeout, &open) &&
+      open)
+    SendMessageTimeout(hImcWnd, WM_IME_CONTROL, 6, 0, SMTO_ABORTIFHUNG,
+                       kImeControlTimeout, nullptr);
+}
 
 static void handle_window_change(HWND hwnd) {
   if (!m_toy || !hwnd || hwnd == hwnd_previous)
     return;
   hwnd_previous = hwnd;
-  m_toy->DestroyUI();
+  m_toy->SwitchSession(hwnd);
 }
 
 // ----------------------------------------------------------------------------
@@ -63,8 +100,13 @@ void CALLBACK ForegroundWindowEventHook(HWINEVENTHOOK hook, DWORD event,
                                         HWND hwnd, LONG idObject, LONG idChild,
                                         DWORD idEventThread,
                                         DWORD dwmsEventTime) {
+  // the keyboard or mouse hook may have switched the session already
   if (event == EVENT_SYSTEM_FOREGROUND)
     handle_window_change(hwnd);
+  // for focus: moved inside the window, maybe to a control of another thread
+  close_system_ime(hwnd);
+  if (m_toy)
+    m_toy->ForgetWorkArea();
 }
 
 LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
@@ -72,15 +114,13 @@ LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
     return CallNextHookEx(hKeyboardHook, nCode, wParam, lParam);
   HWND hwnd = GetForegroundWindow();
   handle_window_change(hwnd);
-  // ensure ime keyboard not open, not ok yet to Weasel
-  HWND hImcWnd = ImmGetDefaultIMEWnd(hwnd);
-  if (hImcWnd) {
-    if (SendMessage(hImcWnd, WM_IME_CONTROL, 5, 0))
-      SendMessage(hImcWnd, WM_IME_CONTROL, 6, 0);
-  }
   if (nCode == HC_ACTION) {
     // update keyState table
     update_keystates(wParam, lParam);
+    // the hook sees no WM_INPUTLANGCHANGE, follow the foreground thread's
+    // layout instead; a no-op unless it changed
+    SyncKeyboardLayout(
+        GetKeyboardLayout(GetWindowThreadProcessId(hwnd, nullptr)));
     KBDLLHOOKSTRUCT *pKeyboard = (KBDLLHOOKSTRUCT *)lParam;
     if (!pKeyboard->vkCode)
       goto skip;
@@ -125,18 +165,32 @@ skip:
 
 LRESULT CALLBACK MouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
   if (rime_toy_enabled && nCode == HC_ACTION && m_toy->UIHwnd()) {
-    HWND hwnd = GetForegroundWindow();
-    if (hwnd != hwnd_previous) {
-      hwnd_previous = hwnd;
-      m_toy->DestroyUI();
-      return CallNextHookEx(NULL, nCode, wParam, lParam);
-    }
+    // may run before EVENT_SYSTEM_FOREGROUND for the same switch
+    handle_window_change(GetForegroundWindow());
   }
   return CallNextHookEx(NULL, nCode, wParam, lParam);
 }
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                     LPWSTR lpCmdLine, int nCmdShow) {
+  // A UI server (--ui-server <channel>), started by an instance running with
+  // --remote-ui, draws that instance's panel; it has no hooks, no rime and no
+  // single-instance mutex, and exits with the instance.
+  if (lpCmdLine) {
+    std::wstring cmd(lpCmdLine);
+    size_t pos = cmd.find(L"--ui-server");
+    if (pos != std::wstring::npos) {
+      size_t p = pos + 11; // length of "--ui-server"
+      while (p < cmd.size() && (cmd[p] == L' ' || cmd[p] == L'\t'))
+        ++p;
+      const std::wstring name = cmd.substr(p, cmd.find_first_of(L" \t", p) - p);
+      SetProcessDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE);
+      HR(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED));
+      const int ret = RunUIServer(name);
+      CoUninitialize();
+      return ret;
+    }
+  }
   // A relaunched instance (--restart <pid>) waits for the previous instance to
   // exit before acquiring the single-instance mutex, so the restart succeeds.
   if (lpCmdLine) {
@@ -175,6 +229,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
   SetProcessDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE);
   HR(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED));
   m_toy = std::make_unique<RimeWithToy>(hInstance);
+  // --remote-ui: the panel is drawn by a UI server process, so that a stalled
+  // or crashed renderer cannot hold up the keyboard hook
+  if (lpCmdLine && wcsstr(lpCmdLine, L"--remote-ui") && !m_toy->StartUIServer())
+    DEBUG << L"Failed to start the UI server, drawing in process";
   // --------------------------------------------------------------------------
   hKeyboardHook =
       SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc, NULL, 0);
@@ -196,6 +254,14 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     DEBUG << L"Failed to install foreground-window hook! " << std::hex
           << GetLastError();
   }
+  g_focusHook =
+      SetWinEventHook(EVENT_OBJECT_FOCUS, EVENT_OBJECT_FOCUS, NULL,
+                      ForegroundWindowEventHook, 0, 0,
+                      WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+  if (!g_focusHook) {
+    DEBUG << L"Failed to install focus hook! " << std::hex << GetLastError();
+  }
+  caret::StartTracking();
   MSG msg;
   while (GetMessage(&msg, NULL, 0, 0)) {
     TranslateMessage(&msg);
@@ -205,6 +271,8 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
   UnhookWindowsHookEx(hMouseHook);
   if (g_foregroundHook)
     UnhookWinEvent(g_foregroundHook);
+  if (g_focusHook)
+    UnhookWinEvent(g_focusHook);
   caret::Shutdown();
   m_toy->Finalize();
   CoUninitialize();
@@ -0,0 +1,126 @@
+#include "rime_context.h"
+#include <utils.h>
+
+namespace weasel {
+
+static wstring GetLabelText(const wstring label, const wchar_t *format) {
+  wchar_t buffer[128];
+  swprintf_s<128>(buffer, format, label.c_str());
+  return std::wstring(buffer);
+}
+
+bool ReadRimeStatus(RimeApi *api, RimeSessionId session, Status &status) {
+  RIME_STRUCT(RimeStatus, status_);
+  if (!api->get_status(session, &status_))
+    return false;
+  status.ascii_mode = !!status_.is_ascii_mode;
+  status.composing = !!status_.is_composing;
+  status.disabled = !!status_.is_disabled;
+  status.full_shape = !!status_.is_full_shape;
+  status.schema_id = u8tow(status_.schema_id);
+  status.schema_name = u8tow(status_.schema_name);
+  api->free_status(&status_);
+  return true;
+}
+
+void ReadCandidateInfo(const RimeContext &ctx, CandidateInfo &cinfo) {
+  cinfo.candies.resize(ctx.menu.num_candidates);
+  cinfo.comments.resize(ctx.menu.num_candidates);
+  cinfo.labels.resize(ctx.menu.num_candidates);
+  for (int i = 0; i < ctx.menu.num_candidates; ++i) {
+    cinfo.candies[i].str = u8tow(ctx.menu.candidates[i].text);
+    if (ctx.menu.candidates[i].comment) {
+      cinfo.comments[i].str = u8tow(ctx.menu.candidates[i].comment);
+    }
+    if (RIME_STRUCT_HAS_MEMBER(ctx, ctx.select_labels) && ctx.select_labels) {
+      cinfo.labels[i].str = u8tow(ctx.select_labels[i]);
+    } else if (ctx.menu.select_keys) {
+      cinfo.labels[i].str = wstring(1, ctx.menu.select_keys[i]);
+    } else {
+      cinfo.labels[i].str = std::to_wstring((i + 1) % 10);
+    }
+  }
+  cinfo.highlighted = ctx.menu.highlighted_candidate_index;
+  cinfo.currentPage = ctx.menu.page_no;
+  cinfo.is_last_page = ctx.menu.is_last_page;
+}
+
+void ReadRimeContext(RimeApi *api, RimeSessionId session, const UIStyle &style,
+                     const Status &status, Context &context) {
+  RIME_STRUCT(RimeContext, ctx);
+  if (api->get_context(session, &ctx)) {
+    if (status.composing) {
+      switch (style.preedit_type) {
+      case UIStyle::PreeditType::PREVIEW_ALL: {
+        CandidateInfo cinfo;
+        ReadCandidateInfo(ctx, cinfo);
+        string topush = string(ctx.composition.preedit) + "  [";
+        auto &candies = ctx.menu.candidates;
+        auto hilite = ctx.menu.highlighted_candidate_index;
+        for (auto i = 0; i < ctx.menu.num_candidates; i++) {
+          string label =
+              style.label_font_point > 0
+                  ? wtou8(GetLabelText(cinfo.labels[i].str,
+                                       style.label_text_format.c_str()))
+                  : "";
+          string comment =
+              style.comment_font_point > 0 ? wtou8(cinfo.comments[i].str) : "";
+          string mark_text =
+              style.mark_text.empty() ? "*" : wtou8(style.mark_text);
+          string prefix = (i != hilite) ? "" : mark_text;
+          topush += " " + prefix + label + (candies[i].text) + " " + comment;
+        }
+        context.preedit.str = u8tow(topush) + wstring(L"]");
+        if (ctx.composition.sel_start <= ctx.composition.sel_end) {
+          TextAttribute attr;
+          attr.range.start =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_start);
+          attr.range.end =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_end);
+          attr.range.cursor =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.cursor_pos);
+          context.preedit.attributes.push_back(attr);
+        }
+      } break;
+      case UIStyle::PreeditType::PREVIEW: {
+        if (ctx.commit_text_preview) {
+          string text = ctx.commit_text_preview;
+          context.preedit.str = u8tow(text);
+          TextAttribute attr;
+          attr.range.start = 0;
+          attr.range.end = utf8towcslen(text.c_str(), (int)text.size());
+          attr.range.cursor = utf8towcslen(text.c_str(), (int)text.size());
+          context.preedit.attributes.push_back(attr);
+        }
+        break;
+      }
+      case UIStyle::PreeditType::COMPOSITION: {
+        auto text = string(ctx.composition.preedit);
+        context.preedit.str = u8tow(text);
+        if (ctx.composition.sel_start <= ctx.composition.sel_end) {
+          TextAttribute attr;
+          auto start =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_start);
+          auto end =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.sel_end);
+          auto cursor =
+              utf8towcslen(ctx.composition.preedit, ctx.composition.cursor_pos);
+          attr.range.start = start;
+          attr.range.end = end;
+          attr.range.cursor = cursor;
+          attr.type = HIGHLIGHTED;
+          context.preedit.attributes.push_back(attr);
+        }
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    if (ctx.menu.num_candidates)
+      ReadCandidateInfo(ctx, context.cinfo);
+    api->free_context(&ctx);
+  }
+}
+
+} // namespace weasel
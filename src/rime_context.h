@@ -0,0 +1,18 @@
+#pragma once
+
+#include <WeaselIPCData.h>
+#include <rime_api.h>
+
+namespace weasel {
+
+// What the panel shows for a rime session, read the same way by RimeWithToy
+// and by the headless replay driver.
+
+// status of session; false if rime has none, status is then unchanged
+bool ReadRimeStatus(RimeApi *api, RimeSessionId session, Status &status);
+void ReadCandidateInfo(const RimeContext &ctx, CandidateInfo &cinfo);
+// preedit per style.preedit_type and the candidates of the current page
+void ReadRimeContext(RimeApi *api, RimeSessionId session, const UIStyle &style,
+                     const Status &status, Context &context);
+
+} // namespace weasel
@@ -29,28 +29,49 @@ bool rime_toy_enabled = true;
 HICON icon_error = LoadIcon(NULL, IDI_ERROR);
 
 TrayIcon::TrayIcon(HINSTANCE hInstance, const std::wstring &tooltip)
-    : hInst(hInstance), hMenu(NULL), deploy_func(nullptr),
-      switch_ascii(nullptr), enable_debug(false) {
+    : hInst(hInstance), m_shown(false), m_quit(false), m_post_count(0),
+      hMenu(NULL), deploy_func(nullptr), switch_ascii(nullptr),
+      enable_debug(false) {
   current_dark_mode = IsUserDarkMode();
   CreateHwnd();
+  nid = {0};
   nid.cbSize = sizeof(NOTIFYICONDATA);
   nid.hWnd = m_hWnd;
   nid.uID = 1;
   nid.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
   nid.uCallbackMessage = WM_USER + 1;
-  wcsncpy_s(nid.szTip, tooltip.c_str(), _countof(nid.szTip) - 1);
-  nid.szTip[_countof(nid.szTip) - 1] = L'\0'; // 确保以空字符结尾
+  m_state.tip = tooltip;
+  m_worker = std::thread([this]() { _WorkerProc(); });
 }
 
 TrayIcon::~TrayIcon() {
+  {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_quit = true;
+  }
+  m_state_cv.notify_one();
+  if (m_worker.joinable())
+    m_worker.join();
   DestroyIcon(icon_error);
   Hide();
   DestroyWindow(m_hWnd);
 }
 
-void TrayIcon::Show() { Shell_NotifyIcon(NIM_ADD, &nid); }
+void TrayIcon::Show() {
+  std::lock_guard<std::mutex> lock(m_state_mutex);
+  NOTIFYICONDATA data = nid;
+  data.hIcon = m_state.icon;
+  wcsncpy_s(data.szTip, m_state.tip.c_str(), _TRUNCATE);
+  Shell_NotifyIcon(NIM_ADD, &data);
+  m_sent = m_state;
+  m_shown = true;
+}
 
-void TrayIcon::Hide() { Shell_NotifyIcon(NIM_DELETE, &nid); }
+void TrayIcon::Hide() {
+  std::lock_guard<std::mutex> lock(m_state_mutex);
+  m_shown = false;
+  Shell_NotifyIcon(NIM_DELETE, &nid);
+}
 
 void TrayIcon::CreateHwnd() {
   WNDCLASS wc = {0};
@@ -67,15 +88,62 @@ void TrayIcon::CreateHwnd() {
 }
 
 void TrayIcon::SetIcon(HICON hIcon) {
-  nid.hIcon = hIcon;
-  Shell_NotifyIcon(NIM_MODIFY, &nid);
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  m_state.icon = hIcon;
+  _Invalidate(lock);
 }
 
 void TrayIcon::SetTooltip(const std::wstring &tooltip) {
-  // 使用 _countof 宏确保数组大小正确
-  wcsncpy_s(nid.szTip, tooltip.c_str(), _countof(nid.szTip) - 1);
-  nid.szTip[_countof(nid.szTip) - 1] = L'\0'; // 确保以空字符结尾
-  Shell_NotifyIcon(NIM_MODIFY, &nid);
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  m_state.tip = tooltip;
+  _Invalidate(lock);
+}
+
+bool TrayIcon::_Dirty() const {
+  return m_shown &&
+         (m_state.icon != m_sent.icon || m_state.tip != m_sent.tip ||
+          m_state.info_serial != m_sent.info_serial);
+}
+
+void TrayIcon::_Invalidate(std::unique_lock<std::mutex> &lock) {
+  const bool dirty = _Dirty();
+  lock.unlock();
+  if (dirty)
+    m_state_cv.notify_one();
+}
+
+void TrayIcon::_Post(const TrayState &state, bool with_info) {
+  NOTIFYICONDATA data = nid;
+  data.hIcon = state.icon;
+  wcsncpy_s(data.szTip, state.tip.c_str(), _TRUNCATE);
+  if (with_info) {
+    // empty title and text remove the balloon
+    data.uFlags |= NIF_INFO;
+    wcsncpy_s(data.szInfoTitle, state.info_title.c_str(), _TRUNCATE);
+    wcsncpy_s(data.szInfo, state.info.c_str(), _TRUNCATE);
+    data.uTimeout = state.info_timeout;
+    data.dwInfoFlags = NIIF_INFO;
+  }
+  Shell_NotifyIcon(NIM_MODIFY, &data);
+  ++m_post_count;
+  DEBUGIF(enable_debug) << "TrayIcon posted update #" << m_post_count;
+}
+
+void TrayIcon::_WorkerProc() {
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  while (true) {
+    m_state_cv.wait(lock, [this]() { return m_quit || _Dirty(); });
+    if (m_quit)
+      break;
+    // post the latest state only; updates made meanwhile are coalesced into
+    // the next round
+    const TrayState state = m_state;
+    const bool with_info = state.info_serial != m_sent.info_serial;
+    lock.unlock();
+    _Post(state, with_info);
+    lock.lock();
+    m_sent = state;
+  }
 }
 
 void TrayIcon::CreateContextMenu() {
@@ -191,31 +259,27 @@ void TrayIcon::CreateContextMenu() {
 
 void TrayIcon::ShowBalloonTip(const std::wstring &title,
                               const std::wstring &message, DWORD timeout) {
-  if (nid.uFlags | NIF_INFO) {
-    OnBalloonTimeout();
-  }
-  // 设置 NIF_INFO 来显示气泡提示
-  nid.uFlags |= NIF_INFO;
-  // 设置气泡提示的标题和内容
-  wcsncpy_s(nid.szInfoTitle, title.c_str(), _TRUNCATE);
-  wcsncpy_s(nid.szInfo, message.c_str(), _TRUNCATE);
-  // 设置气泡提示的显示时间
-  nid.uTimeout = timeout;      // 以毫秒为单位
-  nid.dwInfoFlags = NIIF_INFO; // 设定气泡提示的类型（信息级别）
-  // 发送更新托盘图标的消息并显示气泡提示
-  Shell_NotifyIcon(NIM_MODIFY, &nid);
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  // a new balloon replaces the current one
+  m_state.info_title = title;
+  m_state.info = message;
+  m_state.info_timeout = timeout; // 以毫秒为单位
+  m_state.info_serial++;
+  _Invalidate(lock);
   // 启动定时器，超时后清除气泡提示
   SetTimer(m_hWnd, TIMER_BALLOON_TIMEOUT, timeout, NULL);
 }
 
 void TrayIcon::OnBalloonTimeout() {
   KillTimer(m_hWnd, TIMER_BALLOON_TIMEOUT);
+  std::unique_lock<std::mutex> lock(m_state_mutex);
+  if (m_state.info_title.empty() && m_state.info.empty())
+    return;
   // 清除气泡提示内容
-  nid.uFlags &= ~NIF_INFO;                             // 移除 NIF_INFO 标志
-  memset(nid.szInfoTitle, 0, sizeof(nid.szInfoTitle)); // 清空标题
-  memset(nid.szInfo, 0, sizeof(nid.szInfo));           // 清空提示内容
-  // 更新托盘图标，清除气泡提示
-  Shell_NotifyIcon(NIM_MODIFY, &nid);
+  m_state.info_title.clear();
+  m_state.info.clear();
+  m_state.info_serial++;
+  _Invalidate(lock);
 }
 
 void TrayIcon::ProcessMessage(HWND hwnd, UINT msg, WPARAM wParam,
@@ -234,7 +298,14 @@ void TrayIcon::ProcessMessage(HWND hwnd, UINT msg, WPARAM wParam,
     }
     break;
 
+  case WM_DISPLAYCHANGE:
+    if (display_change)
+      display_change();
+    break;
+
   case WM_SETTINGCHANGE:
+    if (wParam == SPI_SETWORKAREA && display_change)
+      display_change();
     if (current_dark_mode != IsUserDarkMode()) {
       current_dark_mode = !current_dark_mode;
       if (switch_dark)
@@ -347,6 +418,8 @@ void TrayIcon::ProcessMessage(HWND hwnd, UINT msg, WPARAM wParam,
       GetModuleFileName(NULL, exePath, MAX_PATH);
       std::wstring cmdLine = L"\"" + std::wstring(exePath) + L"\" --restart " +
                              std::to_wstring(GetCurrentProcessId());
+      if (wcsstr(GetCommandLineW(), L"--remote-ui"))
+        cmdLine += L" --remote-ui";
       STARTUPINFOW si = {sizeof(si)};
       PROCESS_INFORMATION pi = {0};
       if (CreateProcessW(exePath, cmdLine.data(), NULL, NULL, FALSE, 0, NULL,
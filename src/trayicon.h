@@ -1,6 +1,10 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <windows.h>
 
@@ -51,6 +55,8 @@ public:
   void SetSyncFunc(const vhandler &func) { sync_data = func; }
   void SetRefreshIconFunc(const vhandler &func) { refresh_icon = func; }
   void SetQuitHandler(const vhandler &func) { quit_app = func; }
+  // WM_DISPLAYCHANGE, or a work area change
+  void SetDisplayChangeFunc(const vhandler &func) { display_change = func; }
   void SetSchemaListFunc(const schema_list_handler &func) {
     get_schema_list = func;
   }
@@ -79,10 +85,36 @@ public:
   }
 
 private:
+  // what the tray icon shows; balloon changes are tracked by info_serial
+  struct TrayState {
+    HICON icon = NULL;
+    std::wstring tip;
+    std::wstring info_title;
+    std::wstring info;
+    DWORD info_timeout = 0;
+    unsigned info_serial = 0;
+  };
   void OnBalloonTimeout();
+  // wake the worker if the wanted state differs from what was last posted
+  void _Invalidate(std::unique_lock<std::mutex> &lock);
+  bool _Dirty() const;
+  void _Post(const TrayState &state, bool with_info);
+  void _WorkerProc();
   static const UINT TIMER_BALLOON_TIMEOUT = 20241202;
   HINSTANCE hInst;
+  // fixed fields (hWnd, uID, callback message) for Shell_NotifyIcon
   NOTIFYICONDATA nid;
+  // Shell_NotifyIcon is a round trip to Explorer: SetIcon and friends only
+  // update m_state, the worker posts the latest state when it differs from
+  // m_sent, so bursts of updates collapse into one call
+  std::mutex m_state_mutex;
+  std::condition_variable m_state_cv;
+  TrayState m_state;
+  TrayState m_sent;
+  bool m_shown;
+  bool m_quit;
+  size_t m_post_count;
+  std::thread m_worker;
   HMENU hMenu;
   HWND m_hWnd;
   vhandler deploy_func;
@@ -94,6 +126,7 @@ private:
   vhandler sync_data;
   vhandler refresh_icon;
   vhandler quit_app;
+  vhandler display_change;
   schema_list_handler get_schema_list;
   string_handler switch_schema;
   current_schema_handler get_current_schema;
@@ -105,7 +138,8 @@ private:
   std::vector<std::wstring> m_schema_ids;
   std::vector<std::wstring> m_option_names;
   std::vector<int> m_position_ids;
-  bool enable_debug;
+  // toggled from the menu, read by the worker and the key path
+  std::atomic<bool> enable_debug;
   bool current_dark_mode;
 
   void CreateContextMenu();
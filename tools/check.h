@@ -0,0 +1,52 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// Shared by the rime.toy tools that need no Windows: EXPECT counts a failure
+// and goes on, so one run reports every mismatch; time_ns times a callable.
+// A tool with only checks and a benchmark runs through check_bench_main:
+//
+//   rime.toy.<tool> check          exits non-zero on any failure
+//   rime.toy.<tool> bench [rounds]
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+inline int failures = 0;
+
+#define EXPECT(cond)                                                           \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);               \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// average ns of fn over rounds calls
+template <typename F> double time_ns(int rounds, F fn) {
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++)
+    fn();
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - t0)
+             .count() /
+         rounds;
+}
+
+// check() runs the EXPECTs, bench(rounds) returns the exit code
+template <typename C, typename B>
+int check_bench_main(int argc, char *argv[], C check, B bench,
+                     int default_rounds) {
+  if (argc >= 2 && !strcmp(argv[1], "check")) {
+    check();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+  }
+  if (argc >= 2 && !strcmp(argv[1], "bench"))
+    return bench(argc >= 3 ? atoi(argv[2]) : default_rounds);
+  fprintf(stderr, "usage: %s check\n"
+                  "       %s bench [rounds]\n",
+          argv[0], argv[0]);
+  return 2;
+}
@@ -0,0 +1,158 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.fontfit: FitFontPoint over modelled fullscreen pages, whose size
+// is what a layout measures: per string text advances rounded to pixels,
+// fixed margins and gaps, wrapping into rows where the page is too wide.
+// "check" fits every page into a few work areas from several start points;
+// "bench" prints the layouts per refresh against the halving search the
+// fullscreen layouts used before. Commands in check.h.
+#include "FontFit.h"
+#include "check.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace weasel;
+
+struct Page {
+  const char *name;
+  // characters per candidate, label and comment included
+  std::vector<int> strings;
+  // wrap into rows when wider than the work area
+  bool wraps;
+};
+
+struct Area {
+  int w;
+  int h;
+};
+
+static const Page kPages[] = {
+    {"short", {3, 4, 3, 5, 4}, false},
+    {"long", {12, 9, 15, 7, 11, 8, 10, 13, 9}, false},
+    {"wrapped", {12, 9, 15, 7, 11, 8, 10, 13, 9, 14, 6, 12}, true},
+    {"single", {2}, false},
+};
+static const Area kAreas[] = {{1880, 1000}, {1240, 640}, {3800, 2060}};
+static const int kStarts[] = {1, 12, 72, 200};
+
+// content size of page at point inside an area avail_w wide
+static FitSize measure(const Page &page, int point, int avail_w) {
+  const int margin = 24, gap = 12;
+  const int line = point * 4 / 3 + point / 3;
+  int x = margin, w = margin, rows = 1;
+  for (int chars : page.strings) {
+    const int advance = (chars * point * 4 + 2) / 3;
+    if (page.wraps && x > margin && x + advance + margin > avail_w) {
+      rows++;
+      x = margin;
+    }
+    x += advance + gap;
+    w = std::max(w, x - gap + margin);
+  }
+  return {w, margin * 2 + rows * line + (rows - 1) * gap};
+}
+
+static bool fits(const FitSize &sz, const Area &area) {
+  return sz.cx <= area.w && sz.cy <= area.h;
+}
+
+// the search before FitFontPoint: step the point by 32, halving and turning
+// around whenever the content crosses the 31/32 band
+static FontFit halving_fit(int point, const Area &area,
+                           const std::function<FitSize(int)> &layout) {
+  FontFit fit;
+  int step = 32;
+  for (;;) {
+    const FitSize sz = layout(point);
+    fit.layouts++;
+    fit.point = point;
+    if (step == 0)
+      break;
+    if (!fits(sz, area)) {
+      if (step > 0)
+        step = -(step >> 1);
+    } else if (sz.cx <= area.w * 31 / 32 && sz.cy <= area.h * 31 / 32) {
+      if (step < 0)
+        step = -step >> 1;
+    } else {
+      break;
+    }
+    point = std::max(point + step, 1);
+  }
+  return fit;
+}
+
+static void check_font_fit() {
+  for (const Page &page : kPages) {
+    for (const Area &area : kAreas) {
+      // the largest point that fits, by a scan
+      int best = 0;
+      for (int p = 1; p <= 2048; p++) {
+        if (fits(measure(page, p, area.w), area))
+          best = p;
+      }
+      for (int start : kStarts) {
+        int laid_out = 0;
+        const FontFit fit =
+            FitFontPoint(start, area.w, area.h, [&](int point) {
+              laid_out = point;
+              return measure(page, point, area.w);
+            });
+        const FitSize sz = measure(page, fit.point, area.w);
+        // the layout is left at the point returned
+        EXPECT(laid_out == fit.point);
+        EXPECT(fit.fits == fits(sz, area));
+        EXPECT(fit.fits);
+        EXPECT(fit.point <= best);
+        EXPECT(fit.layouts <= 2 + kMaxFitPasses + kMaxFitBisections);
+        // in the band, or no point up to the next one that overflows fits
+        EXPECT(sz.cx > area.w * 31 / 32 || sz.cy > area.h * 31 / 32 ||
+               fit.point == best);
+        if (failures)
+          fprintf(stderr, "%s in %dx%d from %d: point %d of %d, %d layouts\n",
+                  page.name, area.w, area.h, start, fit.point, best,
+                  fit.layouts);
+      }
+    }
+  }
+  // nothing fits: the search stops at point 1, overflowing
+  const Area tiny = {40, 20};
+  const FontFit fit = FitFontPoint(30, tiny.w, tiny.h, [&](int point) {
+    return measure(kPages[1], point, tiny.w);
+  });
+  EXPECT(!fit.fits && fit.point == 1);
+  EXPECT(fit.layouts <= 2 + kMaxFitPasses + kMaxFitBisections);
+  // a size that only shrinks to fit one point down from a huge start
+  const FontFit step_down = FitFontPoint(
+      500, 1000, 1000, [](int point) { return FitSize{point * 2, 10}; });
+  EXPECT(step_down.fits && step_down.point == 500);
+}
+
+static int bench_font_fit(int rounds) {
+  int sink = 0;
+  printf("%-8s %-10s %5s  %-16s %-16s %s\n", "page", "area", "start",
+         "FitFontPoint", "halving", "per fit");
+  for (const Page &page : kPages) {
+    for (const Area &area : kAreas) {
+      for (int start : kStarts) {
+        auto layout = [&](int point) { return measure(page, point, area.w); };
+        const FontFit fit = FitFontPoint(start, area.w, area.h, layout);
+        const FontFit old = halving_fit(start, area, layout);
+        const double ns = time_ns(rounds, [&]() {
+          sink += FitFontPoint(start, area.w, area.h, layout).point;
+        });
+        printf("%-8s %4dx%-5d %5d  %2d layouts pt %-3d %2d layouts pt %-3d "
+               "%6.0f ns\n",
+               page.name, area.w, area.h, start, fit.layouts, fit.point,
+               old.layouts, old.point, ns);
+      }
+    }
+  }
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  return check_bench_main(argc, argv, check_font_fit, bench_font_fit, 2000);
+}
@@ -0,0 +1,117 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.fontspec: ParseFontSpec. "check" parses font_face strings as
+// weasel.yaml and its custom patches give them, "bench" times the parse of
+// the same strings. Commands in check.h.
+#include "FontSpec.h"
+#include "check.h"
+#include <cstdio>
+
+using namespace weasel;
+
+static const wchar_t *const kSpecs[] = {
+    L"Microsoft YaHei",
+    L"Microsoft YaHei:bold, Segoe UI Emoji:1f300:1f64f, Segoe UI Symbol",
+    L"Segoe UI:semi_bold:italic:condensed, Microsoft YaHei:4e00:9fff",
+    L"LXGW WenKai:20000:2a6df, Noto Color Emoji, SimSun-ExtB:20000",
+};
+
+// the mapping at i is family over [first, last]
+static bool mapping_is(const FontSpec &spec, size_t i, const wchar_t *family,
+                       uint32_t first, uint32_t last) {
+  return i < spec.fonts.size() && spec.fonts[i].family == family &&
+         spec.fonts[i].first == first && spec.fonts[i].last == last;
+}
+
+static void check_font_spec() {
+  FontSpec spec;
+  // the font_face of weasel.yaml
+  EXPECT(ParseFontSpec(L"Microsoft YaHei", spec));
+  EXPECT(spec.fonts.size() == 1);
+  EXPECT(mapping_is(spec, 0, L"Microsoft YaHei", 0, 0x10ffff));
+  EXPECT(spec.weight == 400 && spec.style == 0 && spec.stretch == 5);
+
+  EXPECT(ParseFontSpec(kSpecs[1], spec));
+  EXPECT(spec.fonts.size() == 3);
+  EXPECT(mapping_is(spec, 0, L"Microsoft YaHei", 0, 0x10ffff));
+  EXPECT(mapping_is(spec, 1, L"Segoe UI Emoji", 0x1f300, 0x1f64f));
+  EXPECT(mapping_is(spec, 2, L"Segoe UI Symbol", 0, 0x10ffff));
+  EXPECT(spec.weight == 700);
+
+  EXPECT(ParseFontSpec(kSpecs[2], spec));
+  EXPECT(spec.fonts.size() == 2);
+  EXPECT(mapping_is(spec, 0, L"Segoe UI", 0, 0x10ffff));
+  EXPECT(mapping_is(spec, 1, L"Microsoft YaHei", 0x4e00, 0x9fff));
+  EXPECT(spec.weight == 600 && spec.style == 2 && spec.stretch == 3);
+
+  EXPECT(ParseFontSpec(kSpecs[3], spec));
+  EXPECT(spec.fonts.size() == 3);
+  EXPECT(mapping_is(spec, 0, L"LXGW WenKai", 0x20000, 0x2a6df));
+  EXPECT(mapping_is(spec, 1, L"Noto Color Emoji", 0, 0x10ffff));
+  EXPECT(mapping_is(spec, 2, L"SimSun-ExtB", 0x20000, 0x10ffff));
+
+  // blanks around names and bounds, names in any case
+  EXPECT(ParseFontSpec(L"  Noto Sans CJK SC : 4E00 : 9fff ,Sarasa:BOLD ",
+                       spec));
+  EXPECT(mapping_is(spec, 0, L"Noto Sans CJK SC", 0x4e00, 0x9fff));
+  EXPECT(mapping_is(spec, 1, L"Sarasa", 0, 0x10ffff));
+  EXPECT(spec.weight == 700);
+  // whole names only: a stretch is no medium weight
+  EXPECT(ParseFontSpec(L"A:medium_stretch", spec));
+  EXPECT(spec.weight == 400 && spec.stretch == 5);
+  EXPECT(ParseFontSpec(L"A:oblique:ultra_expanded:heavy", spec));
+  EXPECT(spec.weight == 900 && spec.style == 1 && spec.stretch == 9);
+  // the last name wins, wherever it is
+  EXPECT(ParseFontSpec(L"A:bold, B:light", spec));
+  EXPECT(spec.weight == 300);
+  EXPECT(mapping_is(spec, 1, L"B", 0, 0x10ffff));
+
+  // bounds go by position, past the names; one that is not hex is open
+  EXPECT(ParseFontSpec(L"A:zz:10", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0, 0x10));
+  EXPECT(ParseFontSpec(L"A:10:zz", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0x10, 0x10ffff));
+  EXPECT(ParseFontSpec(L"A::2f", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0, 0x2f));
+  EXPECT(ParseFontSpec(L"A:20:", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0x20, 0x10ffff));
+  EXPECT(ParseFontSpec(L"A:bold:20:7f", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0x20, 0x7f) && spec.weight == 700);
+  EXPECT(ParseFontSpec(L"A:20:italic:7f", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0x20, 0x7f) && spec.style == 2);
+  EXPECT(ParseFontSpec(L"A:1:2:3", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 1, 2));
+  // past the last code point
+  EXPECT(ParseFontSpec(L"A:110000:ffffffffffff", spec));
+  EXPECT(mapping_is(spec, 0, L"A", 0x10ffff, 0x10ffff));
+
+  // no family: nothing to map
+  EXPECT(!ParseFontSpec(L"", spec) && spec.fonts.empty());
+  EXPECT(!ParseFontSpec(L" , :bold", spec) && spec.fonts.empty());
+  EXPECT(ParseFontSpec(L",A,", spec));
+  EXPECT(spec.fonts.size() == 1 && mapping_is(spec, 0, L"A", 0, 0x10ffff));
+  // a parse starts over
+  EXPECT(ParseFontSpec(L"B", spec));
+  EXPECT(spec.fonts.size() == 1 && spec.weight == 400);
+}
+
+static int bench_font_spec(int rounds) {
+  FontSpec spec;
+  size_t sink = 0;
+  printf("ParseFontSpec, per spec:\n");
+  for (const wchar_t *text : kSpecs) {
+    const std::wstring s = text;
+    const double ns = time_ns(rounds, [&]() {
+      ParseFontSpec(s, spec);
+      sink += spec.fonts.size();
+    });
+    printf("  %zu fonts, %3zu chars %8.1f ns\n", spec.fonts.size(), s.size(),
+           ns);
+  }
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  return check_bench_main(argc, argv, check_font_spec, bench_font_spec, 20000);
+}
@@ -0,0 +1,128 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.hittest: CandidateHitTest. "check" compares Find with a linear
+// scan of the rects at every point around a row, a column and a grid of
+// candidates, with gaps, overlaps and empty rects; "bench" times Build, and
+// Find against the linear scan the panel used before. Commands in check.h.
+#include "HitTest.h"
+#include "check.h"
+#include <cstdio>
+#include <vector>
+
+using namespace weasel;
+
+// what the panel did per mouse message before the grid
+static int linear_find(const std::vector<PlaceRect> &rects, int x, int y) {
+  for (int i = 0; i < (int)rects.size(); i++) {
+    const PlaceRect &rc = rects[i];
+    if (x >= rc.left && x < rc.right && y >= rc.top && y < rc.bottom)
+      return i;
+  }
+  return -1;
+}
+
+// count candidates of w x h in cols columns, gap pixels apart; a negative
+// gap overlaps neighbours like inflated rects do
+static std::vector<PlaceRect> layout(int count, int cols, int w, int h,
+                                     int gap) {
+  std::vector<PlaceRect> rects;
+  for (int i = 0; i < count; i++) {
+    const int x = 10 + (i % cols) * (w + gap);
+    const int y = 10 + (i / cols) * (h + gap);
+    rects.push_back({x, y, x + w, y + h});
+  }
+  return rects;
+}
+
+// every point around the rects, one pixel past their bounds
+static void check_against_scan(const char *name,
+                               const std::vector<PlaceRect> &rects) {
+  CandidateHitTest grid;
+  grid.Build(rects);
+  int right = 0, bottom = 0;
+  for (const auto &rc : rects) {
+    right = rc.right > right ? rc.right : right;
+    bottom = rc.bottom > bottom ? rc.bottom : bottom;
+  }
+  int mismatches = 0;
+  for (int y = -1; y <= bottom + 1; y++) {
+    for (int x = -1; x <= right + 1; x++) {
+      const int want = linear_find(rects, x, y);
+      const int got = grid.Find(x, y);
+      if (got != want && mismatches++ < 5)
+        fprintf(stderr, "%s: (%d, %d) found %d, scan %d\n", name, x, y, got,
+                want);
+    }
+  }
+  failures += mismatches;
+}
+
+static void check_hit_test() {
+  CandidateHitTest grid;
+  EXPECT(grid.empty() && grid.Find(0, 0) == -1);
+  grid.Build({});
+  EXPECT(grid.empty() && grid.Find(0, 0) == -1);
+  grid.Build({{0, 0, 0, 10}, {5, 5, 5, 5}});
+  EXPECT(grid.empty() && grid.Find(0, 0) == -1);
+  // right and bottom edges are outside, as with PtInRect
+  grid.Build({{0, 0, 10, 10}, {10, 0, 20, 10}});
+  EXPECT(grid.Find(0, 0) == 0 && grid.Find(9, 9) == 0);
+  EXPECT(grid.Find(10, 0) == 1 && grid.Find(20, 0) == -1);
+  EXPECT(grid.Find(0, 10) == -1);
+  // overlaps go to the lower index
+  grid.Build({{0, 0, 12, 10}, {8, 0, 20, 10}});
+  EXPECT(grid.Find(9, 5) == 0 && grid.Find(12, 5) == 1);
+  grid.Clear();
+  EXPECT(grid.empty() && grid.Find(9, 5) == -1);
+
+  check_against_scan("row", layout(10, 10, 60, 24, 4));
+  check_against_scan("column", layout(10, 1, 200, 24, 2));
+  check_against_scan("grid", layout(100, 10, 40, 30, 3));
+  check_against_scan("overlap", layout(36, 6, 50, 20, -6));
+  check_against_scan("touching", layout(12, 4, 33, 17, 0));
+  // mixed sizes and an empty rect in the middle, like a hidden comment
+  std::vector<PlaceRect> mixed = layout(9, 3, 70, 25, 5);
+  mixed[1].right += 130;
+  mixed[4] = {mixed[4].left, mixed[4].top, mixed[4].left, mixed[4].bottom};
+  mixed[7].bottom += 60;
+  check_against_scan("mixed", mixed);
+  // one rect far larger than the rest
+  std::vector<PlaceRect> wide = layout(5, 5, 20, 20, 2);
+  wide.push_back({0, 30, 2000, 60});
+  check_against_scan("wide", wide);
+}
+
+static int bench_hit_test(int rounds) {
+  long long sink = 0;
+  for (int count : {10, 100}) {
+    const std::vector<PlaceRect> rects = layout(count, 10, 60, 24, -2);
+    // a mouse sweep over the panel, hits and misses
+    std::vector<std::pair<int, int>> points;
+    for (int y = 0; y < 10 + (count / 10) * 22 + 10; y += 3)
+      for (int x = 0; x < 10 + 10 * 58 + 10; x += 7)
+        points.push_back({x, y});
+    CandidateHitTest grid;
+    const double build_ns = time_ns(rounds, [&]() {
+      grid.Build(rects);
+      sink += grid.empty();
+    });
+    const double find_ns = time_ns(rounds, [&]() {
+      for (const auto &p : points)
+        sink += grid.Find(p.first, p.second);
+    });
+    const double scan_ns = time_ns(rounds, [&]() {
+      for (const auto &p : points)
+        sink += linear_find(rects, p.first, p.second);
+    });
+    printf("%d candidates, %zu points:\n", count, points.size());
+    printf("  Build       %8.1f ns\n", build_ns);
+    printf("  Find        %8.1f ns\n", find_ns / points.size());
+    printf("  linear scan %8.1f ns\n", scan_ns / points.size());
+  }
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  return check_bench_main(argc, argv, check_hit_test, bench_hit_test, 500);
+}
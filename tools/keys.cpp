@@ -0,0 +1,183 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.keys: the platform neutral key tables and KeyMap, no rime needed.
+// "bench" times the lookups over the full keyval set and a KeyMap over every
+// vk and shift state. Commands in check.h.
+#include "check.h"
+#include "key_table.h"
+#include "keymap.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace weasel;
+
+// every keyval with a name; keysyms past 0xffff are only VoidSymbol
+static std::vector<int> named_keyvals() {
+  std::vector<int> keyvals;
+  for (int k = 0; k <= 0xffff; k++)
+    if (GetKeyName(k))
+      keyvals.push_back(k);
+  if (GetKeyName(kVoidSymbol))
+    keyvals.push_back(kVoidSymbol);
+  return keyvals;
+}
+
+static void check_key_table() {
+  const std::vector<int> keyvals = named_keyvals();
+  EXPECT(keyvals.size() > 1000);
+  for (int k : keyvals) {
+    const char *name = GetKeyName(k);
+    // a name of k parses back to k
+    if (GetKeycodeByName(name) != k) {
+      fprintf(stderr, "0x%04x: %s parses to 0x%04x\n", k, name,
+              GetKeycodeByName(name));
+      failures++;
+    }
+  }
+  EXPECT(!strcmp(GetKeyName(0x20), "space"));
+  EXPECT(!strcmp(GetKeyName(0xff55), "Page_Up"));
+  EXPECT(!strcmp(GetKeyName(0xffffff), "VoidSymbol"));
+  // 0x27 is apostrophe and quoteright, the first in name order wins
+  EXPECT(!strcmp(GetKeyName(0x27), "apostrophe"));
+  EXPECT(GetKeycodeByName("quoteright") == 0x27);
+  EXPECT(GetKeyName(0x10000) == nullptr);
+  EXPECT(GetKeycodeByName("Page_Up") == 0xff55);
+  EXPECT(GetKeycodeByName("Prior") == 0xff55);
+  EXPECT(GetKeycodeByName("page_up") == kVoidSymbol);
+  EXPECT(GetKeycodeByName("") == kVoidSymbol);
+  EXPECT(GetKeycodeByName(nullptr) == kVoidSymbol);
+  EXPECT(repr(0x61, 0) == "a");
+  EXPECT(repr(0xff0d, 1 << 2) == "Control+Return");
+  EXPECT(repr(0x41, (1 << 0) | (1 << 3) | (1 << 30)) ==
+         "Shift+Alt+Release+A");
+  EXPECT(repr(0x10000, 0) == "0x010000");
+  EXPECT(repr(0xfe00, 0) == "0xfe00");
+  EXPECT(repr(-1, 0) == "(unknown)");
+}
+
+// what BuildKeyMap records for a US and a German layout: letters, digits,
+// and the dead circumflex and acute of the German OEM keys
+static void fill_key_map(KeyMap &map, bool german) {
+  map.Clear();
+  for (int c = 'A'; c <= 'Z'; c++) {
+    map.Set((uint8_t)c, KeyMap::kPlain, c - 'A' + 'a', false);
+    map.Set((uint8_t)c, KeyMap::kShift, c, false);
+  }
+  if (german) {
+    // Y and Z swap places
+    map.Set('Y', KeyMap::kPlain, 'z', false);
+    map.Set('Y', KeyMap::kShift, 'Z', false);
+    map.Set('Z', KeyMap::kPlain, 'y', false);
+    map.Set('Z', KeyMap::kShift, 'Y', false);
+  }
+  static const char us_shifted[] = ")!@#$%^&*(";
+  static const char de_shifted[] = "=!\"\xa7$%&/()";
+  for (int d = 0; d < 10; d++) {
+    map.Set((uint8_t)('0' + d), KeyMap::kPlain, '0' + d, false);
+    map.Set((uint8_t)('0' + d), KeyMap::kShift,
+            (uint8_t)(german ? de_shifted : us_shifted)[d], false);
+  }
+  map.Set(0x20, KeyMap::kPlain, ' ', false);
+  map.Set(0x20, KeyMap::kShift, ' ', false);
+  if (german) {
+    // VK_OEM_5: dead ^, and a plain degree sign with shift
+    map.Set(0xdc, KeyMap::kPlain, '^', true);
+    map.Set(0xdc, KeyMap::kShift, 0xb0, false);
+    // VK_OEM_6: dead acute and grave
+    map.Set(0xdd, KeyMap::kPlain, 0xb4, true);
+    map.Set(0xdd, KeyMap::kShift, '`', true);
+  } else {
+    map.Set(0xdc, KeyMap::kPlain, '\\', false);
+    map.Set(0xdc, KeyMap::kShift, '|', false);
+    map.Set(0xdd, KeyMap::kPlain, ']', false);
+    map.Set(0xdd, KeyMap::kShift, '}', false);
+  }
+}
+
+static void check_key_map() {
+  KeyMap us, de;
+  fill_key_map(us, false);
+  fill_key_map(de, true);
+  // no character for keys that were never set
+  EXPECT(KeyMap().Lookup('A', KeyMap::kPlain) == 0);
+  EXPECT(us.Lookup(0x70, KeyMap::kPlain) == 0); // VK_F1
+  EXPECT(us.Translate('A', false, false) == 'a');
+  EXPECT(us.Translate('A', true, false) == 'A');
+  // CapsLock goes to LOCK_MASK, the keyval stays lowercase
+  EXPECT(us.Translate('A', false, true) == 'a');
+  EXPECT(us.Translate('A', true, true) == 'A');
+  EXPECT(us.Translate('2', true, false) == '@');
+  EXPECT(us.Translate('2', true, true) == '@');
+  EXPECT(de.Translate('2', true, false) == '"');
+  EXPECT(de.Translate('3', true, false) == 0xa7);
+  EXPECT(de.Translate('Y', false, false) == 'z');
+  EXPECT(de.Translate('Z', true, false) == 'Y');
+  EXPECT(us.Translate(0xdc, false, false) == '\\');
+  // dead keys are recorded, but give no character
+  EXPECT(de.IsDeadKey(0xdc, KeyMap::kPlain));
+  EXPECT(!de.IsDeadKey(0xdc, KeyMap::kShift));
+  EXPECT(de.Lookup(0xdc, KeyMap::kPlain) == 0);
+  EXPECT(de.Translate(0xdc, false, false) == 0);
+  EXPECT(de.Translate(0xdc, true, false) == 0xb0);
+  EXPECT(de.IsDeadKey(0xdd, KeyMap::kShift));
+  EXPECT(de.Translate(0xdd, true, true) == 0);
+  EXPECT(!us.IsDeadKey(0xdc, KeyMap::kPlain));
+  // a layout switch rebuilds the whole table
+  fill_key_map(de, false);
+  EXPECT(!de.IsDeadKey(0xdc, KeyMap::kPlain));
+  EXPECT(de.Translate('Y', false, false) == 'y');
+  for (int vk = 0; vk < 256; vk++) {
+    for (int shift = 0; shift < 2; shift++) {
+      if (de.Translate((uint8_t)vk, shift, false) !=
+          us.Translate((uint8_t)vk, shift, false)) {
+        fprintf(stderr, "vk 0x%02x shift %d differs after rebuild\n", vk,
+                shift);
+        failures++;
+      }
+    }
+  }
+}
+
+static int bench_key_table(int rounds) {
+  const std::vector<int> keyvals = named_keyvals();
+  std::vector<std::string> names;
+  for (int k : keyvals)
+    names.push_back(GetKeyName(k));
+  size_t sink = 0;
+  const double name_ns = time_ns(rounds, [&]() {
+    for (int k : keyvals)
+      sink += (size_t)GetKeyName(k);
+  });
+  const double keycode_ns = time_ns(rounds, [&]() {
+    for (const auto &name : names)
+      sink += GetKeycodeByName(name.c_str());
+  });
+  const double repr_ns = time_ns(rounds, [&]() {
+    for (int k : keyvals)
+      sink += repr(k, 1 << 2).size();
+  });
+  printf("%zu named keyvals, per lookup:\n", keyvals.size());
+  printf("GetKeyName       %8.1f ns\n", name_ns / keyvals.size());
+  printf("GetKeycodeByName %8.1f ns\n", keycode_ns / names.size());
+  printf("repr             %8.1f ns\n", repr_ns / keyvals.size());
+
+  KeyMap map;
+  fill_key_map(map, true);
+  const double translate_ns = time_ns(rounds, [&]() {
+    for (int vk = 0; vk < 256; vk++)
+      for (int state = 0; state < 4; state++)
+        sink += map.Translate((uint8_t)vk, state & 1, state & 2);
+  });
+  printf("KeyMap Translate %8.1f ns\n", translate_ns / (256 * 4));
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  return check_bench_main(argc, argv, []() {
+        check_key_table();
+        check_key_map();
+      }, bench_key_table, 200);
+}
@@ -0,0 +1,282 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.placement: PlacePanel and PickMonitor. "check" runs a few fixed
+// placements, then sweeps anchors over a three monitor desktop with every
+// flag and shadow combination and checks the properties every placement must
+// have; "bench" times both functions. Commands in check.h.
+#include "Placement.h"
+#include "check.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace weasel;
+
+// a 1920x1080 primary with a bottom taskbar, a smaller screen to its left
+// set 200 pixels higher, and a portrait screen to its right with a top
+// taskbar
+static std::vector<MonitorArea> desktop() {
+  return {{{0, 0, 1920, 1080}, {0, 0, 1920, 1040}},
+          {{-1280, -200, 0, 824}, {-1280, -200, 0, 824}},
+          {{1920, -400, 3000, 1520}, {1920, -360, 3000, 1520}}};
+}
+
+// the anchor MoveTo passes for a caret whose bottom-left is x, y
+static PlaceRect anchor_at(int x, int y) { return {x, y, x + 1, y + 6}; }
+
+static long long area(const PlaceRect &a, const PlaceRect &b) {
+  const long long w = std::min(a.right, b.right) - std::max(a.left, b.left);
+  const long long h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+  return (w > 0 && h > 0) ? w * h : 0;
+}
+
+static long long distance2(const PlaceRect &a, const PlaceRect &b) {
+  const long long dx = std::max({0, b.left - a.right, a.left - b.right});
+  const long long dy = std::max({0, b.top - a.bottom, a.top - b.bottom});
+  return dx * dx + dy * dy;
+}
+
+static void check_pick_monitor() {
+  const std::vector<MonitorArea> monitors = desktop();
+  EXPECT(PickMonitor({}, anchor_at(0, 0)) == -1);
+  EXPECT(PickMonitor(monitors, anchor_at(100, 100)) == 0);
+  EXPECT(PickMonitor(monitors, anchor_at(-100, 100)) == 1);
+  EXPECT(PickMonitor(monitors, anchor_at(2000, -300)) == 2);
+  // most of the rect wins, not its top-left corner
+  EXPECT(PickMonitor(monitors, {-10, 100, 90, 200}) == 0);
+  EXPECT(PickMonitor(monitors, {-90, 100, 10, 200}) == 1);
+  // off every screen: the nearest one
+  EXPECT(PickMonitor(monitors, anchor_at(-100, 900)) == 1);
+  EXPECT(PickMonitor(monitors, anchor_at(100, 1200)) == 0);
+  EXPECT(PickMonitor(monitors, anchor_at(5000, 0)) == 2);
+  // touching two screens without covering either: the first in the list
+  EXPECT(PickMonitor(monitors, {0, 100, 0, 200}) == 0);
+
+  // every rect of a sweep: the pick covers the most of it, or when it covers
+  // nothing, no screen is nearer
+  for (int y = -700; y <= 1800; y += 50) {
+    for (int x = -1600; x <= 3300; x += 50) {
+      for (int size : {1, 120, 900}) {
+        const PlaceRect rc = {x, y, x + size, y + size / 2 + 1};
+        const int pick = PickMonitor(monitors, rc);
+        if (pick < 0) {
+          failures++;
+          continue;
+        }
+        const long long pick_area = area(rc, monitors[pick].monitor);
+        for (size_t i = 0; i < monitors.size(); i++) {
+          const long long other = area(rc, monitors[i].monitor);
+          const bool ok =
+              pick_area ? other <= pick_area
+                        : other == 0 && distance2(rc, monitors[pick].monitor) <=
+                                            distance2(rc, monitors[i].monitor);
+          if (!ok) {
+            fprintf(stderr, "rect %d,%d size %d: picked %d over %zu\n", x, y,
+                    size, pick, i);
+            failures++;
+          }
+        }
+      }
+    }
+  }
+}
+
+static PlacementInput panel(int x, int y, int width, int height) {
+  PlacementInput in;
+  in.anchor = anchor_at(x, y);
+  in.width = width;
+  in.height = height;
+  in.adjust = true;
+  return in;
+}
+
+static void check_fixed_placements() {
+  const std::vector<MonitorArea> monitors = desktop();
+  // below the caret, after the gap
+  Placement out = PlacePanel(panel(100, 100, 200, 60), monitors);
+  EXPECT(out.x == 100 && out.y == 106 && !out.sticky && out.monitor == 0);
+  // pushed left off the right edge
+  out = PlacePanel(panel(1900, 100, 200, 60), monitors);
+  EXPECT(out.x == 1720 && out.y == 106);
+  // flipped above the caret off the taskbar
+  out = PlacePanel(panel(100, 1000, 200, 60), monitors);
+  EXPECT(out.sticky && out.y == 1000 - 60 - 6);
+  // a flip sticks while the anchor stays
+  PlacementInput in = panel(100, 100, 200, 60);
+  in.sticky = true;
+  out = PlacePanel(in, monitors);
+  EXPECT(out.sticky && out.y == 100 - 60 - 6);
+  // above the top of the screen is clamped
+  in.anchor = anchor_at(100, 10);
+  out = PlacePanel(in, monitors);
+  EXPECT(out.sticky && out.y == 0);
+  // the left screen, 200 pixels higher, pushed off its right edge
+  out = PlacePanel(panel(-100, -150, 200, 60), monitors);
+  EXPECT(out.x == -200 && out.y == -144 && out.monitor == 1);
+  // under the top taskbar of the right screen
+  out = PlacePanel(panel(2000, -390, 200, 60), monitors);
+  EXPECT(out.y == -360 && out.monitor == 2);
+
+  // only a flip of a vertical layout reverses, a new anchor resets it
+  in = panel(100, 1000, 200, 60);
+  in.auto_reverse = true;
+  EXPECT(PlacePanel(in, monitors).reversed);
+  in = panel(100, 100, 200, 60);
+  in.auto_reverse = true;
+  in.reversed = true;
+  EXPECT(!PlacePanel(in, monitors).reversed);
+  in.adjust = false;
+  EXPECT(PlacePanel(in, monitors).reversed);
+
+  // the shadow margin, all or half of it depending on the shadow's side
+  in = panel(100, 100, 200, 60);
+  in.shadow_radius = 12;
+  in.offset_x = in.offset_y = 16;
+  in.shadow_offset_x = in.shadow_offset_y = 4;
+  out = PlacePanel(in, monitors);
+  EXPECT(out.x == 100 - 16 && out.y == 106 - 16);
+  in.shadow_offset_x = in.shadow_offset_y = -4;
+  out = PlacePanel(in, monitors);
+  EXPECT(out.x == 100 - 8 && out.y == 106 - 8);
+  in.shadow_transparent = true;
+  out = PlacePanel(in, monitors);
+  EXPECT(out.x == 100 - 16 && out.y == 106 - 16);
+  // the vertical margin only applies to a new anchor
+  in.adjust = false;
+  EXPECT(PlacePanel(in, monitors).y == 106);
+
+  // right to left vertical text grows leftwards from the caret
+  in = panel(1000, 100, 200, 60);
+  in.vertical_text_rtl = true;
+  EXPECT(PlacePanel(in, monitors).x == 1000 - 200);
+
+  // no monitors at all still gives a position
+  out = PlacePanel(panel(100, 100, 200, 60), {});
+  EXPECT(out.monitor == -1 && out.x == 0);
+}
+
+struct Shadow {
+  int radius, offset_x, offset_y, margin;
+  bool transparent;
+};
+
+// every shadow side, with and without a shadow
+static const Shadow kShadows[] = {
+    {0, 0, 0, 0, false},   {12, 0, 0, 16, false},  {12, 4, 6, 16, false},
+    {12, -4, -6, 16, false}, {12, 4, -6, 16, false}, {12, -4, 6, 16, false},
+    {12, -4, -6, 16, true},  {12, 0, 6, 24, true},
+};
+
+static const int kSizes[][2] = {{200, 60}, {600, 300}, {1100, 900}};
+
+// y of the panel below the caret, before any clamp
+static int below_y(const PlacementInput &in) {
+  int y = in.anchor.bottom;
+  if (in.shadow_radius && in.adjust)
+    y -= (in.shadow_offset_y > 0 || in.shadow_transparent)
+             ? in.offset_y
+             : (in.offset_y / 2);
+  return y;
+}
+
+static void check_placement_sweep() {
+  const std::vector<MonitorArea> monitors = desktop();
+  long long placements = 0;
+  for (const Shadow &shadow : kShadows) {
+    for (const auto &size : kSizes) {
+      for (int flags = 0; flags < 32; flags++) {
+        for (int y = -550; y <= 1650; y += 45) {
+          // x of the last placement on the same monitor, it never goes back
+          int last_x = 0;
+          int last_monitor = -2;
+          for (int x = -1450; x <= 3150; x += 45) {
+            PlacementInput in = panel(x, y, size[0], size[1]);
+            in.shadow_radius = shadow.radius;
+            in.shadow_offset_x = shadow.offset_x;
+            in.shadow_offset_y = shadow.offset_y;
+            in.offset_x = in.offset_y = shadow.margin;
+            in.shadow_transparent = shadow.transparent;
+            in.vertical_text_rtl = flags & 1;
+            in.auto_reverse = flags & 2;
+            in.adjust = flags & 4;
+            in.sticky = flags & 8;
+            in.reversed = flags & 16;
+            const Placement out = PlacePanel(in, monitors);
+            placements++;
+
+            bool ok = out.monitor == PickMonitor(monitors, in.anchor);
+            const PlaceRect &work = monitors[out.monitor].work;
+            // always on the screen's work area, where it fits
+            ok = ok && out.x >= work.left && out.y >= work.top;
+            if (in.width <= work.right - work.left)
+              ok = ok && out.x + in.width <= work.right;
+            // a flip is kept, and only made when the panel can't fit below
+            ok = ok && (!in.sticky || out.sticky);
+            if (!out.sticky)
+              ok = ok && out.y == (std::max)(below_y(in), work.top) &&
+                   out.y + in.height <= work.bottom;
+            else if (!in.sticky)
+              ok = ok && below_y(in) + in.height > work.bottom;
+            // a flipped panel ends above the caret, short of its shadow
+            // margin, unless the top of the screen pushes it down
+            if (out.sticky && out.y > work.top)
+              ok = ok && out.y + in.height <= in.anchor.top + in.offset_y;
+            const bool reversed =
+                out.sticky ? in.auto_reverse : !in.adjust && in.reversed;
+            ok = ok && out.reversed == reversed;
+            // placing again with the new state changes nothing
+            PlacementInput again = in;
+            again.sticky = out.sticky;
+            again.reversed = out.reversed;
+            const Placement same = PlacePanel(again, monitors);
+            ok = ok && same.x == out.x && same.y == out.y &&
+                 same.sticky == out.sticky && same.reversed == out.reversed;
+            if (out.monitor == last_monitor)
+              ok = ok && out.x >= last_x;
+            last_x = out.x;
+            last_monitor = out.monitor;
+            if (!ok && failures++ < 20)
+              fprintf(stderr,
+                      "anchor %d,%d size %dx%d flags %d shadow %d,%d,%d: "
+                      "placed at %d,%d sticky %d reversed %d monitor %d\n",
+                      x, y, in.width, in.height, flags, shadow.radius,
+                      shadow.offset_x, shadow.offset_y, out.x, out.y,
+                      out.sticky, out.reversed, out.monitor);
+          }
+        }
+      }
+    }
+  }
+  printf("%lld placements checked\n", placements);
+}
+
+static int bench_placement(int rounds) {
+  const std::vector<MonitorArea> monitors = desktop();
+  std::vector<PlacementInput> inputs;
+  for (int y = -550; y <= 1650; y += 110)
+    for (int x = -1450; x <= 3150; x += 115)
+      inputs.push_back(panel(x, y, 600, 300));
+  long long sink = 0;
+  const double pick_ns = time_ns(rounds, [&]() {
+    for (const auto &in : inputs)
+      sink += PickMonitor(monitors, in.anchor);
+  });
+  const double place_ns = time_ns(rounds, [&]() {
+    for (const auto &in : inputs)
+      sink += PlacePanel(in, monitors).y;
+  });
+  printf("%zu anchors on %zu monitors, per call:\n", inputs.size(),
+         monitors.size());
+  printf("PickMonitor %8.1f ns\n", pick_ns / inputs.size());
+  printf("PlacePanel  %8.1f ns\n", place_ns / inputs.size());
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  return check_bench_main(argc, argv, []() {
+        check_pick_monitor();
+        check_fixed_placements();
+        check_placement_sweep();
+      }, bench_placement, 2000);
+}
@@ -0,0 +1,441 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.render: golden images and frame times of the software render
+// backend, no Windows needed. A few panel frames, in a light and a dark
+// theme, are recorded into display lists by hand the way WeaselPanel draws
+// them, then replayed into SoftwareRenderBackend. The layouts measure text
+// with DirectWrite, so they do not lay out these frames: the goldens cover
+// DisplayList, Optimize and the backend, not WeaselPanel or a layout.
+// "golden" compares the DisplayList::Dump of each frame with
+// <dir>/<name>.txt, then writes the frame as <dir>/<name>.png and compares it
+// with the PNG already there, as is and after Optimize; a frame that differs
+// is kept as <name>.actual.txt or .png and the tool exits non-zero.
+// "--update" replaces the golden files. "dump" prints the ops of a frame.
+// "bench" times recording, Optimize and a replay per frame.
+//
+//   rime.toy.render golden <dir> [--update]
+//   rime.toy.render dump <frame>
+//   rime.toy.render bench [rounds]
+#include "DisplayList.h"
+#include "SoftwareRenderBackend.h"
+#include "check.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+using namespace weasel;
+
+// panel colors of a color scheme
+struct Theme {
+  uint32_t back;
+  uint32_t border;
+  uint32_t text;
+  uint32_t label;
+  uint32_t comment;
+  uint32_t hilite;
+  uint32_t hilite_text;
+  uint32_t shadow;
+};
+
+static const Theme kLight = {0xfffaf5f0, 0xffc0a080, 0xff202020,
+                             0xff8a6040, 0xff708090, 0xffe08040,
+                             0xffffffff, 0x60000000};
+// dark back, light text, a translucent highlight and no shadow
+static const Theme kDark = {0xf0202428, 0xff404850, 0xffe0e0e0,
+                            0xff80a0c0, 0xff909090, 0xa04080c0,
+                            0xffffffff, 0x00000000};
+
+static void text(RenderBackend &target, const PlaceRect &rc,
+                 const wchar_t *str, RenderFont font, uint32_t color,
+                 bool repeated = false) {
+  TextRun run;
+  run.text = str;
+  run.length = wcslen(str);
+  run.font = font;
+  run.repeated = repeated;
+  target.DrawTextRun(rc, run, color);
+}
+
+// a 2x2 status icon, premultiplied
+static const uint32_t kIcon[] = {0xff3060c0, 0x80402010, 0x80402010,
+                                 0xff3060c0};
+
+// horizontal: preedit with a highlighted range, five candidates in a row with
+// the second highlighted, page arrows and a status icon
+static void horizontal_frame(RenderBackend &target, const Theme &t) {
+  const RenderCorners all;
+  if (t.shadow >> 24)
+    target.FillShadow({4, 4, 296, 66}, 6, all, 2, 3, 3.0f, t.shadow);
+  target.FillRoundedRect({4, 4, 296, 66}, 6, all, t.back);
+  target.StrokeRoundedRect({4, 4, 296, 66}, 6, all, 1.5f, t.border);
+  TextRun preedit;
+  preedit.text = L"ni hao shi jie";
+  preedit.length = wcslen(preedit.text);
+  preedit.font = kPreeditFont;
+  preedit.hilite_start = 3;
+  preedit.hilite_end = 6;
+  preedit.hilite_color = t.hilite;
+  preedit.hilite_spacing = 2;
+  target.DrawTextRun({12, 10, 140, 26}, preedit, t.text);
+  if (t.shadow >> 24)
+    target.FillShadow({62, 32, 114, 58}, 4, all, 0, 2, 2.0f, t.shadow);
+  target.FillRoundedRect({62, 32, 114, 58}, 4, all, t.hilite);
+  static const wchar_t *const words[] = {L"\x4f60\x597d", L"\x62df\x597d",
+                                         L"\x5c3c", L"\x4f60", L"\x5462"};
+  static const wchar_t *const labels[] = {L"1.", L"2.", L"3.", L"4.", L"5."};
+  for (int i = 0; i < 5; i++) {
+    const int x = 12 + i * 52;
+    const bool hilited = i == 1;
+    text(target, {x, 36, x + 12, 54}, labels[i], kLabelFont,
+         hilited ? t.hilite_text : t.label, true);
+    text(target, {x + 14, 36, x + 14 + 16 * (int)wcslen(words[i]), 54},
+         words[i], kTextFont, hilited ? t.hilite_text : t.text);
+  }
+  target.FillRoundedRect({272, 10, 280, 24}, 0, all, t.label);
+  target.FillRoundedRect({282, 10, 290, 24}, 0, all, t.label);
+  RenderImage icon;
+  icon.width = icon.height = 2;
+  icon.pixels = kIcon;
+  target.DrawImage({270, 40, 286, 56}, icon);
+}
+
+// vertical: square corners at the bottom, a column of candidates with
+// comments, the third highlighted with only its left corners rounded
+static void vertical_frame(RenderBackend &target, const Theme &t) {
+  RenderCorners top;
+  top.bottom_left = top.bottom_right = false;
+  target.FillShadow({6, 6, 152, 180}, 8, top, 0, 4, 4.0f, t.shadow);
+  target.FillRoundedRect({6, 6, 152, 180}, 8, top, t.back);
+  target.StrokeRoundedRect({6, 6, 152, 180}, 8, top, 1.0f, t.border);
+  text(target, {14, 12, 90, 28}, L"zhong", kPreeditFont, t.text);
+  RenderCorners left;
+  left.top_right = left.bottom_right = false;
+  target.FillRoundedRect({10, 92, 148, 120}, 6, left, t.hilite);
+  static const wchar_t *const words[] = {L"\x4e2d", L"\x79cd", L"\x91cd",
+                                         L"\x4f17", L"\x7ec8"};
+  static const wchar_t *const comments[] = {L"zhong1", L"zhong3", L"zhong4",
+                                            L"zhong4", L"zhong1"};
+  for (int i = 0; i < 5; i++) {
+    const int y = 36 + i * 28;
+    const bool hilited = i == 2;
+    wchar_t label[] = {(wchar_t)(L'1' + i), 0};
+    text(target, {16, y + 4, 26, y + 22}, label, kLabelFont,
+         hilited ? t.hilite_text : t.label, true);
+    text(target, {32, y + 4, 50, y + 22}, words[i], kTextFont,
+         hilited ? t.hilite_text : t.text);
+    text(target, {80, y + 6, 140, y + 20}, comments[i], kCommentFont,
+         hilited ? t.hilite_text : t.comment);
+  }
+}
+
+// vertical text: columns right to left, a highlighted range in the aux run
+static void vertical_text_frame(RenderBackend &target, const Theme &t) {
+  const RenderCorners all;
+  target.FillRoundedRect({4, 4, 116, 156}, 10, all, t.back);
+  target.StrokeRoundedRect({4, 4, 116, 156}, 10, all, 2.0f, t.border);
+  TextRun aux;
+  aux.text = L"\x62fc\x97f3\x8f93\x5165";
+  aux.length = 4;
+  aux.font = kPreeditFont;
+  aux.vertical = true;
+  aux.hilite_start = 1;
+  aux.hilite_end = 3;
+  aux.hilite_color = t.hilite;
+  aux.hilite_spacing = 3;
+  target.DrawTextRun({92, 12, 108, 90}, aux, t.text);
+  target.FillRoundedRect({62, 10, 86, 150}, 5, all, t.hilite);
+  for (int i = 0; i < 3; i++) {
+    const int x = 64 - i * 26;
+    TextRun run;
+    run.text = L"\x6c49\x5b57\x8f93\x5165\x6cd5";
+    run.length = 5 - i;
+    run.vertical = true;
+    target.DrawTextRun({x, 34, x + 20, 34 + 22 * (int)run.length}, run,
+                       i == 0 ? t.hilite_text : t.text);
+  }
+}
+
+// fullscreen: the panel covers the work area with square corners, the
+// preedit and a row of candidates at a point fitted to fill it, the first
+// highlighted
+static void fullscreen_frame(RenderBackend &target, const Theme &t) {
+  const RenderCorners all;
+  target.FillRoundedRect({0, 0, 320, 180}, 0, all, t.back);
+  target.StrokeRoundedRect({0, 0, 320, 180}, 0, all, 2.0f, t.border);
+  text(target, {40, 40, 200, 72}, L"quan ping", kPreeditFont, t.text);
+  target.FillRoundedRect({36, 86, 132, 140}, 8, all, t.hilite);
+  static const wchar_t *const words[] = {L"Q68\4f", L"g43^73",
+                                         L"Q68"};
+  for (int i = 0; i < 3; i++) {
+    const int x = 40 + i * 96;
+    const bool hilited = i == 0;
+    wchar_t label[] = {(wchar_t)(L'1' + i), 0};
+    text(target, {x, 94, x + 20, 132}, label, kLabelFont,
+         hilited ? t.hilite_text : t.label, true);
+    text(target, {x + 24, 94, x + 24 + 32 * (int)wcslen(words[i]), 132},
+         words[i], kTextFont, hilited ? t.hilite_text : t.text);
+  }
+}
+
+struct Frame {
+  const char *name;
+  int width;
+  int height;
+  void (*draw)(RenderBackend &, const Theme &);
+  const Theme &theme;
+};
+
+static const Frame kFrames[] = {
+    {"horizontal", 300, 70, horizontal_frame, kLight},
+    {"vertical", 160, 190, vertical_frame, kLight},
+    {"vertical_text", 120, 160, vertical_text_frame, kLight},
+    {"fullscreen", 320, 180, fullscreen_frame, kLight},
+    {"dark", 300, 70, horizontal_frame, kDark},
+};
+
+// Straight RGBA rows of a PNG as SavePng writes it: 8 bit RGBA, stored
+// deflate blocks, no row filters. Anything else is refused.
+static bool load_png(const std::string &path, int &width, int &height,
+                     std::vector<unsigned char> &rgba) {
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  std::string png;
+  char buf[65536];
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+    png.append(buf, n);
+  std::fclose(f);
+  const auto be32 = [&](size_t at) {
+    return (uint32_t)(unsigned char)png[at] << 24 |
+           (uint32_t)(unsigned char)png[at + 1] << 16 |
+           (uint32_t)(unsigned char)png[at + 2] << 8 |
+           (uint32_t)(unsigned char)png[at + 3];
+  };
+  if (png.compare(0, 8, "\x89PNG\r\n\x1a\n", 8) != 0)
+    return false;
+  std::string z;
+  bool header = false;
+  for (size_t at = 8; at + 12 <= png.size();) {
+    const uint32_t len = be32(at);
+    if (at + 12 + len > png.size())
+      return false;
+    const std::string type = png.substr(at + 4, 4);
+    if (type == "IHDR" && len >= 13) {
+      width = (int)be32(at + 8);
+      height = (int)be32(at + 12);
+      header = png.compare(at + 16, 5, "\x08\x06\x00\x00\x00", 5) == 0;
+    } else if (type == "IDAT") {
+      z.append(png, at + 8, len);
+    }
+    at += 12 + len;
+  }
+  if (!header || width <= 0 || height <= 0 || z.size() < 2)
+    return false;
+  std::string raw;
+  for (size_t at = 2; at + 5 <= z.size();) {
+    const unsigned char flags = (unsigned char)z[at];
+    const size_t len = (unsigned char)z[at + 1] | (unsigned char)z[at + 2] << 8;
+    if ((flags & 6) != 0 || at + 5 + len > z.size())
+      return false;
+    raw.append(z, at + 5, len);
+    at += 5 + len;
+    if (flags & 1)
+      break;
+  }
+  const size_t stride = (size_t)width * 4 + 1;
+  if (raw.size() != stride * height)
+    return false;
+  rgba.clear();
+  for (int y = 0; y < height; y++) {
+    if (raw[y * stride] != 0)
+      return false;
+    rgba.insert(rgba.end(), raw.begin() + y * stride + 1,
+                raw.begin() + (y + 1) * stride);
+  }
+  return true;
+}
+
+// Compare two PNGs; channels may differ by tolerance, as float rounding
+// varies between compilers. Prints what differs.
+static bool same_png(const std::string &golden, const std::string &actual,
+                     int tolerance) {
+  int gw = 0, gh = 0, aw = 0, ah = 0;
+  std::vector<unsigned char> g, a;
+  if (!load_png(golden, gw, gh, g)) {
+    fprintf(stderr, "%s: missing or not a stored RGBA PNG\n", golden.c_str());
+    return false;
+  }
+  if (!load_png(actual, aw, ah, a) || aw != gw || ah != gh) {
+    fprintf(stderr, "%s: %dx%d, golden is %dx%d\n", actual.c_str(), aw, ah, gw,
+            gh);
+    return false;
+  }
+  size_t pixels = 0;
+  int max_delta = 0;
+  for (size_t i = 0; i < g.size(); i += 4) {
+    int delta = 0;
+    for (int k = 0; k < 4; k++)
+      delta = std::max(delta, std::abs((int)g[i + k] - (int)a[i + k]));
+    if (delta > tolerance)
+      pixels++;
+    max_delta = std::max(max_delta, delta);
+  }
+  if (pixels)
+    fprintf(stderr, "%s: %zu pixels differ, by up to %d\n", actual.c_str(),
+            pixels, max_delta);
+  return pixels == 0;
+}
+
+static bool read_file(const std::string &path, std::string &out) {
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  char buf[4096];
+  out.clear();
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+    out.append(buf, n);
+  std::fclose(f);
+  return true;
+}
+
+static bool write_file(const std::string &path, const std::string &data) {
+  std::FILE *f = std::fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+  return std::fclose(f) == 0 && ok;
+}
+
+// the lines of a dump in order, to compare op lists regardless of order
+static std::vector<std::string> sorted_lines(const std::string &dump) {
+  std::vector<std::string> lines;
+  for (size_t at = 0, end; at < dump.size(); at = end + 1) {
+    end = dump.find('\n', at);
+    if (end == std::string::npos)
+      end = dump.size();
+    lines.push_back(dump.substr(at, end - at));
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+// The recorded ops against <dir>/<name>.txt, so a change in what the panel
+// records shows up as a text diff before it shows up in pixels, and
+// Optimize against the recording: it may only reorder ops.
+static bool same_ops(const std::string &base, const DisplayList &list,
+                     const DisplayList &optimized, bool update) {
+  std::string dump, optimized_dump, golden;
+  list.Dump(dump);
+  optimized.Dump(optimized_dump);
+  if (update)
+    return write_file(base + ".txt", dump);
+  if (sorted_lines(dump) != sorted_lines(optimized_dump)) {
+    fprintf(stderr, "%s: Optimize changed the ops, not only their order\n",
+            base.c_str());
+    return false;
+  }
+  if (!read_file(base + ".txt", golden) || golden != dump) {
+    write_file(base + ".actual.txt", dump);
+    fprintf(stderr, "%s.actual.txt differs from %s.txt\n", base.c_str(),
+            base.c_str());
+    return false;
+  }
+  std::remove((base + ".actual.txt").c_str());
+  return true;
+}
+
+static int golden(const std::string &dir, bool update) {
+  int failed = 0;
+  for (const Frame &frame : kFrames) {
+    DisplayList list;
+    frame.draw(list, frame.theme);
+    DisplayList optimized = list;
+    optimized.Optimize();
+    const std::string base = dir + "/" + frame.name;
+    SoftwareRenderBackend backend(frame.width, frame.height);
+    bool ok = same_ops(base, list, optimized, update);
+    for (const DisplayList *replayed : {&list, &optimized}) {
+      if (!ok)
+        break;
+      backend.BeginFrame();
+      replayed->Replay(backend);
+      backend.EndFrame();
+      if (update) {
+        ok = backend.SavePng(base + ".png");
+        break;
+      }
+      const std::string actual = base + ".actual.png";
+      ok = backend.SavePng(actual) && same_png(base + ".png", actual, 1);
+      if (!ok) {
+        fprintf(stderr, "%s%s differs from %s.png\n", frame.name,
+                replayed == &optimized ? " (optimized)" : "", base.c_str());
+        break;
+      }
+      std::remove(actual.c_str());
+    }
+    printf("%-14s %zu ops %s\n", frame.name, list.size(),
+           update ? (ok ? "updated" : "NOT WRITTEN") : (ok ? "ok" : "FAILED"));
+    failed += !ok;
+  }
+  return failed ? 1 : 0;
+}
+
+static int bench(int rounds) {
+  printf("per frame:       record  optimize    replay\n");
+  for (const Frame &frame : kFrames) {
+    DisplayList list;
+    const double record_ns = time_ns(rounds, [&]() {
+      list.Clear();
+      frame.draw(list, frame.theme);
+    });
+    DisplayList optimized;
+    const double optimize_ns = time_ns(rounds, [&]() {
+      optimized = list;
+      optimized.Optimize();
+    });
+    SoftwareRenderBackend backend(frame.width, frame.height);
+    const double replay_ns = time_ns(rounds, [&]() {
+      backend.BeginFrame();
+      list.Replay(backend);
+      backend.EndFrame();
+    });
+    printf("%-14s %7.2f us %7.2f us %7.3f ms\n", frame.name, record_ns / 1e3,
+           optimize_ns / 1e3, replay_ns / 1e6);
+  }
+  return 0;
+}
+
+// print the ops of a frame as recorded
+static int dump(const char *name) {
+  for (const Frame &frame : kFrames) {
+    if (strcmp(frame.name, name) != 0)
+      continue;
+    DisplayList list;
+    frame.draw(list, frame.theme);
+    std::string out;
+    list.Dump(out);
+    fputs(out.c_str(), stdout);
+    return 0;
+  }
+  fprintf(stderr, "no frame %s\n", name);
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 3 && !strcmp(argv[1], "dump"))
+    return dump(argv[2]);
+  if (argc >= 3 && !strcmp(argv[1], "golden"))
+    return golden(argv[2], argc >= 4 && !strcmp(argv[3], "--update"));
+  if (argc >= 2 && !strcmp(argv[1], "bench"))
+    return bench(argc >= 3 ? atoi(argv[2]) : 50);
+  fprintf(stderr, "usage: %s golden <dir> [--update]\n"
+                  "       %s dump <frame>\n"
+                  "       %s bench [rounds]\n",
+          argv[0], argv[0], argv[0]);
+  return 2;
+}
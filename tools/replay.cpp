@@ -0,0 +1,106 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.replay: feed a key record written with "record_keys" into librime
+// without any Windows hook or UI, print the commits and per-key timings. Each
+// key costs what it does in rime.toy: process_key, get_commit, and the status
+// and context read by the same code the panel is fed from.
+//
+//   rime.toy.replay <keys.rec> <shared_dir> <user_dir> [schema_id]
+#include "key_recorder.h"
+#include "key_table.h"
+#include "rime_context.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <rime_api.h>
+#include <string>
+#include <vector>
+
+using namespace weasel;
+
+static int expand_ibus_modifier(int m) {
+  return (m & 0xff) | ((m & 0xff00) << 16);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    std::fprintf(stderr,
+                 "usage: %s <keys.rec> <shared_dir> <user_dir> [schema_id]\n",
+                 argv[0]);
+    return 1;
+  }
+  std::vector<KeyRecord> records;
+  if (!LoadKeyRecords(argv[1], records)) {
+    std::fprintf(stderr, "failed to load key record: %s\n", argv[1]);
+    return 1;
+  }
+
+  RimeApi *api = rime_get_api();
+  RIME_STRUCT(RimeTraits, traits);
+  traits.shared_data_dir = argv[2];
+  traits.user_data_dir = argv[3];
+  traits.prebuilt_data_dir = traits.shared_data_dir;
+  traits.distribution_name = "rime.toy";
+  traits.distribution_code_name = "rime.toy.replay";
+  traits.distribution_version = VERSION_INFO;
+  traits.app_name = "rime.toy.replay";
+  api->setup(&traits);
+  api->initialize(NULL);
+  if (api->start_maintenance(true))
+    api->join_maintenance_thread();
+  RimeSessionId session = api->create_session();
+  if (argc > 4 && !api->select_schema(session, argv[4])) {
+    std::fprintf(stderr, "failed to select schema: %s\n", argv[4]);
+    api->finalize();
+    return 1;
+  }
+
+  using clock = std::chrono::steady_clock;
+  std::vector<double> costs;
+  costs.reserve(records.size());
+  size_t commits = 0;
+  // the default style, composition preedit
+  const UIStyle style;
+  Status status;
+  Context context;
+  for (size_t i = 0; i < records.size(); ++i) {
+    const auto &rec = records[i];
+    const int mask = expand_ibus_modifier(rec.mask);
+    const auto start = clock::now();
+    Bool handled = api->process_key(session, rec.keycode, mask);
+    RIME_STRUCT(RimeCommit, commit);
+    std::string text;
+    if (api->get_commit(session, &commit)) {
+      text = commit.text;
+      api->free_commit(&commit);
+    }
+    context.clear();
+    ReadRimeStatus(api, session, status);
+    ReadRimeContext(api, session, style, status, context);
+    const size_t candidates = context.cinfo.candies.size();
+    const double us =
+        std::chrono::duration<double, std::micro>(clock::now() - start)
+            .count();
+    costs.push_back(us);
+    commits += !text.empty();
+    std::printf("%zu\t%s\t%s\t%.1fus\t%zu\t%s\n", i,
+                repr(rec.keycode, mask).c_str(), handled ? "eaten" : "passed",
+                us, candidates, text.c_str());
+  }
+  api->destroy_session(session);
+  api->finalize();
+
+  if (costs.empty())
+    return 0;
+  double total = 0;
+  for (double c : costs)
+    total += c;
+  std::sort(costs.begin(), costs.end());
+  std::printf("keys: %zu, commits: %zu, total: %.1fms, avg: %.1fus, "
+              "p50: %.1fus, p99: %.1fus, max: %.1fus\n",
+              costs.size(), commits, total / 1000, total / costs.size(),
+              costs[costs.size() / 2], costs[costs.size() * 99 / 100],
+              costs.back());
+  return 0;
+}
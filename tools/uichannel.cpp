@@ -0,0 +1,264 @@
+// Copyright fxliang
+// Distrobuted under GPLv3 https://www.gnu.org/licenses/gpl-3.0.en.html
+//
+// rime.toy.uichannel: both ends of the UI channel without a panel or rime, so
+// the protocol runs anywhere with shared memory. "client" stands in for
+// rime.toy: it publishes pages of made-up candidates and prints the callbacks
+// it gets back. "server" stands in for rime.toy --ui-server: it prints each
+// snapshot it reads and hovers the highlighted candidate back. "bench" times
+// the context snapshot against copying and comparing a Context, and checks
+// that it decodes to what was encoded.
+//
+//   rime.toy.uichannel client <name> [count]
+//   rime.toy.uichannel server <name>
+//   rime.toy.uichannel bench [candidates] [rounds]
+#include "check.h"
+#include <UIChannel.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+using namespace weasel;
+using std::chrono::steady_clock;
+
+static uint32_t current_pid() {
+#ifdef _WIN32
+  return GetCurrentProcessId();
+#else
+  return (uint32_t)getpid();
+#endif
+}
+
+static bool process_alive(uint32_t pid) {
+#ifdef _WIN32
+  HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, pid);
+  if (!h)
+    return false;
+  const bool alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+  CloseHandle(h);
+  return alive;
+#else
+  return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+static std::string to_utf8(std::u16string_view s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    uint32_t c = s[i];
+    if (c >= 0xd800 && c < 0xdc00 && i + 1 < s.size()) {
+      c = 0x10000 + ((c - 0xd800) << 10) + ((uint32_t)s[++i] - 0xdc00);
+    }
+    if (c < 0x80) {
+      out.push_back((char)c);
+    } else if (c < 0x800) {
+      out.push_back((char)(0xc0 | (c >> 6)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+      out.push_back((char)(0xe0 | (c >> 12)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    } else {
+      out.push_back((char)(0xf0 | (c >> 18)));
+      out.push_back((char)(0x80 | ((c >> 12) & 0x3f)));
+      out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+      out.push_back((char)(0x80 | (c & 0x3f)));
+    }
+  }
+  return out;
+}
+
+// a page of count made-up candidates
+static void make_page(int n, int count, Context &ctx, Status &status) {
+  static const wchar_t *const words[] = {L"你好", L"擬好", L"\U0002000B",
+                                         L"nihao", L"尼豪"};
+  ctx.clear();
+  ctx.preedit.str = L"ni hao " + std::to_wstring(n);
+  ctx.preedit.attributes.push_back(
+      TextAttribute(0, 6, TextAttributeType::HIGHLIGHTED));
+  for (int i = 0; i < count; i++) {
+    ctx.cinfo.candies.push_back(Text(words[i % 5]));
+    ctx.cinfo.comments.push_back(Text(L"~" + std::to_wstring(i)));
+    ctx.cinfo.labels.push_back(Text(std::to_wstring(i + 1)));
+  }
+  ctx.cinfo.highlighted = n % count;
+  ctx.cinfo.currentPage = n / count;
+  status.composing = true;
+  status.schema_name = L"朙月拼音";
+  status.schema_id = L"luna_pinyin";
+}
+
+static int run_client(const std::string &name, int count) {
+  UIChannel channel;
+  if (!channel.Create(name)) {
+    fprintf(stderr, "cannot create channel %s\n", name.c_str());
+    return 1;
+  }
+  Context ctx;
+  Status status;
+  UISnapshot snap;
+  snap.style.font_face = L"Noto Sans CJK SC:30:400:7";
+  snap.style.layout_type = UIStyle::LAYOUT_HORIZONTAL;
+  snap.shown = true;
+  std::string data;
+  size_t callbacks = 0, bytes = 0;
+  long long publish_ns = 0;
+  auto drain = [&]() {
+    UICallbackEvent event;
+    while (channel.PopCallback(event)) {
+      callbacks++;
+      printf("callback flags=%u select=%u hover=%u\n", event.flags,
+             event.select, event.hover);
+    }
+  };
+  for (int i = 0; i < count; i++) {
+    make_page(i, 5, ctx, status);
+    snap.input_left = 100 + i;
+    snap.input_top = 200;
+    snap.input_right = snap.input_left + 2;
+    snap.input_bottom = 220;
+    EncodeUISnapshot(ctx, status, snap, data);
+    const auto t0 = steady_clock::now();
+    if (!channel.Publish(data)) {
+      fprintf(stderr, "snapshot of %zu bytes does not fit\n", data.size());
+      return 1;
+    }
+    publish_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      steady_clock::now() - t0)
+                      .count();
+    bytes += data.size();
+    drain();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  // give the server a moment to answer the last one
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  drain();
+  UIServerState state;
+  if (channel.ReadServerState(state))
+    printf("server pid=%u shown=%d\n", state.pid, (int)state.shown);
+  printf("published %d snapshots, %zu bytes each, %lld ns per publish, "
+         "%zu callbacks\n",
+         count, count ? bytes / count : 0,
+         count ? publish_ns / count : 0, callbacks);
+  return 0;
+}
+
+static int run_server(const std::string &name) {
+  UIChannel channel;
+  const auto deadline = steady_clock::now() + std::chrono::seconds(2);
+  while (!channel.Open(name)) {
+    if (steady_clock::now() > deadline) {
+      fprintf(stderr, "cannot open channel %s\n", name.c_str());
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const uint32_t client = channel.ClientProcess();
+  uint64_t serial = 0;
+  size_t read = 0, rejected = 0;
+  std::string data;
+  ContextSnapshotView context;
+  UISnapshot snap;
+  while (process_alive(client)) {
+    if (!channel.ReadLatest(serial, data)) {
+      // the real server sleeps in its message loop until notified
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    if (!DecodeUISnapshot(data.data(), data.size(), context, snap) ||
+        context.candidate_count() < 3) {
+      rejected++;
+      continue;
+    }
+    read++;
+    printf("snapshot %llu preedit=\"%s\" candidates=%zu highlighted=%d "
+           "first=\"%s\" third=\"%s\" at=%d,%d\n",
+           (unsigned long long)serial, to_utf8(context.preedit().str).c_str(),
+           context.candidate_count(), context.highlighted(),
+           to_utf8(context.candidate(0).str).c_str(),
+           to_utf8(context.candidate(2).str).c_str(), snap.input_left,
+           snap.input_top);
+    UIServerState state;
+    state.pid = current_pid();
+    state.show_serial = snap.show_serial;
+    state.shown = snap.shown;
+    channel.WriteServerState(state);
+    UICallbackEvent event;
+    event.flags = UICallbackEvent::HOVER;
+    event.hover = (uint32_t)context.highlighted();
+    channel.PushCallback(event);
+  }
+  printf("client gone; read %zu snapshots, rejected %zu\n", read, rejected);
+  return 0;
+}
+
+static int run_bench(int count, int rounds) {
+  Context ctx, copy;
+  Status status, status_copy;
+  make_page(7, count, ctx, status);
+  std::string data;
+  EncodeContextSnapshot(ctx, status, data);
+  ContextSnapshotView view;
+  if (!view.Open(data.data(), data.size())) {
+    fprintf(stderr, "snapshot does not open\n");
+    return 1;
+  }
+  view.Decode(copy, status_copy);
+  if (copy != ctx || !(status_copy == status) || !view.Equals(ctx, status)) {
+    fprintf(stderr, "snapshot does not round trip\n");
+    return 1;
+  }
+  // a change anywhere must show up
+  copy.cinfo.labels.back().str += L"!";
+  if (view.Equals(copy, status)) {
+    fprintf(stderr, "snapshot misses a change\n");
+    return 1;
+  }
+  size_t sink = 0;
+  printf("%d candidates, snapshot %zu bytes\n", count, data.size());
+  printf("encode          %8.0f ns\n", time_ns(rounds, [&]() {
+           data.clear();
+           EncodeContextSnapshot(ctx, status, data);
+         }));
+  printf("open            %8.0f ns\n", time_ns(rounds, [&]() {
+           sink += view.Open(data.data(), data.size());
+         }));
+  printf("view equals     %8.0f ns\n", time_ns(rounds, [&]() {
+           sink += view.Equals(ctx, status);
+         }));
+  printf("decode          %8.0f ns\n", time_ns(rounds, [&]() {
+           view.Decode(copy, status_copy);
+         }));
+  printf("Context copy    %8.0f ns\n", time_ns(rounds, [&]() {
+           copy = ctx;
+           sink += copy.cinfo.candies.size();
+         }));
+  printf("Context ==      %8.0f ns\n", time_ns(rounds, [&]() {
+           sink += copy == ctx;
+         }));
+  return sink ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 2 && !strcmp(argv[1], "bench"))
+    return run_bench(argc >= 3 ? atoi(argv[2]) : 10,
+                     argc >= 4 ? atoi(argv[3]) : 100000);
+  if (argc >= 3 && !strcmp(argv[1], "client"))
+    return run_client(argv[2], argc >= 4 ? atoi(argv[3]) : 100);
+  if (argc >= 3 && !strcmp(argv[1], "server"))
+    return run_server(argv[2]);
+  fprintf(stderr, "usage: %s client <name> [count]\n"
+                  "       %s server <name>\n"
+                  "       %s bench [candidates] [rounds]\n",
+          argv[0], argv[0], argv[0]);
+  return 2;
+}
@@ -88,3 +88,116 @@ target(project_name)
       generate_rc()
     end
   end)
+
+-- headless key replay driver: rime.toy.replay <keys.rec> <shared> <user>
+target(project_name .. ".replay")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/replay.cpp", "src/key_recorder.cpp", "src/key_table.cpp",
+            "src/rime_context.cpp")
+  add_includedirs("./src")
+  add_links("rime")
+  add_defines("VERSION_INFO="..version)
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+  add_linkdirs(is_arch("x86", "i386") and "lib" or "lib64")
+
+-- both ends of the UI channel, no panel or rime, and a context snapshot
+-- bench; builds with POSIX shared memory too:
+-- rime.toy.uichannel client|server <name>, rime.toy.uichannel bench
+target(project_name .. ".uichannel")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/uichannel.cpp", "WeaselUI/UIChannel.cpp",
+            "WeaselUI/ContextSnapshot.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  elseif is_plat('linux') then
+    add_syslinks("rt")
+  end
+
+-- checks and micro-benchmarks of the key tables and KeyMap, no Windows or
+-- rime needed: rime.toy.keys check, rime.toy.keys bench [rounds]
+target(project_name .. ".keys")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/keys.cpp", "src/key_table.cpp", "src/keymap.cpp")
+  add_includedirs("./src")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+
+-- checks and micro-benchmarks of the panel placement, no Windows needed:
+-- rime.toy.placement check, rime.toy.placement bench [rounds]
+target(project_name .. ".placement")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/placement.cpp", "WeaselUI/Placement.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+
+-- checks and micro-benchmarks of the candidate hit test grid, no Windows
+-- needed: rime.toy.hittest check, rime.toy.hittest bench [rounds]
+target(project_name .. ".hittest")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/hittest.cpp", "WeaselUI/HitTest.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+
+-- golden images and frame times of the software render backend, no Windows
+-- needed: rime.toy.render golden tools/golden [--update],
+-- rime.toy.render bench [rounds]
+target(project_name .. ".render")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/render.cpp", "WeaselUI/DisplayList.cpp",
+            "WeaselUI/SoftwareRenderBackend.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+
+-- checks and micro-benchmarks of the font face spec parser, no Windows
+-- needed: rime.toy.fontspec check, rime.toy.fontspec bench [rounds]
+target(project_name .. ".fontspec")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/fontspec.cpp", "WeaselUI/FontSpec.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end
+
+-- checks and layouts per refresh of the fullscreen text point search, no
+-- Windows needed: rime.toy.fontfit check, rime.toy.fontfit bench [rounds]
+target(project_name .. ".fontfit")
+  set_kind(binary)
+  set_languages("c++17")
+  set_default(false)
+  add_files("tools/fontfit.cpp", "WeaselUI/FontFit.cpp")
+  add_includedirs("./WeaselUI")
+  if is_plat('windows') then
+    set_runtimes("MT")
+    add_cxflags("/utf-8")
+  end